@@ -0,0 +1,128 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Definitions of the binary format of the log files.  A file starts with
+  a header followed by fixed-size records of one type.  All fields are in
+  network byte order, times and floating-point values use the formats
+  from the command and monitoring protocol.
+
+  */
+
+#ifndef GOT_BINLOG_H
+#define GOT_BINLOG_H
+
+#include "candm.h"
+
+/* "CBLG" */
+#define BLG_MAGIC 0x43424c47
+
+/* Increase this when changing any of the records */
+#define BLG_VERSION 1
+
+#define BLG_MEASUREMENTS 1
+#define BLG_STATISTICS 2
+#define BLG_TRACKING 3
+#define BLG_REFCLOCKS 4
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  uint32_t record_length;
+} BLG_FileHeader;
+
+/* Bits in the tests field of the measurements record */
+#define BLG_TEST1 0x1
+#define BLG_TEST2 0x2
+#define BLG_TEST3 0x4
+#define BLG_TEST4 0x8
+#define BLG_TEST4A 0x10
+#define BLG_TEST4B 0x20
+#define BLG_TEST4C 0x40
+#define BLG_TEST5 0x80
+#define BLG_TEST6 0x100
+#define BLG_TEST7 0x200
+#define BLG_TEST8 0x400
+
+typedef struct {
+  Timeval time;
+  IPAddr ip_addr;
+  uint8_t leap;
+  uint8_t stratum;
+  uint16_t tests;
+  int8_t local_poll;
+  int8_t remote_poll;
+  uint16_t reserved;
+  Float score;
+  Float offset;
+  Float peer_delay;
+  Float peer_dispersion;
+  Float root_delay;
+  Float root_dispersion;
+} BLG_Measurement;
+
+/* If the address family is unspecified, the source is a refclock
+   identified by the ref_id field */
+typedef struct {
+  Timeval time;
+  IPAddr ip_addr;
+  uint32_t ref_id;
+  Float std_dev;
+  Float est_offset;
+  Float offset_sd;
+  Float diff_freq;
+  Float skew;
+  Float stress;
+  uint16_t samples;
+  uint16_t best_start;
+  uint16_t runs;
+  uint16_t reserved;
+} BLG_Statistics;
+
+typedef struct {
+  Timeval time;
+  IPAddr ip_addr;
+  uint32_t ref_id;
+  uint8_t stratum;
+  uint8_t leap;
+  uint16_t combined_sources;
+  Float freq;
+  Float skew;
+  Float offset;
+  Float offset_sd;
+  Float remaining_correction;
+} BLG_Tracking;
+
+typedef struct {
+  Timeval time;
+  uint32_t ref_id;
+  int8_t driver_poll;
+  uint8_t leap;
+  uint8_t pulse;
+  uint8_t filtered;
+  Float raw_offset;
+  Float cooked_offset;
+  Float dispersion;
+} BLG_Refclock;
+
+#endif /* GOT_BINLOG_H */
@@ -37,15 +37,24 @@
 #include "reference.h"
 #include "util.h"
 #include "ntp_io.h"
+#include "logging.h"
 
+/* Destinations with the same interval, socket and multicast options are
+   grouped and served by a single timeout, which sends the same packet to
+   all destinations of the group */
 typedef struct {
-  NTP_Remote_Address addr;
-  NTP_Local_Address local_addr;
   int interval;
-} Destination;
-static Destination *destinations = 0;
-static int n_destinations = 0;
-static int max_destinations = 0;
+  int sock_fd;
+  int ttl;
+  unsigned int if_index;
+  NTP_Packet message;
+  NTP_Remote_Address *addrs;
+  int n_addrs;
+  int max_addrs;
+} Group;
+
+static Group **groups = NULL;
+static int n_groups = 0;
 
 void
 BRD_Initialise(void)
@@ -57,27 +66,36 @@ BRD_Initialise(void)
 void
 BRD_Finalise(void)
 {
+  int i;
+
+  for (i = 0; i < n_groups; i++) {
+    Free(groups[i]->addrs);
+    Free(groups[i]);
+  }
+  Free(groups);
+
+  groups = NULL;
+  n_groups = 0;
 }
 
 /* ================================================== */
-/* This is a cut-down version of what transmit_packet in ntp_core.c does */
+/* This is a cut-down version of what transmit_packet in ntp_core.c does.
+   Only the fields which can change are updated, the rest of the packet
+   was prepared when the group was created. */
 
 static void
 timeout_handler(void *arbitrary)
 {
-  Destination *d = (Destination *) arbitrary;
-  NTP_Packet message;
+  Group *g = (Group *) arbitrary;
+  NTP_Packet *message = &g->message;
   /* Parameters read from reference module */
-  int version;
   int leap;
   int are_we_synchronised, our_stratum;
   NTP_Leap leap_status;
-  uint32_t our_ref_id, ts_fuzz;
-  struct timeval our_ref_time;
+  uint32_t our_ref_id;
+  struct timespec our_ref_time;
   double our_root_delay, our_root_dispersion;
-  struct timeval local_transmit;
-
-  version = 3;
+  struct timespec local_transmit;
 
   LCL_ReadCookedTime(&local_transmit, NULL);
   REF_GetReferenceParams(&local_transmit,
@@ -86,74 +104,99 @@ timeout_handler(void *arbitrary)
                          &our_ref_id, &our_ref_time,
                          &our_root_delay, &our_root_dispersion);
 
-
   if (are_we_synchronised) {
     leap = (int) leap_status;
   } else {
     leap = LEAP_Unsynchronised;
   }
 
-  message.lvm = ((leap << 6) &0xc0) | ((version << 3) & 0x38) | (MODE_BROADCAST & 0x07);
-  message.stratum = our_stratum;
-  message.poll = 6; /* FIXME: what should this be? */
-  message.precision = LCL_GetSysPrecisionAsLog();
-
-  /* If we're sending a client mode packet and we aren't synchronized yet, 
-     we might have to set up artificial values for some of these parameters */
-  message.root_delay = UTI_DoubleToInt32(our_root_delay);
-  message.root_dispersion = UTI_DoubleToInt32(our_root_dispersion);
+  message->lvm = (message->lvm & 0x3f) | ((leap << 6) & 0xc0);
+  message->stratum = our_stratum;
+  message->root_delay = UTI_DoubleToInt32(our_root_delay);
+  message->root_dispersion = UTI_DoubleToInt32(our_root_dispersion);
+  message->reference_id = htonl((NTP_int32) our_ref_id);
+  UTI_TimespecToInt64(&our_ref_time, &message->reference_ts, 0);
 
-  message.reference_id = htonl((NTP_int32) our_ref_id);
+  UTI_TimespecToInt64(&local_transmit, &message->transmit_ts,
+                     UTI_GetNTPTsFuzz(message->precision));
 
-  /* Now fill in timestamps */
-  UTI_TimevalToInt64(&our_ref_time, &message.reference_ts, 0);
-  message.originate_ts.hi = 0UL;
-  message.originate_ts.lo = 0UL;
-  message.receive_ts.hi = 0UL;
-  message.receive_ts.lo = 0UL;
-
-  ts_fuzz = UTI_GetNTPTsFuzz(message.precision);
-  LCL_ReadCookedTime(&local_transmit, NULL);
-  UTI_TimevalToInt64(&local_transmit, &message.transmit_ts, ts_fuzz);
-  NIO_SendNormalPacket(&message, &d->addr, &d->local_addr);
+  NIO_SetMulticastOptions(g->sock_fd, g->ttl, g->if_index);
+  NIO_SendPacketToMany(message, NTP_NORMAL_PACKET_SIZE, g->addrs, g->n_addrs, g->sock_fd);
 
   /* Requeue timeout.  Don't care if interval drifts gradually, so just do it
    * at the end. */
-  SCH_AddTimeoutInClass((double) d->interval, 1.0, 0.02,
+  SCH_AddTimeoutInClass((double) g->interval, 1.0, 0.02,
                         SCH_NtpBroadcastClass,
-                        timeout_handler, (void *) d);
-
-
+                        timeout_handler, (void *) g);
 }
 
 /* ================================================== */
 
-void 
-BRD_AddDestination(IPAddr *addr, unsigned short port, int interval)
+static Group *
+get_group(int interval, int sock_fd, int ttl, unsigned int if_index)
 {
-  if (max_destinations == n_destinations) {
-    /* Expand array */
-    max_destinations += 8;
-    if (destinations) {
-      destinations = ReallocArray(Destination, max_destinations, destinations);
-    } else {
-      destinations = MallocArray(Destination, max_destinations);
-    }
+  Group *g;
+  int i, version = 3;
+
+  for (i = 0; i < n_groups; i++) {
+    g = groups[i];
+    if (g->interval == interval && g->sock_fd == sock_fd &&
+        g->ttl == ttl && g->if_index == if_index)
+      return g;
   }
 
-  destinations[n_destinations].addr.ip_addr = *addr;
-  destinations[n_destinations].addr.port = port;
-  destinations[n_destinations].local_addr.ip_addr.family = IPADDR_UNSPEC;
-  destinations[n_destinations].local_addr.sock_fd =
-    NIO_GetServerSocket(&destinations[n_destinations].addr);
-  destinations[n_destinations].interval = interval;
+  g = MallocNew(Group);
+  g->interval = interval;
+  g->sock_fd = sock_fd;
+  g->ttl = ttl;
+  g->if_index = if_index;
+  g->addrs = NULL;
+  g->n_addrs = g->max_addrs = 0;
+
+  memset(&g->message, 0, sizeof (g->message));
+  g->message.lvm = ((LEAP_Unsynchronised << 6) & 0xc0) |
+                   ((version << 3) & 0x38) | (MODE_BROADCAST & 0x07);
+  g->message.poll = 6; /* FIXME: what should this be? */
+  g->message.precision = LCL_GetSysPrecisionAsLog();
+
+  groups = ReallocArray(Group *, n_groups + 1, groups);
+  groups[n_groups++] = g;
 
   SCH_AddTimeoutInClass((double) interval, 1.0, 0.0,
                         SCH_NtpBroadcastClass,
-                        timeout_handler, (void *)(destinations + n_destinations));
-  
-  ++n_destinations;
+                        timeout_handler, (void *) g);
 
+  return g;
 }
 
+/* ================================================== */
+
+void 
+BRD_AddDestination(IPAddr *addr, unsigned short port, int interval,
+                   int ttl, const char *iface)
+{
+  NTP_Remote_Address remote_addr;
+  unsigned int if_index = 0;
+  Group *g;
+
+  if (iface) {
+    if_index = if_nametoindex(iface);
+    if (!if_index) {
+      LOG(LOGS_ERR, LOGF_Broadcast, "Unknown interface %s for broadcast to %s",
+          iface, UTI_IPToString(addr));
+      return;
+    }
+  }
+
+  remote_addr.ip_addr = *addr;
+  remote_addr.port = port;
+
+  g = get_group(interval, NIO_GetServerSocket(&remote_addr), ttl, if_index);
 
+  if (g->n_addrs == g->max_addrs) {
+    g->max_addrs = g->max_addrs ? 2 * g->max_addrs : 8;
+    g->addrs = ReallocArray(NTP_Remote_Address, g->max_addrs, g->addrs);
+  }
+
+  g->addrs[g->n_addrs++] = remote_addr;
+}
@@ -31,7 +31,8 @@
 
 extern void BRD_Initialise(void);
 extern void BRD_Finalise(void);
-extern void BRD_AddDestination(IPAddr *addr, unsigned short port, int interval);
+extern void BRD_AddDestination(IPAddr *addr, unsigned short port, int interval,
+                               int ttl, const char *iface);
 
 #endif /* GOT_BROADCAST_H */
 
@@ -88,7 +88,14 @@
 #define REQ_MODIFY_MAXDELAYDEVRATIO 47
 #define REQ_RESELECT 48
 #define REQ_RESELECTDISTANCE 49
-#define N_REQUEST_TYPES 50
+#define REQ_SOURCE_REPORTS 50
+#define REQ_RELOAD_LEAP 51
+#define REQ_CMDMON_STATS 52
+#define REQ_SERVER_COUNTERS 53
+#define REQ_LATENCY_STATS 54
+#define REQ_SERVER_LATENCY 55
+#define REQ_SUBSCRIBE 56
+#define N_REQUEST_TYPES 57
 
 /* Special utoken value used to log on with first exchange being the
    password.  (This time value has long since gone by) */
@@ -334,6 +341,54 @@ typedef struct {
   int32_t EOR;
 } REQ_ReselectDistance;
 
+/* This is based on the response size rather than the
+   request size */
+#define MAX_SOURCE_REPORTS 8
+
+typedef struct {
+  uint32_t first_index;
+  uint32_t n_indices;
+  int32_t EOR;
+} REQ_SourceReports;
+
+typedef struct {
+  int32_t EOR;
+} REQ_ReloadLeap;
+
+typedef struct {
+  int32_t EOR;
+} REQ_CmdmonStats;
+
+typedef struct {
+  int32_t EOR;
+} REQ_ServerCounters;
+
+typedef struct {
+  uint32_t index;
+  int32_t EOR;
+} REQ_LatencyStats;
+
+typedef struct {
+  int32_t EOR;
+} REQ_ServerLatency;
+
+/* Events which can be subscribed to */
+#define REQ_SUBSCRIBE_TRACKING 0x1
+#define REQ_SUBSCRIBE_SELECTION 0x2
+#define REQ_SUBSCRIBE_LEAP 0x4
+
+/* The subscription expires after the lease (in seconds) unless it is
+   renewed by another request from the same address.  A request with
+   no events or zero lease cancels the subscription. */
+#define MAX_SUBSCRIPTION_LEASE 3600
+
+typedef struct {
+  uint32_t events;
+  uint32_t lease;
+  Float min_interval;
+  int32_t EOR;
+} REQ_Subscribe;
+
 /* ================================================== */
 
 #define PKT_TYPE_CMD_REQUEST 1
@@ -376,8 +431,8 @@ typedef struct {
 #define PROTO_VERSION_PADDING 6
 
 /* The maximum length of padding in request packet, currently
-   defined by CLIENT_ACCESSES_BY_INDEX and MANUAL_LIST */
-#define MAX_PADDING_LENGTH 396
+   defined by SOURCE_REPORTS */
+#define MAX_PADDING_LENGTH 684
 
 /* ================================================== */
 
@@ -433,6 +488,13 @@ typedef struct {
     REQ_Activity activity;
     REQ_Reselect reselect;
     REQ_ReselectDistance reselect_distance;
+    REQ_SourceReports source_reports;
+    REQ_ReloadLeap reload_leap;
+    REQ_CmdmonStats cmdmon_stats;
+    REQ_ServerCounters server_counters;
+    REQ_LatencyStats latency_stats;
+    REQ_ServerLatency server_latency;
+    REQ_Subscribe subscribe;
   } data; /* Command specific parameters */
 
   /* The following fields only set the maximum size of the packet.
@@ -468,7 +530,13 @@ typedef struct {
 #define RPY_CLIENT_ACCESSES_BY_INDEX 10
 #define RPY_MANUAL_LIST 11
 #define RPY_ACTIVITY 12
-#define N_REPLY_TYPES 13
+#define RPY_SOURCE_REPORTS 13
+#define RPY_CMDMON_STATS 14
+#define RPY_SERVER_COUNTERS 15
+#define RPY_LATENCY_STATS 16
+#define RPY_SERVER_LATENCY 17
+#define RPY_EVENT 18
+#define N_REPLY_TYPES 19
 
 /* Status codes */
 #define STT_SUCCESS 0
@@ -629,6 +697,116 @@ typedef struct {
   int32_t EOR;
 } RPY_Activity;
 
+/* Combined source data and sourcestats of one source */
+typedef struct {
+  IPAddr ip_addr;
+  uint32_t ref_id;
+  int16_t poll;
+  uint16_t stratum;
+  uint16_t state;
+  uint16_t mode;
+  uint16_t flags;
+  uint16_t reachability;
+  uint32_t since_sample;
+  Float orig_latest_meas;
+  Float latest_meas;
+  Float latest_meas_err;
+  uint32_t n_samples;
+  uint32_t n_runs;
+  uint32_t span_seconds;
+  Float sd;
+  Float resid_freq_ppm;
+  Float skew_ppm;
+  Float est_offset;
+  Float est_offset_err;
+} RPY_SourceReports_Source;
+
+typedef struct {
+  uint32_t n_indices;      /* how many sources there are in the server */
+  uint32_t next_index;     /* the index 1 beyond those processed on this call */
+  uint32_t n_sources;      /* the number of valid entries in the following array */
+  RPY_SourceReports_Source sources[MAX_SOURCE_REPORTS];
+  int32_t EOR;
+} RPY_SourceReports;
+
+typedef struct {
+  uint32_t kept_replies;
+  uint32_t max_kept_replies;
+  uint32_t seen_timestamps;
+  uint32_t max_seen_timestamps;
+  uint32_t resent_replies;
+  uint32_t rejected_timestamps;
+  int32_t EOR;
+} RPY_CmdmonStats;
+
+#define MAX_SERVER_COUNTERS 64
+
+/* 64-bit counters split to two words, in the order defined in counters.h */
+typedef struct {
+  uint32_t n_counters;
+  struct {
+    uint32_t high;
+    uint32_t low;
+  } counters[MAX_SERVER_COUNTERS];
+  int32_t EOR;
+} RPY_ServerCounters;
+
+#define RPY_LAT_DISPATCH_DELAY 0
+#define RPY_LAT_TIMEOUT_HANDLER 1
+#define RPY_LAT_FILE_HANDLER 2
+
+#define MAX_LATENCY_BUCKETS 24
+
+typedef struct {
+  uint32_t n_stats;
+  uint32_t index;
+  uint32_t type;
+  uint32_t handler_high;
+  uint32_t handler_low;
+  uint32_t count;
+  Float mean;
+  Float max;
+  uint32_t buckets[MAX_LATENCY_BUCKETS];
+  int32_t EOR;
+} RPY_LatencyStats;
+
+#define MAX_WORST_LATENCIES 8
+
+typedef struct {
+  uint32_t count;
+  uint32_t n_worst;
+  Float mean;
+  Float p50;
+  Float p90;
+  Float p99;
+  Float p999;
+  Float max;
+  struct {
+    IPAddr ip_addr;
+    Timeval when;
+    Float latency;
+  } worst[MAX_WORST_LATENCIES];
+  int32_t EOR;
+} RPY_ServerLatency;
+
+/* Reply to the SUBSCRIBE request and updates sent to subscribed clients
+   with the sequence number of their last SUBSCRIBE request.  The events
+   field has the events which occurred since the previous update. */
+typedef struct {
+  uint32_t events;
+  uint32_t ref_id;
+  IPAddr ip_addr;
+  uint16_t stratum;
+  uint16_t leap_status;
+  Timeval ref_time;
+  Float current_correction;
+  Float last_offset;
+  Float skew_ppm;
+  Float root_delay;
+  Float root_dispersion;
+  int32_t EOR;
+} RPY_Event;
+
 typedef struct {
   uint8_t version;
   uint8_t pkt_type;
@@ -655,6 +833,12 @@ typedef struct {
     RPY_ClientAccessesByIndex client_accesses_by_index;
     RPY_ManualList manual_list;
     RPY_Activity activity;
+    RPY_SourceReports source_reports;
+    RPY_CmdmonStats cmdmon_stats;
+    RPY_ServerCounters server_counters;
+    RPY_LatencyStats latency_stats;
+    RPY_ServerLatency server_latency;
+    RPY_Event event;
   } data; /* Reply specific parameters */
 
   /* authentication of the packet, there is no hole after the actual data
@@ -0,0 +1,184 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Layout of the ring buffer of samples used by the SHM refclock driver
+  with the ring option, and a writer which can be included in programs
+  providing the samples.  The writer doesn't depend on any other chrony
+  headers.
+
+  The segment is created by chronyd.  There can be only one writer.
+  Each slot is protected by its own sequence lock.  The writer
+  increments the sequence number of the slot before and after writing
+  the sample and then increments the write index.  chronyd reads all
+  samples written since the last read and skips samples which were
+  overwritten while being copied.
+
+  Example:
+
+    struct chrony_shmring *ring;
+    struct timespec clock_ts, receive_ts;
+    int fd;
+
+    ring = chrony_shmring_attach(CHRONY_SHMRING_KEY + 0);
+    fd = chrony_shmring_open_notify("/var/run/chrony/shm0.fifo");
+    if (ring) {
+      ...
+      chrony_shmring_write(ring, &clock_ts, &receive_ts, 0, 1e-7);
+      if (fd >= 0)
+        chrony_shmring_notify(fd);
+    }
+  */
+
+#ifndef GOT_CHRONY_SHMRING_H
+#define GOT_CHRONY_SHMRING_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/* "CSHR" */
+#define CHRONY_SHMRING_MAGIC 0x43534852
+
+/* Increase this when changing the layout */
+#define CHRONY_SHMRING_VERSION 1
+
+/* "NTR0", the number of the segment is added to the key */
+#define CHRONY_SHMRING_KEY 0x4e545230
+
+/* Number of slots in the ring (power of 2) */
+#define CHRONY_SHMRING_SLOTS 64
+
+struct chrony_shmring_sample {
+  /* Sequence number, odd while the slot is being written */
+  uint32_t seq;
+  /* Write index of the sample */
+  uint32_t index;
+
+  /* Time from the reference clock and system time when it was received */
+  int64_t clock_sec;
+  int64_t receive_sec;
+  int32_t clock_nsec;
+  int32_t receive_nsec;
+
+  /* Leap second status (0 normal, 1 insert, 2 delete, 3 unsynchronised) */
+  int32_t leap;
+  int32_t _pad;
+
+  /* Estimated error of the sample in seconds */
+  double dispersion;
+};
+
+struct chrony_shmring {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sample_size;
+  uint32_t slots;
+
+  /* Index of the next sample to be written */
+  uint32_t write_index;
+  uint32_t _pad[3];
+
+  struct chrony_shmring_sample samples[CHRONY_SHMRING_SLOTS];
+};
+
+/* Attach the segment created by chronyd, return NULL on error */
+static inline struct chrony_shmring *
+chrony_shmring_attach(key_t key)
+{
+  struct chrony_shmring *ring;
+  int id;
+
+  id = shmget(key, 0, 0);
+  if (id < 0)
+    return NULL;
+
+  ring = (struct chrony_shmring *)shmat(id, NULL, 0);
+  if (ring == (void *)-1)
+    return NULL;
+
+  if (ring->magic != CHRONY_SHMRING_MAGIC || ring->version != CHRONY_SHMRING_VERSION ||
+      ring->sample_size != sizeof (struct chrony_shmring_sample) ||
+      ring->slots != CHRONY_SHMRING_SLOTS) {
+    shmdt(ring);
+    return NULL;
+  }
+
+  return ring;
+}
+
+static inline void
+chrony_shmring_detach(struct chrony_shmring *ring)
+{
+  shmdt(ring);
+}
+
+/* Add a new sample to the ring */
+static inline void
+chrony_shmring_write(struct chrony_shmring *ring, const struct timespec *clock_ts,
+                     const struct timespec *receive_ts, int leap, double dispersion)
+{
+  volatile struct chrony_shmring_sample *sample;
+  uint32_t index;
+
+  index = ring->write_index;
+  sample = &ring->samples[index % CHRONY_SHMRING_SLOTS];
+
+  sample->seq++;
+  __sync_synchronize();
+
+  sample->index = index;
+  sample->clock_sec = clock_ts->tv_sec;
+  sample->clock_nsec = clock_ts->tv_nsec;
+  sample->receive_sec = receive_ts->tv_sec;
+  sample->receive_nsec = receive_ts->tv_nsec;
+  sample->leap = leap;
+  sample->dispersion = dispersion;
+
+  __sync_synchronize();
+  sample->seq++;
+  __sync_synchronize();
+
+  *(volatile uint32_t *)&ring->write_index = index + 1;
+}
+
+/* Open the FIFO of chronyd configured with the notify option, return -1
+   on error */
+static inline int
+chrony_shmring_open_notify(const char *fifo)
+{
+  return open(fifo, O_WRONLY | O_NONBLOCK);
+}
+
+/* Wake up chronyd after writing new samples, return 0 on error */
+static inline int
+chrony_shmring_notify(int fd)
+{
+  /* A full FIFO means chronyd has a pending notification */
+  return write(fd, "", 1) == 1 || errno == EAGAIN;
+}
+
+#endif /* GOT_CHRONY_SHMRING_H */
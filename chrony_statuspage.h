@@ -0,0 +1,200 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Layout of the time status page which chronyd publishes in a SysV shared
+  memory segment (enabled by the statuspage directive), and a reader
+  which can be included in other programs.  The reader doesn't depend on
+  any other chrony headers.
+
+  The page is protected by a sequence lock.  chronyd increments the
+  sequence number before and after each update, a reader retries if the
+  number was odd or changed while copying the data.
+
+  Example:
+
+    struct chrony_status_page *page;
+    struct chrony_status status;
+    struct timespec now;
+
+    page = chrony_status_attach(CHRONY_STATUS_DEFAULT_KEY);
+    if (page && chrony_status_read(page, &status)) {
+      clock_gettime(CLOCK_REALTIME, &now);
+      printf("leap %d max error %e\n", status.leap_status,
+             chrony_status_max_error(&status, &now));
+    }
+  */
+
+#ifndef GOT_CHRONY_STATUSPAGE_H
+#define GOT_CHRONY_STATUSPAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/* "CSPG" */
+#define CHRONY_STATUS_MAGIC 0x43535047
+
+/* Increase this when changing the layout */
+#define CHRONY_STATUS_VERSION 1
+
+/* "CHRS" */
+#define CHRONY_STATUS_DEFAULT_KEY 0x43485253
+
+/* Values of the ip_family field */
+#define CHRONY_STATUS_IP_UNSPEC 0
+#define CHRONY_STATUS_IP_INET4 1
+#define CHRONY_STATUS_IP_INET6 2
+
+/* Values of the leap_status field */
+#define CHRONY_STATUS_LEAP_NORMAL 0
+#define CHRONY_STATUS_LEAP_INSERT 1
+#define CHRONY_STATUS_LEAP_DELETE 2
+#define CHRONY_STATUS_LEAP_UNSYNC 3
+
+struct chrony_status {
+  /* Reference ID (in host order) and address (in network order) of the
+     current source */
+  uint32_t ref_id;
+  uint16_t ip_family;
+  uint16_t stratum;
+  uint8_t ip_addr[16];
+
+  int32_t leap_status;
+  int32_t synchronised;
+
+  /* Time of the last update of the reference */
+  int64_t ref_time_sec;
+  int64_t ref_time_nsec;
+
+  /* System time (corrected) when the page was last updated */
+  int64_t update_time_sec;
+  int64_t update_time_nsec;
+
+  /* Offset correction being applied to the system clock at the update
+     time (positive if the clock is slow), in seconds */
+  double offset;
+
+  /* Frequency error of the uncompensated system clock (positive if it
+     runs fast), residual frequency and skew, in ppm */
+  double freq_ppm;
+  double resid_freq_ppm;
+  double skew_ppm;
+
+  /* Root delay and dispersion at the update time, in seconds */
+  double root_delay;
+  double root_dispersion;
+
+  double last_offset;
+  double rms_offset;
+  double last_update_interval;
+
+  /* Maximum frequency error of the local clock (in ppm) and precision
+     of the system clock (in seconds) */
+  double max_clock_error_ppm;
+  double precision;
+};
+
+struct chrony_status_page {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seq;
+  uint32_t size;
+  struct chrony_status status;
+};
+
+/* Attach the segment read-only, return NULL on error */
+static inline struct chrony_status_page *
+chrony_status_attach(key_t key)
+{
+  struct chrony_status_page *page;
+  int id;
+
+  id = shmget(key, 0, 0);
+  if (id < 0)
+    return NULL;
+
+  page = (struct chrony_status_page *)shmat(id, NULL, SHM_RDONLY);
+  if (page == (void *)-1)
+    return NULL;
+
+  return page;
+}
+
+static inline void
+chrony_status_detach(struct chrony_status_page *page)
+{
+  shmdt(page);
+}
+
+/* Copy a consistent snapshot of the status, return 0 if the page is not
+   valid or it couldn't be read */
+static inline int
+chrony_status_read(const struct chrony_status_page *page, struct chrony_status *status)
+{
+  const volatile uint32_t *seq = &page->seq;
+  uint32_t seq1, seq2;
+  int i;
+
+  if (page->magic != CHRONY_STATUS_MAGIC || page->version != CHRONY_STATUS_VERSION ||
+      page->size != sizeof (struct chrony_status))
+    return 0;
+
+  for (i = 0; i < 1000; i++) {
+    seq1 = *seq;
+    __sync_synchronize();
+    if (seq1 & 1)
+      continue;
+
+    memcpy(status, (const void *)&page->status, sizeof (*status));
+
+    __sync_synchronize();
+    seq2 = *seq;
+
+    if (seq1 == seq2)
+      return 1;
+  }
+
+  return 0;
+}
+
+/* Return the maximum error of the system clock at the specified time */
+static inline double
+chrony_status_max_error(const struct chrony_status *status, const struct timespec *now)
+{
+  double elapsed, resid_freq;
+
+  elapsed = (now->tv_sec - status->update_time_sec) +
+            (now->tv_nsec - status->update_time_nsec) * 1e-9;
+  if (elapsed < 0.0)
+    elapsed = 0.0;
+
+  resid_freq = status->resid_freq_ppm >= 0.0 ? status->resid_freq_ppm :
+                                               -status->resid_freq_ppm;
+
+  return status->root_delay / 2.0 + status->root_dispersion +
+         (status->skew_ppm + resid_freq + status->max_clock_error_ppm) * 1e-6 * elapsed;
+}
+
+#endif /* GOT_CHRONY_STATUSPAGE_H */
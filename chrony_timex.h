@@ -70,4 +70,11 @@ struct timex {
 
 extern int adjtimex(struct timex *);
 
+#ifdef HAVE_CLOCK_ADJTIME
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME 0
+#endif
+extern int clock_adjtime(int, struct timex *);
+#endif
+
 #endif /* CHRONY_TIMEX_H */
@@ -0,0 +1,333 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Program converting binary log files written by chronyd to the text
+  format or CSV.
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "binlog.h"
+#include "util.h"
+
+/* ================================================== */
+
+static int csv = 0;
+static int banner = 1;
+
+static const char leap_codes[4] = {'N', '+', '-', '?'};
+
+/* ================================================== */
+
+static void
+print_header(const char *text_banner, const char *csv_header)
+{
+  int i, len;
+
+  if (!banner)
+    return;
+
+  if (csv) {
+    printf("%s\n", csv_header);
+    return;
+  }
+
+  len = strlen(text_banner);
+  for (i = 0; i < len; i++)
+    putchar('=');
+  printf("\n%s\n", text_banner);
+  for (i = 0; i < len; i++)
+    putchar('=');
+  putchar('\n');
+}
+
+/* ================================================== */
+
+static char *
+source_to_string(IPAddr *ip_addr, uint32_t ref_id)
+{
+  IPAddr ip;
+
+  UTI_IPNetworkToHost(ip_addr, &ip);
+  if (ip.family != IPADDR_UNSPEC)
+    return UTI_IPToString(&ip);
+  return UTI_RefidToString(ntohl(ref_id));
+}
+
+/* ================================================== */
+
+static void
+print_time(Timeval *time, int text_usec)
+{
+  struct timespec tv;
+
+  UTI_TimespecNetworkToHost(time, &tv);
+
+  if (csv)
+    printf("%s.%06d,", UTI_TimeToLogForm(tv.tv_sec), (int)(tv.tv_nsec / 1000));
+  else if (text_usec)
+    printf("%s.%06d ", UTI_TimeToLogForm(tv.tv_sec), (int)(tv.tv_nsec / 1000));
+  else
+    printf("%s ", UTI_TimeToLogForm(tv.tv_sec));
+}
+
+/* ================================================== */
+
+static void
+print_measurement(BLG_Measurement *r)
+{
+  unsigned int t;
+
+  t = ntohs(r->tests);
+
+  print_time(&r->time, 0);
+  printf(csv ? "%s,%c,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f,%.9e,%.9e,%.9e,%.9e,%.9e\n" :
+               "%-15s %1c %2d %1d%1d%1d%1d %1d%1d%1d %1d%1d%1d%1d %2d %2d %4.2f %10.3e %10.3e %10.3e %10.3e %10.3e\n",
+         source_to_string(&r->ip_addr, 0),
+         leap_codes[r->leap & 0x3], r->stratum,
+         !!(t & BLG_TEST1), !!(t & BLG_TEST2), !!(t & BLG_TEST3), !!(t & BLG_TEST4),
+         !!(t & BLG_TEST4A), !!(t & BLG_TEST4B), !!(t & BLG_TEST4C),
+         !!(t & BLG_TEST5), !!(t & BLG_TEST6), !!(t & BLG_TEST7), !!(t & BLG_TEST8),
+         r->local_poll, r->remote_poll,
+         UTI_FloatNetworkToHost(r->score),
+         UTI_FloatNetworkToHost(r->offset),
+         UTI_FloatNetworkToHost(r->peer_delay),
+         UTI_FloatNetworkToHost(r->peer_dispersion),
+         UTI_FloatNetworkToHost(r->root_delay),
+         UTI_FloatNetworkToHost(r->root_dispersion));
+}
+
+/* ================================================== */
+
+static void
+print_statistics(BLG_Statistics *r)
+{
+  print_time(&r->time, 0);
+  printf(csv ? "%s,%.9e,%.9e,%.9e,%.9e,%.9e,%.9e,%d,%d,%d\n" :
+               "%-15s %10.3e %10.3e %10.3e %10.3e %10.3e %7.1e %3d %3d %3d\n",
+         source_to_string(&r->ip_addr, r->ref_id),
+         UTI_FloatNetworkToHost(r->std_dev),
+         UTI_FloatNetworkToHost(r->est_offset),
+         UTI_FloatNetworkToHost(r->offset_sd),
+         UTI_FloatNetworkToHost(r->diff_freq),
+         UTI_FloatNetworkToHost(r->skew),
+         UTI_FloatNetworkToHost(r->stress),
+         ntohs(r->samples), ntohs(r->best_start), ntohs(r->runs));
+}
+
+/* ================================================== */
+
+static void
+print_tracking(BLG_Tracking *r)
+{
+  print_time(&r->time, 0);
+  printf(csv ? "%s,%d,%.6f,%.6f,%.9e,%c,%d,%.9e,%.9e\n" :
+               "%-15s %2d %10.3f %10.3f %10.3e %1c %2d %10.3e %10.3e\n",
+         source_to_string(&r->ip_addr, r->ref_id),
+         r->stratum,
+         UTI_FloatNetworkToHost(r->freq),
+         UTI_FloatNetworkToHost(r->skew),
+         UTI_FloatNetworkToHost(r->offset),
+         leap_codes[r->leap & 0x3],
+         ntohs(r->combined_sources),
+         UTI_FloatNetworkToHost(r->offset_sd),
+         UTI_FloatNetworkToHost(r->remaining_correction));
+}
+
+/* ================================================== */
+
+static void
+print_refclock(BLG_Refclock *r)
+{
+  print_time(&r->time, 1);
+
+  if (csv) {
+    printf("%s,%d,%c,%d,%d,%.9e,%.9e,%.9e\n",
+           UTI_RefidToString(ntohl(r->ref_id)), r->driver_poll,
+           leap_codes[r->leap & 0x3], r->pulse, r->filtered,
+           UTI_FloatNetworkToHost(r->raw_offset),
+           UTI_FloatNetworkToHost(r->cooked_offset),
+           UTI_FloatNetworkToHost(r->dispersion));
+  } else if (!r->filtered) {
+    printf("%-5s %3d %1c %1d %13.6e %13.6e %10.3e\n",
+           UTI_RefidToString(ntohl(r->ref_id)), r->driver_poll,
+           leap_codes[r->leap & 0x3], r->pulse,
+           UTI_FloatNetworkToHost(r->raw_offset),
+           UTI_FloatNetworkToHost(r->cooked_offset),
+           UTI_FloatNetworkToHost(r->dispersion));
+  } else {
+    printf("%-5s   - %1c -       -       %13.6e %10.3e\n",
+           UTI_RefidToString(ntohl(r->ref_id)),
+           leap_codes[r->leap & 0x3],
+           UTI_FloatNetworkToHost(r->cooked_offset),
+           UTI_FloatNetworkToHost(r->dispersion));
+  }
+}
+
+/* ================================================== */
+
+static int
+read_header(FILE *f, const char *filename)
+{
+  BLG_FileHeader header;
+  unsigned int length, expected_length;
+  int type;
+
+  if (fread(&header, sizeof (header), 1, f) != 1 || ntohl(header.magic) != BLG_MAGIC) {
+    fprintf(stderr, "%s is not a binary chrony log\n", filename);
+    return 0;
+  }
+
+  if (ntohs(header.version) != BLG_VERSION) {
+    fprintf(stderr, "%s has unsupported version %d\n", filename, ntohs(header.version));
+    return 0;
+  }
+
+  type = ntohs(header.type);
+  length = ntohl(header.record_length);
+
+  switch (type) {
+    case BLG_MEASUREMENTS:
+      expected_length = sizeof (BLG_Measurement);
+      break;
+    case BLG_STATISTICS:
+      expected_length = sizeof (BLG_Statistics);
+      break;
+    case BLG_TRACKING:
+      expected_length = sizeof (BLG_Tracking);
+      break;
+    case BLG_REFCLOCKS:
+      expected_length = sizeof (BLG_Refclock);
+      break;
+    default:
+      fprintf(stderr, "%s has unknown log type %d\n", filename, type);
+      return 0;
+  }
+
+  if (length != expected_length) {
+    fprintf(stderr, "%s has unexpected record length %u\n", filename, length);
+    return 0;
+  }
+
+  return type;
+}
+
+/* ================================================== */
+
+static int
+decode_file(const char *filename)
+{
+  union {
+    BLG_Measurement measurement;
+    BLG_Statistics statistics;
+    BLG_Tracking tracking;
+    BLG_Refclock refclock;
+  } record;
+  FILE *f;
+  int type;
+
+  f = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+  if (!f) {
+    fprintf(stderr, "Could not open %s : %s\n", filename, strerror(errno));
+    return 0;
+  }
+
+  type = read_header(f, filename);
+
+  switch (type) {
+    case 0:
+      break;
+    case BLG_MEASUREMENTS:
+      print_header("   Date (UTC) Time     IP Address   L St 1234 abc 5678 LP RP Score Offset     Peer del. Peer disp. Root del.  Root disp.",
+                   "Time,IP Address,Leap,Stratum,Test1,Test2,Test3,Test4,Test4a,Test4b,Test4c,Test5,Test6,Test7,Test8,Local poll,Remote poll,Score,Offset,Peer delay,Peer dispersion,Root delay,Root dispersion");
+      while (fread(&record.measurement, sizeof (record.measurement), 1, f) == 1)
+        print_measurement(&record.measurement);
+      break;
+    case BLG_STATISTICS:
+      print_header("   Date (UTC) Time     IP Address    Std dev'n Est offset  Offset sd  Diff freq   Est skew  Stress  Ns  Bs  Nr",
+                   "Time,IP Address,Std dev,Est offset,Offset sd,Diff freq,Est skew,Stress,Samples,Best start,Runs");
+      while (fread(&record.statistics, sizeof (record.statistics), 1, f) == 1)
+        print_statistics(&record.statistics);
+      break;
+    case BLG_TRACKING:
+      print_header("   Date (UTC) Time     IP Address   St   Freq ppm   Skew ppm     Offset L Co  Offset sd Rem. corr.",
+                   "Time,IP Address,Stratum,Freq ppm,Skew ppm,Offset,Leap,Combined sources,Offset sd,Remaining correction");
+      while (fread(&record.tracking, sizeof (record.tracking), 1, f) == 1)
+        print_tracking(&record.tracking);
+      break;
+    case BLG_REFCLOCKS:
+      print_header("   Date (UTC) Time         Refid  DP L P  Raw offset   Cooked offset      Disp.",
+                   "Time,Refid,Driver poll,Leap,Pulse,Filtered,Raw offset,Cooked offset,Dispersion");
+      while (fread(&record.refclock, sizeof (record.refclock), 1, f) == 1)
+        print_refclock(&record.refclock);
+      break;
+    default:
+      assert(0);
+  }
+
+  if (f != stdin)
+    fclose(f);
+
+  return type != 0;
+}
+
+/* ================================================== */
+
+int
+main(int argc, char **argv)
+{
+  const char *progname = argv[0];
+  int ret = 1;
+
+  while (++argv, --argc) {
+    if (!strcmp(*argv, "-c")) {
+      csv = 1;
+    } else if (!strcmp(*argv, "-n")) {
+      banner = 0;
+    } else if (!strcmp("-v", *argv) || !strcmp("--version", *argv)) {
+      printf("chronylog (chrony) version %s\n", CHRONY_VERSION);
+      return 0;
+    } else if (!strcmp(*argv, "-") || strncmp(*argv, "-", 1)) {
+      break;
+    } else {
+      argc = 0;
+      break;
+    }
+  }
+
+  if (argc == 0) {
+    fprintf(stderr, "Usage : %s [-c] [-n] <file>...\n", progname);
+    return 1;
+  }
+
+  for (; argc > 0; argv++, argc--) {
+    if (!decode_file(*argv))
+      ret = 0;
+  }
+
+  return !ret;
+}
+
+/* ================================================== */
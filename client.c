@@ -55,6 +55,7 @@ union sockaddr_in46 {
 #ifdef HAVE_IPV6
   struct sockaddr_in6 in6;
 #endif
+  struct sockaddr_un un;
   struct sockaddr u;
 };
 
@@ -68,6 +69,14 @@ static int no_dns = 0;
 
 static int recv_errqueue = 0;
 
+/* Flag indicating the daemon is contacted via its Unix domain socket */
+static int unix_socket = 0;
+
+/* Address of the daemon if the Unix domain socket was selected
+   automatically, which is used instead when a password is set */
+static const char *udp_hostname = NULL;
+static int udp_port;
+
 /* ================================================== */
 /* Ought to extract some code from util.c to make
    a new set of utilities that can be linked into either
@@ -134,6 +143,45 @@ read_line(void)
   
 }
 
+/* ================================================== */
+/* Try to connect to the Unix domain socket of the daemon.  The socket
+   can be used only by a daemon running on the same host, but requests
+   don't need to be authenticated. */
+
+static int
+open_unix_io(const char *path)
+{
+  struct sockaddr_un my_addr;
+
+  if (strlen(path) >= sizeof (his_addr.un.sun_path))
+    return 0;
+
+  sock_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock_fd < 0)
+    return 0;
+
+  /* Bind the socket to an automatically selected abstract address, so
+     the daemon can send the replies back and no file needs to be
+     removed on exit */
+  memset(&my_addr, 0, sizeof (my_addr));
+  my_addr.sun_family = AF_UNIX;
+
+  memset(&his_addr, 0, sizeof (his_addr));
+  his_addr.un.sun_family = AF_UNIX;
+  strcpy(his_addr.un.sun_path, path);
+  his_addr_len = sizeof (his_addr.un);
+
+  if (bind(sock_fd, (struct sockaddr *)&my_addr, sizeof (sa_family_t)) < 0 ||
+      connect(sock_fd, &his_addr.u, his_addr_len) < 0) {
+    close(sock_fd);
+    return 0;
+  }
+
+  unix_socket = 1;
+
+  return 1;
+}
+
 /* ================================================== */
 /* Initialise the socket used to talk to the daemon */
 
@@ -143,6 +191,15 @@ open_io(const char *hostname, int port)
   IPAddr ip;
   int on_off = 1;
 
+  /* Hostname starting with / is the path of the Unix domain socket */
+  if (hostname[0] == '/') {
+    if (!open_unix_io(hostname)) {
+      fprintf(stderr, "Could not connect to %s : %s\n", hostname, strerror(errno));
+      exit(1);
+    }
+    return;
+  }
+
   /* Note, this call could block for a while */
   if (DNS_Name2IPAddress(hostname, &ip) != DNS_Success) {
     fprintf(stderr, "Could not get IP address for %s\n", hostname);
@@ -207,6 +264,28 @@ close_io(void)
 
 }
 
+/* ================================================== */
+/* Requests sent to the Unix domain socket are not authenticated and only
+   root and the user of the daemon can run privileged commands.  Switch to
+   UDP when a password is set, so other users can use the command key. */
+
+static void
+switch_to_udp(void)
+{
+  if (!unix_socket)
+    return;
+
+  if (!udp_hostname) {
+    fprintf(stderr, "Password is not used with the Unix domain socket\n");
+    return;
+  }
+
+  close_io();
+  unix_socket = 0;
+  open_io(udp_hostname, udp_port);
+  udp_hostname = NULL;
+}
+
 /* ================================================== */
 
 static void
@@ -1111,9 +1190,11 @@ static int
 process_cmd_password(CMD_Request *msg, char *line)
 {
   char *p;
-  struct timeval now;
+  struct timespec now;
   int i, len;
 
+  switch_to_udp();
+
   /* Blank and free the old password */
   if (password) {
     for (i = 0; i < password_length; i++)
@@ -1149,12 +1230,12 @@ process_cmd_password(CMD_Request *msg, char *line)
       return 0;
   }
 
-  if (gettimeofday(&now, NULL) < 0) {
+  if (clock_gettime(CLOCK_REALTIME, &now) < 0) {
     printf("500 - Could not read time of day\n");
     return 0;
   } else {
     msg->command = htons(REQ_LOGON); /* Just force a round trip so that we get tokens etc */
-    UTI_TimevalHostToNetwork(&now, &msg->data.logon.ts);
+    UTI_TimespecHostToNetwork(&now, &msg->data.logon.ts);
     return 1;
   }
 }
@@ -1209,6 +1290,7 @@ give_help(void)
   printf("cmdallow all [<subnet-addr>] : Allow command access to that subnet and all children\n");
   printf("cmddeny [<subnet-addr>] : Deny command access to that subnet as a default\n");
   printf("cmddeny all [<subnet-addr>] : Deny command access to that subnet and all children\n");
+  printf("cmdstats : Report on caches of command request processing\n");
   printf("cyclelogs : Close and re-open logs files\n");
   printf("delete <address> : Remove an NTP server or peer\n");
   printf("deny [<subnet-addr>] : Deny NTP access to that subnet as a default\n");
@@ -1230,11 +1312,16 @@ give_help(void)
   printf("online [<mask>/<masked-address>] : Set sources in subnet to online status\n");
   printf("password [<new-password>] : Set command authentication password\n");
   printf("polltarget <address> <new-poll-target> : Modify poll target of source\n");
+  printf("reloadleap : Reload table of leap seconds\n");
   printf("reselect : Reselect synchronisation source\n");
   printf("rtcdata : Print current RTC performance parameters\n");
+  printf("schedstats : Display latency histograms of scheduler handlers\n");
+  printf("serverlatency : Display latency of replies to NTP clients\n");
+  printf("serverstats : Display counters of events in the daemon\n");
   printf("settime <date/time (e.g. Nov 21, 1997 16:30:05 or 16:30:05)> : Manually set the daemon time\n");
   printf("sources [-v] : Display information about current sources\n");
   printf("sourcestats [-v] : Display estimation information about current sources\n");
+  printf("subscribe [updates [min-interval]] : Display updates of tracking, selection and leap status\n");
   printf("tracking : Display system time information\n");
   printf("trimrtc : Correct RTC relative to system clock\n");
   printf("waitsync [max-tries [max-correction [max-skew]]] : Wait until synchronised\n");
@@ -1260,6 +1347,220 @@ static int max_retries = 2;
 static int initial_timeout = 1000;
 static int proto_version = PROTO_VERSION_NUMBER;
 
+/* ================================================== */
+/* Fill in the header of a new request and assign it a sequence number */
+
+static void
+init_request(CMD_Request *request)
+{
+  request->pkt_type = PKT_TYPE_CMD_REQUEST;
+  request->res1 = 0;
+  request->res2 = 0;
+  request->sequence = htonl(sequence++);
+  request->attempt = 0;
+  request->utoken = htonl(utoken);
+  request->token = htonl(token);
+}
+
+/* ================================================== */
+/* Set the protocol version, padding and authentication data of the
+   request before it is (re)transmitted.  Returns the length of the
+   packet to be sent. */
+
+static int
+prepare_request(CMD_Request *request)
+{
+  int command_length;
+  int padding_length;
+  int auth_length;
+
+  request->version = proto_version;
+  command_length = PKL_CommandLength(request);
+  padding_length = PKL_CommandPaddingLength(request);
+  assert(command_length > 0 && command_length > padding_length);
+
+  /* Zero the padding to avoid sending uninitialized data. This needs to be
+     done before generating auth data as it includes the padding. */
+  memset(((char *)request) + command_length - padding_length, 0, padding_length);
+
+  /* The Unix domain socket doesn't need padding and authentication */
+  if (unix_socket) {
+    command_length -= padding_length;
+    auth_length = 0;
+  } else if (password) {
+    if (!utoken || (request->command == htons(REQ_LOGON))) {
+      /* Otherwise, the daemon won't bother authenticating our
+         packet and we won't get a token back */
+      request->utoken = htonl(SPECIAL_UTOKEN);
+    }
+    auth_length = generate_auth(request);
+  } else {
+    auth_length = 0;
+  }
+
+  /* add empty MD5 auth so older servers will not drop the request
+     due to bad length */
+  if (!auth_length && !unix_socket) {
+    memset(((char *)request) + command_length, 0, 16);
+    auth_length = 16;
+  }
+
+#if 0
+  printf("Sent command length=%d bytes auth length=%d bytes\n", command_length, auth_length);
+#endif
+
+  return command_length + auth_length;
+}
+
+/* ================================================== */
+/* Read a reply from the socket.  Returns its length, or zero if the
+   reading failed, the reply is truncated or it didn't come from the
+   daemon. */
+
+static int
+receive_reply(CMD_Reply *reply)
+{
+  socklen_t where_from_len;
+  union sockaddr_in46 where_from;
+  int bad_length, bad_sender;
+  int recvfrom_status;
+  int read_length;
+  int expected_length;
+
+  where_from_len = sizeof(where_from);
+  recvfrom_status = recvfrom(sock_fd, (void *) reply, sizeof(CMD_Reply), 0,
+                             &where_from.u, &where_from_len);
+
+#if 0
+  printf("Received packet, status=%d\n", recvfrom_status);
+#endif
+
+  if (recvfrom_status < 0) {
+    /* If we get connrefused here, it suggests the sendto is
+       going to a dead port - but only if the daemon machine is
+       running Linux (Solaris doesn't return anything) */
+
+#ifdef IP_RECVERR
+    /* Fetch the message from the error queue */
+    if (recv_errqueue &&
+        recvfrom(sock_fd, (void *)reply, sizeof(CMD_Reply), MSG_ERRQUEUE,
+                 &where_from.u, &where_from_len) < 0)
+      ;
+#endif
+
+    return 0;
+  }
+
+  read_length = recvfrom_status;
+  if (read_length >= offsetof(CMD_Reply, data)) {
+    expected_length = PKL_ReplyLength(reply);
+  } else {
+    expected_length = 0;
+  }
+
+  bad_length = (read_length < expected_length ||
+                expected_length < offsetof(CMD_Reply, data));
+  /* The Unix domain socket is connected to the daemon */
+  bad_sender = !unix_socket &&
+               (where_from.u.sa_family != his_addr.u.sa_family ||
+                (where_from.u.sa_family == AF_INET &&
+                 (where_from.in4.sin_addr.s_addr != his_addr.in4.sin_addr.s_addr ||
+                  where_from.in4.sin_port != his_addr.in4.sin_port)) ||
+#ifdef HAVE_IPV6
+                (where_from.u.sa_family == AF_INET6 &&
+                 (memcmp(where_from.in6.sin6_addr.s6_addr, his_addr.in6.sin6_addr.s6_addr,
+                         sizeof (where_from.in6.sin6_addr.s6_addr)) != 0 ||
+                  where_from.in6.sin6_port != his_addr.in6.sin6_port)) ||
+#endif
+                0);
+
+  if (bad_length || bad_sender)
+    return 0;
+
+  return read_length;
+}
+
+/* ================================================== */
+
+static int
+check_reply_header(CMD_Request *request, CMD_Reply *reply)
+{
+  return !((reply->version != proto_version &&
+            !(reply->version >= PROTO_VERSION_MISMATCH_COMPAT_CLIENT &&
+              ntohs(reply->status) == STT_BADPKTVERSION)) ||
+           (reply->pkt_type != PKT_TYPE_CMD_REPLY) ||
+           (reply->res1 != 0) ||
+           (reply->res2 != 0) ||
+           (reply->command != request->command));
+}
+
+/* ================================================== */
+/* Check if the daemon doesn't support our protocol version and the
+   request needs to be sent again with the previous version */
+
+static int
+check_version_fallback(CMD_Request *request, CMD_Reply *reply)
+{
+#if PROTO_VERSION_NUMBER == 6
+  /* Protocol version 5 is similar to 6 except there is no padding.
+     If a version 5 reply with STT_BADPKTVERSION is received,
+     switch our version and try again. */
+  if (request->version == PROTO_VERSION_NUMBER &&
+      reply->version == PROTO_VERSION_NUMBER - 1) {
+    proto_version = PROTO_VERSION_NUMBER - 1;
+    return 1;
+  }
+#else
+#error unknown compatibility with PROTO_VERSION - 1
+#endif
+
+  return 0;
+}
+
+/* ================================================== */
+/* Process a valid reply to our request.  Returns a Boolean indicating
+   whether the reply is authentic. */
+
+static int
+accept_reply(CMD_Reply *reply, int read_length)
+{
+  int reply_auth_ok;
+
+#if 0
+  printf("Reply cmd=%d reply=%d stat=%d seq=%d utok=%08lx tok=%d\n",
+         ntohs(reply->command), ntohs(reply->reply),
+         ntohs(reply->status),
+         ntohl(reply->sequence),
+         ntohl(reply->utoken),
+         ntohl(reply->token));
+#endif
+
+  if (password && !unix_socket) {
+    reply_auth_ok = check_reply_auth(reply, read_length);
+  } else {
+    /* Assume in this case that the reply is always considered
+       to be authentic */
+    reply_auth_ok = 1;
+  }
+
+  utoken = ntohl(reply->utoken);
+
+  if (reply_auth_ok) {
+    /* If we're in authenticated mode, only acquire the utoken
+       and new token values if the reply authenticated properly.
+       This protects against forged packets with bogus tokens
+       in.  We won't accept a repeat of an old message with a
+       stale token in it, due to bad_sequence processing
+       earlier. */
+    utoken = ntohl(reply->utoken);
+    token = ntohl(reply->token);
+  }
+
+  return reply_auth_ok;
+}
+
+/* ================================================== */
+
 /* This is the core protocol module.  Complete particular fields in
    the outgoing packet, send it, wait for a response, handle retries,
    etc.  Returns a Boolean indicating whether the protocol was
@@ -1268,69 +1569,26 @@ static int proto_version = PROTO_VERSION_NUMBER;
 static int
 submit_request(CMD_Request *request, CMD_Reply *reply, int *reply_auth_ok)
 {
-  unsigned long tx_sequence;
-  socklen_t where_from_len;
-  union sockaddr_in46 where_from;
-  int bad_length, bad_sender, bad_sequence, bad_header;
   int select_status;
-  int recvfrom_status;
   int read_length;
-  int expected_length;
-  int command_length;
-  int padding_length;
-  int auth_length;
+  int tx_length;
+  struct timespec deadline, now, ts;
   struct timeval tv;
+  double remaining;
   int timeout;
   int n_attempts;
   fd_set rdfd, wrfd, exfd;
 
-  request->pkt_type = PKT_TYPE_CMD_REQUEST;
-  request->res1 = 0;
-  request->res2 = 0;
-  tx_sequence = sequence++;
-  request->sequence = htonl(tx_sequence);
-  request->attempt = 0;
-  request->utoken = htonl(utoken);
-  request->token = htonl(token);
+  init_request(request);
 
   timeout = initial_timeout;
 
   n_attempts = 0;
 
   do {
-    request->version = proto_version;
-    command_length = PKL_CommandLength(request);
-    padding_length = PKL_CommandPaddingLength(request);
-    assert(command_length > 0 && command_length > padding_length);
-
-    /* Zero the padding to avoid sending uninitialized data. This needs to be
-       done before generating auth data as it includes the padding. */
-    memset(((char *)request) + command_length - padding_length, 0, padding_length);
-
-    /* Decide whether to authenticate */
-    if (password) {
-      if (!utoken || (request->command == htons(REQ_LOGON))) {
-        /* Otherwise, the daemon won't bother authenticating our
-           packet and we won't get a token back */
-        request->utoken = htonl(SPECIAL_UTOKEN);
-      }
-      auth_length = generate_auth(request);
-    } else {
-      auth_length = 0;
-    }
-
-    /* add empty MD5 auth so older servers will not drop the request
-       due to bad length */
-    if (!auth_length) {
-      memset(((char *)request) + command_length, 0, 16);
-      auth_length = 16;
-    }
-
-#if 0
-    printf("Sent command length=%d bytes auth length=%d bytes\n", command_length, auth_length);
-#endif
+    tx_length = prepare_request(request);
 
-    if (sendto(sock_fd, (void *) request, command_length + auth_length, 0,
+    if (sendto(sock_fd, (void *) request, tx_length, 0,
                &his_addr.u, his_addr_len) < 0) {
 
 
@@ -1342,18 +1600,29 @@ submit_request(CMD_Request *request, CMD_Reply *reply, int *reply_auth_ok)
 
     /* Increment this for next time */
     ++ request->attempt;
-      
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = timeout % 1000 * 1000;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    UTI_AddDoubleToTimespec(&deadline, timeout / 1000.0, &deadline);
     timeout *= 2;
 
-    FD_ZERO(&rdfd);
-    FD_ZERO(&wrfd);
-    FD_ZERO(&exfd);
+    /* Wait for the reply.  Updates sent to an earlier subscription (e.g.
+       before its renewal) are dropped without counting as an attempt. */
+    do {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      UTI_DiffTimespecsToDouble(&remaining, &deadline, &now);
+      UTI_DoubleToTimespec(remaining > 0.0 ? remaining : 0.0, &ts);
+      UTI_TimespecToTimeval(&ts, &tv);
 
-    FD_SET(sock_fd, &rdfd);
+      FD_ZERO(&rdfd);
+      FD_ZERO(&wrfd);
+      FD_ZERO(&exfd);
+
+      FD_SET(sock_fd, &rdfd);
 
-    select_status = select(sock_fd + 1, &rdfd, &wrfd, &exfd, &tv);
+      select_status = select(sock_fd + 1, &rdfd, &wrfd, &exfd, &tv);
+      read_length = select_status > 0 ? receive_reply(reply) : 0;
+    } while (read_length && reply->sequence != request->sequence &&
+             ntohs(reply->reply) == RPY_EVENT);
 
     if (select_status < 0) {
 #if 0
@@ -1368,135 +1637,23 @@ submit_request(CMD_Request *request, CMD_Reply *reply, int *reply_auth_ok)
 
       /* Back to top of loop to do resend */
       continue;
-      
-    } else {
-      
-      where_from_len = sizeof(where_from);
-      recvfrom_status = recvfrom(sock_fd, (void *) reply, sizeof(CMD_Reply), 0,
-                                 &where_from.u, &where_from_len);
-      
-
-#if 0
-      printf("Received packet, status=%d\n", recvfrom_status);
-#endif
-
-      if (recvfrom_status < 0) {
-        /* If we get connrefused here, it suggests the sendto is
-           going to a dead port - but only if the daemon machine is
-           running Linux (Solaris doesn't return anything) */
-
-#ifdef IP_RECVERR
-        /* Fetch the message from the error queue */
-        if (recv_errqueue &&
-            recvfrom(sock_fd, (void *)reply, sizeof(CMD_Reply), MSG_ERRQUEUE,
-                     &where_from.u, &where_from_len) < 0)
-          ;
-#endif
 
+    } else {
+      if (!read_length || reply->sequence != request->sequence ||
+          !check_reply_header(request, reply)) {
         n_attempts++;
         if (n_attempts > max_retries) {
           return 0;
         }
-      } else {
-        
-        read_length = recvfrom_status;
-        if (read_length >= offsetof(CMD_Reply, data)) {
-          expected_length = PKL_ReplyLength(reply);
-        } else {
-          expected_length = 0;
-        }
-
-        bad_length = (read_length < expected_length ||
-                      expected_length < offsetof(CMD_Reply, data));
-        bad_sender = (where_from.u.sa_family != his_addr.u.sa_family ||
-                      (where_from.u.sa_family == AF_INET &&
-                       (where_from.in4.sin_addr.s_addr != his_addr.in4.sin_addr.s_addr ||
-                        where_from.in4.sin_port != his_addr.in4.sin_port)) ||
-#ifdef HAVE_IPV6
-                      (where_from.u.sa_family == AF_INET6 &&
-                       (memcmp(where_from.in6.sin6_addr.s6_addr, his_addr.in6.sin6_addr.s6_addr,
-                               sizeof (where_from.in6.sin6_addr.s6_addr)) != 0 ||
-                        where_from.in6.sin6_port != his_addr.in6.sin6_port)) ||
-#endif
-                      0);
-        
-        if (!bad_length) {
-          bad_sequence = (ntohl(reply->sequence) != tx_sequence);
-        } else {
-          bad_sequence = 0;
-        }
-        
-        if (bad_length || bad_sender || bad_sequence) {
-          n_attempts++;
-          if (n_attempts > max_retries) {
-            return 0;
-          }
-          continue;
-        }
-        
-        bad_header = ((reply->version != proto_version &&
-                       !(reply->version >= PROTO_VERSION_MISMATCH_COMPAT_CLIENT &&
-                         ntohs(reply->status) == STT_BADPKTVERSION)) ||
-                      (reply->pkt_type != PKT_TYPE_CMD_REPLY) ||
-                      (reply->res1 != 0) ||
-                      (reply->res2 != 0) ||
-                      (reply->command != request->command));
-        
-        if (bad_header) {
-          n_attempts++;
-          if (n_attempts > max_retries) {
-            return 0;
-          }
-          continue;
-        }
-        
-#if PROTO_VERSION_NUMBER == 6
-        /* Protocol version 5 is similar to 6 except there is no padding.
-           If a version 5 reply with STT_BADPKTVERSION is received,
-           switch our version and try again. */
-        if (proto_version == PROTO_VERSION_NUMBER &&
-            reply->version == PROTO_VERSION_NUMBER - 1) {
-          proto_version = PROTO_VERSION_NUMBER - 1;
-          continue;
-        }
-#else
-#error unknown compatibility with PROTO_VERSION - 1
-#endif
-
-        /* Good packet received, print out results */
-#if 0
-        printf("Reply cmd=%d reply=%d stat=%d seq=%d utok=%08lx tok=%d\n",
-               ntohs(reply->command), ntohs(reply->reply),
-               ntohs(reply->status),
-               ntohl(reply->sequence),
-               ntohl(reply->utoken),
-               ntohl(reply->token));
-#endif
+        continue;
+      }
 
-        if (password) {
-          *reply_auth_ok = check_reply_auth(reply, read_length);
-        } else {
-          /* Assume in this case that the reply is always considered
-             to be authentic */
-          *reply_auth_ok = 1;
-        }
-            
-        utoken = ntohl(reply->utoken);
-
-        if (*reply_auth_ok) {
-          /* If we're in authenticated mode, only acquire the utoken
-             and new token values if the reply authenticated properly.
-             This protects against forged packets with bogus tokens
-             in.  We won't accept a repeat of an old message with a
-             stale token in it, due to bad_sequence processing
-             earlier. */
-          utoken = ntohl(reply->utoken);
-          token = ntohl(reply->token);
-        }
-        
-        break;
+      if (check_version_fallback(request, reply))
+        continue;
 
-      }
+      /* Good packet received */
+      *reply_auth_ok = accept_reply(reply, read_length);
+      break;
     }
   } while (1);
 
@@ -1504,20 +1661,16 @@ submit_request(CMD_Request *request, CMD_Reply *reply, int *reply_auth_ok)
 }
 
 /* ================================================== */
+/* Print the status of a reply.  Returns a Boolean indicating whether
+   the request was successful. */
 
 static int
-request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int verbose)
+check_reply_status(CMD_Reply *reply, int reply_auth_ok, int requested_reply, int verbose)
 {
-  int reply_auth_ok;
   int status;
 
-  if (!submit_request(request, reply, &reply_auth_ok)) {
-    printf("506 Cannot talk to daemon\n");
-    return 0;
-  }
-
   status = ntohs(reply->status);
-        
+
   if (verbose || status != STT_SUCCESS) {
     switch (status) {
       case STT_SUCCESS:
@@ -1588,12 +1741,18 @@ request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int v
     } else {
       printf(" --- Reply not authenticated\n");
     }
+
+    if (status == STT_UNAUTH && unix_socket) {
+      fflush(stdout);
+      fprintf(stderr, "Privileged commands sent to the Unix domain socket are "
+              "allowed only for root and the user of chronyd\n");
+    }
   }
-  
+
   if (status != STT_SUCCESS &&
       status != STT_ACCESSALLOWED && status != STT_ACCESSDENIED) {
     return 0;
-  } 
+  }
 
   if (ntohs(reply->reply) != requested_reply) {
     printf("508 Bad reply from daemon\n");
@@ -1605,37 +1764,288 @@ request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int v
 
 /* ================================================== */
 
-static void
-print_seconds(unsigned long s)
+static int
+request_reply(CMD_Request *request, CMD_Reply *reply, int requested_reply, int verbose)
 {
-  unsigned long d;
-  if (s <= 1024) {
-    printf("%4ld", s);
-  } else if (s < 36000) {
-    printf("%3ldm", s / 60);
-  } else if (s < 345600) {
-    printf("%3ldh", s / 3600);
-  } else {
-    d = s / 86400;
-    if (d > 999) {
-      printf("%3ldy", d / 365);
-    } else {
-      printf("%3ldd", d);
-    }
+  int reply_auth_ok;
+
+  if (!submit_request(request, reply, &reply_auth_ok)) {
+    printf("506 Cannot talk to daemon\n");
+    return 0;
   }
+
+  return check_reply_status(reply, reply_auth_ok, requested_reply, verbose);
 }
 
 /* ================================================== */
+/* In the batch mode, requests which have only a status reply are queued
+   and sent to the daemon in a pipeline instead of waiting for each reply
+   before sending the next request.  Replies are matched to the requests
+   by their sequence numbers and printed in the order of the commands. */
 
-static void
-print_nanoseconds(double s)
-{
-  s = fabs(s);
+/* Maximum number of requests waiting for a reply.  It is smaller than
+   the default length of the receive queue of Unix domain datagram
+   sockets (10), so neither the daemon nor chronyc blocks in sending. */
+#define MAX_PIPELINED_REQUESTS 8
 
-  if (s < 9999.5e-9) {
-    printf("%4.0fns", s * 1e9);
-  } else if (s < 9999.5e-6) {
-    printf("%4.0fus", s * 1e6);
+typedef enum {
+  QRS_QUEUED,
+  QRS_SENT,
+  QRS_REPLIED,
+  QRS_FAILED
+} QueuedRequestState;
+
+typedef struct {
+  CMD_Request request;
+  CMD_Reply reply;
+  QueuedRequestState state;
+  int reply_auth_ok;
+  int n_attempts;
+  int timeout;
+  struct timespec deadline;
+} QueuedRequest;
+
+static int batch_mode = 0;
+
+static QueuedRequest *queued_requests = NULL;
+static int n_queued_requests = 0;
+static int max_queued_requests = 0;
+
+/* Cleared when a queued request fails */
+static int queued_requests_ok = 1;
+
+/* Commands which are parsed into a single request with a status reply
+   and can be pipelined */
+static const char *pipelined_commands[] = {
+  "accheck", "add", "allow", "burst", "cmdaccheck", "cmdallow", "cmddeny",
+  "cyclelogs", "delete", "deny", "dfreq", "doffset", "dump", "local",
+  "makestep", "maxdelay", "maxdelaydevratio", "maxdelayratio", "maxpoll",
+  "maxupdateskew", "minpoll", "minstratum", "offline", "online", "polltarget",
+  "rekey", "reloadleap", "reselect", "reselectdist", "trimrtc", "writertc",
+  NULL
+};
+
+/* ================================================== */
+
+static int
+is_pipelined_command(const char *command)
+{
+  int i;
+
+  for (i = 0; pipelined_commands[i]; i++) {
+    if (!strcmp(command, pipelined_commands[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+can_pipeline_requests(void)
+{
+  /* Authenticated requests sent over UDP need the token from the
+     previous reply, so they have to be sent one by one */
+  return batch_mode && (unix_socket || !password);
+}
+
+/* ================================================== */
+
+static int
+queue_request(CMD_Request *request)
+{
+  QueuedRequest *qr;
+
+  if (n_queued_requests >= max_queued_requests) {
+    max_queued_requests = max_queued_requests ? 2 * max_queued_requests : 16;
+    queued_requests = ReallocArray(QueuedRequest, max_queued_requests, queued_requests);
+  }
+
+  qr = &queued_requests[n_queued_requests++];
+  qr->request = *request;
+  qr->state = QRS_QUEUED;
+  qr->reply_auth_ok = 0;
+  qr->n_attempts = 0;
+  qr->timeout = initial_timeout;
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+send_queued_request(QueuedRequest *qr, struct timespec *now)
+{
+  int tx_length;
+
+  tx_length = prepare_request(&qr->request);
+
+  if (sendto(sock_fd, (void *) &qr->request, tx_length, 0,
+             &his_addr.u, his_addr_len) < 0) {
+    qr->state = QRS_FAILED;
+    return;
+  }
+
+  ++qr->request.attempt;
+
+  qr->state = QRS_SENT;
+  UTI_AddDoubleToTimespec(now, qr->timeout / 1000.0, &qr->deadline);
+  qr->timeout *= 2;
+}
+
+/* ================================================== */
+
+static void
+receive_queued_reply(struct timespec *now)
+{
+  QueuedRequest *qr;
+  CMD_Reply reply;
+  unsigned long index;
+  int read_length;
+
+  read_length = receive_reply(&reply);
+  if (!read_length)
+    return;
+
+  /* The sequence numbers of the queued requests are consecutive */
+  index = ntohl(reply.sequence) - ntohl(queued_requests[0].request.sequence);
+  if (index >= (unsigned long)n_queued_requests)
+    return;
+
+  qr = &queued_requests[index];
+  if (qr->state != QRS_SENT || !check_reply_header(&qr->request, &reply))
+    return;
+
+  if (check_version_fallback(&qr->request, &reply)) {
+    send_queued_request(qr, now);
+    return;
+  }
+
+  qr->reply = reply;
+  qr->reply_auth_ok = accept_reply(&reply, read_length);
+  qr->state = QRS_REPLIED;
+}
+
+/* ================================================== */
+/* Send all queued requests, wait for their replies and print them in
+   the order in which the requests were queued */
+
+static void
+flush_queued_requests(void)
+{
+  QueuedRequest *qr;
+  struct timespec now, first_deadline, ts;
+  struct timeval tv;
+  double timeout;
+  fd_set rdfd;
+  int i, next_print, next_send, select_status;
+
+  if (!n_queued_requests)
+    return;
+
+  for (i = 0; i < n_queued_requests; i++)
+    init_request(&queued_requests[i].request);
+
+  next_print = next_send = 0;
+
+  while (next_print < n_queued_requests) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (; next_send < n_queued_requests &&
+           next_send - next_print < MAX_PIPELINED_REQUESTS; next_send++)
+      send_queued_request(&queued_requests[next_send], &now);
+
+    /* Resend requests with an expired timeout */
+    for (i = next_print; i < next_send; i++) {
+      qr = &queued_requests[i];
+      if (qr->state != QRS_SENT || UTI_CompareTimespecs(&qr->deadline, &now) > 0)
+        continue;
+
+      if (++qr->n_attempts > max_retries)
+        qr->state = QRS_FAILED;
+      else
+        send_queued_request(qr, &now);
+    }
+
+    /* Print the replies which are next in the order */
+    for (; next_print < next_send; next_print++) {
+      qr = &queued_requests[next_print];
+
+      if (qr->state == QRS_SENT) {
+        break;
+      } else if (qr->state == QRS_FAILED) {
+        printf("506 Cannot talk to daemon\n");
+        queued_requests_ok = 0;
+      } else if (!check_reply_status(&qr->reply, qr->reply_auth_ok, RPY_NULL, 1)) {
+        queued_requests_ok = 0;
+      }
+    }
+
+    if (next_print >= next_send)
+      continue;
+
+    /* Wait for a reply until the first timeout */
+    first_deadline = queued_requests[next_print].deadline;
+    for (i = next_print + 1; i < next_send; i++) {
+      qr = &queued_requests[i];
+      if (qr->state == QRS_SENT && UTI_CompareTimespecs(&qr->deadline, &first_deadline) < 0)
+        first_deadline = qr->deadline;
+    }
+
+    UTI_DiffTimespecsToDouble(&timeout, &first_deadline, &now);
+    if (timeout < 0.0)
+      timeout = 0.0;
+    UTI_DoubleToTimespec(timeout, &ts);
+    UTI_TimespecToTimeval(&ts, &tv);
+
+    FD_ZERO(&rdfd);
+    FD_SET(sock_fd, &rdfd);
+
+    select_status = select(sock_fd + 1, &rdfd, NULL, NULL, &tv);
+
+    if (select_status > 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      receive_queued_reply(&now);
+    }
+  }
+
+  n_queued_requests = 0;
+}
+
+/* ================================================== */
+
+static void
+print_seconds(unsigned long s)
+{
+  unsigned long d;
+  if (s <= 1024) {
+    printf("%4ld", s);
+  } else if (s < 36000) {
+    printf("%3ldm", s / 60);
+  } else if (s < 345600) {
+    printf("%3ldh", s / 3600);
+  } else {
+    d = s / 86400;
+    if (d > 999) {
+      printf("%3ldy", d / 365);
+    } else {
+      printf("%3ldd", d);
+    }
+  }
+}
+
+/* ================================================== */
+
+static void
+print_nanoseconds(double s)
+{
+  s = fabs(s);
+
+  if (s < 9999.5e-9) {
+    printf("%4.0fns", s * 1e9);
+  } else if (s < 9999.5e-6) {
+    printf("%4.0fus", s * 1e6);
   } else if (s < 9999.5e-3) {
     printf("%4.0fms", s * 1e3);
   } else if (s < 999.5) {
@@ -1722,16 +2132,158 @@ check_for_verbose_flag(char *line)
 
 /* ================================================== */
 
+/* Get reports of all sources from a daemon which doesn't support the
+   SOURCE_REPORTS request, using separate requests for each source */
+
 static int
-process_cmd_sources(char *line)
+get_source_reports_by_index(RPY_SourceReports_Source **sources)
 {
   CMD_Request request;
   CMD_Reply reply;
+  RPY_SourceReports_Source *source;
+  int i, n_sources;
+
+  request.command = htons(REQ_N_SOURCES);
+  if (!request_reply(&request, &reply, RPY_N_SOURCES, 0))
+    return -1;
+
+  n_sources = ntohl(reply.data.n_sources.n_sources);
+  *sources = malloc((n_sources + 1) * sizeof (**sources));
+
+  for (i = 0; i < n_sources; i++) {
+    source = &(*sources)[i];
+
+    request.command = htons(REQ_SOURCE_DATA);
+    request.data.source_data.index = htonl(i);
+    if (!request_reply(&request, &reply, RPY_SOURCE_DATA, 0))
+      break;
+
+    source->ip_addr = reply.data.source_data.ip_addr;
+    source->poll = reply.data.source_data.poll;
+    source->stratum = reply.data.source_data.stratum;
+    source->state = reply.data.source_data.state;
+    source->mode = reply.data.source_data.mode;
+    source->flags = reply.data.source_data.flags;
+    source->reachability = reply.data.source_data.reachability;
+    source->since_sample = reply.data.source_data.since_sample;
+    source->orig_latest_meas = reply.data.source_data.orig_latest_meas;
+    source->latest_meas = reply.data.source_data.latest_meas;
+    source->latest_meas_err = reply.data.source_data.latest_meas_err;
+
+    request.command = htons(REQ_SOURCESTATS);
+    request.data.sourcestats.index = htonl(i);
+    if (!request_reply(&request, &reply, RPY_SOURCESTATS, 0))
+      break;
+
+    source->ref_id = reply.data.sourcestats.ref_id;
+    source->n_samples = reply.data.sourcestats.n_samples;
+    source->n_runs = reply.data.sourcestats.n_runs;
+    source->span_seconds = reply.data.sourcestats.span_seconds;
+    source->sd = reply.data.sourcestats.sd;
+    source->resid_freq_ppm = reply.data.sourcestats.resid_freq_ppm;
+    source->skew_ppm = reply.data.sourcestats.skew_ppm;
+    source->est_offset = reply.data.sourcestats.est_offset;
+    source->est_offset_err = reply.data.sourcestats.est_offset_err;
+  }
+
+  if (i < n_sources) {
+    free(*sources);
+    return -1;
+  }
+
+  return n_sources;
+}
+
+/* ================================================== */
+/* Get reports of all sources (in network order) with as few requests as
+   possible.  Return the number of sources, or -1 on error.  The array
+   needs to be freed by the caller. */
+
+static int
+get_source_reports(RPY_SourceReports_Source **sources)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+  unsigned long first_index, next_index, n;
+  int n_sources, reply_auth_ok;
+
+  *sources = NULL;
+  n_sources = 0;
+  first_index = 0;
+
+  while (1) {
+    request.command = htons(REQ_SOURCE_REPORTS);
+    request.data.source_reports.first_index = htonl(first_index);
+    request.data.source_reports.n_indices = htonl(MAX_SOURCE_REPORTS);
+
+    if (!submit_request(&request, &reply, &reply_auth_ok)) {
+      /* Older daemons drop requests they don't know without a reply */
+      if (first_index == 0)
+        return get_source_reports_by_index(sources);
+      printf("506 Cannot talk to daemon\n");
+      break;
+    }
+
+    /* Fall back to the old requests if the daemon doesn't know this one */
+    if (first_index == 0 && (ntohs(reply.status) == STT_INVALID ||
+                             ntohs(reply.status) == STT_BADPKTVERSION))
+      return get_source_reports_by_index(sources);
+
+    if (ntohs(reply.status) != STT_SUCCESS ||
+        ntohs(reply.reply) != RPY_SOURCE_REPORTS) {
+      printf("508 Bad reply from daemon\n");
+      break;
+    }
+
+    n = ntohl(reply.data.source_reports.n_sources);
+    *sources = realloc(*sources, (n_sources + n + 1) * sizeof (**sources));
+    memcpy(*sources + n_sources, reply.data.source_reports.sources,
+           n * sizeof (**sources));
+    n_sources += n;
+
+    /* Stop when the last source was reported, or if the daemon made no
+       progress */
+    next_index = ntohl(reply.data.source_reports.next_index);
+    if (next_index >= ntohl(reply.data.source_reports.n_indices) ||
+        next_index <= first_index)
+      return n_sources;
+
+    first_index = next_index;
+  }
+
+  free(*sources);
+  return -1;
+}
+
+/* ================================================== */
+
+static void
+format_source_name(RPY_SourceReports_Source *source, char *buf, int len)
+{
+  IPAddr ip_addr;
+
+  UTI_IPNetworkToHost(&source->ip_addr, &ip_addr);
+
+  if (ntohs(source->mode) == RPY_SD_MD_REF) {
+    snprintf(buf, len, "%s", UTI_RefidToString(ip_addr.addr.in4));
+  } else if (no_dns) {
+    snprintf(buf, len, "%s", UTI_IPToString(&ip_addr));
+  } else {
+    DNS_IPAddress2Name(&ip_addr, buf, len);
+    buf[25] = 0;
+  }
+}
+
+/* ================================================== */
+
+static int
+process_cmd_sources(char *line)
+{
+  RPY_SourceReports_Source *sources;
   int n_sources, i;
   int verbose = 0;
 
   double orig_latest_meas, latest_meas, latest_meas_err;
-  IPAddr ip_addr;
   uint32_t latest_meas_ago;
   int16_t poll;
   uint16_t stratum, state, mode, flags, reachability;
@@ -1740,100 +2292,87 @@ process_cmd_sources(char *line)
   /* Check whether to output verbose headers */
   verbose = check_for_verbose_flag(line);
   
-  request.command = htons(REQ_N_SOURCES);
-  if (request_reply(&request, &reply, RPY_N_SOURCES, 0)) {
-    n_sources = ntohl(reply.data.n_sources.n_sources);
-    printf("210 Number of sources = %d\n", n_sources);
-    if (verbose) {
-      printf("\n");
-      printf("  .-- Source mode  '^' = server, '=' = peer, '#' = local clock.\n");
-      printf(" / .- Source state '*' = current synced, '+' = combined , '-' = not combined,\n");
-      printf("| /   '?' = unreachable, 'x' = time may be in error, '~' = time too variable.\n");
-      printf("||                                                 .- xxxx [ yyyy ] +/- zzzz\n");
-      printf("||                                                /   xxxx = adjusted offset,\n");
-      printf("||         Log2(Polling interval) -.             |    yyyy = measured offset,\n");
-      printf("||                                  \\            |    zzzz = estimated error.\n");
-      printf("||                                   |           |                         \n");
+  n_sources = get_source_reports(&sources);
+  if (n_sources < 0)
+    return 0;
+
+  printf("210 Number of sources = %d\n", n_sources);
+  if (verbose) {
+    printf("\n");
+    printf("  .-- Source mode  '^' = server, '=' = peer, '#' = local clock.\n");
+    printf(" / .- Source state '*' = current synced, '+' = combined , '-' = not combined,\n");
+    printf("| /   '?' = unreachable, 'x' = time may be in error, '~' = time too variable.\n");
+    printf("||                                                 .- xxxx [ yyyy ] +/- zzzz\n");
+    printf("||                                                /   xxxx = adjusted offset,\n");
+    printf("||         Log2(Polling interval) -.             |    yyyy = measured offset,\n");
+    printf("||                                  \\            |    zzzz = estimated error.\n");
+    printf("||                                   |           |                         \n");
+  }
+
+  printf("MS Name/IP address         Stratum Poll Reach LastRx Last sample\n");
+  printf("===============================================================================\n");
+
+  /*     "MS NNNNNNNNNNNNNNNNNNNNNNNNNNN  SS  PP   RRR  RRRR  SSSSSSS[SSSSSSS] +/- SSSSSS" */
+
+  for (i = 0; i < n_sources; i++) {
+    poll = ntohs(sources[i].poll);
+    stratum = ntohs(sources[i].stratum);
+    state = ntohs(sources[i].state);
+    mode = ntohs(sources[i].mode);
+    flags = ntohs(sources[i].flags);
+    reachability = ntohs(sources[i].reachability);
+    latest_meas_ago = ntohl(sources[i].since_sample);
+    orig_latest_meas = UTI_FloatNetworkToHost(sources[i].orig_latest_meas);
+    latest_meas = UTI_FloatNetworkToHost(sources[i].latest_meas);
+    latest_meas_err = UTI_FloatNetworkToHost(sources[i].latest_meas_err);
+
+    format_source_name(&sources[i], hostname_buf, sizeof (hostname_buf));
+
+    switch (mode) {
+      case RPY_SD_MD_CLIENT:
+        printf("^"); break;
+      case RPY_SD_MD_PEER:
+        printf("="); break;
+      case RPY_SD_MD_REF:
+        printf("#"); break;
+      default:
+        printf(" ");
+    }
+    switch (state) {
+      case RPY_SD_ST_SYNC:
+        printf("*"); break;
+      case RPY_SD_ST_UNREACH:
+        printf("?"); break;
+      case RPY_SD_ST_FALSETICKER:
+        printf("x"); break;
+      case RPY_SD_ST_JITTERY:
+        printf("~"); break;
+      case RPY_SD_ST_CANDIDATE:
+        printf("+"); break;
+      case RPY_SD_ST_OUTLIER:
+        printf("-"); break;
+      default:
+        printf(" ");
+    }
+    switch (flags) {
+      default:
+        break;
     }
 
-    printf("MS Name/IP address         Stratum Poll Reach LastRx Last sample\n");
-    printf("===============================================================================\n");
-
-    /*     "MS NNNNNNNNNNNNNNNNNNNNNNNNNNN  SS  PP   RRR  RRRR  SSSSSSS[SSSSSSS] +/- SSSSSS" */
-
-    for (i=0; i<n_sources; i++) {
-      request.command = htons(REQ_SOURCE_DATA);
-      request.data.source_data.index = htonl(i);
-      if (request_reply(&request, &reply, RPY_SOURCE_DATA, 0)) {
-          UTI_IPNetworkToHost(&reply.data.source_data.ip_addr, &ip_addr);
-          poll = ntohs(reply.data.source_data.poll);
-          stratum = ntohs(reply.data.source_data.stratum);
-          state = ntohs(reply.data.source_data.state);
-          mode = ntohs(reply.data.source_data.mode);
-          flags = ntohs(reply.data.source_data.flags);
-          reachability = ntohs(reply.data.source_data.reachability);
-          latest_meas_ago = ntohl(reply.data.source_data.since_sample);
-          orig_latest_meas = UTI_FloatNetworkToHost(reply.data.source_data.orig_latest_meas);
-          latest_meas = UTI_FloatNetworkToHost(reply.data.source_data.latest_meas);
-          latest_meas_err = UTI_FloatNetworkToHost(reply.data.source_data.latest_meas_err);
-
-          if (mode == RPY_SD_MD_REF) {
-            snprintf(hostname_buf, sizeof(hostname_buf), "%s", UTI_RefidToString(ip_addr.addr.in4));
-          } else if (no_dns) {
-            snprintf(hostname_buf, sizeof(hostname_buf), "%s", UTI_IPToString(&ip_addr));
-          } else {
-            DNS_IPAddress2Name(&ip_addr, hostname_buf, sizeof(hostname_buf));
-            hostname_buf[25] = 0;
-          }
+    printf(" %-27s  %2d  %2d   %3o  ", hostname_buf, stratum, poll, reachability);
+    print_seconds(latest_meas_ago);
+    printf("  ");
+    print_signed_nanoseconds(latest_meas);
+    printf("[");
+    print_signed_nanoseconds(orig_latest_meas);
+    printf("]");
+    printf(" +/- ");
+    print_nanoseconds(latest_meas_err);
+    printf("\n");
+  }
 
-          switch (mode) {
-            case RPY_SD_MD_CLIENT:
-              printf("^"); break;
-            case RPY_SD_MD_PEER:
-              printf("="); break;
-            case RPY_SD_MD_REF:
-              printf("#"); break;
-            default:
-              printf(" ");
-          }
-          switch (state) {
-            case RPY_SD_ST_SYNC:
-              printf("*"); break;
-            case RPY_SD_ST_UNREACH:
-              printf("?"); break;
-            case RPY_SD_ST_FALSETICKER:
-              printf("x"); break;
-            case RPY_SD_ST_JITTERY:
-              printf("~"); break;
-            case RPY_SD_ST_CANDIDATE:
-              printf("+"); break;
-            case RPY_SD_ST_OUTLIER:
-              printf("-"); break;
-            default:
-              printf(" ");
-          }
-          switch (flags) {
-            default:
-              break;
-          }
+  free(sources);
 
-          printf(" %-27s  %2d  %2d   %3o  ", hostname_buf, stratum, poll, reachability);
-          print_seconds(latest_meas_ago);
-          printf("  ");
-          print_signed_nanoseconds(latest_meas);
-          printf("[");
-          print_signed_nanoseconds(orig_latest_meas);
-          printf("]");
-          printf(" +/- ");
-          print_nanoseconds(latest_meas_err);
-          printf("\n");
-      } else {
-        return 0;
-      }
-    }
-  } else {
-    return 0;
-  }
   return 1;
 }
 
@@ -1842,82 +2381,65 @@ process_cmd_sources(char *line)
 static int
 process_cmd_sourcestats(char *line)
 {
-  CMD_Request request;
-  CMD_Reply reply;
+  RPY_SourceReports_Source *sources;
   int n_sources, i;
   int verbose = 0;
 
   char hostname_buf[50];
   unsigned long n_samples, n_runs, span_seconds;
   double resid_freq_ppm, skew_ppm, sd, est_offset;
-  uint32_t ref_id;
-  IPAddr ip_addr;
 
   verbose = check_for_verbose_flag(line);
 
-  request.command = htons(REQ_N_SOURCES);
-  if (request_reply(&request, &reply, RPY_N_SOURCES, 0)) {
-    n_sources = ntohl(reply.data.n_sources.n_sources);
-    printf("210 Number of sources = %d\n", n_sources);
-    if (verbose) {
-      printf("                             .- Number of sample points in measurement set.\n");
-      printf("                            /    .- Number of residual runs with same sign.\n");
-      printf("                           |    /    .- Length of measurement set (time).\n");
-      printf("                           |   |    /      .- Est. clock freq error (ppm).\n");
-      printf("                           |   |   |      /           .- Est. error in freq.\n");
-      printf("                           |   |   |     |           /         .- Est. offset.\n");
-      printf("                           |   |   |     |          |          |   On the -.\n");
-      printf("                           |   |   |     |          |          |   samples. \\\n");
-      printf("                           |   |   |     |          |          |             |\n");
-    }
-
-    printf("Name/IP Address            NP  NR  Span  Frequency  Freq Skew  Offset  Std Dev\n");
-    printf("==============================================================================\n");
-
-    /*      NNNNNNNNNNNNNNNNNNNNNNNNN  NP  NR  SSSS FFFFFFFFFF SSSSSSSSSS  SSSSSSS  SSSSSS*/
-
-    for (i=0; i<n_sources; i++) {
-      request.command = htons(REQ_SOURCESTATS);
-      request.data.source_data.index = htonl(i);
-      if (request_reply(&request, &reply, RPY_SOURCESTATS, 0)) {
-          ref_id = ntohl(reply.data.sourcestats.ref_id);
-          UTI_IPNetworkToHost(&reply.data.sourcestats.ip_addr, &ip_addr);
-          n_samples = ntohl(reply.data.sourcestats.n_samples);
-          n_runs = ntohl(reply.data.sourcestats.n_runs);
-          span_seconds = ntohl(reply.data.sourcestats.span_seconds);
-          resid_freq_ppm = UTI_FloatNetworkToHost(reply.data.sourcestats.resid_freq_ppm);
-          skew_ppm = UTI_FloatNetworkToHost(reply.data.sourcestats.skew_ppm);
-          sd = UTI_FloatNetworkToHost(reply.data.sourcestats.sd);
-          est_offset = UTI_FloatNetworkToHost(reply.data.sourcestats.est_offset);
-          /* est_offset_err = UTI_FloatNetworkToHost(reply.data.sourcestats.est_offset_err); */
-
-          if (ip_addr.family == IPADDR_UNSPEC)
-            snprintf(hostname_buf, sizeof(hostname_buf), "%s", UTI_RefidToString(ref_id));
-          else if (no_dns) {
-            snprintf(hostname_buf, sizeof(hostname_buf), "%s", UTI_IPToString(&ip_addr));
-          } else {
-            DNS_IPAddress2Name(&ip_addr, hostname_buf, sizeof(hostname_buf));
-            hostname_buf[25] = 0;
-          }
-
-          printf("%-25s %3lu %3lu  ", hostname_buf, n_samples, n_runs);
-          print_seconds(span_seconds);
-          printf(" ");
-          print_signed_freq_ppm(resid_freq_ppm);
-          printf(" ");
-          print_freq_ppm(skew_ppm);
-          printf("  ");
-          print_signed_nanoseconds(est_offset);
-          printf("  ");
-          print_nanoseconds(sd);
-          printf("\n");
-      } else {
-        return 0;
-      }
-    }
-  } else {
+  n_sources = get_source_reports(&sources);
+  if (n_sources < 0)
     return 0;
+
+  printf("210 Number of sources = %d\n", n_sources);
+  if (verbose) {
+    printf("                             .- Number of sample points in measurement set.\n");
+    printf("                            /    .- Number of residual runs with same sign.\n");
+    printf("                           |    /    .- Length of measurement set (time).\n");
+    printf("                           |   |    /      .- Est. clock freq error (ppm).\n");
+    printf("                           |   |   |      /           .- Est. error in freq.\n");
+    printf("                           |   |   |     |           /         .- Est. offset.\n");
+    printf("                           |   |   |     |          |          |   On the -.\n");
+    printf("                           |   |   |     |          |          |   samples. \\\n");
+    printf("                           |   |   |     |          |          |             |\n");
+  }
+
+  printf("Name/IP Address            NP  NR  Span  Frequency  Freq Skew  Offset  Std Dev\n");
+  printf("==============================================================================\n");
+
+  /*      NNNNNNNNNNNNNNNNNNNNNNNNN  NP  NR  SSSS FFFFFFFFFF SSSSSSSSSS  SSSSSSS  SSSSSS*/
+
+  for (i = 0; i < n_sources; i++) {
+    n_samples = ntohl(sources[i].n_samples);
+    n_runs = ntohl(sources[i].n_runs);
+    span_seconds = ntohl(sources[i].span_seconds);
+    resid_freq_ppm = UTI_FloatNetworkToHost(sources[i].resid_freq_ppm);
+    skew_ppm = UTI_FloatNetworkToHost(sources[i].skew_ppm);
+    sd = UTI_FloatNetworkToHost(sources[i].sd);
+    est_offset = UTI_FloatNetworkToHost(sources[i].est_offset);
+    /* est_offset_err = UTI_FloatNetworkToHost(sources[i].est_offset_err); */
+
+    format_source_name(&sources[i], hostname_buf, sizeof (hostname_buf));
+
+    printf("%-25s %3lu %3lu  ", hostname_buf, n_samples, n_runs);
+    print_seconds(span_seconds);
+    printf(" ");
+    print_signed_freq_ppm(resid_freq_ppm);
+    printf(" ");
+    print_freq_ppm(skew_ppm);
+    printf("  ");
+    print_signed_nanoseconds(est_offset);
+    printf("  ");
+    print_nanoseconds(sd);
+    printf("\n");
   }
+
+  free(sources);
+
   return 1;
 }
 
@@ -1932,7 +2454,7 @@ process_cmd_tracking(char *line)
   uint32_t ref_id;
   char host[50];
   char *ref_ip;
-  struct timeval ref_time;
+  struct timespec ref_time;
   struct tm ref_time_tm;
   unsigned long a, b, c, d;
   double correction;
@@ -1984,7 +2506,7 @@ process_cmd_tracking(char *line)
 
     printf("Reference ID    : %lu.%lu.%lu.%lu (%s)\n", a, b, c, d, ref_ip);
     printf("Stratum         : %lu\n", (unsigned long) ntohs(reply.data.tracking.stratum));
-    UTI_TimevalNetworkToHost(&reply.data.tracking.ref_time, &ref_time);
+    UTI_TimespecNetworkToHost(&reply.data.tracking.ref_time, &ref_time);
     ref_time_tm = *gmtime((time_t *)&ref_time.tv_sec);
     printf("Ref time (UTC)  : %s", asctime(&ref_time_tm));
     correction = UTI_FloatNetworkToHost(reply.data.tracking.current_correction);
@@ -2018,7 +2540,7 @@ process_cmd_rtcreport(char *line)
 {
   CMD_Request request;
   CMD_Reply reply;
-  struct timeval ref_time;
+  struct timespec ref_time;
   struct tm ref_time_tm;
   unsigned short n_samples;
   unsigned short n_runs;
@@ -2028,7 +2550,7 @@ process_cmd_rtcreport(char *line)
   
   request.command = htons(REQ_RTCREPORT);
   if (request_reply(&request, &reply, RPY_RTC, 0)) {
-    UTI_TimevalNetworkToHost(&reply.data.rtc.ref_time, &ref_time);
+    UTI_TimespecNetworkToHost(&reply.data.rtc.ref_time, &ref_time);
     ref_time_tm = *gmtime(&ref_time.tv_sec);
     n_samples = ntohs(reply.data.rtc.n_samples);
     n_runs = ntohs(reply.data.rtc.n_runs);
@@ -2150,7 +2672,7 @@ process_cmd_manual_list(const char *line)
   int n_samples;
   RPY_ManualListSample *sample;
   int i;
-  struct timeval when;
+  struct timespec when;
   double slewed_offset, orig_offset, residual;
 
   request.command = htons(REQ_MANUAL_LIST);
@@ -2161,7 +2683,7 @@ process_cmd_manual_list(const char *line)
                  "====================================================\n");
           for (i=0; i<n_samples; i++) {
             sample = &reply.data.manual_list.samples[i];
-            UTI_TimevalNetworkToHost(&sample->when, &when);
+            UTI_TimespecNetworkToHost(&sample->when, &when);
             slewed_offset = UTI_FloatNetworkToHost(sample->slewed_offset);
             orig_offset = UTI_FloatNetworkToHost(sample->orig_offset);
             residual = UTI_FloatNetworkToHost(sample->residual);
@@ -2195,7 +2717,7 @@ process_cmd_manual_delete(CMD_Request *msg, const char *line)
 static int
 process_cmd_settime(char *line)
 {
-  struct timeval ts;
+  struct timespec ts;
   time_t now, new_time;
   CMD_Request request;
   CMD_Reply reply;
@@ -2210,8 +2732,8 @@ process_cmd_settime(char *line)
     printf("510 - Could not parse date string\n");
   } else {
     ts.tv_sec = new_time;
-    ts.tv_usec = 0;
-    UTI_TimevalHostToNetwork(&ts, &request.data.settime.ts);
+    ts.tv_nsec = 0;
+    UTI_TimespecHostToNetwork(&ts, &request.data.settime.ts);
     request.command = htons(REQ_SETTIME);
     if (request_reply(&request, &reply, RPY_MANUAL_TIMESTAMP, 1)) {
           offset_cs = ntohl(reply.data.manual_timestamp.centiseconds);
@@ -2236,6 +2758,14 @@ process_cmd_rekey(CMD_Request *msg, char *line)
 
 /* ================================================== */
 
+static void
+process_cmd_reloadleap(CMD_Request *msg, char *line)
+{
+  msg->command = htons(REQ_RELOAD_LEAP);
+}
+
+/* ================================================== */
+
 static void
 process_cmd_makestep(CMD_Request *msg, char *line)
 {
@@ -2244,6 +2774,217 @@ process_cmd_makestep(CMD_Request *msg, char *line)
 
 /* ================================================== */
 
+static int
+process_cmd_cmdstats(const char *line)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+
+  request.command = htons(REQ_CMDMON_STATS);
+  if (request_reply(&request, &reply, RPY_CMDMON_STATS, 0)) {
+    printf("Kept replies    : %lu (maximum %lu)\n"
+           "Seen timestamps : %lu (maximum %lu)\n"
+           "Resent replies  : %lu\n"
+           "Rejected logons : %lu\n",
+           (unsigned long)ntohl(reply.data.cmdmon_stats.kept_replies),
+           (unsigned long)ntohl(reply.data.cmdmon_stats.max_kept_replies),
+           (unsigned long)ntohl(reply.data.cmdmon_stats.seen_timestamps),
+           (unsigned long)ntohl(reply.data.cmdmon_stats.max_seen_timestamps),
+           (unsigned long)ntohl(reply.data.cmdmon_stats.resent_replies),
+           (unsigned long)ntohl(reply.data.cmdmon_stats.rejected_timestamps));
+    return 1;
+  }
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+process_cmd_schedstats(const char *line)
+{
+  const char *types[] = {"delay", "timeout", "file"};
+  CMD_Request request;
+  CMD_Reply reply;
+  unsigned long i, j, n, type, count, bucket;
+  uint64_t handler;
+  double mean, max;
+
+  printf("Handler            Type         Count   Mean     Max\n");
+  printf("=====================================================\n");
+
+  for (i = 0, n = 1; i < n; i++) {
+    request.command = htons(REQ_LATENCY_STATS);
+    request.data.latency_stats.index = htonl(i);
+    if (!request_reply(&request, &reply, RPY_LATENCY_STATS, 0))
+      return 0;
+
+    n = ntohl(reply.data.latency_stats.n_stats);
+    type = ntohl(reply.data.latency_stats.type);
+    handler = (uint64_t)ntohl(reply.data.latency_stats.handler_high) << 32 |
+              ntohl(reply.data.latency_stats.handler_low);
+    count = ntohl(reply.data.latency_stats.count);
+    mean = UTI_FloatNetworkToHost(reply.data.latency_stats.mean);
+    max = UTI_FloatNetworkToHost(reply.data.latency_stats.max);
+
+    if (type == RPY_LAT_DISPATCH_DELAY)
+      printf("%-18s", "select");
+    else
+      printf("0x%-16"PRIx64, handler);
+    printf(" %-8s %10lu ", type < sizeof (types) / sizeof (types[0]) ? types[type] : "?",
+           count);
+    print_nanoseconds(mean);
+    printf("  ");
+    print_nanoseconds(max);
+    printf("\n");
+
+    if (!count)
+      continue;
+
+    /* Print the non-empty buckets with their upper bound */
+    printf("  ");
+    for (j = 0; j < MAX_LATENCY_BUCKETS; j++) {
+      bucket = ntohl(reply.data.latency_stats.buckets[j]);
+      if (!bucket)
+        continue;
+      if (j < MAX_LATENCY_BUCKETS - 1)
+        printf(" <%luus:%lu", 1UL << j, bucket);
+      else
+        printf(" >=%luus:%lu", 1UL << (j - 1), bucket);
+    }
+    printf("\n");
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+process_cmd_serverlatency(const char *line)
+{
+  CMD_Request request;
+  CMD_Reply reply;
+  IPAddr ip_addr;
+  struct timespec when;
+  struct tm when_tm;
+  char time_buf[32], host[50];
+  unsigned long i, n_worst;
+
+  request.command = htons(REQ_SERVER_LATENCY);
+  if (!request_reply(&request, &reply, RPY_SERVER_LATENCY, 0))
+    return 0;
+
+  printf("Replies            : %"PRIu32"\n", ntohl(reply.data.server_latency.count));
+  printf("Mean latency       : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.mean));
+  printf("\n50th percentile    : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.p50));
+  printf("\n90th percentile    : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.p90));
+  printf("\n99th percentile    : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.p99));
+  printf("\n99.9th percentile  : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.p999));
+  printf("\nMaximum latency    : ");
+  print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.max));
+  printf("\n");
+
+  n_worst = ntohl(reply.data.server_latency.n_worst);
+  if (n_worst > MAX_WORST_LATENCIES)
+    n_worst = MAX_WORST_LATENCIES;
+  if (!n_worst)
+    return 1;
+
+  printf("\nTime of request (UTC) Latency  Client\n");
+  printf("=====================================================\n");
+
+  for (i = 0; i < n_worst; i++) {
+    UTI_TimespecNetworkToHost(&reply.data.server_latency.worst[i].when, &when);
+    when_tm = *gmtime(&when.tv_sec);
+    strftime(time_buf, sizeof (time_buf), "%Y-%m-%d %H:%M:%S", &when_tm);
+
+    UTI_IPNetworkToHost(&reply.data.server_latency.worst[i].ip_addr, &ip_addr);
+    if (no_dns)
+      snprintf(host, sizeof (host), "%s", UTI_IPToString(&ip_addr));
+    else
+      DNS_IPAddress2Name(&ip_addr, host, sizeof (host));
+
+    printf("%s    ", time_buf);
+    print_nanoseconds(UTI_FloatNetworkToHost(reply.data.server_latency.worst[i].latency));
+    printf("  %s\n", host);
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+process_cmd_serverstats(const char *line)
+{
+  /* Names of the counters in the order defined in counters.h */
+  const char *names[] = {
+    "NTP packets received (server IPv4)",
+    "NTP packets received (server IPv6)",
+    "NTP packets received (client IPv4)",
+    "NTP packets received (client IPv6)",
+    "NTP packets sent (server IPv4)",
+    "NTP packets sent (server IPv6)",
+    "NTP packets sent (client IPv4)",
+    "NTP packets sent (client IPv6)",
+    "NTP packets dropped",
+    "NTP send errors",
+    "NTP test 1 failed",
+    "NTP test 2 failed",
+    "NTP test 3 failed",
+    "NTP test 4 failed",
+    "NTP test 4a failed",
+    "NTP test 4b failed",
+    "NTP test 4c failed",
+    "NTP test 5 failed",
+    "NTP test 6 failed",
+    "NTP test 7 failed",
+    "NTP test 8 failed",
+    "NTP authentication failures",
+    "Command requests received (Unix)",
+    "Command requests received (IPv4)",
+    "Command requests received (IPv6)",
+    "Command replies sent",
+    "Command requests dropped",
+    "Command authentication failures",
+    "Scheduler iterations",
+    "Timeouts dispatched",
+    "File handlers dispatched",
+    "Regressions",
+    "Source selections",
+    "Log bytes written",
+    "Log records dropped"
+  };
+  CMD_Request request;
+  CMD_Reply reply;
+  unsigned long i, n;
+  uint64_t value;
+
+  request.command = htons(REQ_SERVER_COUNTERS);
+  if (!request_reply(&request, &reply, RPY_SERVER_COUNTERS, 0))
+    return 0;
+
+  n = ntohl(reply.data.server_counters.n_counters);
+
+  for (i = 0; i < n; i++) {
+    value = (uint64_t)ntohl(reply.data.server_counters.counters[i].high) << 32 |
+            ntohl(reply.data.server_counters.counters[i].low);
+    if (i < sizeof (names) / sizeof (names[0]))
+      printf("%-36s : %"PRIu64"\n", names[i], value);
+    else
+      printf("Counter %-28lu : %"PRIu64"\n", i, value);
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_cmd_activity(const char *line)
 {
@@ -2292,16 +3033,127 @@ process_cmd_reselect(CMD_Request *msg, char *line)
   msg->command = htons(REQ_RESELECT);
 }
 
+/* ================================================== */
+/* Subscriptions to events in the daemon.  The lease is renewed when half
+   of it has passed. */
+
+#define SUBSCRIPTION_LEASE 60
+
+static int
+subscribe(CMD_Request *request, CMD_Reply *reply, int events, double min_interval,
+          int verbose)
+{
+  int reply_auth_ok;
+
+  request->command = htons(REQ_SUBSCRIBE);
+  request->data.subscribe.events = htonl(events);
+  request->data.subscribe.lease = htonl(events ? SUBSCRIPTION_LEASE : 0);
+  request->data.subscribe.min_interval = UTI_FloatHostToNetwork(min_interval);
+
+  if (verbose)
+    return request_reply(request, reply, RPY_EVENT, 0);
+
+  /* Older daemons don't support subscriptions */
+  return submit_request(request, reply, &reply_auth_ok) &&
+         ntohs(reply->status) == STT_SUCCESS && ntohs(reply->reply) == RPY_EVENT;
+}
+
+/* ================================================== */
+/* Wait for an update sent by the daemon to the subscription.  Returns
+   zero if no update was received before the deadline. */
+
+static int
+wait_for_update(CMD_Request *subscription, CMD_Reply *reply, struct timespec *deadline)
+{
+  struct timespec now, ts;
+  struct timeval tv;
+  double timeout;
+  fd_set rdfd;
+  int read_length;
+
+  while (1) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    UTI_DiffTimespecsToDouble(&timeout, deadline, &now);
+    if (timeout <= 0.0)
+      return 0;
+
+    UTI_DoubleToTimespec(timeout, &ts);
+    UTI_TimespecToTimeval(&ts, &tv);
+
+    FD_ZERO(&rdfd);
+    FD_SET(sock_fd, &rdfd);
+
+    if (select(sock_fd + 1, &rdfd, NULL, NULL, &tv) <= 0)
+      continue;
+
+    read_length = receive_reply(reply);
+    if (!read_length || reply->sequence != subscription->sequence ||
+        !check_reply_header(subscription, reply) ||
+        ntohs(reply->reply) != RPY_EVENT)
+      continue;
+
+    /* Updates don't carry a new token, ignore those which are not
+       authentic */
+    if (password && !unix_socket && !check_reply_auth(reply, read_length))
+      continue;
+
+    return 1;
+  }
+}
+
+/* ================================================== */
+
+static void
+get_renewal_time(struct timespec *renewal)
+{
+  clock_gettime(CLOCK_MONOTONIC, renewal);
+  renewal->tv_sec += SUBSCRIPTION_LEASE / 2;
+}
+
+/* ================================================== */
+
+static int
+check_sync(CMD_Reply *reply, int try, double max_correction, double max_skew_ppm)
+{
+  uint32_t ref_id, a, b, c, d;
+  double correction, skew_ppm;
+
+  if (ntohs(reply->reply) == RPY_EVENT) {
+    ref_id = ntohl(reply->data.event.ref_id);
+    correction = UTI_FloatNetworkToHost(reply->data.event.current_correction);
+    skew_ppm = UTI_FloatNetworkToHost(reply->data.event.skew_ppm);
+  } else {
+    ref_id = ntohl(reply->data.tracking.ref_id);
+    correction = UTI_FloatNetworkToHost(reply->data.tracking.current_correction);
+    skew_ppm = UTI_FloatNetworkToHost(reply->data.tracking.skew_ppm);
+  }
+
+  a = (ref_id >> 24);
+  b = (ref_id >> 16) & 0xff;
+  c = (ref_id >> 8) & 0xff;
+  d = (ref_id) & 0xff;
+
+  correction = fabs(correction);
+
+  printf("try: %d, refid: %d.%d.%d.%d, correction: %.9f, skew: %.3f\n",
+      try, a, b, c, d, correction, skew_ppm);
+  fflush(stdout);
+
+  return ref_id != 0 && ref_id != 0x7f7f0101L /* LOCAL refid */ &&
+         (max_correction == 0.0 || correction <= max_correction) &&
+         (max_skew_ppm == 0.0 || skew_ppm <= max_skew_ppm);
+}
+
 /* ================================================== */
 
 static int
 process_cmd_waitsync(char *line)
 {
-  CMD_Request request;
+  CMD_Request request, subscription;
   CMD_Reply reply;
-  uint32_t ref_id, a, b, c, d;
-  double correction, skew_ppm, max_correction, max_skew_ppm;
-  int ret = 0, max_tries, i;
+  struct timespec deadline, renewal;
+  double max_correction, max_skew_ppm;
+  int ret = 0, max_tries, i, subscribed, have_reply;
 
   max_tries = 0;
   max_correction = 0.0;
@@ -2311,39 +3163,147 @@ process_cmd_waitsync(char *line)
 
   request.command = htons(REQ_TRACKING);
 
+  /* Get updates from the daemon as soon as the reference is updated
+     instead of polling it.  The reply includes the current state. */
+  subscribed = subscribe(&subscription, &reply, REQ_SUBSCRIBE_TRACKING, 0.0, 0);
+  get_renewal_time(&renewal);
+  have_reply = subscribed;
+
   for (i = 1; ; i++) {
-    if (request_reply(&request, &reply, RPY_TRACKING, 0)) {
-      ref_id = ntohl(reply.data.tracking.ref_id);
-      a = (ref_id >> 24);
-      b = (ref_id >> 16) & 0xff;
-      c = (ref_id >> 8) & 0xff;
-      d = (ref_id) & 0xff;
-
-      correction = UTI_FloatNetworkToHost(reply.data.tracking.current_correction);
-      correction = fabs(correction);
-      skew_ppm = UTI_FloatNetworkToHost(reply.data.tracking.skew_ppm);
-
-      printf("try: %d, refid: %d.%d.%d.%d, correction: %.9f, skew: %.3f\n",
-          i, a, b, c, d, correction, skew_ppm);
-
-      if (ref_id != 0 && ref_id != 0x7f7f0101L /* LOCAL refid */ &&
-          (max_correction == 0.0 || correction <= max_correction) &&
-          (max_skew_ppm == 0.0 || skew_ppm <= max_skew_ppm)) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += 10;
+
+    if (subscribed && i > 1) {
+      /* Without an update only the correction can change, renew the
+         subscription (which gets a new state) only when it's needed */
+      if (max_correction != 0.0 || UTI_CompareTimespecs(&renewal, &deadline) < 0) {
+        subscribed = have_reply =
+          subscribe(&subscription, &reply, REQ_SUBSCRIBE_TRACKING, 0.0, 0);
+        get_renewal_time(&renewal);
+      }
+    }
+
+    if (!subscribed && !have_reply)
+      have_reply = request_reply(&request, &reply, RPY_TRACKING, 0);
+
+    while (1) {
+      if (have_reply && check_sync(&reply, i, max_correction, max_skew_ppm)) {
         ret = 1;
+        break;
       }
+
+      if (!subscribed)
+        break;
+
+      have_reply = wait_for_update(&subscription, &reply, &deadline);
+      if (!have_reply)
+        break;
     }
 
+    have_reply = 0;
+
     if (!ret && (!max_tries || i < max_tries)) {
-      sleep(10);
+      if (!subscribed)
+        sleep(10);
     } else {
       break;
     }
   }
+
+  if (subscribed)
+    subscribe(&subscription, &reply, 0, 0.0, 0);
+
   return ret;
 }
 
 /* ================================================== */
 
+static void
+print_update(CMD_Reply *reply)
+{
+  uint32_t ref_id, a, b, c, d;
+  int events;
+  const char *leap_status;
+
+  events = ntohl(reply->data.event.events);
+  ref_id = ntohl(reply->data.event.ref_id);
+  a = (ref_id >> 24);
+  b = (ref_id >> 16) & 0xff;
+  c = (ref_id >> 8) & 0xff;
+  d = (ref_id) & 0xff;
+
+  switch (ntohs(reply->data.event.leap_status)) {
+    case LEAP_Normal:
+      leap_status = "normal";
+      break;
+    case LEAP_InsertSecond:
+      leap_status = "insert";
+      break;
+    case LEAP_DeleteSecond:
+      leap_status = "delete";
+      break;
+    case LEAP_Unsynchronised:
+      leap_status = "unsync";
+      break;
+    default:
+      leap_status = "unknown";
+      break;
+  }
+
+  printf("events: %c%c%c, refid: %d.%d.%d.%d, stratum: %d, leap: %s, "
+         "correction: %.9f, offset: %.9f, skew: %.3f\n",
+         events & REQ_SUBSCRIBE_TRACKING ? 'T' : '-',
+         events & REQ_SUBSCRIBE_SELECTION ? 'S' : '-',
+         events & REQ_SUBSCRIBE_LEAP ? 'L' : '-',
+         a, b, c, d, ntohs(reply->data.event.stratum), leap_status,
+         UTI_FloatNetworkToHost(reply->data.event.current_correction),
+         UTI_FloatNetworkToHost(reply->data.event.last_offset),
+         UTI_FloatNetworkToHost(reply->data.event.skew_ppm));
+  fflush(stdout);
+}
+
+/* ================================================== */
+
+static int
+process_cmd_subscribe(char *line)
+{
+  CMD_Request subscription;
+  CMD_Reply reply;
+  struct timespec renewal;
+  double min_interval;
+  int i, max_updates, events;
+
+  max_updates = 0;
+  min_interval = 0.0;
+
+  sscanf(line, "%d %lf", &max_updates, &min_interval);
+
+  events = REQ_SUBSCRIBE_TRACKING | REQ_SUBSCRIBE_SELECTION | REQ_SUBSCRIBE_LEAP;
+
+  if (!subscribe(&subscription, &reply, events, min_interval, 1))
+    return 0;
+  get_renewal_time(&renewal);
+
+  print_update(&reply);
+
+  for (i = 0; !max_updates || i < max_updates; ) {
+    if (wait_for_update(&subscription, &reply, &renewal)) {
+      print_update(&reply);
+      i++;
+    } else {
+      if (!subscribe(&subscription, &reply, events, min_interval, 1))
+        return 0;
+      get_renewal_time(&renewal);
+    }
+  }
+
+  subscribe(&subscription, &reply, 0, 0.0, 0);
+
+  return 1;
+}
+
+/* ================================================== */
+
 static int
 process_cmd_dns(const char *line)
 {
@@ -2380,6 +3340,8 @@ process_cmd_authhash(const char *line)
     return 0;
   }
 
+  switch_to_udp();
+
   new_hash_id = HSH_GetHashId(hash_name);
   if (new_hash_id < 0) {
     fprintf(stderr, "Unknown hash name: %s\n", hash_name);
@@ -2450,6 +3412,10 @@ process_line(char *line, int *quit)
   command = line;
   line = CPS_SplitWord(line);
 
+  /* Don't let other commands overtake the queued requests */
+  if (!is_pipelined_command(command))
+    flush_queued_requests();
+
   if (!strcmp(command, "accheck")) {
     do_normal_submit = process_cmd_accheck(&tx_message, line);
   } else if (!strcmp(command, "activity")) {
@@ -2488,6 +3454,9 @@ process_line(char *line, int *quit)
     } else {
       do_normal_submit = process_cmd_cmddeny(&tx_message, line);
     }
+  } else if (!strcmp(command, "cmdstats")) {
+    do_normal_submit = 0;
+    ret = process_cmd_cmdstats(line);
   } else if (!strcmp(command, "cyclelogs")) {
     process_cmd_cyclelogs(&tx_message, line);
   } else if (!strcmp(command, "delete")) {
@@ -2556,6 +3525,8 @@ process_line(char *line, int *quit)
     ret = 1;
   } else if (!strcmp(command, "rekey")) {
     process_cmd_rekey(&tx_message, line);
+  } else if (!strcmp(command, "reloadleap")) {
+    process_cmd_reloadleap(&tx_message, line);
   } else if (!strcmp(command, "reselect")) {
     process_cmd_reselect(&tx_message, line);
   } else if (!strcmp(command, "reselectdist")) {
@@ -2566,6 +3537,15 @@ process_line(char *line, int *quit)
   } else if (!strcmp(command, "rtcdata")) {
     do_normal_submit = 0;
     ret = process_cmd_rtcreport(line);
+  } else if (!strcmp(command, "schedstats")) {
+    do_normal_submit = 0;
+    ret = process_cmd_schedstats(line);
+  } else if (!strcmp(command, "serverlatency")) {
+    do_normal_submit = 0;
+    ret = process_cmd_serverlatency(line);
+  } else if (!strcmp(command, "serverstats")) {
+    do_normal_submit = 0;
+    ret = process_cmd_serverstats(line);
   } else if (!strcmp(command, "settime")) {
     do_normal_submit = 0;
     ret = process_cmd_settime(line);
@@ -2575,6 +3555,9 @@ process_line(char *line, int *quit)
   } else if (!strcmp(command, "sourcestats")) {
     do_normal_submit = 0;
     ret = process_cmd_sourcestats(line);
+  } else if (!strcmp(command, "subscribe")) {
+    ret = process_cmd_subscribe(line);
+    do_normal_submit = 0;
   } else if (!strcmp(command, "timeout")) {
     ret = process_cmd_timeout(line);
     do_normal_submit = 0;
@@ -2594,7 +3577,10 @@ process_line(char *line, int *quit)
   }
     
   if (do_normal_submit) {
-    ret = request_reply(&tx_message, &rx_message, RPY_NULL, 1);
+    if (can_pipeline_requests())
+      ret = queue_request(&tx_message);
+    else
+      ret = request_reply(&tx_message, &rx_message, RPY_NULL, 1);
   }
   fflush(stderr);
   fflush(stdout);
@@ -2753,6 +3739,9 @@ main(int argc, char **argv)
       }
     } else if (!strcmp(*argv, "-a")) {
       auto_auth = 1;
+    } else if (!strcmp(*argv, "-b")) {
+      batch_mode = 1;
+      multi = 1;
     } else if (!strcmp(*argv, "-m")) {
       multi = 1;
     } else if (!strcmp(*argv, "-n")) {
@@ -2765,7 +3754,7 @@ main(int argc, char **argv)
       printf("chronyc (chrony) version %s\n", CHRONY_VERSION);
       exit(0);
     } else if (!strncmp(*argv, "-", 1)) {
-      fprintf(stderr, "Usage : %s [-h <hostname>] [-p <port-number>] [-n] [-4|-6] [-m] [-a] [-f <file>]] [command]\n", progname);
+      fprintf(stderr, "Usage : %s [-h <hostname>] [-p <port-number>] [-n] [-4|-6] [-m] [-b] [-a] [-f <file>]] [command]\n", progname);
       exit(1);
     } else {
       break; /* And process remainder of line as a command */
@@ -2794,9 +3783,19 @@ main(int argc, char **argv)
 #ifdef FEAT_ASYNCDNS
     initial_timeout /= 10;
 #endif
+
+    /* Prefer the Unix domain socket if the daemon is running locally,
+       unless the requests will be authenticated with the command key */
+    if (family == IPADDR_UNSPEC && !auto_auth &&
+        open_unix_io(DEFAULT_COMMAND_SOCKET)) {
+      udp_hostname = hostname;
+      udp_port = port;
+      hostname = NULL;
+    }
   }
 
-  open_io(hostname, port);
+  if (hostname)
+    open_io(hostname, port);
 
   if (auto_auth) {
     ret = authenticate_from_config(conf_file);
@@ -2818,6 +3817,13 @@ main(int argc, char **argv)
     } while (line && !quit);
   }
 
+  if (batch_mode) {
+    flush_queued_requests();
+    if (!queued_requests_ok)
+      ret = 0;
+    Free(queued_requests);
+  }
+
   close_io();
 
   free(password);
@@ -358,6 +358,9 @@ CLG_LogCommandAccess(IPAddr *client, CLG_Command_Type type, time_t now)
         split_ip6(client, ip6);
         node = (Node *) find_subnet(&top_subnet6, ip6, 4, 0);
         break;
+      case IPADDR_UNSPEC:
+        /* Clients of the Unix domain socket have no address */
+        return;
       default:
         assert(0);
     }
@@ -31,12 +31,14 @@
 
 #include "cmdmon.h"
 #include "candm.h"
+#include "counters.h"
 #include "sched.h"
 #include "util.h"
 #include "logging.h"
 #include "keys.h"
 #include "ntp_sources.h"
 #include "ntp_core.h"
+#include "ntp_io.h"
 #include "sources.h"
 #include "sourcestats.h"
 #include "reference.h"
@@ -49,6 +51,8 @@
 #include "pktlength.h"
 #include "clientlog.h"
 #include "refclock.h"
+#include "mkdirpp.h"
+#include "leapdb.h"
 
 /* ================================================== */
 
@@ -57,10 +61,12 @@ union sockaddr_in46 {
 #ifdef HAVE_IPV6
   struct sockaddr_in6 in6;
 #endif
+  struct sockaddr_un un;
   struct sockaddr u;
 };
 
 /* File descriptors for command and monitoring sockets */
+static int sock_fdu;
 static int sock_fd4;
 #ifdef HAVE_IPV6
 static int sock_fd6;
@@ -84,9 +90,9 @@ static unsigned long token_base;
 /* The position of the next free token to issue in the issue register */
 static unsigned long issue_pointer;
 
-/* Type and linked list for buffering responses */
-typedef struct _ResponseCell {
-  struct _ResponseCell *next;
+/* Type and table for buffering responses */
+typedef struct {
+  int used;
   unsigned long tok; /* The token that the client sent in the message
                         to which this was the reply */
   unsigned long next_tok; /* The next token issued to the same client.
@@ -99,13 +105,75 @@ typedef struct _ResponseCell {
                             with this sequence number (prevents attacker
                             firing the same request at us to make us
                             keep generating the same reply). */
-  struct timeval ts; /* Time we saved the reply - allows purging based
+  struct timespec ts; /* Time we saved the reply - allows purging based
                         on staleness. */
   CMD_Reply rpy;
 } ResponseCell;
 
-static ResponseCell kept_replies;
-static ResponseCell *free_replies;
+/* Replies are saved only for requests with a valid token and each reply
+   issues a new token, so both tokens of a saved reply are unique.  The
+   table is indexed by the token from the request, the second table maps
+   the issued token to the slot.  A new reply replaces any older reply in
+   the same slot. */
+#define REPLY_SLOTS 64
+
+static ResponseCell *kept_replies;
+static int acked_reply_slots[REPLY_SLOTS];
+
+/* Requests received on the Unix domain socket don't use tokens, so replies
+   to privileged requests are kept by the address of the client, sequence
+   number and command to not process a request resent by the client twice.
+   A new reply replaces the oldest one. */
+#define UNIX_REPLY_SLOTS 16
+#define UNIX_REPLY_MAXAGE 60
+
+typedef struct {
+  int used;
+  struct sockaddr_un addr;
+  socklen_t addr_len;
+  unsigned long msg_seq;
+  unsigned short command;
+  struct timespec ts;
+  CMD_Reply rpy;
+} UnixResponseCell;
+
+static UnixResponseCell unix_replies[UNIX_REPLY_SLOTS];
+
+/* Set of timestamps from the logon requests, with TS_WAYS entries in
+   each of TS_BUCKETS buckets */
+#define TS_BUCKETS 64
+#define TS_WAYS 4
+
+static struct timespec seen_ts[TS_BUCKETS][TS_WAYS];
+
+/* Statistics reported to clients */
+static unsigned long resent_replies;
+static unsigned long rejected_ts;
+
+/* Clients subscribed to events.  Updates are sent from a timeout, so
+   events occurring in one source selection are reported together, and
+   not more often than the minimum interval requested by the client. */
+typedef struct {
+  int used;
+  union sockaddr_in46 addr;
+  socklen_t addr_len;
+  uint32_t sequence; /* Sequence number of the last SUBSCRIBE request
+                        (in network order) */
+  int events;
+  int pending_events;
+  int authenticated;
+  double min_interval;
+  struct timespec last_update; /* Raw time of the last update */
+  struct timespec expiry;      /* Raw time when the lease expires */
+  SCH_TimeoutID timeout_id;
+} Subscriber;
+
+#define MAX_SUBSCRIBERS 16
+
+/* Minimum interval between updates sent to a subscriber */
+#define MIN_EVENT_INTERVAL 1.0
+
+static Subscriber subscribers[MAX_SUBSCRIBERS];
 
 /* ================================================== */
 /* Array of permission levels for command types */
@@ -160,7 +228,14 @@ static int permissions[] = {
   PERMIT_AUTH, /* MODIFY_POLLTARGET */
   PERMIT_AUTH, /* MODIFY_MAXDELAYDEVRATIO */
   PERMIT_AUTH, /* RESELECT */
-  PERMIT_AUTH  /* RESELECTDISTANCE */
+  PERMIT_AUTH, /* RESELECTDISTANCE */
+  PERMIT_OPEN, /* SOURCE_REPORTS */
+  PERMIT_AUTH, /* RELOAD_LEAP */
+  PERMIT_OPEN, /* CMDMON_STATS */
+  PERMIT_OPEN, /* SERVER_COUNTERS */
+  PERMIT_OPEN, /* LATENCY_STATS */
+  PERMIT_AUTH, /* SERVER_LATENCY */
+  PERMIT_LOCAL /* SUBSCRIBE */
 };
 
 /* ================================================== */
@@ -172,6 +247,9 @@ static ADF_AuthTable access_auth_table;
 /* ================================================== */
 /* Forward prototypes */
 static void read_from_cmd_socket(void *anything);
+static void remove_subscriber(Subscriber *s);
+static void handle_slew(struct timespec *raw, struct timespec *cooked, double dfreq,
+                        double doffset, LCL_ChangeType change_type, void *anything);
 
 /* ================================================== */
 
@@ -267,6 +345,70 @@ prepare_socket(int family, int port_number)
 
 /* ================================================== */
 
+static int
+prepare_unix_socket(const char *path)
+{
+  struct sockaddr_un my_addr;
+  char *dir, *slash;
+  int sock_fd, on_off = 1;
+
+  if (strlen(path) >= sizeof (my_addr.sun_path)) {
+    LOG(LOGS_ERR, LOGF_CmdMon, "Unix command socket path %s too long", path);
+    return -1;
+  }
+
+  /* Create the directory for the socket if it doesn't exist yet */
+  dir = strdup(path);
+  slash = strrchr(dir, '/');
+  if (slash && slash != dir) {
+    *slash = '\0';
+    if (!mkdir_and_parents(dir))
+      LOG(LOGS_ERR, LOGF_CmdMon, "Could not create directory %s", dir);
+  }
+  free(dir);
+
+  sock_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock_fd < 0) {
+    LOG(LOGS_ERR, LOGF_CmdMon, "Could not open Unix command socket : %s",
+        strerror(errno));
+    return -1;
+  }
+
+  UTI_FdSetCloexec(sock_fd);
+
+  memset(&my_addr, 0, sizeof (my_addr));
+  my_addr.sun_family = AF_UNIX;
+  strcpy(my_addr.sun_path, path);
+
+  /* Remove socket left by previous instance */
+  unlink(path);
+
+  if (bind(sock_fd, (struct sockaddr *)&my_addr, sizeof (my_addr)) < 0) {
+    LOG(LOGS_ERR, LOGF_CmdMon, "Could not bind Unix command socket to %s : %s",
+        path, strerror(errno));
+    close(sock_fd);
+    return -1;
+  }
+
+  /* Anyone who can access the directory can send monitoring requests,
+     privileged commands are checked with the credentials of the sender */
+  if (chmod(path, 0666) < 0)
+    LOG(LOGS_ERR, LOGF_CmdMon, "Could not change permissions of %s : %s",
+        path, strerror(errno));
+
+#ifdef SO_PASSCRED
+  /* Receive credentials of the sender with each message */
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_PASSCRED, &on_off, sizeof (on_off)) < 0)
+    LOG(LOGS_ERR, LOGF_CmdMon, "Could not set passcred socket option");
+#endif
+
+  SCH_AddInputFileHandler(sock_fd, read_from_cmd_socket, (void *)(long)sock_fd);
+
+  return sock_fd;
+}
+
+/* ================================================== */
+
 void
 CAM_Initialise(int family)
 {
@@ -276,6 +418,12 @@ CAM_Initialise(int family)
   initialised = 1;
 
   assert(sizeof (permissions) / sizeof (permissions[0]) == N_REQUEST_TYPES);
+  assert(CNT_Max <= MAX_SERVER_COUNTERS);
+  assert(SCH_LATENCY_BUCKETS == MAX_LATENCY_BUCKETS);
+  assert(RPT_MAX_WORST_LATENCIES == MAX_WORST_LATENCIES);
+  assert(CAM_EVENT_TRACKING == REQ_SUBSCRIBE_TRACKING &&
+         CAM_EVENT_SELECTION == REQ_SUBSCRIBE_SELECTION &&
+         CAM_EVENT_LEAP == REQ_SUBSCRIBE_LEAP);
 
   for (i = 0; i < N_REQUEST_TYPES; i++) {
     CMD_Request r;
@@ -295,11 +443,26 @@ CAM_Initialise(int family)
   token_base = 1; /* zero is the value used when the previous command was
                      unauthenticated */
 
-  free_replies = NULL;
-  kept_replies.next = NULL;
+  kept_replies = MallocArray(ResponseCell, REPLY_SLOTS);
+  for (i = 0; i < REPLY_SLOTS; i++) {
+    kept_replies[i].used = 0;
+    acked_reply_slots[i] = -1;
+  }
+
+  memset(unix_replies, 0, sizeof (unix_replies));
+  memset(seen_ts, 0, sizeof (seen_ts));
+  resent_replies = rejected_ts = 0;
+
+  memset(subscribers, 0, sizeof (subscribers));
+  LCL_AddParameterChangeHandler(handle_slew, NULL);
 
   port_number = CNF_GetCommandPort();
 
+  if (CNF_GetBindCommandPath()[0])
+    sock_fdu = prepare_unix_socket(CNF_GetBindCommandPath());
+  else
+    sock_fdu = -1;
+
   if (port_number && (family == IPADDR_UNSPEC || family == IPADDR_INET4))
     sock_fd4 = prepare_socket(AF_INET, port_number);
   else
@@ -328,6 +491,15 @@ CAM_Initialise(int family)
 void
 CAM_Finalise(void)
 {
+  int i;
+
+  if (sock_fdu >= 0) {
+    SCH_RemoveInputFileHandler(sock_fdu);
+    close(sock_fdu);
+    unlink(CNF_GetBindCommandPath());
+  }
+  sock_fdu = -1;
+
   if (sock_fd4 >= 0) {
     SCH_RemoveInputFileHandler(sock_fd4);
     close(sock_fd4);
@@ -343,6 +515,14 @@ CAM_Finalise(void)
 
   ADF_DestroyTable(access_auth_table);
 
+  Free(kept_replies);
+
+  for (i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i].used)
+      remove_subscriber(&subscribers[i]);
+  }
+  LCL_RemoveParameterChangeHandler(handle_slew, NULL);
+
   initialised = 0;
 }
 
@@ -450,148 +630,73 @@ check_token(unsigned long token)
 
 /* ================================================== */
 
-typedef struct _TimestampCell {
-  struct _TimestampCell *next;
-  struct timeval ts;
-} TimestampCell;
-
-static struct _TimestampCell seen_ts_list={NULL};
-static struct _TimestampCell *free_ts_list=NULL;
-
-#define EXTEND_QUANTUM 32
-
-/* ================================================== */
-
-static TimestampCell *
-allocate_ts_cell(void)
+static unsigned int
+get_ts_bucket(struct timespec *ts)
 {
-  TimestampCell *result;
-  int i;
-  if (free_ts_list == NULL) {
-    free_ts_list = MallocArray(TimestampCell, EXTEND_QUANTUM);
-    for (i=0; i<EXTEND_QUANTUM-1; i++) {
-      free_ts_list[i].next = free_ts_list + i + 1;
-    }
-    free_ts_list[EXTEND_QUANTUM - 1].next = NULL;
-  }
+  uint32_t x;
 
-  result = free_ts_list;
-  free_ts_list = free_ts_list->next;
-  return result;
-}
-
-/* ================================================== */
+  x = (uint32_t)ts->tv_sec * 2654435761U ^ (uint32_t)ts->tv_nsec;
+  x ^= x >> 16;
 
-static void
-release_ts_cell(TimestampCell *node)
-{
-  node->next = free_ts_list;
-  free_ts_list = node;
+  return (x * 2654435761U >> 16) % TS_BUCKETS;
 }
 
 /* ================================================== */
-/* Return 1 if not found, 0 if found (i.e. not unique).  Prune out any
-   stale entries. */
+/* Return 1 if not found, 0 if found (i.e. not unique) or the bucket is
+   full.  Entries which are stale are reused. */
 
 static int
-check_unique_ts(struct timeval *ts, struct timeval *now)
+check_unique_ts(struct timespec *ts, struct timespec *now)
 {
-  TimestampCell *last_valid, *cell, *next;
-  int ok;
+  struct timespec *bucket;
+  int i, free_way;
 
-  ok = 1;
-  last_valid = &(seen_ts_list);
-  cell = last_valid->next;
+  bucket = seen_ts[get_ts_bucket(ts)];
 
-  while (cell) {
-    next = cell->next;
-    /* Check if stale */
-    if ((now->tv_sec - cell->ts.tv_sec) > TS_MARGIN) {
-      release_ts_cell(cell);
-      last_valid->next = next;
-    } else {
-      /* Timestamp in cell is still within window */
-      last_valid->next = cell;
-      last_valid = cell;
-      if ((cell->ts.tv_sec == ts->tv_sec) && (cell->ts.tv_usec == ts->tv_usec)) {
-        ok = 0;
-      }
+  for (i = 0, free_way = -1; i < TS_WAYS; i++) {
+    if (bucket[i].tv_sec == 0 || (now->tv_sec - bucket[i].tv_sec) > TS_MARGIN) {
+      if (free_way < 0)
+        free_way = i;
+    } else if (bucket[i].tv_sec == ts->tv_sec && bucket[i].tv_nsec == ts->tv_nsec) {
+      return 0;
     }
-    cell = next;
   }
 
-  if (ok) {
-    /* Need to add this timestamp to the list */
-    cell = allocate_ts_cell();
-    last_valid->next = cell;
-    cell->next = NULL;
-    cell->ts = *ts;
+  if (free_way < 0) {
+    /* Don't drop a timestamp which is still valid, the request would
+       become replayable */
+    DEBUG_LOG(LOGF_CmdMon, "Timestamp bucket full");
+    rejected_ts++;
+    return 0;
   }
 
-  return ok;
+  bucket[free_way] = *ts;
+
+  return 1;
 }
 
 /* ================================================== */
 
 static int
-ts_is_unique_and_not_stale(struct timeval *ts, struct timeval *now)
+ts_is_unique_and_not_stale(struct timespec *ts, struct timespec *now)
 {
-  int within_margin=0;
-  int is_unique=0;
   long diff;
 
   diff = now->tv_sec - ts->tv_sec;
-  if ((diff < TS_MARGIN) && (diff > -TS_MARGIN)) {
-    within_margin = 1;
-  } else {
-    within_margin = 0;
-  }
-  is_unique = check_unique_ts(ts, now);
-    
-  return within_margin && is_unique;
-}
-
-/* ================================================== */
-
-#define REPLY_EXTEND_QUANTUM 32
-
-static void
-get_more_replies(void)
-{
-  ResponseCell *new_replies;
-  int i;
+  if ((diff >= TS_MARGIN) || (diff <= -TS_MARGIN) || ts->tv_sec == 0)
+    return 0;
 
-  if (!free_replies) {
-    new_replies = MallocArray(ResponseCell, REPLY_EXTEND_QUANTUM);
-    for (i=1; i<REPLY_EXTEND_QUANTUM; i++) {
-      new_replies[i-1].next = new_replies + i;
-    }
-    new_replies[REPLY_EXTEND_QUANTUM - 1].next = NULL;
-    free_replies = new_replies;
-  }
+  return check_unique_ts(ts, now);
 }
 
 /* ================================================== */
 
-static ResponseCell *
-get_reply_slot(void)
-{
-  ResponseCell *result;
-  if (!free_replies) {
-    get_more_replies();
-  }
-  result = free_replies;
-  free_replies = result->next;
-  return result;
-}
-
-/* ================================================== */
+#define REPLY_MAXAGE 300
 
-static void
-free_reply_slot(ResponseCell *cell)
+static ResponseCell *
+get_reply_slot(unsigned long tok)
 {
-  cell->next = free_replies;
-  free_replies = cell;
+  return &kept_replies[tok % REPLY_SLOTS];
 }
 
 /* ================================================== */
@@ -602,12 +707,13 @@ save_reply(CMD_Reply *msg,
            unsigned long new_tok_issued,
            unsigned long client_msg_seq,
            unsigned short attempt,
-           struct timeval *now)
+           struct timespec *now)
 {
   ResponseCell *cell;
 
-  cell = get_reply_slot();
+  cell = get_reply_slot(tok_reply_to);
 
+  cell->used = 1;
   cell->ts = *now;
   memcpy(&cell->rpy, msg, sizeof(CMD_Reply));
   cell->tok = tok_reply_to;
@@ -615,83 +721,163 @@ save_reply(CMD_Reply *msg,
   cell->msg_seq = client_msg_seq;
   cell->attempt = (unsigned long) attempt;
 
-  cell->next = kept_replies.next;
-  kept_replies.next = cell;
+  acked_reply_slots[new_tok_issued % REPLY_SLOTS] = cell - kept_replies;
+}
+
+/* ================================================== */
+
+static CMD_Reply *
+lookup_reply(unsigned long prev_msg_token, unsigned long client_msg_seq,
+             unsigned short attempt, struct timespec *now)
+{
+  ResponseCell *cell;
+
+  cell = get_reply_slot(prev_msg_token);
+
+  if (cell->used &&
+      (cell->tok == prev_msg_token) &&
+      (cell->msg_seq == client_msg_seq) &&
+      ((unsigned long) attempt > cell->attempt) &&
+      (now->tv_sec - cell->ts.tv_sec) <= REPLY_MAXAGE) {
+
+    /* Set the attempt field to remember the highest number we have
+       had so far */
+    cell->attempt = (unsigned long) attempt;
+    resent_replies++;
+    return &cell->rpy;
+  }
 
+  return NULL;
+}
+
+/* ================================================== */
+
+static int
+compare_unix_cell(UnixResponseCell *cell, struct sockaddr_un *addr, socklen_t addr_len,
+                  unsigned long client_msg_seq, unsigned short command)
+{
+  return cell->used && cell->addr_len == addr_len &&
+         !memcmp(&cell->addr, addr, addr_len) &&
+         cell->msg_seq == client_msg_seq && cell->command == command;
+}
+
+/* ================================================== */
+
+static void
+save_unix_reply(CMD_Reply *msg, struct sockaddr_un *addr, socklen_t addr_len,
+                unsigned long client_msg_seq, unsigned short command,
+                struct timespec *now)
+{
+  UnixResponseCell *cell;
+  int i, oldest;
+
+  if (addr_len > sizeof (*addr))
+    return;
+
+  for (i = oldest = 0; i < UNIX_REPLY_SLOTS; i++) {
+    if (!unix_replies[i].used) {
+      oldest = i;
+      break;
+    }
+    if (UTI_CompareTimespecs(&unix_replies[i].ts, &unix_replies[oldest].ts) < 0)
+      oldest = i;
+  }
+
+  cell = &unix_replies[oldest];
+  cell->used = 1;
+  memcpy(&cell->addr, addr, addr_len);
+  cell->addr_len = addr_len;
+  cell->msg_seq = client_msg_seq;
+  cell->command = command;
+  cell->ts = *now;
+  memcpy(&cell->rpy, msg, sizeof (CMD_Reply));
 }
 
 /* ================================================== */
 
 static CMD_Reply *
-lookup_reply(unsigned long prev_msg_token, unsigned long client_msg_seq, unsigned short attempt)
+lookup_unix_reply(struct sockaddr_un *addr, socklen_t addr_len,
+                  unsigned long client_msg_seq, unsigned short command,
+                  struct timespec *now)
 {
-  ResponseCell *ptr;
+  UnixResponseCell *cell;
+  int i;
 
-  ptr = kept_replies.next;
-  while (ptr) {
-    if ((ptr->tok == prev_msg_token) &&
-        (ptr->msg_seq == client_msg_seq) &&
-        ((unsigned long) attempt > ptr->attempt)) {
+  if (addr_len > sizeof (*addr))
+    return NULL;
 
-      /* Set the attempt field to remember the highest number we have
-         had so far */
-      ptr->attempt = (unsigned long) attempt;
-      return &ptr->rpy;
+  for (i = 0; i < UNIX_REPLY_SLOTS; i++) {
+    cell = &unix_replies[i];
+    if (compare_unix_cell(cell, addr, addr_len, client_msg_seq, command) &&
+        (now->tv_sec - cell->ts.tv_sec) <= UNIX_REPLY_MAXAGE) {
+      resent_replies++;
+      return &cell->rpy;
     }
-    ptr = ptr->next;
   }
 
   return NULL;
 }
 
-
 /* ================================================== */
 
-#define REPLY_MAXAGE 300
+static void
+token_acknowledged(unsigned long token)
+{
+  ResponseCell *cell;
+  int slot;
+
+  slot = acked_reply_slots[token % REPLY_SLOTS];
+  if (slot < 0)
+    return;
+
+  /* Discard the reply if it's the one */
+  cell = &kept_replies[slot];
+  if (cell->used && cell->next_tok == token) {
+    cell->used = 0;
+    acked_reply_slots[token % REPLY_SLOTS] = -1;
+  }
+}
+
+/* ================================================== */
 
 static void
-token_acknowledged(unsigned long token, struct timeval *now)
+get_cache_stats(struct timespec *now, int *n_replies, int *n_ts)
 {
-  ResponseCell *last_valid, *cell, *next;
+  int i, j;
 
-  last_valid = &kept_replies;
-  cell = kept_replies.next;
-  
-  while(cell) {
-    next = cell->next;
-
-    /* Discard if it's the one or if the reply is stale */
-    if ((cell->next_tok == token) ||
-        ((now->tv_sec - cell->ts.tv_sec) > REPLY_MAXAGE)) {
-      free_reply_slot(cell);
-      last_valid->next = next;
-    } else {
-      last_valid->next = cell;
-      last_valid = cell;
+  for (i = *n_replies = 0; i < REPLY_SLOTS; i++) {
+    if (kept_replies[i].used && (now->tv_sec - kept_replies[i].ts.tv_sec) <= REPLY_MAXAGE)
+      (*n_replies)++;
+  }
+
+  for (i = *n_ts = 0; i < TS_BUCKETS; i++) {
+    for (j = 0; j < TS_WAYS; j++) {
+      if (seen_ts[i][j].tv_sec != 0 && (now->tv_sec - seen_ts[i][j].tv_sec) <= TS_MARGIN)
+        (*n_ts)++;
     }
-    cell = next;
   }
 }
 
 /* ================================================== */
 
-static void
-transmit_reply(CMD_Reply *msg, union sockaddr_in46 *where_to, int auth_len)
+static int
+transmit_reply(CMD_Reply *msg, union sockaddr_in46 *where_to, socklen_t addrlen,
+               int auth_len)
 {
   int status;
   int tx_message_length;
   int sock_fd;
-  socklen_t addrlen;
   
   switch (where_to->u.sa_family) {
+    case AF_UNIX:
+      sock_fd = sock_fdu;
+      break;
     case AF_INET:
       sock_fd = sock_fd4;
-      addrlen = sizeof (where_to->in4);
       break;
 #ifdef HAVE_IPV6
     case AF_INET6:
       sock_fd = sock_fd6;
-      addrlen = sizeof (where_to->in6);
       break;
 #endif
     default:
@@ -707,6 +893,10 @@ transmit_reply(CMD_Reply *msg, union sockaddr_in46 *where_to, int auth_len)
     IPAddr ip;
 
     switch (where_to->u.sa_family) {
+      case AF_UNIX:
+        ip.family = IPADDR_UNSPEC;
+        port = 0;
+        break;
       case AF_INET:
         ip.family = IPADDR_INET4;
         ip.addr.in4 = ntohl(where_to->in4.sin_addr.s_addr);
@@ -724,7 +914,12 @@ transmit_reply(CMD_Reply *msg, union sockaddr_in46 *where_to, int auth_len)
     }
 
     DEBUG_LOG(LOGF_CmdMon, "Could not send response to %s:%hu", UTI_IPToString(&ip), port);
+    return 0;
   }
+
+  CNT_INC(CNT_CmdTx);
+
+  return 1;
 }
   
 
@@ -927,10 +1122,10 @@ handle_modify_maxupdateskew(CMD_Request *rx_message, CMD_Reply *tx_message)
 static void
 handle_settime(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
-  struct timeval ts;
+  struct timespec ts;
   long offset_cs;
   double dfreq_ppm, new_afreq_ppm;
-  UTI_TimevalNetworkToHost(&rx_message->data.settime.ts, &ts);
+  UTI_TimespecNetworkToHost(&rx_message->data.settime.ts, &ts);
   if (MNL_AcceptTimestamp(&ts, &offset_cs, &dfreq_ppm, &new_afreq_ppm)) {
     tx_message->status = htons(STT_SUCCESS);
     tx_message->reply = htons(RPY_MANUAL_TIMESTAMP);
@@ -993,72 +1188,98 @@ handle_n_sources(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+/* Get the report of a source including the data specific to its type */
+
+static int
+report_source(int index, RPT_SourceReport *report, struct timespec *now)
+{
+  if (!SRC_ReportSource(index, report, now))
+    return 0;
+
+  switch (SRC_GetType(index)) {
+    case SRC_NTP:
+      NSR_ReportSource(report, now);
+      break;
+    case SRC_REFCLOCK:
+      RCL_ReportSource(report, now);
+      break;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+/* Convert the state, mode and selection option of a source report to
+   the codes used in the protocol (in network order) */
+
+static void
+convert_source_codes(RPT_SourceReport *report, uint16_t *state, uint16_t *mode,
+                     uint16_t *flags)
+{
+  switch (report->state) {
+    case RPT_SYNC:
+      *state = htons(RPY_SD_ST_SYNC);
+      break;
+    case RPT_UNREACH:
+      *state = htons(RPY_SD_ST_UNREACH);
+      break;
+    case RPT_FALSETICKER:
+      *state = htons(RPY_SD_ST_FALSETICKER);
+      break;
+    case RPT_JITTERY:
+      *state = htons(RPY_SD_ST_JITTERY);
+      break;
+    case RPT_CANDIDATE:
+      *state = htons(RPY_SD_ST_CANDIDATE);
+      break;
+    case RPT_OUTLIER:
+      *state = htons(RPY_SD_ST_OUTLIER);
+      break;
+  }
+  switch (report->mode) {
+    case RPT_NTP_CLIENT:
+      *mode = htons(RPY_SD_MD_CLIENT);
+      break;
+    case RPT_NTP_PEER:
+      *mode = htons(RPY_SD_MD_PEER);
+      break;
+    case RPT_LOCAL_REFERENCE:
+      *mode = htons(RPY_SD_MD_REF);
+      break;
+  }
+  switch (report->sel_option) {
+    case RPT_NORMAL:
+      *flags = htons(0);
+      break;
+    case RPT_PREFER:
+      *flags = htons(RPY_SD_FLAG_PREFER);
+      break;
+    case RPT_NOSELECT:
+      *flags = htons(RPY_SD_FLAG_NOSELECT);
+      break;
+  }
+}
+
+/* ================================================== */
+
 static void
 handle_source_data(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
   RPT_SourceReport report;
-  struct timeval now_corr;
+  struct timespec now_corr;
 
   /* Get data */
   LCL_ReadCookedTime(&now_corr, NULL);
-  if (SRC_ReportSource(ntohl(rx_message->data.source_data.index), &report, &now_corr)) {
-    switch (SRC_GetType(ntohl(rx_message->data.source_data.index))) {
-      case SRC_NTP:
-        NSR_ReportSource(&report, &now_corr);
-        break;
-      case SRC_REFCLOCK:
-        RCL_ReportSource(&report, &now_corr);
-        break;
-    }
-    
+  if (report_source(ntohl(rx_message->data.source_data.index), &report, &now_corr)) {
     tx_message->status = htons(STT_SUCCESS);
     tx_message->reply  = htons(RPY_SOURCE_DATA);
     
     UTI_IPHostToNetwork(&report.ip_addr, &tx_message->data.source_data.ip_addr);
     tx_message->data.source_data.stratum = htons(report.stratum);
     tx_message->data.source_data.poll    = htons(report.poll);
-    switch (report.state) {
-      case RPT_SYNC:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_SYNC);
-        break;
-      case RPT_UNREACH:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_UNREACH);
-        break;
-      case RPT_FALSETICKER:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_FALSETICKER);
-        break;
-      case RPT_JITTERY:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_JITTERY);
-        break;
-      case RPT_CANDIDATE:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_CANDIDATE);
-        break;
-      case RPT_OUTLIER:
-        tx_message->data.source_data.state   = htons(RPY_SD_ST_OUTLIER);
-        break;
-    }
-    switch (report.mode) {
-      case RPT_NTP_CLIENT:
-        tx_message->data.source_data.mode    = htons(RPY_SD_MD_CLIENT);
-        break;
-      case RPT_NTP_PEER:
-        tx_message->data.source_data.mode    = htons(RPY_SD_MD_PEER);
-        break;
-      case RPT_LOCAL_REFERENCE:
-        tx_message->data.source_data.mode    = htons(RPY_SD_MD_REF);
-        break;
-    }
-    switch (report.sel_option) {
-      case RPT_NORMAL:
-        tx_message->data.source_data.flags = htons(0);
-        break;
-      case RPT_PREFER:
-        tx_message->data.source_data.flags = htons(RPY_SD_FLAG_PREFER);
-        break;
-      case RPT_NOSELECT:
-        tx_message->data.source_data.flags = htons(RPY_SD_FLAG_PREFER);
-        break;
-    }
+    convert_source_codes(&report, &tx_message->data.source_data.state,
+                         &tx_message->data.source_data.mode,
+                         &tx_message->data.source_data.flags);
     tx_message->data.source_data.reachability = htons(report.reachability);
     tx_message->data.source_data.since_sample = htonl(report.latest_meas_ago);
     tx_message->data.source_data.orig_latest_meas = UTI_FloatHostToNetwork(report.orig_latest_meas);
@@ -1080,6 +1301,17 @@ handle_rekey(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+handle_reload_leap(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  if (LDB_Reload())
+    tx_message->status = htons(STT_SUCCESS);
+  else
+    tx_message->status = htons(STT_FAILED);
+}
+
+/* ================================================== */
+
 static void
 handle_allow(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -1368,7 +1600,7 @@ handle_tracking(CMD_Request *rx_message, CMD_Reply *tx_message)
   UTI_IPHostToNetwork(&rpt.ip_addr, &tx_message->data.tracking.ip_addr);
   tx_message->data.tracking.stratum = htons(rpt.stratum);
   tx_message->data.tracking.leap_status = htons(rpt.leap_status);
-  UTI_TimevalHostToNetwork(&rpt.ref_time, &tx_message->data.tracking.ref_time);
+  UTI_TimespecHostToNetwork(&rpt.ref_time, &tx_message->data.tracking.ref_time);
   tx_message->data.tracking.current_correction = UTI_FloatHostToNetwork(rpt.current_correction);
   tx_message->data.tracking.last_offset = UTI_FloatHostToNetwork(rpt.last_offset);
   tx_message->data.tracking.rms_offset = UTI_FloatHostToNetwork(rpt.rms_offset);
@@ -1387,7 +1619,7 @@ handle_sourcestats(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
   int status;
   RPT_SourcestatsReport report;
-  struct timeval now_corr;
+  struct timespec now_corr;
 
   LCL_ReadCookedTime(&now_corr, NULL);
   status = SRC_ReportSourcestats(ntohl(rx_message->data.sourcestats.index),
@@ -1422,7 +1654,7 @@ handle_rtcreport(CMD_Request *rx_message, CMD_Reply *tx_message)
   if (status) {
     tx_message->status = htons(STT_SUCCESS);
     tx_message->reply  = htons(RPY_RTC);
-    UTI_TimevalHostToNetwork(&report.ref_time, &tx_message->data.rtc.ref_time);
+    UTI_TimespecHostToNetwork(&report.ref_time, &tx_message->data.rtc.ref_time);
     tx_message->data.rtc.n_samples = htons(report.n_samples);
     tx_message->data.rtc.n_runs = htons(report.n_runs);
     tx_message->data.rtc.span_seconds = htonl(report.span_seconds);
@@ -1466,7 +1698,7 @@ handle_client_accesses_by_index(CMD_Request *rx_message, CMD_Reply *tx_message)
   RPT_ClientAccessByIndex_Report report;
   unsigned long first_index, n_indices, last_index, n_indices_in_table;
   int i, j;
-  struct timeval now;
+  struct timespec now;
 
   LCL_ReadCookedTime(&now, NULL);
 
@@ -1513,6 +1745,66 @@ handle_client_accesses_by_index(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+handle_source_reports(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  RPT_SourceReport report;
+  RPT_SourcestatsReport stats;
+  RPY_SourceReports_Source *source;
+  unsigned long i, first_index, n_indices, n_sources;
+  int j;
+  struct timespec now_corr;
+
+  LCL_ReadCookedTime(&now_corr, NULL);
+
+  first_index = ntohl(rx_message->data.source_reports.first_index);
+  n_indices = ntohl(rx_message->data.source_reports.n_indices);
+  if (n_indices > MAX_SOURCE_REPORTS)
+    n_indices = MAX_SOURCE_REPORTS;
+
+  n_sources = SRC_ReadNumberOfSources();
+
+  /* An index beyond the table gets a reply with no sources */
+  if (first_index > n_sources)
+    first_index = n_sources;
+
+  tx_message->status = htons(STT_SUCCESS);
+  tx_message->reply = htons(RPY_SOURCE_REPORTS);
+  tx_message->data.source_reports.n_indices = htonl(n_sources);
+
+  for (i = first_index, j = 0; i < n_sources && j < n_indices; i++) {
+    if (!report_source(i, &report, &now_corr) ||
+        !SRC_ReportSourcestats(i, &stats, &now_corr))
+      continue; /* ignore this index */
+
+    source = &tx_message->data.source_reports.sources[j++];
+
+    UTI_IPHostToNetwork(&report.ip_addr, &source->ip_addr);
+    source->ref_id = htonl(stats.ref_id);
+    source->poll = htons(report.poll);
+    source->stratum = htons(report.stratum);
+    convert_source_codes(&report, &source->state, &source->mode, &source->flags);
+    source->reachability = htons(report.reachability);
+    source->since_sample = htonl(report.latest_meas_ago);
+    source->orig_latest_meas = UTI_FloatHostToNetwork(report.orig_latest_meas);
+    source->latest_meas = UTI_FloatHostToNetwork(report.latest_meas);
+    source->latest_meas_err = UTI_FloatHostToNetwork(report.latest_meas_err);
+    source->n_samples = htonl(stats.n_samples);
+    source->n_runs = htonl(stats.n_runs);
+    source->span_seconds = htonl(stats.span_seconds);
+    source->sd = UTI_FloatHostToNetwork(stats.sd);
+    source->resid_freq_ppm = UTI_FloatHostToNetwork(stats.resid_freq_ppm);
+    source->skew_ppm = UTI_FloatHostToNetwork(stats.skew_ppm);
+    source->est_offset = UTI_FloatHostToNetwork(stats.est_offset);
+    source->est_offset_err = UTI_FloatHostToNetwork(stats.est_offset_err);
+  }
+
+  tx_message->data.source_reports.next_index = htonl(i);
+  tx_message->data.source_reports.n_sources = htonl(j);
+}
+
+/* ================================================== */
+
 static void
 handle_manual_list(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -1528,7 +1820,7 @@ handle_manual_list(CMD_Request *rx_message, CMD_Reply *tx_message)
   tx_message->data.manual_list.n_samples = htonl(n_samples);
   for (i=0; i<n_samples; i++) {
     sample = &tx_message->data.manual_list.samples[i];
-    UTI_TimevalHostToNetwork(&report[i].when, &sample->when);
+    UTI_TimespecHostToNetwork(&report[i].when, &sample->when);
     sample->slewed_offset = UTI_FloatHostToNetwork(report[i].slewed_offset);
     sample->orig_offset = UTI_FloatHostToNetwork(report[i].orig_offset);
     sample->residual = UTI_FloatHostToNetwork(report[i].residual);
@@ -1579,6 +1871,291 @@ handle_activity(CMD_Request *rx_message, CMD_Reply *tx_message)
 
 /* ================================================== */
 
+static void
+handle_cmdmon_stats(CMD_Request *rx_message, CMD_Reply *tx_message, struct timespec *now)
+{
+  int n_replies, n_ts;
+
+  get_cache_stats(now, &n_replies, &n_ts);
+
+  tx_message->data.cmdmon_stats.kept_replies = htonl(n_replies);
+  tx_message->data.cmdmon_stats.max_kept_replies = htonl(REPLY_SLOTS);
+  tx_message->data.cmdmon_stats.seen_timestamps = htonl(n_ts);
+  tx_message->data.cmdmon_stats.max_seen_timestamps = htonl(TS_BUCKETS * TS_WAYS);
+  tx_message->data.cmdmon_stats.resent_replies = htonl(resent_replies);
+  tx_message->data.cmdmon_stats.rejected_timestamps = htonl(rejected_ts);
+  tx_message->status = htons(STT_SUCCESS);
+  tx_message->reply = htons(RPY_CMDMON_STATS);
+}
+
+/* ================================================== */
+
+static void
+handle_server_counters(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  uint64_t counters[CNT_Max];
+  int i;
+
+  CNT_GetCounters(counters);
+
+  for (i = 0; i < CNT_Max; i++) {
+    tx_message->data.server_counters.counters[i].high = htonl(counters[i] >> 32);
+    tx_message->data.server_counters.counters[i].low = htonl(counters[i]);
+  }
+
+  tx_message->data.server_counters.n_counters = htonl(CNT_Max);
+  tx_message->status = htons(STT_SUCCESS);
+  tx_message->reply = htons(RPY_SERVER_COUNTERS);
+}
+
+/* ================================================== */
+
+static void
+handle_latency_stats(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  SCH_LatencyReport report;
+  uint64_t handler;
+  int i;
+
+  if (!SCH_GetLatencyStats(ntohl(rx_message->data.latency_stats.index), &report)) {
+    tx_message->status = htons(STT_INVALID);
+    return;
+  }
+
+  switch (report.type) {
+    case SCH_DispatchDelay:
+      tx_message->data.latency_stats.type = htonl(RPY_LAT_DISPATCH_DELAY);
+      break;
+    case SCH_TimeoutLatency:
+      tx_message->data.latency_stats.type = htonl(RPY_LAT_TIMEOUT_HANDLER);
+      break;
+    case SCH_FileLatency:
+      tx_message->data.latency_stats.type = htonl(RPY_LAT_FILE_HANDLER);
+      break;
+    default:
+      assert(0);
+  }
+
+  handler = report.handler;
+  tx_message->data.latency_stats.n_stats = htonl(SCH_GetNumberOfLatencyStats());
+  tx_message->data.latency_stats.index = rx_message->data.latency_stats.index;
+  tx_message->data.latency_stats.handler_high = htonl(handler >> 32);
+  tx_message->data.latency_stats.handler_low = htonl(handler);
+  tx_message->data.latency_stats.count = htonl(report.count);
+  tx_message->data.latency_stats.mean = UTI_FloatHostToNetwork(report.mean);
+  tx_message->data.latency_stats.max = UTI_FloatHostToNetwork(report.max);
+  for (i = 0; i < MAX_LATENCY_BUCKETS; i++)
+    tx_message->data.latency_stats.buckets[i] = htonl(report.buckets[i]);
+
+  tx_message->status = htons(STT_SUCCESS);
+  tx_message->reply = htons(RPY_LATENCY_STATS);
+}
+
+/* ================================================== */
+
+static void
+handle_server_latency(CMD_Request *rx_message, CMD_Reply *tx_message)
+{
+  RPT_ServerLatencyReport report;
+  int i;
+
+  if (!NIO_GetServerLatencyReport(&report)) {
+    tx_message->status = htons(STT_NOTENABLED);
+    return;
+  }
+
+  tx_message->data.server_latency.count = htonl(report.count);
+  tx_message->data.server_latency.n_worst = htonl(report.n_worst);
+  tx_message->data.server_latency.mean = UTI_FloatHostToNetwork(report.mean);
+  tx_message->data.server_latency.p50 = UTI_FloatHostToNetwork(report.p50);
+  tx_message->data.server_latency.p90 = UTI_FloatHostToNetwork(report.p90);
+  tx_message->data.server_latency.p99 = UTI_FloatHostToNetwork(report.p99);
+  tx_message->data.server_latency.p999 = UTI_FloatHostToNetwork(report.p999);
+  tx_message->data.server_latency.max = UTI_FloatHostToNetwork(report.max);
+
+  memset(tx_message->data.server_latency.worst, 0,
+         sizeof (tx_message->data.server_latency.worst));
+  for (i = 0; i < report.n_worst; i++) {
+    UTI_IPHostToNetwork(&report.worst[i].ip_addr,
+                        &tx_message->data.server_latency.worst[i].ip_addr);
+    UTI_TimespecHostToNetwork(&report.worst[i].when,
+                             &tx_message->data.server_latency.worst[i].when);
+    tx_message->data.server_latency.worst[i].latency =
+      UTI_FloatHostToNetwork(report.worst[i].latency);
+  }
+
+  tx_message->status = htons(STT_SUCCESS);
+  tx_message->reply = htons(RPY_SERVER_LATENCY);
+}
+
+/* ================================================== */
+
+static void
+fill_event(CMD_Reply *msg, int events)
+{
+  RPT_TrackingReport rpt;
+
+  REF_GetTrackingReport(&rpt);
+
+  msg->reply = htons(RPY_EVENT);
+  msg->data.event.events = htonl(events);
+  msg->data.event.ref_id = htonl(rpt.ref_id);
+  UTI_IPHostToNetwork(&rpt.ip_addr, &msg->data.event.ip_addr);
+  msg->data.event.stratum = htons(rpt.stratum);
+  msg->data.event.leap_status = htons(rpt.leap_status);
+  UTI_TimespecHostToNetwork(&rpt.ref_time, &msg->data.event.ref_time);
+  msg->data.event.current_correction = UTI_FloatHostToNetwork(rpt.current_correction);
+  msg->data.event.last_offset = UTI_FloatHostToNetwork(rpt.last_offset);
+  msg->data.event.skew_ppm = UTI_FloatHostToNetwork(rpt.skew_ppm);
+  msg->data.event.root_delay = UTI_FloatHostToNetwork(rpt.root_delay);
+  msg->data.event.root_dispersion = UTI_FloatHostToNetwork(rpt.root_dispersion);
+}
+
+/* ================================================== */
+
+static void
+remove_subscriber(Subscriber *s)
+{
+  if (s->timeout_id)
+    SCH_RemoveTimeout(s->timeout_id);
+  s->timeout_id = 0;
+  s->used = 0;
+}
+
+/* ================================================== */
+/* Shift the raw timestamps of the subscriptions when the clock is stepped,
+   so their leases and minimum intervals don't change */
+
+static void
+handle_slew(struct timespec *raw, struct timespec *cooked, double dfreq,
+            double doffset, LCL_ChangeType change_type, void *anything)
+{
+  int i;
+
+  if (change_type == LCL_ChangeAdjust)
+    return;
+
+  for (i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (!subscribers[i].used)
+      continue;
+    UTI_AddDoubleToTimespec(&subscribers[i].last_update, -doffset,
+                            &subscribers[i].last_update);
+    UTI_AddDoubleToTimespec(&subscribers[i].expiry, -doffset, &subscribers[i].expiry);
+  }
+}
+
+/* ================================================== */
+
+static void
+send_update(void *arg)
+{
+  Subscriber *s = arg;
+  CMD_Reply msg;
+  struct timespec now;
+  int auth_length;
+
+  s->timeout_id = 0;
+
+  LCL_ReadRawTime(&now);
+
+  if (UTI_CompareTimespecs(&s->expiry, &now) < 0) {
+    DEBUG_LOG(LOGF_CmdMon, "Subscription expired");
+    remove_subscriber(s);
+    return;
+  }
+
+  memset(&msg, 0, offsetof(CMD_Reply, data));
+  msg.version = PROTO_VERSION_NUMBER;
+  msg.pkt_type = PKT_TYPE_CMD_REPLY;
+  msg.command = htons(REQ_SUBSCRIBE);
+  msg.status = htons(STT_SUCCESS);
+  msg.sequence = s->sequence;
+  msg.utoken = htonl(utoken);
+  msg.token = htonl(0xffffffffUL);
+  fill_event(&msg, s->pending_events);
+
+  auth_length = s->authenticated ? generate_tx_packet_auth(&msg) : 0;
+
+  s->pending_events = 0;
+  s->last_update = now;
+
+  /* Drop clients which closed their Unix domain socket */
+  if (!transmit_reply(&msg, &s->addr, s->addr_len, auth_length) &&
+      s->addr.u.sa_family == AF_UNIX)
+    remove_subscriber(s);
+}
+
+/* ================================================== */
+
+/* The timestamps of the subscriptions are in raw time, like now */
+
+static void
+handle_subscribe(CMD_Request *rx_message, CMD_Reply *tx_message,
+                 union sockaddr_in46 *where_from, socklen_t from_length,
+                 int auth_ok, struct timespec *now)
+{
+  Subscriber *s, *free_s;
+  unsigned long lease;
+  double min_interval;
+  int i, events;
+
+  events = ntohl(rx_message->data.subscribe.events) &
+           (REQ_SUBSCRIBE_TRACKING | REQ_SUBSCRIBE_SELECTION | REQ_SUBSCRIBE_LEAP);
+  lease = ntohl(rx_message->data.subscribe.lease);
+  min_interval = UTI_FloatNetworkToHost(rx_message->data.subscribe.min_interval);
+
+  for (i = 0, s = free_s = NULL; i < MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i].used && subscribers[i].addr_len == from_length &&
+        !memcmp(&subscribers[i].addr, where_from, from_length)) {
+      s = &subscribers[i];
+    } else if (!free_s && (!subscribers[i].used ||
+                           UTI_CompareTimespecs(&subscribers[i].expiry, now) < 0)) {
+      free_s = &subscribers[i];
+    }
+  }
+
+  if (!events || !lease) {
+    if (s)
+      remove_subscriber(s);
+  } else {
+    if (!s) {
+      if (!free_s) {
+        tx_message->status = htons(STT_FAILED);
+        return;
+      }
+
+      s = free_s;
+      if (s->used)
+        remove_subscriber(s);
+
+      s->used = 1;
+      memcpy(&s->addr, where_from, from_length);
+      s->addr_len = from_length;
+      s->pending_events = 0;
+      s->last_update = *now;
+    }
+
+    if (!(min_interval >= MIN_EVENT_INTERVAL))
+      min_interval = MIN_EVENT_INTERVAL;
+    if (min_interval > MAX_SUBSCRIPTION_LEASE)
+      min_interval = MAX_SUBSCRIPTION_LEASE;
+    if (lease > MAX_SUBSCRIPTION_LEASE)
+      lease = MAX_SUBSCRIPTION_LEASE;
+
+    s->sequence = rx_message->sequence;
+    s->events = events;
+    s->authenticated = auth_ok;
+    s->min_interval = min_interval;
+    s->expiry = *now;
+    s->expiry.tv_sec += lease;
+  }
+
+  tx_message->status = htons(STT_SUCCESS);
+  fill_event(tx_message, 0);
+}
+
+/* ================================================== */
+
 static void
 handle_reselect_distance(CMD_Request *rx_message, CMD_Reply *tx_message)
 {
@@ -1597,6 +2174,28 @@ handle_reselect(CMD_Request *rx_message, CMD_Reply *tx_message)
   tx_message->status = htons(STT_SUCCESS);
 }
 
+/* ================================================== */
+/* Check if a message received on the Unix domain socket was sent by
+   root or the user chronyd is running as */
+
+static int
+has_privileged_credentials(struct msghdr *msg)
+{
+#ifdef SCM_CREDENTIALS
+  struct cmsghdr *cmsg;
+  struct ucred cred;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+      memcpy(&cred, CMSG_DATA(cmsg), sizeof (cred));
+      return cred.uid == 0 || cred.uid == geteuid();
+    }
+  }
+#endif
+
+  return 0;
+}
+
 /* ================================================== */
 /* Read a packet and process it */
 
@@ -1613,6 +2212,9 @@ read_from_cmd_socket(void *anything)
   int sock_fd;
   union sockaddr_in46 where_from;
   socklen_t from_length;
+  struct msghdr msg;
+  struct iovec iov;
+  char cmsgbuf[256];
   IPAddr remote_ip;
   unsigned short remote_port;
   int auth_length;
@@ -1622,22 +2224,32 @@ read_from_cmd_socket(void *anything)
   int valid_ts;
   int authenticated;
   int localhost;
+  int unix_socket;
   int allowed;
   unsigned short rx_command;
   unsigned long rx_message_token;
   unsigned long tx_message_token;
   unsigned long rx_message_seq;
   unsigned long rx_attempt;
-  struct timeval now;
-  struct timeval cooked_now;
+  struct timespec now;
+  struct timespec cooked_now;
 
   flags = 0;
   rx_message_length = sizeof(rx_message);
-  from_length = sizeof(where_from);
+
+  iov.iov_base = &rx_message;
+  iov.iov_len = rx_message_length;
+  msg.msg_name = &where_from;
+  msg.msg_namelen = sizeof(where_from);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cmsgbuf;
+  msg.msg_controllen = sizeof(cmsgbuf);
+  msg.msg_flags = 0;
 
   sock_fd = (long)anything;
-  status = recvfrom(sock_fd, (char *)&rx_message, rx_message_length, flags,
-                    &where_from.u, &from_length);
+  status = recvmsg(sock_fd, &msg, flags);
+  from_length = msg.msg_namelen;
 
   if (status < 0) {
     LOG(LOGS_WARN, LOGF_CmdMon, "Error [%s] reading from control socket %d",
@@ -1653,7 +2265,15 @@ read_from_cmd_socket(void *anything)
   LCL_ReadRawTime(&now);
   LCL_CookTime(&now, &cooked_now, NULL);
 
+  unix_socket = 0;
+
   switch (where_from.u.sa_family) {
+    case AF_UNIX:
+      remote_ip.family = IPADDR_UNSPEC;
+      remote_port = 0;
+      localhost = 1;
+      unix_socket = 1;
+      break;
     case AF_INET:
       remote_ip.family = IPADDR_INET4;
       remote_ip.addr.in4 = ntohl(where_from.in4.sin_addr.s_addr);
@@ -1677,29 +2297,38 @@ read_from_cmd_socket(void *anything)
       assert(0);
   }
 
+  CNT_INC(unix_socket ? CNT_CmdRxUnix :
+          remote_ip.family == IPADDR_INET4 ? CNT_CmdRx4 : CNT_CmdRx6);
+
   if (!(localhost || ADF_IsAllowed(access_auth_table, &remote_ip))) {
     /* The client is not allowed access, so don't waste any more time
        on him.  Note that localhost is always allowed access
        regardless of the defined access rules - otherwise, we could
        shut ourselves out completely! */
+    CNT_INC(CNT_CmdRxDropped);
     return;
   }
 
-  /* Message size sanity check */
+  /* Message size sanity check.  Requests received on the Unix domain
+     socket don't need to be padded, as there is no amplification to
+     prevent. */
   if (read_length >= offsetof(CMD_Request, data)) {
     expected_length = PKL_CommandLength(&rx_message);
+    if (unix_socket && expected_length > 0)
+      expected_length -= PKL_CommandPaddingLength(&rx_message);
   } else {
     expected_length = 0;
   }
 
   if (expected_length < offsetof(CMD_Request, data) ||
-      read_length < offsetof(CMD_Reply, data) ||
+      (!unix_socket && read_length < offsetof(CMD_Reply, data)) ||
       rx_message.pkt_type != PKT_TYPE_CMD_REQUEST ||
       rx_message.res1 != 0 ||
       rx_message.res2 != 0) {
 
     /* We don't know how to process anything like this */
     CLG_LogCommandAccess(&remote_ip, CLG_CMD_BAD_PKT, cooked_now.tv_sec);
+    CNT_INC(CNT_CmdRxDropped);
     
     return;
   }
@@ -1727,10 +2356,11 @@ read_from_cmd_socket(void *anything)
     DEBUG_LOG(LOGF_CmdMon, "Read command packet with protocol version %d (expected %d) from %s:%hu", rx_message.version, PROTO_VERSION_NUMBER, UTI_IPToString(&remote_ip), remote_port);
 
     CLG_LogCommandAccess(&remote_ip, CLG_CMD_BAD_PKT, cooked_now.tv_sec);
+    CNT_INC(CNT_CmdRxDropped);
 
     if (rx_message.version >= PROTO_VERSION_MISMATCH_COMPAT_SERVER) {
       tx_message.status = htons(STT_BADPKTVERSION);
-      transmit_reply(&tx_message, &where_from, 0);
+      transmit_reply(&tx_message, &where_from, from_length, 0);
     }
     return;
   }
@@ -1739,9 +2369,10 @@ read_from_cmd_socket(void *anything)
     DEBUG_LOG(LOGF_CmdMon, "Read command packet with invalid command %d from %s:%hu", rx_command, UTI_IPToString(&remote_ip), remote_port);
 
     CLG_LogCommandAccess(&remote_ip, CLG_CMD_BAD_PKT, cooked_now.tv_sec);
+    CNT_INC(CNT_CmdRxDropped);
 
     tx_message.status = htons(STT_INVALID);
-    transmit_reply(&tx_message, &where_from, 0);
+    transmit_reply(&tx_message, &where_from, from_length, 0);
     return;
   }
 
@@ -1749,9 +2380,10 @@ read_from_cmd_socket(void *anything)
     DEBUG_LOG(LOGF_CmdMon, "Read incorrectly sized command packet from %s:%hu", UTI_IPToString(&remote_ip), remote_port);
 
     CLG_LogCommandAccess(&remote_ip, CLG_CMD_BAD_PKT, cooked_now.tv_sec);
+    CNT_INC(CNT_CmdRxDropped);
 
     tx_message.status = htons(STT_BADPKTLENGTH);
-    transmit_reply(&tx_message, &where_from, 0);
+    transmit_reply(&tx_message, &where_from, from_length, 0);
     return;
   }
 
@@ -1759,9 +2391,12 @@ read_from_cmd_socket(void *anything)
 
   /* Do authentication stuff and command tokens here.  Well-behaved
      clients will set their utokens to 0 to save us wasting our time
-     if the packet is unauthenticatable. */
-  if (rx_message.utoken != 0) {
+     if the packet is unauthenticatable.  Requests from the Unix domain
+     socket are authorised by the credentials of the sender instead. */
+  if (rx_message.utoken != 0 && !unix_socket) {
     auth_ok = check_rx_packet_auth(&rx_message, read_length);
+    if (!auth_ok)
+      CNT_INC(CNT_CmdAuthFailed);
   } else {
     auth_ok = 0;
   }
@@ -1823,24 +2458,33 @@ read_from_cmd_socket(void *anything)
   if (auth_ok && utoken_ok && !token_ok) {
     /* This might be a resent message, due to the client not getting
        our reply to the first attempt.  See if we can find the message. */
-    prev_tx_message = lookup_reply(rx_message_token, rx_message_seq, rx_attempt);
-    if (prev_tx_message) {
-      /* Just send this message again */
-      tx_message_length = PKL_ReplyLength(prev_tx_message);
-      status = sendto(sock_fd, (void *) prev_tx_message, tx_message_length, 0,
-                      &where_from.u, from_length);
-      if (status < 0) {
-        DEBUG_LOG(LOGF_CmdMon, "Could not send response to %s:%hu", UTI_IPToString(&remote_ip), remote_port);
-      }
-      return;
-    }
+    prev_tx_message = lookup_reply(rx_message_token, rx_message_seq, rx_attempt, &now);
     /* Otherwise, just fall through into normal processing */
+  } else if (unix_socket && permissions[rx_command] == PERMIT_AUTH) {
+    /* This might be a request resent by a client which didn't get the
+       reply in time, e.g. while the daemon was busy */
+    prev_tx_message = lookup_unix_reply(&where_from.un, from_length, rx_message_seq,
+                                        rx_command, &now);
+  } else {
+    prev_tx_message = NULL;
+  }
 
+  if (prev_tx_message) {
+    /* Just send this message again */
+    tx_message_length = PKL_ReplyLength(prev_tx_message);
+    status = sendto(sock_fd, (void *) prev_tx_message, tx_message_length, 0,
+                    &where_from.u, from_length);
+    if (status < 0) {
+      DEBUG_LOG(LOGF_CmdMon, "Could not send response to %s:%hu", UTI_IPToString(&remote_ip), remote_port);
+    } else {
+      CNT_INC(CNT_CmdTx);
+    }
+    return;
   }
 
   if (auth_ok && utoken_ok && token_ok) {
     /* See whether we can discard the previous reply from storage */
-    token_acknowledged(rx_message_token, &now);
+    token_acknowledged(rx_message_token);
   }
 
   valid_ts = 0;
@@ -1851,9 +2495,9 @@ read_from_cmd_socket(void *anything)
       issue_token = 1;
     } else if (rx_command == REQ_LOGON &&
                ntohl(rx_message.utoken) == SPECIAL_UTOKEN) {
-      struct timeval ts;
+      struct timespec ts;
 
-      UTI_TimevalNetworkToHost(&rx_message.data.logon.ts, &ts);
+      UTI_TimespecNetworkToHost(&rx_message.data.logon.ts, &ts);
       valid_ts = ts_is_unique_and_not_stale(&ts, &now);
 
       if (valid_ts) {
@@ -1862,7 +2506,10 @@ read_from_cmd_socket(void *anything)
     }
   }
 
-  authenticated = auth_ok & utoken_ok & token_ok;
+  if (unix_socket)
+    authenticated = has_privileged_credentials(&msg);
+  else
+    authenticated = auth_ok & utoken_ok & token_ok;
 
   if (authenticated) {
     CLG_LogCommandAccess(&remote_ip, CLG_CMD_AUTH, cooked_now.tv_sec);
@@ -1967,7 +2614,7 @@ read_from_cmd_socket(void *anything)
                 auth_ok, valid_ts);
           }
 
-          if (issue_token == 1) {
+          if (issue_token == 1 || (unix_socket && authenticated)) {
             tx_message.status = htons(STT_SUCCESS);
           } else if (!auth_ok) {
             tx_message.status = htons(STT_UNAUTH);
@@ -2123,6 +2770,35 @@ read_from_cmd_socket(void *anything)
           handle_modify_polltarget(&rx_message, &tx_message);
           break;
 
+        case REQ_SOURCE_REPORTS:
+          handle_source_reports(&rx_message, &tx_message);
+          break;
+
+        case REQ_RELOAD_LEAP:
+          handle_reload_leap(&rx_message, &tx_message);
+          break;
+
+        case REQ_CMDMON_STATS:
+          handle_cmdmon_stats(&rx_message, &tx_message, &now);
+          break;
+
+        case REQ_SERVER_COUNTERS:
+          handle_server_counters(&rx_message, &tx_message);
+          break;
+
+        case REQ_LATENCY_STATS:
+          handle_latency_stats(&rx_message, &tx_message);
+          break;
+
+        case REQ_SERVER_LATENCY:
+          handle_server_latency(&rx_message, &tx_message);
+          break;
+
+        case REQ_SUBSCRIBE:
+          handle_subscribe(&rx_message, &tx_message, &where_from, from_length,
+                           auth_ok, &now);
+          break;
+
         default:
           assert(0);
           break;
@@ -2145,6 +2821,9 @@ read_from_cmd_socket(void *anything)
                rx_message_seq,
                rx_attempt,
                &now);
+  } else if (unix_socket && permissions[rx_command] == PERMIT_AUTH) {
+    save_unix_reply(&tx_message, &where_from.un, from_length, rx_message_seq,
+                    rx_command, &now);
   }
 
   /* Transmit the response */
@@ -2154,7 +2833,7 @@ read_from_cmd_socket(void *anything)
     static int do_it=1;
 
     if (do_it) {
-      transmit_reply(&tx_message, &where_from, auth_length);
+      transmit_reply(&tx_message, &where_from, from_length, auth_length);
     }
 
 #if 0
@@ -2201,6 +2880,37 @@ CAM_CheckAccessRestriction(IPAddr *ip_addr)
   return ADF_IsAllowed(access_auth_table, ip_addr);
 }
 
+/* ================================================== */
+
+void
+CAM_NotifyEvent(int event)
+{
+  struct timespec now;
+  double delay;
+  Subscriber *s;
+  int i;
+
+  for (i = 0; i < MAX_SUBSCRIBERS; i++) {
+    s = &subscribers[i];
+    if (!s->used || !(s->events & event))
+      continue;
+
+    s->pending_events |= event;
+    if (s->timeout_id)
+      continue;
+
+    LCL_ReadRawTime(&now);
+    UTI_DiffTimespecsToDouble(&delay, &s->last_update, &now);
+    delay += s->min_interval;
+    if (delay < 0.0)
+      delay = 0.0;
+    else if (delay > s->min_interval)
+      delay = s->min_interval;
+
+    s->timeout_id = SCH_AddTimeoutByDelay(delay, send_update, s);
+  }
+}
+
 
 /* ================================================== */
 /* ================================================== */
@@ -36,4 +36,12 @@ extern void CAM_Finalise(void);
 extern int CAM_AddAccessRestriction(IPAddr *ip_addr, int subnet_bits, int allow, int all);
 extern int CAM_CheckAccessRestriction(IPAddr *ip_addr);
 
+/* Events reported to subscribed clients */
+#define CAM_EVENT_TRACKING 0x1
+#define CAM_EVENT_SELECTION 0x2
+#define CAM_EVENT_LEAP 0x4
+
+/* Schedule an update for clients subscribed to the event */
+extern void CAM_NotifyEvent(int event);
+
 #endif /* GOT_CMDMON_H */
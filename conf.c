@@ -40,6 +40,7 @@
 #include "memory.h"
 #include "cmdparse.h"
 #include "broadcast.h"
+#include "chrony_statuspage.h"
 #include "util.h"
 
 /* ================================================== */
@@ -65,12 +66,16 @@ static void parse_include(char *);
 static void parse_initstepslew(char *);
 static void parse_local(char *);
 static void parse_log(char *);
+static void parse_logbuffer(char *);
+static void parse_logformat(char *);
 static void parse_mailonchange(char *);
 static void parse_makestep(char *);
 static void parse_maxchange(char *);
+static void parse_metrics(char *);
 static void parse_peer(char *);
 static void parse_refclock(char *);
 static void parse_server(char *);
+static void parse_statuspage(char *);
 static void parse_tempcomp(char *);
 
 /* ================================================== */
@@ -89,6 +94,10 @@ static double max_update_skew = 1000.0;
 static double correction_time_ratio = 3.0;
 static double max_clock_error = 1.0; /* in ppm */
 static double max_slew_rate = 1e6 / 12.0; /* in ppm */
+static double timer_slack = 0.0;
+
+/* Maximum offset corrected by the kernel PLL (zero disables the PLL) */
+static double kernel_pll_max_offset = 0.0;
 
 static double reselect_distance = 1e-4;
 static double stratum_weight = 1.0;
@@ -103,7 +112,15 @@ static int do_log_rtc = 0;
 static int do_log_refclocks = 0;
 static int do_log_tempcomp = 0;
 static int do_dump_on_exit = 0;
+static int measure_server_latency = 0;
 static int log_banner = 32;
+/* Size of the buffer for log files written by a separate thread (zero
+   means the files are written directly) and its flush interval */
+static unsigned long log_buffer_size = 0;
+static double log_flush_interval = 1.0;
+/* Flag set if the measurements, statistics, tracking and refclocks logs
+   should be written in the binary format */
+static int log_binary = 0;
 static char *logdir = ".";
 static char *dumpdir = ".";
 
@@ -130,6 +147,9 @@ static char *hwclock_file = NULL;
 /* Flag set if the RTC should be automatically synchronised by kernel */
 static int rtc_sync = 0;
 
+/* Flag set if the RTC should be sampled without update interrupts */
+static int rtc_on_demand = 0;
+
 /* Limit and threshold for clock stepping */
 static int make_step_limit = 0;
 static double make_step_threshold = 0.0;
@@ -178,6 +198,10 @@ static IPAddr bind_acq_address4, bind_acq_address6;
    use the value of bind_address */
 static IPAddr bind_cmd_address4, bind_cmd_address6;
 
+/* Path to the Unix domain command socket.  An empty string disables
+   the socket */
+static char *bind_cmd_path = DEFAULT_COMMAND_SOCKET;
+
 /* Filename to use for storing pid of running chronyd, to prevent multiple
  * chronyds being started. */
 static char *pidfile = "/var/run/chronyd.pid";
@@ -190,9 +214,24 @@ static double tempcomp_T0, tempcomp_k0, tempcomp_k1, tempcomp_k2;
 static int sched_priority = 0;
 static int lock_memory = 0;
 
+/* Flag set if the time status page should be published in shared memory
+   and the key of the segment */
+static int status_page = 0;
+static long status_page_key = CHRONY_STATUS_DEFAULT_KEY;
+
+/* Port on the loopback interface or path of the Unix domain socket on
+   which metrics are served and the minimum interval between refreshes
+   of the cached metrics */
+static int metrics_port = 0;
+static char *metrics_path = NULL;
+static double metrics_interval = 5.0;
+
 /* Name of a system timezone containing leap seconds occuring at midnight */
 static char *leapsec_tz = NULL;
 
+/* File with a list of leap seconds */
+static char *leapsec_file = NULL;
+
 /* Name of the user to which will be dropped root privileges. */
 static char *user = DEFAULT_USER;
 
@@ -228,6 +267,8 @@ typedef struct {
   IPAddr addr;
   unsigned short port;
   int interval;
+  int ttl;
+  char *iface;
 } NTP_Broadcast_Destination;
 
 static NTP_Broadcast_Destination *broadcasts = NULL;
@@ -381,8 +422,12 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_include(p);
   } else if (!strcasecmp(command, "initstepslew")) {
     parse_initstepslew(p);
+  } else if (!strcasecmp(command, "kernelpll")) {
+    parse_double(p, &kernel_pll_max_offset);
   } else if (!strcasecmp(command, "keyfile")) {
     parse_string(p, &keys_file);
+  } else if (!strcasecmp(command, "leapsecfile")) {
+    parse_string(p, &leapsec_file);
   } else if (!strcasecmp(command, "leapsectz")) {
     parse_string(p, &leapsec_tz);
   } else if (!strcasecmp(command, "linux_freq_scale")) {
@@ -397,6 +442,10 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_log(p);
   } else if (!strcasecmp(command, "logbanner")) {
     parse_int(p, &log_banner);
+  } else if (!strcasecmp(command, "logbuffer")) {
+    parse_logbuffer(p);
+  } else if (!strcasecmp(command, "logformat")) {
+    parse_logformat(p);
   } else if (!strcasecmp(command, "logchange")) {
     do_log_change = parse_double(p, &log_change_threshold);
   } else if (!strcasecmp(command, "logdir")) {
@@ -417,6 +466,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_double(p, &max_slew_rate);
   } else if (!strcasecmp(command, "maxupdateskew")) {
     parse_double(p, &max_update_skew);
+  } else if (!strcasecmp(command, "metrics")) {
+    parse_metrics(p);
   } else if (!strcasecmp(command, "minsamples")) {
     parse_int(p, &min_samples);
   } else if (!strcasecmp(command, "noclientlog")) {
@@ -437,6 +488,8 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_string(p, &rtc_device);
   } else if (!strcasecmp(command, "rtcfile")) {
     parse_string(p, &rtc_file);
+  } else if (!strcasecmp(command, "rtcondemand")) {
+    rtc_on_demand = parse_null(p);
   } else if (!strcasecmp(command, "rtconutc")) {
     rtc_on_utc = parse_null(p);
   } else if (!strcasecmp(command, "rtcsync")) {
@@ -445,10 +498,16 @@ CNF_ParseLine(const char *filename, int number, char *line)
     parse_int(p, &sched_priority);
   } else if (!strcasecmp(command, "server")) {
     parse_server(p);
+  } else if (!strcasecmp(command, "serverlatency")) {
+    measure_server_latency = parse_null(p);
+  } else if (!strcasecmp(command, "statuspage")) {
+    parse_statuspage(p);
   } else if (!strcasecmp(command, "stratumweight")) {
     parse_double(p, &stratum_weight);
   } else if (!strcasecmp(command, "tempcomp")) {
     parse_tempcomp(p);
+  } else if (!strcasecmp(command, "timerslack")) {
+    parse_double(p, &timer_slack);
   } else if (!strcasecmp(command, "user")) {
     parse_string(p, &user);
   } else {
@@ -739,6 +798,64 @@ parse_log(char *line)
 
 /* ================================================== */
 
+static void
+parse_logbuffer(char *line)
+{
+  long size;
+  int n;
+
+  n = sscanf(line, "%ld %lf", &size, &log_flush_interval);
+  if (n < 1) {
+    command_parse_error();
+    return;
+  }
+
+  check_number_of_args(line, n);
+
+  if (size < 0) {
+    other_parse_error("Invalid logbuffer size");
+    return;
+  }
+
+  log_buffer_size = size;
+
+  if (log_flush_interval <= 0.0)
+    other_parse_error("Invalid logbuffer flush interval");
+}
+
+/* ================================================== */
+
+static void
+parse_logformat(char *line)
+{
+  check_number_of_args(line, 1);
+  if (!strcasecmp(line, "text")) {
+    log_binary = 0;
+  } else if (!strcasecmp(line, "binary")) {
+    log_binary = 1;
+  } else {
+    command_parse_error();
+  }
+}
+
+/* ================================================== */
+
+static void
+parse_statuspage(char *line)
+{
+  status_page = 1;
+
+  if (!*line)
+    return;
+
+  check_number_of_args(line, 1);
+  if (sscanf(line, "%li", &status_page_key) != 1) {
+    command_parse_error();
+  }
+}
+
+/* ================================================== */
+
 static void
 parse_local(char *line)
 {
@@ -1051,7 +1168,15 @@ parse_bindcmdaddress(char *line)
   IPAddr ip;
 
   check_number_of_args(line, 1);
-  if (UTI_StringToIP(line, &ip)) {
+
+  /* Address starting with / is for the Unix domain socket */
+  if (line[0] == '/') {
+    /* / disables the socket */
+    if (!strcmp(line, "/"))
+      bind_cmd_path = "";
+    else
+      bind_cmd_path = strdup(line);
+  } else if (UTI_StringToIP(line, &ip)) {
     if (ip.family == IPADDR_INET4)
       bind_cmd_address4 = ip;
     else if (ip.family == IPADDR_INET6)
@@ -1066,10 +1191,10 @@ parse_bindcmdaddress(char *line)
 static void
 parse_broadcast(char *line)
 {
-  /* Syntax : broadcast <interval> <broadcast-IP-addr> [<port>] */
-  int port;
-  int interval;
-  char *p;
+  /* Syntax : broadcast <interval> <broadcast-IP-addr> [<port>]
+                        [ttl <ttl>] [interface <name>] */
+  int port, interval, ttl;
+  char *p, *iface;
   IPAddr ip;
   
   p = line;
@@ -1088,17 +1213,45 @@ parse_broadcast(char *line)
     return;
   }
 
+  /* default port */
+  port = 123;
+  ttl = 1;
+  iface = NULL;
+
   p = line;
   line = CPS_SplitWord(line);
 
-  if (*p) {
-    if (sscanf(p, "%d", &port) != 1 || *line) {
+  if (*p && isdigit((unsigned char)*p)) {
+    if (sscanf(p, "%d", &port) != 1) {
       command_parse_error();
       return;
     }
-  } else {
-    /* default port */
-    port = 123;
+    p = line;
+    line = CPS_SplitWord(line);
+  }
+
+  while (*p) {
+    if (!strcasecmp(p, "ttl")) {
+      p = line;
+      line = CPS_SplitWord(line);
+      if (sscanf(p, "%d", &ttl) != 1 || ttl < 0 || ttl > 255) {
+        command_parse_error();
+        return;
+      }
+    } else if (!strcasecmp(p, "interface")) {
+      p = line;
+      line = CPS_SplitWord(line);
+      if (!*p) {
+        command_parse_error();
+        return;
+      }
+      iface = p;
+    } else {
+      command_parse_error();
+      return;
+    }
+    p = line;
+    line = CPS_SplitWord(line);
   }
 
   if (max_broadcasts == n_broadcasts) {
@@ -1114,11 +1267,53 @@ parse_broadcast(char *line)
   broadcasts[n_broadcasts].addr = ip;
   broadcasts[n_broadcasts].port = port;
   broadcasts[n_broadcasts].interval = interval;
+  broadcasts[n_broadcasts].ttl = ttl;
+  broadcasts[n_broadcasts].iface = iface ? strdup(iface) : NULL;
   ++n_broadcasts;
 }
 
 /* ================================================== */
 
+static void
+parse_metrics(char *line)
+{
+  char *p;
+
+  p = line;
+  line = CPS_SplitWord(line);
+
+  /* Address starting with / is for the Unix domain socket */
+  if (p[0] == '/') {
+    metrics_path = strdup(p);
+  } else if (sscanf(p, "%d", &metrics_port) != 1 ||
+             metrics_port <= 0 || metrics_port > 65535) {
+    metrics_port = 0;
+    command_parse_error();
+    return;
+  }
+
+  p = line;
+  line = CPS_SplitWord(line);
+
+  while (*p) {
+    if (!strcasecmp(p, "interval")) {
+      p = line;
+      line = CPS_SplitWord(line);
+      if (sscanf(p, "%lf", &metrics_interval) != 1 || metrics_interval < 0.0) {
+        command_parse_error();
+        return;
+      }
+    } else {
+      command_parse_error();
+      return;
+    }
+    p = line;
+    line = CPS_SplitWord(line);
+  }
+}
+
+/* ================================================== */
+
 static void
 parse_tempcomp(char *line)
 {
@@ -1206,7 +1401,9 @@ CNF_AddBroadcasts(void)
   for (i=0; i<n_broadcasts; i++) {
     BRD_AddDestination(&broadcasts[i].addr,
                        broadcasts[i].port,
-                       broadcasts[i].interval);
+                       broadcasts[i].interval,
+                       broadcasts[i].ttl,
+                       broadcasts[i].iface);
   }
 }
 
@@ -1244,6 +1441,23 @@ CNF_GetLogBanner(void)
 
 /* ================================================== */
 
+void
+CNF_GetLogBuffer(unsigned long *size, double *flush_interval)
+{
+  *size = log_buffer_size;
+  *flush_interval = log_flush_interval;
+}
+
+/* ================================================== */
+
+int
+CNF_GetLogBinary(void)
+{
+  return log_binary;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetLogDir(void)
 {
@@ -1356,6 +1570,14 @@ CNF_GetGenerateCommandKey(void)
 
 /* ================================================== */
 
+int
+CNF_GetServerLatency(void)
+{
+  return measure_server_latency;
+}
+
+/* ================================================== */
+
 int
 CNF_GetDumpOnExit(void)
 {
@@ -1396,6 +1618,22 @@ CNF_GetMaxSlewRate(void)
 
 /* ================================================== */
 
+double
+CNF_GetTimerSlack(void)
+{
+  return timer_slack;
+}
+
+/* ================================================== */
+
+double
+CNF_GetKernelPllMaxOffset(void)
+{
+  return kernel_pll_max_offset;
+}
+
+/* ================================================== */
+
 double
 CNF_GetReselectDistance(void)
 {
@@ -1464,6 +1702,14 @@ CNF_GetRtcSync(void)
 
 /* ================================================== */
 
+int
+CNF_GetRtcOnDemand(void)
+{
+  return rtc_on_demand;
+}
+
+/* ================================================== */
+
 void
 CNF_GetMakeStep(int *limit, double *threshold)
 {
@@ -1595,6 +1841,14 @@ CNF_GetBindCommandAddress(int family, IPAddr *addr)
 
 /* ================================================== */
 
+char *
+CNF_GetBindCommandPath(void)
+{
+  return bind_cmd_path;
+}
+
+/* ================================================== */
+
 char *
 CNF_GetPidFile(void)
 {
@@ -1611,6 +1865,14 @@ CNF_GetLeapSecTimezone(void)
 
 /* ================================================== */
 
+char *
+CNF_GetLeapSecFile(void)
+{
+  return leapsec_file;
+}
+
+/* ================================================== */
+
 int
 CNF_GetSchedPriority(void)
 {
@@ -1685,3 +1947,22 @@ CNF_GetInitStepThreshold(void)
 {
   return init_slew_threshold;
 }
+
+/* ================================================== */
+
+int
+CNF_GetStatusPage(long *key)
+{
+  *key = status_page_key;
+  return status_page;
+}
+
+/* ================================================== */
+
+void
+CNF_GetMetrics(int *port, char **path, double *interval)
+{
+  *port = metrics_port;
+  *path = metrics_path;
+  *interval = metrics_interval;
+}
@@ -0,0 +1,29 @@
+#define LINUX 1
+#define HAVE_LONG_TIME_T 1
+#define NTP_ERA_SPLIT (1792377952LL - 18250 * 24 * 3600)
+#define HAS_STDINT_H 1
+#define HAS_INTTYPES_H 1
+#define HAVE_IPV6 1
+#define _GNU_SOURCE 1
+#define HAVE_IN6_PKTINFO 1
+#define HAVE_RECVMMSG 1
+#define HAVE_SENDMMSG 1
+#define HAVE_DLADDR 1
+#define HAVE_GETADDRINFO 1
+#define FEAT_ASYNCDNS 1
+#define USE_PTHREAD_ASYNCDNS 1
+#define FEAT_ASYNCLOG 1
+#define FEAT_RTC 1
+#define FEAT_PHC 1
+#define HAVE_CLOCK_ADJTIME 1
+#define HAVE_SCHED_SETSCHEDULER 1
+#define HAVE_MLOCKALL 1
+#define FORCE_DNSRETRY 1
+#define FEAT_READLINE 1
+#define GENERATE_SHA1_KEY 1
+#define DEBUG 0
+#define DEFAULT_CONF_FILE "/etc/chrony.conf"
+#define DEFAULT_COMMAND_SOCKET "/var/run/chrony/chronyd.sock"
+#define DEFAULT_USER "root"
+#define MAIL_PROGRAM "/usr/lib/sendmail"
+#define CHRONY_VERSION "1.31.1"
@@ -0,0 +1,58 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Counters of events on the hot paths of the daemon (received and sent
+  packets, failed tests, scheduler dispatches, etc).  The counters are
+  kept in one array, so incrementing them is cheap and they can be
+  reported in bulk.
+
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "counters.h"
+#include "logging.h"
+
+/* ================================================== */
+
+uint64_t CNT_Counters[CNT_Max];
+
+/* ================================================== */
+
+void
+CNT_GetCounters(uint64_t *counters)
+{
+  unsigned long bytes, dropped;
+
+  memcpy(counters, CNT_Counters, sizeof (CNT_Counters));
+
+  /* These are updated by the logging code, which may run in a separate
+     thread */
+  LOG_GetFileLogStats(&bytes, &dropped);
+  counters[CNT_LogBytes] = bytes;
+  counters[CNT_LogDropped] = dropped;
+}
+
+/* ================================================== */
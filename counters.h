@@ -0,0 +1,83 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Header file for the counters of events on the hot paths of the daemon.
+
+  */
+
+#ifndef GOT_COUNTERS_H
+#define GOT_COUNTERS_H
+
+#include "sysincl.h"
+
+/* The order of the counters is used in the SERVER_COUNTERS reply, new
+   counters need to be added at the end (before CNT_Max) and their names
+   added to chronyc */
+typedef enum {
+  CNT_NtpServerRx4,
+  CNT_NtpServerRx6,
+  CNT_NtpClientRx4,
+  CNT_NtpClientRx6,
+  CNT_NtpServerTx4,
+  CNT_NtpServerTx6,
+  CNT_NtpClientTx4,
+  CNT_NtpClientTx6,
+  CNT_NtpRxDropped,
+  CNT_NtpTxErrors,
+  CNT_NtpTest1Failed,
+  CNT_NtpTest2Failed,
+  CNT_NtpTest3Failed,
+  CNT_NtpTest4Failed,
+  CNT_NtpTest4aFailed,
+  CNT_NtpTest4bFailed,
+  CNT_NtpTest4cFailed,
+  CNT_NtpTest5Failed,
+  CNT_NtpTest6Failed,
+  CNT_NtpTest7Failed,
+  CNT_NtpTest8Failed,
+  CNT_NtpAuthFailed,
+  CNT_CmdRxUnix,
+  CNT_CmdRx4,
+  CNT_CmdRx6,
+  CNT_CmdTx,
+  CNT_CmdRxDropped,
+  CNT_CmdAuthFailed,
+  CNT_SchIterations,
+  CNT_SchTimeouts,
+  CNT_SchFileHandlers,
+  CNT_Regressions,
+  CNT_Selections,
+  CNT_LogBytes,
+  CNT_LogDropped,
+  CNT_Max
+} CNT_Counter;
+
+extern uint64_t CNT_Counters[CNT_Max];
+
+/* Increment a counter */
+#define CNT_INC(counter) (CNT_Counters[(counter)]++)
+
+/* Get the current values of all counters */
+extern void CNT_GetCounters(uint64_t *counters);
+
+#endif /* GOT_COUNTERS_H */
@@ -145,8 +145,8 @@ static int
 determine_hash_delay(unsigned long key_id)
 {
   NTP_Packet pkt;
-  struct timeval before, after;
-  unsigned long usecs, min_usecs=0;
+  struct timespec before, after;
+  unsigned long nsecs, min_nsecs=0;
   int i;
 
   for (i = 0; i < 10; i++) {
@@ -155,19 +155,19 @@ determine_hash_delay(unsigned long key_id)
         (unsigned char *)&pkt.auth_data, sizeof (pkt.auth_data));
     LCL_ReadRawTime(&after);
 
-    usecs = (after.tv_sec - before.tv_sec) * 1000000 + (after.tv_usec - before.tv_usec);
+    nsecs = (after.tv_sec - before.tv_sec) * 1000000000 + (after.tv_nsec - before.tv_nsec);
 
-    if (i == 0 || usecs < min_usecs) {
-      min_usecs = usecs;
+    if (i == 0 || nsecs < min_nsecs) {
+      min_nsecs = nsecs;
     }
   }
 
   /* Add on a bit extra to allow for copying, conversions etc */
-  min_usecs += min_usecs >> 4;
+  min_nsecs += min_nsecs >> 4;
 
-  DEBUG_LOG(LOGF_Keys, "authentication delay for key %lu: %ld useconds", key_id, min_usecs);
+  DEBUG_LOG(LOGF_Keys, "authentication delay for key %lu: %lu nseconds", key_id, min_nsecs);
 
-  return min_usecs;
+  return min_nsecs;
 }
 
 /* ================================================== */
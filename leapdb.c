@@ -0,0 +1,449 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Table of leap seconds loaded from a file in the leap-seconds.list
+  format (as distributed by IERS and NIST), the leapseconds file from
+  the tz database, or a compiled timezone file from a zoneinfo
+  directory (e.g. right/UTC).  The leap second for the current day is
+  cached, so the lookup doesn't need to search the table or touch the
+  timezone state of the C library.
+
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "conf.h"
+#include "leapdb.h"
+#include "logging.h"
+#include "memory.h"
+#include "util.h"
+
+/* ================================================== */
+
+/* Default directory with compiled timezone files, TZDIR overrides it */
+#define ZONEINFO_DIR "/usr/share/zoneinfo"
+
+/* Difference between the NTP and Unix epoch in seconds */
+#define NTP_UNIX_OFFSET 2208988800UL
+
+#define SECS_PER_DAY 86400
+
+/* Time of a leap second included in the table */
+struct LeapEntry {
+  /* Start of the UTC day following the leap second */
+  time_t when;
+  /* +1 for inserted second, -1 for deleted second */
+  int leap;
+};
+
+static struct LeapEntry *table;
+static int table_size;
+
+/* Time when the table expires, zero if unknown */
+static time_t table_expiry;
+
+/* Path of the file and whether it is a compiled timezone file */
+static char *table_file;
+static int table_tzif;
+
+/* Start of the day for which the leap second was last looked up */
+static time_t cached_day;
+static NTP_Leap cached_leap;
+
+static int expiry_warned;
+
+/* ================================================== */
+
+/* Return the number of days since 1970-01-01 of the specified date in the
+   proleptic Gregorian calendar */
+
+static long
+days_from_civil(int year, int month, int day)
+{
+  long era, yoe, doy, doe;
+
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + doe - 719468;
+}
+
+/* ================================================== */
+
+static int
+parse_month(const char *name)
+{
+  const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                          "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  int i;
+
+  for (i = 0; i < 12; i++) {
+    if (!strcasecmp(name, months[i]))
+      return i + 1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+add_entry(struct LeapEntry **entries, int *size, time_t when, int leap)
+{
+  /* Leap seconds can occur only at the end of a day and the entries
+     need to be in order */
+  if (when <= 0 || when % SECS_PER_DAY != 0 || (leap != 1 && leap != -1) ||
+      (*size > 0 && (*entries)[*size - 1].when >= when))
+    return 0;
+
+  *entries = ReallocArray(struct LeapEntry, *size + 1, *entries);
+  (*entries)[*size].when = when;
+  (*entries)[*size].leap = leap;
+  (*size)++;
+
+  return 1;
+}
+
+/* ================================================== */
+/* Read a file in the leap-seconds.list or tz leapseconds format */
+
+static int
+read_list_file(FILE *f, struct LeapEntry **entries, int *size, time_t *expiry)
+{
+  char line[256], month[4], sign;
+  unsigned long ntp_time;
+  int year, mon, day, hour, min, sec, tai_offset, prev_tai_offset;
+  int line_number;
+  long expires;
+
+  prev_tai_offset = 0;
+
+  for (line_number = 1; fgets(line, sizeof (line), f); line_number++) {
+    if (!strncmp(line, "#@", 2)) {
+      /* Expiry in the leap-seconds.list format */
+      if (sscanf(line + 2, "%lu", &ntp_time) != 1)
+        break;
+      *expiry = ntp_time - NTP_UNIX_OFFSET;
+    } else if (!strncmp(line, "#expires", 8)) {
+      /* Expiry in the tz leapseconds format */
+      if (sscanf(line + 8, "%ld", &expires) != 1)
+        break;
+      *expiry = expires;
+    } else if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+      continue;
+    } else if (!strncmp(line, "Leap", 4)) {
+      if (sscanf(line + 4, "%d %3s %d %d:%d:%d %c", &year, month, &day,
+                 &hour, &min, &sec, &sign) != 7 || !(mon = parse_month(month)) ||
+          (sign != '+' && sign != '-') ||
+          !add_entry(entries, size, (days_from_civil(year, mon, day) + 1) * SECS_PER_DAY,
+                     sign == '+' ? 1 : -1))
+        break;
+    } else if (!strncmp(line, "Expires", 7)) {
+      if (sscanf(line + 7, "%d %3s %d %d:%d:%d", &year, month, &day,
+                 &hour, &min, &sec) != 6 || !(mon = parse_month(month)))
+        break;
+      *expiry = days_from_civil(year, mon, day) * SECS_PER_DAY +
+                hour * 3600 + min * 60 + sec;
+    } else {
+      /* Line with NTP time and TAI-UTC offset in the leap-seconds.list
+         format, the first line sets only the initial offset */
+      if (sscanf(line, "%lu %d", &ntp_time, &tai_offset) != 2 || ntp_time < NTP_UNIX_OFFSET)
+        break;
+      if (prev_tai_offset &&
+          !add_entry(entries, size, ntp_time - NTP_UNIX_OFFSET, tai_offset - prev_tai_offset))
+        break;
+      prev_tai_offset = tai_offset;
+    }
+  }
+
+  if (!feof(f)) {
+    LOG(LOGS_WARN, LOGF_LeapDb, "Could not parse line %d in %s", line_number, table_file);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static uint32_t
+read_tzif_number(const unsigned char *buf)
+{
+  return (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 | (uint32_t)buf[2] << 8 | buf[3];
+}
+
+/* ================================================== */
+
+static int64_t
+read_tzif_number64(const unsigned char *buf)
+{
+  return (int64_t)((uint64_t)read_tzif_number(buf) << 32 | read_tzif_number(buf + 4));
+}
+
+/* ================================================== */
+/* Read the header of a data block, return the version of the file */
+
+static int
+read_tzif_header(FILE *f, uint32_t *counts)
+{
+  unsigned char header[44];
+  int i;
+
+  if (fread(header, sizeof (header), 1, f) != 1 || memcmp(header, "TZif", 4))
+    return -1;
+
+  /* Counts of UT/local indicators, standard/wall indicators, leap second
+     records, transition times, local time types and characters */
+  for (i = 0; i < 6; i++)
+    counts[i] = read_tzif_number(header + 20 + i * 4);
+
+  return header[4] ? header[4] - '0' : 1;
+}
+
+/* ================================================== */
+/* Read leap second records from a compiled timezone file.  In files of
+   version 2 and later the version 1 data block (which may be empty if the
+   file was compiled with zic -b slim) is skipped and the second block with
+   64-bit times is used.  The times of the records include the previous
+   corrections. */
+
+static int
+read_tzif_file(FILE *f, struct LeapEntry **entries, int *size)
+{
+  unsigned char record[12];
+  uint32_t counts[6], i, time_size;
+  int64_t t;
+  int32_t correction, prev_correction;
+  int version;
+
+  version = read_tzif_header(f, counts);
+  if (version < 0) {
+    LOG(LOGS_WARN, LOGF_LeapDb, "%s is not a timezone file", table_file);
+    return 0;
+  }
+
+  time_size = 4;
+
+  if (version >= 2) {
+    /* Skip the whole version 1 data block */
+    if (fseek(f, counts[3] * 5 + counts[4] * 6 + counts[5] + counts[2] * 8 +
+              counts[1] + counts[0], SEEK_CUR) < 0 ||
+        read_tzif_header(f, counts) < 2) {
+      LOG(LOGS_WARN, LOGF_LeapDb, "Invalid second header in %s", table_file);
+      return 0;
+    }
+    time_size = 8;
+  }
+
+  if (fseek(f, counts[3] * (time_size + 1) + counts[4] * 6 + counts[5], SEEK_CUR) < 0)
+    return 0;
+
+  prev_correction = 0;
+
+  for (i = 0; i < counts[2]; i++) {
+    if (fread(record, time_size + 4, 1, f) != 1)
+      return 0;
+
+    if (time_size == 8)
+      t = read_tzif_number64(record);
+    else
+      t = (int32_t)read_tzif_number(record);
+    correction = read_tzif_number(record + time_size);
+
+    if (!add_entry(entries, size, t - prev_correction, correction - prev_correction)) {
+      LOG(LOGS_WARN, LOGF_LeapDb, "Invalid leap second record in %s", table_file);
+      return 0;
+    }
+
+    prev_correction = correction;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+load_table(void)
+{
+  struct LeapEntry *entries;
+  time_t expiry;
+  int i, size, ok;
+  FILE *f;
+
+  f = fopen(table_file, "r");
+  if (!f) {
+    LOG(LOGS_WARN, LOGF_LeapDb, "Could not open %s : %s", table_file, strerror(errno));
+    return 0;
+  }
+
+  entries = NULL;
+  size = 0;
+  expiry = 0;
+
+  if (table_tzif)
+    ok = read_tzif_file(f, &entries, &size);
+  else
+    ok = read_list_file(f, &entries, &size, &expiry);
+
+  fclose(f);
+
+  /* Check that the table has the leap second of Dec 31 2008 */
+  if (ok) {
+    for (i = 0; i < size; i++) {
+      if (entries[i].when == 1230768000 && entries[i].leap == 1)
+        break;
+    }
+    if (i == size) {
+      LOG(LOGS_WARN, LOGF_LeapDb, "%s failed leap second check", table_file);
+      ok = 0;
+    }
+  }
+
+  if (!ok) {
+    Free(entries);
+    return 0;
+  }
+
+  Free(table);
+  table = entries;
+  table_size = size;
+  table_expiry = expiry;
+
+  /* Force new lookup */
+  cached_day = -1;
+  expiry_warned = 0;
+
+  LOG(LOGS_INFO, LOGF_LeapDb, "Loaded %d leap seconds from %s%s%s", size, table_file,
+      expiry ? ", expires " : "", expiry ? UTI_TimeToLogForm(expiry) : "");
+
+  return 1;
+}
+
+/* ================================================== */
+
+void
+LDB_Initialise(void)
+{
+  char *file, *tz, *dir;
+
+  table = NULL;
+  table_size = 0;
+  table_expiry = 0;
+  table_file = NULL;
+  cached_day = -1;
+  cached_leap = LEAP_Normal;
+
+  file = CNF_GetLeapSecFile();
+  tz = CNF_GetLeapSecTimezone();
+
+  if (file) {
+    table_file = strdup(file);
+    table_tzif = 0;
+  } else if (tz) {
+    if (tz[0] == '/') {
+      table_file = strdup(tz);
+    } else {
+      dir = getenv("TZDIR");
+      if (!dir || !dir[0])
+        dir = ZONEINFO_DIR;
+      table_file = Malloc(strlen(dir) + strlen(tz) + 2);
+      sprintf(table_file, "%s/%s", dir, tz);
+    }
+    table_tzif = 1;
+  } else {
+    return;
+  }
+
+  if (!load_table())
+    LOG(LOGS_WARN, LOGF_LeapDb, "Ignoring leap second data from %s", table_file);
+}
+
+/* ================================================== */
+
+void
+LDB_Finalise(void)
+{
+  Free(table);
+  free(table_file);
+}
+
+/* ================================================== */
+
+int
+LDB_IsActive(void)
+{
+  return table_size > 0;
+}
+
+/* ================================================== */
+
+NTP_Leap
+LDB_GetLeap(time_t when)
+{
+  time_t day;
+  int i;
+
+  if (when <= 0)
+    return LEAP_Normal;
+
+  day = when - when % SECS_PER_DAY;
+
+  if (day == cached_day)
+    return cached_leap;
+
+  cached_day = day;
+  cached_leap = LEAP_Normal;
+
+  if (table_expiry && day + SECS_PER_DAY > table_expiry && !expiry_warned) {
+    LOG(LOGS_WARN, LOGF_LeapDb, "Leap second data from %s expired", table_file);
+    expiry_warned = 1;
+  }
+
+  for (i = table_size - 1; i >= 0 && table[i].when > day; i--) {
+    if (table[i].when == day + SECS_PER_DAY) {
+      cached_leap = table[i].leap > 0 ? LEAP_InsertSecond : LEAP_DeleteSecond;
+      break;
+    }
+  }
+
+  return cached_leap;
+}
+
+/* ================================================== */
+
+int
+LDB_Reload(void)
+{
+  if (!table_file)
+    return 0;
+
+  return load_table();
+}
+
+/* ================================================== */
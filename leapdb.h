@@ -0,0 +1,47 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Header file for the table of leap seconds.
+
+  */
+
+#ifndef GOT_LEAPDB_H
+#define GOT_LEAPDB_H
+
+#include "ntp.h"
+
+extern void LDB_Initialise(void);
+extern void LDB_Finalise(void);
+
+/* Return non-zero if a table of leap seconds is loaded */
+extern int LDB_IsActive(void);
+
+/* Return the leap second scheduled at the end of the UTC day containing
+   the specified time */
+extern NTP_Leap LDB_GetLeap(time_t when);
+
+/* Reload the table from the file, return 0 on error (the previous table
+   is kept) */
+extern int LDB_Reload(void);
+
+#endif /* GOT_LEAPDB_H */
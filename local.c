@@ -104,34 +104,34 @@ static double max_clock_error;
 static void
 calculate_sys_precision(void)
 {
-  struct timeval tv, old_tv;
-  int dusec, best_dusec;
+  struct timespec ts, old_ts;
+  int dnsec, best_dnsec;
   int iters;
 
-  gettimeofday(&old_tv, NULL);
-  best_dusec = 1000000; /* Assume we must be better than a second */
+  LCL_ReadRawTime(&old_ts);
+  best_dnsec = 1000000000; /* Assume we must be better than a second */
   iters = 0;
   do {
-    gettimeofday(&tv, NULL);
-    dusec = 1000000*(tv.tv_sec - old_tv.tv_sec) + (tv.tv_usec - old_tv.tv_usec);
-    old_tv = tv;
-    if (dusec > 0)  {
-      if (dusec < best_dusec) {
-        best_dusec = dusec;
+    LCL_ReadRawTime(&ts);
+    dnsec = 1000000000 * (ts.tv_sec - old_ts.tv_sec) + (ts.tv_nsec - old_ts.tv_nsec);
+    old_ts = ts;
+    if (dnsec > 0)  {
+      if (dnsec < best_dnsec) {
+        best_dnsec = dnsec;
       }
       iters++;
     }
   } while (iters < NITERS);
 
-  assert(best_dusec > 0);
+  assert(best_dnsec > 0);
 
-  precision_quantum = best_dusec * 1.0e-6;
+  precision_quantum = best_dnsec * 1.0e-9;
 
   /* Get rounded log2 value of the measured precision */
   precision_log = 0;
-  while (best_dusec < 707107) {
+  while (best_dnsec < 707106781) {
     precision_log--;
-    best_dusec *= 2;
+    best_dnsec *= 2;
   }
 
   DEBUG_LOG(LOGF_Local, "Clock precision %.9f (%d)", precision_quantum, precision_log);
@@ -261,7 +261,7 @@ LCL_IsFirstParameterChangeHandler(LCL_ParameterChangeHandler handler)
 /* ================================================== */
 
 static void
-invoke_parameter_change_handlers(struct timeval *raw, struct timeval *cooked,
+invoke_parameter_change_handlers(struct timespec *raw, struct timespec *cooked,
                                  double dfreq, double doffset,
                                  LCL_ChangeType change_type)
 {
@@ -328,23 +328,23 @@ void LCL_RemoveDispersionNotifyHandler(LCL_DispersionNotifyHandler handler, void
 }
 
 /* ================================================== */
-/* At the moment, this is just gettimeofday(), because
+/* At the moment, this is just clock_gettime(CLOCK_REALTIME), because
    I can't think of a Unix system where it would not be */
 
 void
-LCL_ReadRawTime(struct timeval *result)
+LCL_ReadRawTime(struct timespec *result)
 {
-  if (gettimeofday(result, NULL) < 0) {
-    LOG_FATAL(LOGF_Local, "gettimeofday() failed");
+  if (clock_gettime(CLOCK_REALTIME, result) < 0) {
+    LOG_FATAL(LOGF_Local, "clock_gettime() failed");
   }
 }
 
 /* ================================================== */
 
 void
-LCL_ReadCookedTime(struct timeval *result, double *err)
+LCL_ReadCookedTime(struct timespec *result, double *err)
 {
-  struct timeval raw;
+  struct timespec raw;
 
   LCL_ReadRawTime(&raw);
   LCL_CookTime(&raw, result, err);
@@ -353,18 +353,18 @@ LCL_ReadCookedTime(struct timeval *result, double *err)
 /* ================================================== */
 
 void
-LCL_CookTime(struct timeval *raw, struct timeval *cooked, double *err)
+LCL_CookTime(struct timespec *raw, struct timespec *cooked, double *err)
 {
   double correction;
 
   LCL_GetOffsetCorrection(raw, &correction, err);
-  UTI_AddDoubleToTimeval(raw, correction, cooked);
+  UTI_AddDoubleToTimespec(raw, correction, cooked);
 }
 
 /* ================================================== */
 
 void
-LCL_GetOffsetCorrection(struct timeval *raw, double *correction, double *err)
+LCL_GetOffsetCorrection(struct timespec *raw, double *correction, double *err)
 {
   /* Call system specific driver to get correction */
   (*drv_offset_convert)(raw, correction, err);
@@ -395,7 +395,7 @@ LCL_ReadAbsoluteFrequency(void)
 void
 LCL_SetAbsoluteFrequency(double afreq_ppm)
 {
-  struct timeval raw, cooked;
+  struct timespec raw, cooked;
   double dfreq;
   
   /* Apply temperature compensation */
@@ -424,7 +424,7 @@ LCL_SetAbsoluteFrequency(double afreq_ppm)
 void
 LCL_AccumulateDeltaFrequency(double dfreq)
 {
-  struct timeval raw, cooked;
+  struct timespec raw, cooked;
   double old_freq_ppm;
 
   old_freq_ppm = current_freq_ppm;
@@ -451,7 +451,7 @@ LCL_AccumulateDeltaFrequency(double dfreq)
 void
 LCL_AccumulateOffset(double offset, double corr_rate)
 {
-  struct timeval raw, cooked;
+  struct timespec raw, cooked;
 
   /* In this case, the cooked time to be passed to the notify clients
      has to be the cooked time BEFORE the change was made */
@@ -470,7 +470,7 @@ LCL_AccumulateOffset(double offset, double corr_rate)
 void
 LCL_ApplyStepOffset(double offset)
 {
-  struct timeval raw, cooked;
+  struct timespec raw, cooked;
 
   /* In this case, the cooked time to be passed to the notify clients
      has to be the cooked time BEFORE the change was made */
@@ -487,7 +487,7 @@ LCL_ApplyStepOffset(double offset)
 /* ================================================== */
 
 void
-LCL_NotifyExternalTimeStep(struct timeval *raw, struct timeval *cooked,
+LCL_NotifyExternalTimeStep(struct timespec *raw, struct timespec *cooked,
     double offset, double dispersion)
 {
   /* Dispatch to all handlers */
@@ -501,7 +501,7 @@ LCL_NotifyExternalTimeStep(struct timeval *raw, struct timeval *cooked,
 void
 LCL_AccumulateFrequencyAndOffset(double dfreq, double doffset, double corr_rate)
 {
-  struct timeval raw, cooked;
+  struct timespec raw, cooked;
   double old_freq_ppm;
 
   LCL_ReadRawTime(&raw);
@@ -571,7 +571,7 @@ lcl_RegisterSystemDrivers(lcl_ReadFrequencyDriver read_freq,
 int
 LCL_MakeStep(void)
 {
-  struct timeval raw;
+  struct timespec raw;
   double correction;
 
   LCL_ReadRawTime(&raw);
@@ -29,8 +29,10 @@
 
 #include "sysincl.h"
 
+#include "binlog.h"
 #include "conf.h"
 #include "logging.h"
+#include "memory.h"
 #include "mkdirpp.h"
 #include "util.h"
 
@@ -56,8 +58,11 @@ static FILE *logfile;
 struct LogFile {
   const char *name;
   const char *banner;
+  int binary_type;
+  int record_length;
   FILE *file;
   unsigned long writes;
+  int close_pending;
 };
 
 static int n_filelogs = 0;
@@ -67,6 +72,46 @@ static int n_filelogs = 0;
 
 static struct LogFile logfiles[MAX_FILELOGS];
 
+/* Statistics of the file logging */
+static unsigned long written_bytes = 0;
+static unsigned long dropped_records = 0;
+static unsigned long dropped_records_reported = 0;
+
+#ifdef FEAT_ASYNCLOG
+#include <poll.h>
+#include <pthread.h>
+
+/* With buffered logging, preformatted records are copied by the main thread
+   to a ring buffer and written to the files by a separate thread.  The head
+   is written only by the main thread and the tail only by the writer thread,
+   so no locking is needed.  Each record starts with this header.  A negative
+   length means the file should be closed. */
+struct RecordHeader {
+  FILE *file;
+  int length;
+};
+
+#define MAX_RING_SIZE (1UL << 30)
+
+/* Size of the ring buffer (a power of two), zero if buffered logging is
+   disabled.  The head and tail are free-running positions reduced by
+   masking, which stays correct when the counters wrap around. */
+static unsigned long ring_size = 0;
+static char *ring_buffer;
+static unsigned long ring_head;
+static unsigned long ring_tail;
+
+static int writer_running = 0;
+static int writer_quit;
+static int writer_timeout;
+static int writer_pipe[2];
+static pthread_t writer_thread;
+
+static void start_writer(void);
+static void stop_writer(void);
+static int enqueue_record(FILE *file, const char *data, int length);
+#endif
+
 /* ================================================== */
 /* Init function */
 
@@ -98,6 +143,13 @@ LOG_Finalise(void)
 
   LOG_CycleLogFiles();
 
+#ifdef FEAT_ASYNCLOG
+  stop_writer();
+#endif
+
+  if (dropped_records)
+    LOG(LOGS_WARN, LOGF_Logging, "%lu log records were dropped", dropped_records);
+
   initialised = 0;
 }
 
@@ -237,67 +289,233 @@ LOG_CloseParentFd()
 
 /* ================================================== */
 
-LOG_FileID
-LOG_FileOpen(const char *name, const char *banner)
+static LOG_FileID
+add_file(const char *name, const char *banner, int binary_type, int record_length)
 {
   assert(n_filelogs < MAX_FILELOGS);
 
+#ifdef FEAT_ASYNCLOG
+  if (!n_filelogs)
+    start_writer();
+#endif
+
   logfiles[n_filelogs].name = name;
   logfiles[n_filelogs].banner = banner;
+  logfiles[n_filelogs].binary_type = binary_type;
+  logfiles[n_filelogs].record_length = record_length;
   logfiles[n_filelogs].file = NULL;
   logfiles[n_filelogs].writes = 0;
+  logfiles[n_filelogs].close_pending = 0;
 
   return n_filelogs++;
 }
 
 /* ================================================== */
 
-void
-LOG_FileWrite(LOG_FileID id, const char *format, ...)
+LOG_FileID
+LOG_FileOpen(const char *name, const char *banner)
 {
-  va_list other_args;
-  int banner;
+  return add_file(name, banner, 0, 0);
+}
+
+/* ================================================== */
+
+LOG_FileID
+LOG_FileOpenBinary(const char *name, int type, int record_length)
+{
+  return add_file(name, NULL, type, record_length);
+}
+
+/* ================================================== */
+
+int
+LOG_FileIsBinary(LOG_FileID id)
+{
+  if (id < 0 || id >= n_filelogs)
+    return 0;
+
+  return logfiles[id].binary_type != 0;
+}
+
+/* ================================================== */
+
+/* Check the header of an existing binary file, or write a new one */
+
+static int
+check_binary_header(LOG_FileID id)
+{
+  BLG_FileHeader header;
+  FILE *f = logfiles[id].file;
+
+  if (fseek(f, 0, SEEK_END) < 0)
+    return 0;
+
+  if (ftell(f) > 0) {
+    rewind(f);
+    if (fread(&header, sizeof (header), 1, f) != 1 ||
+        ntohl(header.magic) != BLG_MAGIC ||
+        ntohs(header.version) != BLG_VERSION ||
+        ntohs(header.type) != logfiles[id].binary_type ||
+        ntohl(header.record_length) != logfiles[id].record_length)
+      return 0;
+    return fseek(f, 0, SEEK_END) == 0;
+  }
+
+  header.magic = htonl(BLG_MAGIC);
+  header.version = htons(BLG_VERSION);
+  header.type = htons(logfiles[id].binary_type);
+  header.record_length = htonl(logfiles[id].record_length);
+
+  return fwrite(&header, sizeof (header), 1, f) == 1 && fflush(f) == 0;
+}
+
+/* ================================================== */
+
+/* Close a file, or let the writer close it after writing the buffered
+   records.  If the buffer is full, the file is kept open and closing is
+   tried again on its next write instead of waiting for the writer. */
+
+static int
+close_file(LOG_FileID id)
+{
+#ifdef FEAT_ASYNCLOG
+  if (writer_running) {
+    if (!enqueue_record(logfiles[id].file, NULL, -1)) {
+      logfiles[id].close_pending = 1;
+      return 0;
+    }
+  } else
+#endif
+    fclose(logfiles[id].file);
+
+  logfiles[id].file = NULL;
+  logfiles[id].writes = 0;
+  logfiles[id].close_pending = 0;
+
+  return 1;
+}
+
+/* ================================================== */
+
+static int
+open_file(LOG_FileID id)
+{
+  char filename[512];
 
   if (id < 0 || id >= n_filelogs || !logfiles[id].name)
-    return;
+    return 0;
+
+  if (logfiles[id].close_pending)
+    close_file(id);
+
+  if (logfiles[id].file)
+    return 1;
 
-  if (!logfiles[id].file) {
-    char filename[512];
+  if (snprintf(filename, sizeof(filename), "%s/%s.%s", CNF_GetLogDir(),
+        logfiles[id].name, logfiles[id].binary_type ? "bin" : "log") >= sizeof(filename) ||
+      !(logfiles[id].file = fopen(filename, logfiles[id].binary_type ? "a+" : "a"))) {
+    LOG(LOGS_WARN, LOGF_Refclock, "Couldn't open logfile %s for update", filename);
+    logfiles[id].name = NULL;
+    return 0;
+  }
+
+  /* Close on exec */
+  UTI_FdSetCloexec(fileno(logfiles[id].file));
 
-    if (snprintf(filename, sizeof(filename), "%s/%s.log",
-          CNF_GetLogDir(), logfiles[id].name) >= sizeof(filename) ||
-        !(logfiles[id].file = fopen(filename, "a"))) {
-      LOG(LOGS_WARN, LOGF_Refclock, "Couldn't open logfile %s for update", filename);
-      logfiles[id].name = NULL;
+  if (logfiles[id].binary_type && !check_binary_header(id)) {
+    LOG(LOGS_WARN, LOGF_Logging, "Logfile %s has unexpected format", filename);
+    fclose(logfiles[id].file);
+    logfiles[id].file = NULL;
+    logfiles[id].name = NULL;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+write_data(LOG_FileID id, const void *data, int length)
+{
+#ifdef FEAT_ASYNCLOG
+  if (writer_running) {
+    if (!enqueue_record(logfiles[id].file, data, length)) {
+      dropped_records++;
       return;
     }
 
-    /* Close on exec */
-    UTI_FdSetCloexec(fileno(logfiles[id].file));
+    if (dropped_records != dropped_records_reported) {
+      LOG(LOGS_WARN, LOGF_Logging, "Log buffer overflowed, %lu records dropped",
+          dropped_records - dropped_records_reported);
+      dropped_records_reported = dropped_records;
+    }
+
+    written_bytes += length;
+    return;
   }
+#endif
+
+  fwrite(data, 1, length, logfiles[id].file);
+  fflush(logfiles[id].file);
+
+  written_bytes += length;
+}
+
+/* ================================================== */
+
+void
+LOG_FileWrite(LOG_FileID id, const char *format, ...)
+{
+  char buf[2048];
+  va_list other_args;
+  int banner, len, r;
+
+  if (!open_file(id))
+    return;
+
+  len = 0;
 
   banner = CNF_GetLogBanner();
   if (banner && logfiles[id].writes++ % banner == 0) {
-    char bannerline[256];
     int i, bannerlen;
 
     bannerlen = strlen(logfiles[id].banner);
+    if (bannerlen > 255)
+      bannerlen = 255;
 
     for (i = 0; i < bannerlen; i++)
-      bannerline[i] = '=';
-    bannerline[i] = '\0';
+      buf[i] = '=';
+    buf[i] = '\n';
+    len = i + 1;
+
+    len += snprintf(buf + len, sizeof (buf) - len, "%.255s\n", logfiles[id].banner);
 
-    fprintf(logfiles[id].file, "%s\n", bannerline);
-    fprintf(logfiles[id].file, "%s\n", logfiles[id].banner);
-    fprintf(logfiles[id].file, "%s\n", bannerline);
+    memcpy(buf + len, buf, bannerlen + 1);
+    len += bannerlen + 1;
   }
 
   va_start(other_args, format);
-  vfprintf(logfiles[id].file, format, other_args);
+  r = vsnprintf(buf + len, sizeof (buf) - len - 1, format, other_args);
   va_end(other_args);
-  fprintf(logfiles[id].file, "\n");
 
-  fflush(logfiles[id].file);
+  if (r < 0)
+    r = 0;
+  len += r < sizeof (buf) - len - 1 ? r : sizeof (buf) - len - 2;
+  buf[len++] = '\n';
+
+  write_data(id, buf, len);
+}
+
+/* ================================================== */
+
+void
+LOG_FileWriteRecord(LOG_FileID id, const void *record)
+{
+  if (!open_file(id))
+    return;
+
+  write_data(id, record, logfiles[id].record_length);
 }
 
 /* ================================================== */
@@ -322,11 +540,247 @@ LOG_CycleLogFiles(void)
   LOG_FileID i;
 
   for (i = 0; i < n_filelogs; i++) {
-    if (logfiles[i].file)
-      fclose(logfiles[i].file);
-    logfiles[i].file = NULL;
-    logfiles[i].writes = 0;
+    if (logfiles[i].file && !close_file(i))
+      LOG(LOGS_WARN, LOGF_Logging, "Log buffer full, closing of %s delayed",
+          logfiles[i].name);
   }
 }
 
 /* ================================================== */
+
+void
+LOG_GetFileLogStats(unsigned long *bytes, unsigned long *dropped)
+{
+  *bytes = written_bytes;
+  *dropped = dropped_records;
+}
+
+/* ================================================== */
+
+#ifdef FEAT_ASYNCLOG
+
+static void
+ring_copy_in(unsigned long pos, const void *data, unsigned long length)
+{
+  unsigned long offset, first;
+
+  offset = pos & (ring_size - 1);
+  first = ring_size - offset < length ? ring_size - offset : length;
+
+  memcpy(ring_buffer + offset, data, first);
+  memcpy(ring_buffer, (const char *)data + first, length - first);
+}
+
+/* ================================================== */
+
+static void
+ring_copy_out(unsigned long pos, void *data, unsigned long length)
+{
+  unsigned long offset, first;
+
+  offset = pos & (ring_size - 1);
+  first = ring_size - offset < length ? ring_size - offset : length;
+
+  memcpy(data, ring_buffer + offset, first);
+  memcpy((char *)data + first, ring_buffer, length - first);
+}
+
+/* ================================================== */
+
+static void
+wake_writer(void)
+{
+  if (write(writer_pipe[1], "", 1) < 0)
+    ; /* The pipe is full, the writer will wake up anyway */
+}
+
+/* ================================================== */
+
+/* Copy a record to the ring buffer, return 0 if there is not enough space */
+
+static int
+enqueue_record(FILE *file, const char *data, int length)
+{
+  struct RecordHeader header;
+  unsigned long tail, used, record_length;
+
+  tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+  used = ring_head - tail;
+  record_length = sizeof (header) + (length > 0 ? length : 0);
+
+  if (ring_size - used < record_length)
+    return 0;
+
+  header.file = file;
+  header.length = length;
+  ring_copy_in(ring_head, &header, sizeof (header));
+  if (length > 0)
+    ring_copy_in(ring_head + sizeof (header), data, length);
+
+  __atomic_store_n(&ring_head, ring_head + record_length, __ATOMIC_RELEASE);
+
+  /* Don't wait for the timeout if the buffer is getting full or a file
+     needs to be closed */
+  if ((used < ring_size / 2 && used + record_length >= ring_size / 2) || length < 0)
+    wake_writer();
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void *
+run_writer(void *anything)
+{
+  FILE *files[MAX_FILELOGS + 1];
+  struct RecordHeader header;
+  struct pollfd pfd;
+  unsigned long head, tail;
+  char buf[256];
+  int i, n_files, length, quit;
+
+  pfd.fd = writer_pipe[0];
+  pfd.events = POLLIN;
+
+  for (quit = 0; !quit; ) {
+    if (poll(&pfd, 1, writer_timeout) > 0) {
+      while (read(writer_pipe[0], buf, sizeof (buf)) > 0)
+        ;
+    }
+
+    quit = __atomic_load_n(&writer_quit, __ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    tail = ring_tail;
+    n_files = 0;
+
+    while (tail != head) {
+      ring_copy_out(tail, &header, sizeof (header));
+      tail += sizeof (header);
+
+      for (i = 0; i < n_files && files[i] != header.file; i++)
+        ;
+
+      if (header.length < 0) {
+        if (i < n_files)
+          files[i] = files[--n_files];
+        fclose(header.file);
+      } else {
+        for (length = header.length; length > 0; length -= sizeof (buf)) {
+          ring_copy_out(tail, buf, length < sizeof (buf) ? length : sizeof (buf));
+          fwrite(buf, 1, length < sizeof (buf) ? length : sizeof (buf), header.file);
+          tail += length < sizeof (buf) ? length : sizeof (buf);
+        }
+        if (i == n_files && n_files < MAX_FILELOGS + 1)
+          files[n_files++] = header.file;
+      }
+
+      /* Release the space as soon as possible when the buffer is large */
+      if (tail - ring_tail >= ring_size / 4)
+        __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    for (i = 0; i < n_files; i++)
+      fflush(files[i]);
+
+    __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}
+
+/* ================================================== */
+
+static void
+start_writer(void)
+{
+  sigset_t signals, old_signals;
+  unsigned long size;
+  double interval;
+  int i;
+
+  CNF_GetLogBuffer(&ring_size, &interval);
+
+  if (!ring_size)
+    return;
+
+  /* The buffer must be able to hold the largest record */
+  if (ring_size < 4096)
+    ring_size = 4096;
+  if (ring_size > MAX_RING_SIZE)
+    ring_size = MAX_RING_SIZE;
+
+  /* Round the size up to a power of two */
+  for (size = 4096; size < ring_size; size <<= 1)
+    ;
+  ring_size = size;
+
+  if (pipe(writer_pipe)) {
+    LOG(LOGS_ERR, LOGF_Logging, "Could not create pipe for log writer : %s",
+        strerror(errno));
+    ring_size = 0;
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    UTI_FdSetCloexec(writer_pipe[i]);
+    fcntl(writer_pipe[i], F_SETFL, O_NONBLOCK);
+  }
+
+  ring_buffer = Malloc(ring_size);
+  ring_head = ring_tail = 0;
+  writer_quit = 0;
+  writer_timeout = interval * 1000.0;
+  if (writer_timeout < 1)
+    writer_timeout = 1;
+
+  /* Block all signals in the writer thread, they need to interrupt
+     the select() in the main loop */
+  sigfillset(&signals);
+  pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+  if (pthread_create(&writer_thread, NULL, run_writer, NULL)) {
+    LOG_FATAL(LOGF_Logging, "pthread_create() failed");
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  writer_running = 1;
+
+  DEBUG_LOG(LOGF_Logging, "Started log writer size=%lu interval=%d",
+            ring_size, writer_timeout);
+}
+
+/* ================================================== */
+
+static void
+stop_writer(void)
+{
+  LOG_FileID i;
+
+  if (!writer_running)
+    return;
+
+  __atomic_store_n(&writer_quit, 1, __ATOMIC_RELEASE);
+  wake_writer();
+
+  if (pthread_join(writer_thread, NULL)) {
+    LOG_FATAL(LOGF_Logging, "pthread_join() failed");
+  }
+
+  writer_running = 0;
+
+  /* Close the files which didn't fit in the buffer */
+  for (i = 0; i < n_filelogs; i++) {
+    if (logfiles[i].close_pending)
+      close_file(i);
+  }
+
+  close(writer_pipe[0]);
+  close(writer_pipe[1]);
+  Free(ring_buffer);
+  ring_size = 0;
+}
+
+#endif
+
+/* ================================================== */
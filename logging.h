@@ -99,7 +99,11 @@ typedef enum {
   LOGF_SysWinnt,
   LOGF_TempComp,
   LOGF_RtcLinux,
-  LOGF_Refclock
+  LOGF_Refclock,
+  LOGF_StatusPage,
+  LOGF_LeapDb,
+  LOGF_Broadcast,
+  LOGF_Metrics
 } LOG_Facility;
 
 /* Init function */
@@ -139,7 +143,17 @@ extern LOG_FileID LOG_FileOpen(const char *name, const char *banner);
 FORMAT_ATTRIBUTE_PRINTF(2, 3)
 extern void LOG_FileWrite(LOG_FileID id, const char *format, ...);
 
+/* Binary log files contain fixed-size records of one type as specified
+   in binlog.h */
+extern LOG_FileID LOG_FileOpenBinary(const char *name, int type, int record_length);
+extern int LOG_FileIsBinary(LOG_FileID id);
+extern void LOG_FileWriteRecord(LOG_FileID id, const void *record);
+
 extern void LOG_CreateLogFileDir(void);
 extern void LOG_CycleLogFiles(void);
 
+/* Get number of bytes written to the log files and number of records
+   dropped due to a full log buffer */
+extern void LOG_GetFileLogStats(unsigned long *bytes, unsigned long *dropped);
+
 #endif /* GOT_LOGGING_H */
@@ -51,6 +51,9 @@
 #include "broadcast.h"
 #include "nameserv.h"
 #include "tempcomp.h"
+#include "statuspage.h"
+#include "leapdb.h"
+#include "metrics.h"
 
 /* ================================================== */
 
@@ -86,6 +89,7 @@ MAI_CleanupAndExit(void)
     SRC_DumpSources();
   }
 
+  STP_Finalise();
   TMC_Finalise();
   MNL_Finalise();
   CLG_Finalise();
@@ -94,10 +98,12 @@ MAI_CleanupAndExit(void)
   BRD_Finalise();
   SST_Finalise();
   REF_Finalise();
+  LDB_Finalise();
   KEY_Finalise();
   RCL_Finalise();
   SRC_Finalise();
   RTC_Finalise();
+  MET_Finalise();
   CAM_Finalise();
   NIO_Finalise();
   SYS_Finalise();
@@ -123,27 +129,38 @@ signal_cleanup(int x)
 /* ================================================== */
 
 static void
-ntp_source_resolving_end(void)
+signal_dump_latency(int x)
 {
-  NSR_SetSourceResolvingEndHandler(NULL);
+  SCH_RequestLatencyDump();
+}
 
-  if (reload) {
-    /* Note, we want reload to come well after the initialisation from
-       the real time clock - this gives us a fighting chance that the
-       system-clock scale for the reloaded samples still has a
-       semblence of validity about it. */
-    SRC_ReloadSources();
-  }
+/* ================================================== */
 
+static void
+start_sources(void)
+{
   RTC_StartMeasurements();
   RCL_StartRefclocks();
   NSR_StartSources();
   NSR_AutoStartSources();
+}
+
+/* ================================================== */
 
-  /* Special modes can end only when sources update their reachability.
-     Give up immediatelly if there are no active sources. */
-  if (ref_mode != REF_ModeNormal && !SRC_ActiveSources()) {
-    REF_SetUnsynchronised();
+static void
+ntp_source_resolving_end(void)
+{
+  NSR_SetSourceResolvingEndHandler(NULL);
+  SRC_SetReloadNewSources(0);
+
+  if (ref_mode != REF_ModeNormal) {
+    start_sources();
+
+    /* Special modes can end only when sources update their reachability.
+       Give up immediatelly if there are no active sources. */
+    if (!SRC_ActiveSources()) {
+      REF_SetUnsynchronised();
+    }
   }
 }
 
@@ -165,6 +182,22 @@ post_init_ntp_hook(void *anything)
   CNF_AddSources();
   CNF_AddBroadcasts();
 
+  if (reload) {
+    /* Note, we want reload to come well after the initialisation from
+       the real time clock - this gives us a fighting chance that the
+       system-clock scale for the reloaded samples still has a
+       semblence of validity about it.  Sources with names are loaded
+       when they are resolved. */
+    SRC_ReloadSources();
+    SRC_SetReloadNewSources(1);
+  }
+
+  /* In the normal mode start the sources which have an address now and
+     the others as soon as their names are resolved.  Special modes need
+     all sources to be added before they are started. */
+  if (ref_mode == REF_ModeNormal)
+    start_sources();
+
   NSR_SetSourceResolvingEndHandler(ntp_source_resolving_end);
   NSR_ResolveSources();
 }
@@ -457,6 +490,7 @@ int main
   SYS_Initialise();
   NIO_Initialise(address_family);
   CAM_Initialise(address_family);
+  MET_Initialise();
   RTC_Initialise(do_init_rtc);
   SRC_Initialise();
   RCL_Initialise();
@@ -483,6 +517,7 @@ int main
 
   LOG_CreateLogFileDir();
 
+  LDB_Initialise();
   REF_Initialise();
   SST_Initialise();
   BRD_Initialise();
@@ -491,6 +526,7 @@ int main
   CLG_Initialise();
   MNL_Initialise();
   TMC_Initialise();
+  STP_Initialise();
 
   /* From now on, it is safe to do finalisation on exit */
   initialised = 1;
@@ -515,6 +551,7 @@ int main
 #if !defined(WINNT)
   signal(SIGQUIT, signal_cleanup);
   signal(SIGHUP, signal_cleanup);
+  signal(SIGUSR1, signal_dump_latency);
 #endif /* WINNT */
 
   /* The program normally runs under control of the main loop in
@@ -0,0 +1,967 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Metrics endpoint.  The tracking, source, RTC and client log reports and
+  the internal counters are rendered in the Prometheus text exposition
+  format and served over a stream socket on the loopback interface or
+  a Unix domain socket, either as an HTTP/1.0 response or as plain text
+  if the client doesn't send an HTTP request.  The rendered text is
+  cached and refreshed at most once per configured interval, so frequent
+  scrapes don't cost more than one scrape per interval.  The sockets are
+  nonblocking and a connection which can't take the whole response is
+  retried from a timeout, so a slow client can't stall the main loop.
+
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "clientlog.h"
+#include "conf.h"
+#include "counters.h"
+#include "logging.h"
+#include "memory.h"
+#include "metrics.h"
+#include "mkdirpp.h"
+#include "ntp_sources.h"
+#include "reference.h"
+#include "refclock.h"
+#include "reports.h"
+#include "rtc.h"
+#include "sched.h"
+#include "sources.h"
+#include "util.h"
+
+/* Maximum number of clients served at the same time */
+#define MAX_CONNECTIONS 8
+
+/* Maximum length of a request including the HTTP headers */
+#define MAX_REQUEST_LENGTH 1024
+
+/* Delay before next attempt to send the rest of a response when
+   the socket buffer is full */
+#define WRITE_RETRY_INTERVAL 0.1
+
+/* Time after which a connection is closed even if the request or
+   the response was not complete */
+#define CONNECTION_TIMEOUT 10.0
+
+/* Maximum length of labels of one series */
+#define MAX_LABELS_LENGTH 128
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+typedef struct {
+  int fd;
+  int reading;
+  int request_length;
+  char request[MAX_REQUEST_LENGTH];
+  char *response;
+  int response_length;
+  int sent;
+  SCH_TimeoutID retry_id;
+  SCH_TimeoutID timeout_id;
+} Connection;
+
+typedef struct {
+  const char *name;
+  const char *type;
+  const char *help;
+} Metric;
+
+typedef char Labels[MAX_LABELS_LENGTH];
+
+/* ================================================== */
+
+static int initialised = 0;
+
+static int listen_fd = -1;
+static char *listen_path = NULL;
+
+static Connection connections[MAX_CONNECTIONS];
+
+/* Minimum interval between refreshes of the cached metrics */
+static double refresh_interval;
+
+/* Cached metrics */
+static char *snapshot = NULL;
+static int snapshot_length;
+static int snapshot_size;
+static int snapshot_valid = 0;
+static struct timespec snapshot_time;
+
+/* ================================================== */
+
+static const Metric tracking_metrics[] = {
+  { "chrony_tracking_stratum", "gauge", "Stratum of the local clock" },
+  { "chrony_tracking_ref_time_seconds", "gauge", "Time of the last update of the reference" },
+  { "chrony_tracking_system_time_offset_seconds", "gauge",
+    "Remaining correction of the system clock (positive is slow)" },
+  { "chrony_tracking_last_offset_seconds", "gauge", "Offset estimated in the last clock update" },
+  { "chrony_tracking_rms_offset_seconds", "gauge", "Long-term average of the offset" },
+  { "chrony_tracking_frequency_ppm", "gauge",
+    "Frequency error of the system clock (positive is fast)" },
+  { "chrony_tracking_residual_frequency_ppm", "gauge",
+    "Residual frequency of the reference source" },
+  { "chrony_tracking_skew_ppm", "gauge", "Estimated error bound of the frequency" },
+  { "chrony_tracking_root_delay_seconds", "gauge", "Total delay to the stratum-1 reference" },
+  { "chrony_tracking_root_dispersion_seconds", "gauge",
+    "Total dispersion accumulated up to the stratum-1 reference" },
+  { "chrony_tracking_update_interval_seconds", "gauge", "Interval between the last two clock updates" },
+};
+
+static const Metric source_info_metric =
+  { "chrony_source_info", "gauge", "Selection state and option of the source" };
+
+static const Metric source_metrics[] = {
+  { "chrony_source_stratum", "gauge", "Stratum of the source" },
+  { "chrony_source_poll_interval_seconds", "gauge", "Polling interval of the source" },
+  { "chrony_source_reachability", "gauge", "Reachability register of the source" },
+  { "chrony_source_last_sample_age_seconds", "gauge", "Time since the last sample was received" },
+  { "chrony_source_last_sample_offset_seconds", "gauge",
+    "Adjusted offset of the last sample (positive is local clock ahead)" },
+  { "chrony_source_last_sample_original_offset_seconds", "gauge",
+    "Measured offset of the last sample" },
+  { "chrony_source_last_sample_error_seconds", "gauge", "Error bound of the last sample" },
+};
+
+static const Metric sourcestats_metrics[] = {
+  { "chrony_sourcestats_samples", "gauge", "Number of retained samples" },
+  { "chrony_sourcestats_runs", "gauge", "Number of runs of residuals with the same sign" },
+  { "chrony_sourcestats_span_seconds", "gauge", "Interval covered by the retained samples" },
+  { "chrony_sourcestats_frequency_ppm", "gauge", "Estimated residual frequency of the source" },
+  { "chrony_sourcestats_skew_ppm", "gauge", "Estimated error bound of the frequency" },
+  { "chrony_sourcestats_offset_seconds", "gauge", "Estimated offset of the source" },
+  { "chrony_sourcestats_offset_error_seconds", "gauge", "Error bound of the estimated offset" },
+  { "chrony_sourcestats_std_dev_seconds", "gauge", "Estimated standard deviation of the samples" },
+};
+
+static const Metric rtc_metrics[] = {
+  { "chrony_rtc_ref_time_seconds", "gauge", "Time of the last RTC measurement" },
+  { "chrony_rtc_samples", "gauge", "Number of retained RTC samples" },
+  { "chrony_rtc_runs", "gauge", "Number of runs of residuals with the same sign" },
+  { "chrony_rtc_span_seconds", "gauge", "Interval covered by the retained samples" },
+  { "chrony_rtc_offset_seconds", "gauge", "Estimated offset of the RTC (positive is fast)" },
+  { "chrony_rtc_gain_rate_ppm", "gauge", "Rate at which the RTC gains time" },
+};
+
+static const Metric clientlog_metrics[] = {
+  { "chrony_clientlog_clients", "gauge", "Number of hosts in the client log" },
+  { "chrony_clientlog_ntp_requests_total", "counter",
+    "NTP client requests from hosts in the client log" },
+  { "chrony_clientlog_peer_requests_total", "counter",
+    "NTP peer requests from hosts in the client log" },
+};
+
+static const Metric clientlog_cmd_metric =
+  { "chrony_clientlog_cmd_requests_total", "counter",
+    "Command requests from hosts in the client log" };
+
+/* Counters in the order of CNT_Counter, consecutive counters with the same
+   name are series of one metric */
+static const struct {
+  const char *name;
+  const char *labels;
+  const char *help;
+} counters[] = {
+  { "chrony_ntp_received_packets_total", "role=\"server\",family=\"ipv4\"", "Received NTP packets" },
+  { "chrony_ntp_received_packets_total", "role=\"server\",family=\"ipv6\"", NULL },
+  { "chrony_ntp_received_packets_total", "role=\"client\",family=\"ipv4\"", NULL },
+  { "chrony_ntp_received_packets_total", "role=\"client\",family=\"ipv6\"", NULL },
+  { "chrony_ntp_sent_packets_total", "role=\"server\",family=\"ipv4\"", "Sent NTP packets" },
+  { "chrony_ntp_sent_packets_total", "role=\"server\",family=\"ipv6\"", NULL },
+  { "chrony_ntp_sent_packets_total", "role=\"client\",family=\"ipv4\"", NULL },
+  { "chrony_ntp_sent_packets_total", "role=\"client\",family=\"ipv6\"", NULL },
+  { "chrony_ntp_dropped_packets_total", "", "Dropped NTP packets" },
+  { "chrony_ntp_send_errors_total", "", "Errors in sending of NTP packets" },
+  { "chrony_ntp_failed_tests_total", "test=\"1\"", "NTP packets which failed a test" },
+  { "chrony_ntp_failed_tests_total", "test=\"2\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"3\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"4\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"4a\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"4b\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"4c\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"5\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"6\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"7\"", NULL },
+  { "chrony_ntp_failed_tests_total", "test=\"8\"", NULL },
+  { "chrony_ntp_auth_failures_total", "", "NTP packets which failed authentication" },
+  { "chrony_cmd_received_requests_total", "family=\"unix\"", "Received command requests" },
+  { "chrony_cmd_received_requests_total", "family=\"ipv4\"", NULL },
+  { "chrony_cmd_received_requests_total", "family=\"ipv6\"", NULL },
+  { "chrony_cmd_sent_replies_total", "", "Sent command replies" },
+  { "chrony_cmd_dropped_requests_total", "", "Dropped command requests" },
+  { "chrony_cmd_auth_failures_total", "", "Command requests which failed authentication" },
+  { "chrony_sched_iterations_total", "", "Iterations of the main loop" },
+  { "chrony_sched_timeouts_total", "", "Dispatched timeouts" },
+  { "chrony_sched_file_handlers_total", "", "Dispatched file handlers" },
+  { "chrony_regressions_total", "", "Regressions of source samples" },
+  { "chrony_source_selections_total", "", "Runs of the source selection" },
+  { "chrony_log_written_bytes_total", "", "Bytes written to log files" },
+  { "chrony_log_dropped_messages_total", "", "Log messages dropped on full buffer" },
+};
+
+/* ================================================== */
+
+static void
+append(const char *format, ...)
+{
+  va_list ap;
+  int len;
+
+  while (1) {
+    va_start(ap, format);
+    len = vsnprintf(snapshot + snapshot_length, snapshot_size - snapshot_length, format, ap);
+    va_end(ap);
+
+    if (len < 0)
+      return;
+
+    if (snapshot_length + len < snapshot_size) {
+      snapshot_length += len;
+      return;
+    }
+
+    snapshot_size = 2 * snapshot_size + len;
+    snapshot = Realloc(snapshot, snapshot_size);
+  }
+}
+
+/* ================================================== */
+
+static void
+append_header(const Metric *metric)
+{
+  append("# HELP %s %s\n# TYPE %s %s\n",
+         metric->name, metric->help, metric->name, metric->type);
+}
+
+/* ================================================== */
+
+static void
+append_sample(const char *name, const char *labels, double value)
+{
+  if (labels[0])
+    append("%s{%s} %.15g\n", name, labels, value);
+  else
+    append("%s %.15g\n", name, value);
+}
+
+/* ================================================== */
+/* Append metrics of n series, values are indexed by series and metric */
+
+static void
+append_metrics(const Metric *metrics, int n_metrics, Labels *labels, double *values, int n)
+{
+  int i, j;
+
+  for (i = 0; i < n_metrics; i++) {
+    append_header(&metrics[i]);
+    for (j = 0; j < n; j++)
+      append_sample(metrics[i].name, labels[j], values[j * n_metrics + i]);
+  }
+}
+
+/* ================================================== */
+
+static void
+format_address_label(Labels labels, const char *address)
+{
+  int i, j;
+
+  j = snprintf(labels, sizeof (Labels), "address=\"");
+
+  /* Reference IDs of refclocks may contain characters to be escaped */
+  for (i = 0; address[i] && j < sizeof (Labels) - 3; i++) {
+    if (address[i] == '"' || address[i] == '\\')
+      labels[j++] = '\\';
+    labels[j++] = address[i];
+  }
+
+  labels[j++] = '"';
+  labels[j] = '\0';
+}
+
+/* ================================================== */
+
+static const char *
+get_address(IPAddr *ip_addr, uint32_t ref_id)
+{
+  if (ip_addr->family == IPADDR_UNSPEC)
+    return UTI_RefidToString(ref_id);
+  return UTI_IPToString(ip_addr);
+}
+
+/* ================================================== */
+
+static void
+append_tracking(void)
+{
+  RPT_TrackingReport report;
+  double values[sizeof (tracking_metrics) / sizeof (tracking_metrics[0])];
+  Labels labels;
+  const char *leap;
+
+  REF_GetTrackingReport(&report);
+
+  switch (report.leap_status) {
+    case LEAP_Normal:
+      leap = "normal";
+      break;
+    case LEAP_InsertSecond:
+      leap = "insert";
+      break;
+    case LEAP_DeleteSecond:
+      leap = "delete";
+      break;
+    default:
+      leap = "unsynchronised";
+      break;
+  }
+
+  format_address_label(labels, get_address(&report.ip_addr, report.ref_id));
+  append("# HELP chrony_tracking_info Reference and leap status of the local clock\n"
+         "# TYPE chrony_tracking_info gauge\n"
+         "chrony_tracking_info{ref_id=\"%08"PRIX32"\",%s,leap_status=\"%s\"} 1\n",
+         report.ref_id, labels, leap);
+
+  values[0] = report.stratum;
+  UTI_TimespecToDouble(&report.ref_time, &values[1]);
+  values[2] = report.current_correction;
+  values[3] = report.last_offset;
+  values[4] = report.rms_offset;
+  values[5] = report.freq_ppm;
+  values[6] = report.resid_freq_ppm;
+  values[7] = report.skew_ppm;
+  values[8] = report.root_delay;
+  values[9] = report.root_dispersion;
+  values[10] = report.last_update_interval;
+
+  labels[0] = '\0';
+  append_metrics(tracking_metrics, sizeof (tracking_metrics) / sizeof (tracking_metrics[0]),
+                 &labels, values, 1);
+}
+
+/* ================================================== */
+
+static void
+append_sources(struct timespec *now)
+{
+  const int n_metrics = sizeof (source_metrics) / sizeof (source_metrics[0]);
+  const int n_stats_metrics = sizeof (sourcestats_metrics) / sizeof (sourcestats_metrics[0]);
+  RPT_SourceReport report;
+  RPT_SourcestatsReport stats_report;
+  Labels *labels, *info_labels, *stats_labels;
+  double *values, *stats_values, *v;
+  const char *mode, *state, *option, *address;
+  int i, n, n_stats;
+
+  n = SRC_ReadNumberOfSources();
+  if (n <= 0)
+    return;
+
+  labels = MallocArray(Labels, n);
+  info_labels = MallocArray(Labels, n);
+  stats_labels = MallocArray(Labels, n);
+  values = MallocArray(double, n * n_metrics);
+  stats_values = MallocArray(double, n * n_stats_metrics);
+
+  for (i = n_stats = 0; i < n; i++) {
+    if (!SRC_ReportSource(i, &report, now))
+      break;
+
+    /* Add the mode and polling interval specific to the type */
+    switch (SRC_GetType(i)) {
+      case SRC_NTP:
+        NSR_ReportSource(&report, now);
+        break;
+      case SRC_REFCLOCK:
+        RCL_ReportSource(&report, now);
+        break;
+    }
+
+    switch (report.mode) {
+      case RPT_NTP_CLIENT:
+        mode = "client";
+        break;
+      case RPT_NTP_PEER:
+        mode = "peer";
+        break;
+      default:
+        mode = "refclock";
+        break;
+    }
+
+    switch (report.state) {
+      case RPT_SYNC:
+        state = "sync";
+        break;
+      case RPT_UNREACH:
+        state = "unreach";
+        break;
+      case RPT_FALSETICKER:
+        state = "falseticker";
+        break;
+      case RPT_JITTERY:
+        state = "jittery";
+        break;
+      case RPT_CANDIDATE:
+        state = "candidate";
+        break;
+      default:
+        state = "outlier";
+        break;
+    }
+
+    switch (report.sel_option) {
+      case RPT_PREFER:
+        option = "prefer";
+        break;
+      case RPT_NOSELECT:
+        option = "noselect";
+        break;
+      default:
+        option = "normal";
+        break;
+    }
+
+    /* Refclocks are reported with the reference ID as address */
+    if (report.mode == RPT_LOCAL_REFERENCE)
+      address = UTI_RefidToString(report.ip_addr.addr.in4);
+    else
+      address = UTI_IPToString(&report.ip_addr);
+
+    format_address_label(labels[i], address);
+    snprintf(labels[i] + strlen(labels[i]), sizeof (Labels) - strlen(labels[i]),
+             ",mode=\"%s\"", mode);
+    snprintf(info_labels[i], sizeof (Labels), "%s,state=\"%s\",option=\"%s\"",
+             labels[i], state, option);
+
+    v = &values[i * n_metrics];
+    v[0] = report.stratum;
+    v[1] = ldexp(1.0, report.poll);
+    v[2] = report.reachability;
+    v[3] = report.latest_meas_ago;
+    v[4] = report.latest_meas;
+    v[5] = report.orig_latest_meas;
+    v[6] = report.latest_meas_err;
+
+    /* Sources without statistics are left out of the sourcestats series */
+    if (SRC_ReportSourcestats(i, &stats_report, now)) {
+      memcpy(stats_labels[n_stats], labels[i], sizeof (Labels));
+      v = &stats_values[n_stats * n_stats_metrics];
+      v[0] = stats_report.n_samples;
+      v[1] = stats_report.n_runs;
+      v[2] = stats_report.span_seconds;
+      v[3] = stats_report.resid_freq_ppm;
+      v[4] = stats_report.skew_ppm;
+      v[5] = stats_report.est_offset;
+      v[6] = stats_report.est_offset_err;
+      v[7] = stats_report.sd;
+      n_stats++;
+    }
+  }
+
+  n = i;
+
+  append_header(&source_info_metric);
+  for (i = 0; i < n; i++)
+    append_sample(source_info_metric.name, info_labels[i], 1.0);
+
+  append_metrics(source_metrics, n_metrics, labels, values, n);
+
+  if (n_stats > 0)
+    append_metrics(sourcestats_metrics, n_stats_metrics, stats_labels, stats_values,
+                   n_stats);
+
+  Free(labels);
+  Free(info_labels);
+  Free(stats_labels);
+  Free(values);
+  Free(stats_values);
+}
+
+/* ================================================== */
+
+static void
+append_rtc(void)
+{
+  RPT_RTC_Report report;
+  double values[sizeof (rtc_metrics) / sizeof (rtc_metrics[0])];
+  Labels labels;
+
+  if (!RTC_GetReport(&report))
+    return;
+
+  UTI_TimespecToDouble(&report.ref_time, &values[0]);
+  values[1] = report.n_samples;
+  values[2] = report.n_runs;
+  values[3] = report.span_seconds;
+  values[4] = report.rtc_seconds_fast;
+  values[5] = report.rtc_gain_rate_ppm;
+
+  labels[0] = '\0';
+  append_metrics(rtc_metrics, sizeof (rtc_metrics) / sizeof (rtc_metrics[0]),
+                 &labels, values, 1);
+}
+
+/* ================================================== */
+
+static void
+append_clientlog(struct timespec *now)
+{
+  RPT_ClientAccessByIndex_Report report;
+  double values[sizeof (clientlog_metrics) / sizeof (clientlog_metrics[0])];
+  double cmd_values[3];
+  Labels labels, cmd_labels[3];
+  unsigned long n_indices;
+  int i;
+
+  memset(values, 0, sizeof (values));
+  memset(cmd_values, 0, sizeof (cmd_values));
+
+  for (i = 0; ; i++) {
+    switch (CLG_GetClientAccessReportByIndex(i, &report, now->tv_sec, &n_indices)) {
+      case CLG_INACTIVE:
+        return;
+      case CLG_SUCCESS:
+        values[0]++;
+        values[1] += report.client_hits;
+        values[2] += report.peer_hits;
+        cmd_values[0] += report.cmd_hits_auth;
+        cmd_values[1] += report.cmd_hits_normal;
+        cmd_values[2] += report.cmd_hits_bad;
+        continue;
+      default:
+        break;
+    }
+    break;
+  }
+
+  labels[0] = '\0';
+  append_metrics(clientlog_metrics, sizeof (clientlog_metrics) / sizeof (clientlog_metrics[0]),
+                 &labels, values, 1);
+
+  snprintf(cmd_labels[0], sizeof (Labels), "type=\"auth\"");
+  snprintf(cmd_labels[1], sizeof (Labels), "type=\"normal\"");
+  snprintf(cmd_labels[2], sizeof (Labels), "type=\"bad\"");
+  append_metrics(&clientlog_cmd_metric, 1, cmd_labels, cmd_values, 3);
+}
+
+/* ================================================== */
+
+static void
+append_counters(void)
+{
+  uint64_t values[CNT_Max];
+  int i;
+
+  CNT_GetCounters(values);
+
+  for (i = 0; i < CNT_Max; i++) {
+    if (counters[i].help)
+      append("# HELP %s %s\n# TYPE %s counter\n",
+             counters[i].name, counters[i].help, counters[i].name);
+    if (counters[i].labels[0])
+      append("%s{%s} %"PRIu64"\n", counters[i].name, counters[i].labels, values[i]);
+    else
+      append("%s %"PRIu64"\n", counters[i].name, values[i]);
+  }
+}
+
+/* ================================================== */
+
+static void
+refresh_snapshot(void)
+{
+  struct timespec now;
+  double age;
+
+  SCH_GetLastEventTime(&now, NULL, NULL);
+
+  if (snapshot_valid) {
+    UTI_DiffTimespecsToDouble(&age, &now, &snapshot_time);
+    /* Refresh also when the clock was stepped back */
+    if (age >= 0.0 && age < refresh_interval)
+      return;
+  }
+
+  snapshot_length = 0;
+  snapshot[0] = '\0';
+
+  append_tracking();
+  append_sources(&now);
+  append_rtc();
+  append_clientlog(&now);
+  append_counters();
+
+  snapshot_time = now;
+  snapshot_valid = 1;
+
+  DEBUG_LOG(LOGF_Metrics, "Refreshed metrics (%d bytes)", snapshot_length);
+}
+
+/* ================================================== */
+
+static void
+close_connection(Connection *conn)
+{
+  if (conn->reading)
+    SCH_RemoveInputFileHandler(conn->fd);
+  if (conn->retry_id)
+    SCH_RemoveTimeout(conn->retry_id);
+  if (conn->timeout_id)
+    SCH_RemoveTimeout(conn->timeout_id);
+
+  close(conn->fd);
+  Free(conn->response);
+
+  conn->fd = -1;
+  conn->reading = 0;
+  conn->response = NULL;
+  conn->retry_id = 0;
+  conn->timeout_id = 0;
+}
+
+/* ================================================== */
+
+static void
+handle_timeout(void *arg)
+{
+  Connection *conn = arg;
+
+  conn->timeout_id = 0;
+  DEBUG_LOG(LOGF_Metrics, "Metrics connection timed out");
+  close_connection(conn);
+}
+
+/* ================================================== */
+
+static void
+write_response(void *arg)
+{
+  Connection *conn = arg;
+  int len;
+
+  conn->retry_id = 0;
+
+  while (conn->sent < conn->response_length) {
+    len = send(conn->fd, conn->response + conn->sent,
+               conn->response_length - conn->sent, SEND_FLAGS);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        conn->retry_id = SCH_AddTimeoutByDelay(WRITE_RETRY_INTERVAL, write_response, conn);
+        return;
+      }
+      DEBUG_LOG(LOGF_Metrics, "Could not send metrics : %s", strerror(errno));
+      break;
+    }
+    conn->sent += len;
+  }
+
+  close_connection(conn);
+}
+
+/* ================================================== */
+
+static void
+make_response(Connection *conn, const char *status, int with_body)
+{
+  char header[256];
+  int header_length, body_length;
+
+  body_length = with_body ? snapshot_length : 0;
+
+  if (status)
+    header_length = snprintf(header, sizeof (header),
+                             "HTTP/1.0 %s\r\n"
+                             "Content-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: %d\r\n"
+                             "Connection: close\r\n\r\n", status, body_length);
+  else
+    header_length = 0;
+
+  conn->response_length = header_length + body_length;
+  conn->response = Malloc(conn->response_length + 1);
+  memcpy(conn->response, header, header_length);
+  memcpy(conn->response + header_length, snapshot, body_length);
+  conn->sent = 0;
+}
+
+/* ================================================== */
+
+static void
+process_request(Connection *conn, int http)
+{
+  char *path, *end;
+
+  SCH_RemoveInputFileHandler(conn->fd);
+  conn->reading = 0;
+
+  refresh_snapshot();
+
+  if (!http) {
+    make_response(conn, NULL, 1);
+  } else if (strncmp(conn->request, "GET ", 4)) {
+    make_response(conn, "405 Method Not Allowed", 0);
+  } else {
+    path = conn->request + 4;
+    end = path + strcspn(path, " ?\r\n");
+    if ((end - path == 1 && !strncmp(path, "/", 1)) ||
+        (end - path == 8 && !strncmp(path, "/metrics", 8)))
+      make_response(conn, "200 OK", 1);
+    else
+      make_response(conn, "404 Not Found", 0);
+  }
+
+  write_response(conn);
+}
+
+/* ================================================== */
+
+static void
+read_request(void *arg)
+{
+  Connection *conn = arg;
+  char *eol;
+  int len, http;
+
+  len = recv(conn->fd, conn->request + conn->request_length,
+             sizeof (conn->request) - 1 - conn->request_length, 0);
+  if (len < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return;
+    close_connection(conn);
+    return;
+  }
+
+  conn->request_length += len;
+  conn->request[conn->request_length] = '\0';
+
+  /* A request line of HTTP is followed by headers ending with an empty
+     line, any other line (or no data at all) asks for plain metrics */
+  eol = strchr(conn->request, '\n');
+  http = 0;
+  if (eol) {
+    *eol = '\0';
+    http = strstr(conn->request, " HTTP/") != NULL;
+    *eol = '\n';
+  }
+
+  if (len > 0 && conn->request_length < sizeof (conn->request) - 1) {
+    if (!eol)
+      return;
+    if (http && !strstr(conn->request, "\r\n\r\n") && !strstr(conn->request, "\n\n"))
+      return;
+  }
+
+  process_request(conn, http);
+}
+
+/* ================================================== */
+
+static void
+accept_connection(void *anything)
+{
+  Connection *conn;
+  int i, fd;
+
+  fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0) {
+    DEBUG_LOG(LOGF_Metrics, "Could not accept metrics connection : %s", strerror(errno));
+    return;
+  }
+
+  for (i = 0; i < MAX_CONNECTIONS && connections[i].fd >= 0; i++)
+    ;
+
+  if (i == MAX_CONNECTIONS) {
+    DEBUG_LOG(LOGF_Metrics, "Too many metrics connections");
+    close(fd);
+    return;
+  }
+
+  UTI_FdSetCloexec(fd);
+
+  if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+    DEBUG_LOG(LOGF_Metrics, "Could not set O_NONBLOCK : %s", strerror(errno));
+    close(fd);
+    return;
+  }
+
+  conn = &connections[i];
+  conn->fd = fd;
+  conn->request_length = 0;
+  conn->reading = 1;
+  conn->timeout_id = SCH_AddTimeoutByDelay(CONNECTION_TIMEOUT, handle_timeout, conn);
+
+  SCH_AddInputFileHandler(fd, read_request, conn);
+}
+
+/* ================================================== */
+
+static int
+open_socket(int port, const char *path)
+{
+  union {
+    struct sockaddr u;
+    struct sockaddr_in in4;
+    struct sockaddr_un un;
+  } addr;
+  socklen_t addr_len;
+  char *dir, *slash;
+  int fd, on_off = 1;
+
+  memset(&addr, 0, sizeof (addr));
+
+  if (path) {
+    if (strlen(path) >= sizeof (addr.un.sun_path)) {
+      LOG(LOGS_ERR, LOGF_Metrics, "Unix metrics socket path %s too long", path);
+      return -1;
+    }
+
+    /* Create the directory for the socket if it doesn't exist yet */
+    dir = strdup(path);
+    slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+      *slash = '\0';
+      if (!mkdir_and_parents(dir))
+        LOG(LOGS_ERR, LOGF_Metrics, "Could not create directory %s", dir);
+    }
+    free(dir);
+
+    addr.un.sun_family = AF_UNIX;
+    strcpy(addr.un.sun_path, path);
+    addr_len = sizeof (addr.un);
+
+    /* Remove socket left by previous instance */
+    unlink(path);
+  } else {
+    /* Serve only local clients */
+    addr.in4.sin_family = AF_INET;
+    addr.in4.sin_port = htons(port);
+    addr.in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_len = sizeof (addr.in4);
+  }
+
+  fd = socket(addr.u.sa_family, SOCK_STREAM, 0);
+  if (fd < 0) {
+    LOG(LOGS_ERR, LOGF_Metrics, "Could not open metrics socket : %s", strerror(errno));
+    return -1;
+  }
+
+  UTI_FdSetCloexec(fd);
+
+  if (!path && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on_off, sizeof (on_off)) < 0)
+    LOG(LOGS_ERR, LOGF_Metrics, "Could not set reuseaddr socket option");
+
+  if (bind(fd, &addr.u, addr_len) < 0) {
+    LOG(LOGS_ERR, LOGF_Metrics, "Could not bind metrics socket to %s : %s",
+        path ? path : "loopback", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  /* Metrics are not privileged, allow any local user to get them */
+  if (path && chmod(path, 0666) < 0)
+    LOG(LOGS_ERR, LOGF_Metrics, "Could not change permissions of %s : %s",
+        path, strerror(errno));
+
+  if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || listen(fd, MAX_CONNECTIONS) < 0) {
+    LOG(LOGS_ERR, LOGF_Metrics, "Could not listen on metrics socket : %s", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* ================================================== */
+
+void
+MET_Initialise(void)
+{
+  char *path;
+  int i, port;
+
+  assert(!initialised);
+  assert(sizeof (counters) / sizeof (counters[0]) == CNT_Max);
+
+  CNF_GetMetrics(&port, &path, &refresh_interval);
+
+  if (!port && !path)
+    return;
+
+  listen_fd = open_socket(port, path);
+  if (listen_fd < 0)
+    return;
+
+  for (i = 0; i < MAX_CONNECTIONS; i++) {
+    memset(&connections[i], 0, sizeof (connections[i]));
+    connections[i].fd = -1;
+  }
+
+  listen_path = path;
+  snapshot_size = 4096;
+  snapshot = Malloc(snapshot_size);
+  snapshot_valid = 0;
+
+  SCH_AddInputFileHandler(listen_fd, accept_connection, NULL);
+
+  initialised = 1;
+}
+
+/* ================================================== */
+
+void
+MET_Finalise(void)
+{
+  int i;
+
+  if (!initialised)
+    return;
+
+  for (i = 0; i < MAX_CONNECTIONS; i++) {
+    if (connections[i].fd >= 0)
+      close_connection(&connections[i]);
+  }
+
+  SCH_RemoveInputFileHandler(listen_fd);
+  close(listen_fd);
+  listen_fd = -1;
+
+  if (listen_path)
+    unlink(listen_path);
+
+  Free(snapshot);
+  snapshot = NULL;
+
+  initialised = 0;
+}
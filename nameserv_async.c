@@ -54,6 +54,11 @@ struct DNS_Async_Instance {
 
 static int resolving_threads = 0;
 
+#ifndef HAVE_GETADDRINFO
+/* gethostbyname() is not thread-safe */
+static pthread_mutex_t resolving_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* ================================================== */
 
 static void *
@@ -61,8 +66,16 @@ start_resolving(void *anything)
 {
   struct DNS_Async_Instance *inst = (struct DNS_Async_Instance *)anything;
 
+#ifndef HAVE_GETADDRINFO
+  pthread_mutex_lock(&resolving_mutex);
+#endif
+
   inst->status = DNS_Name2IPAddress(inst->name, &inst->addr);
 
+#ifndef HAVE_GETADDRINFO
+  pthread_mutex_unlock(&resolving_mutex);
+#endif
+
   /* Notify the main thread that the result is ready */
   if (write(inst->pipe[1], "", 1) < 0)
     ;
@@ -110,7 +123,7 @@ DNS_Name2IPAddressAsync(const char *name, DNS_NameResolveHandler handler, void *
   }
 
   resolving_threads++;
-  assert(resolving_threads <= 1);
+  assert(resolving_threads <= DNS_MAX_ASYNC_REQUESTS);
 
   if (pthread_create(&inst->thread, NULL, start_resolving, inst)) {
     LOG_FATAL(LOGF_Nameserv, "pthread_create() failed");
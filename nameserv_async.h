@@ -33,6 +33,9 @@
 /* Function type for callback to process the result */
 typedef void (*DNS_NameResolveHandler)(DNS_Status status, IPAddr *ip_addr, void *anything);
 
+/* Maximum number of requests which can be resolved concurrently */
+#define DNS_MAX_ASYNC_REQUESTS 8
+
 /* Request resolving of a name to IP address. The handler will be
    called when the result is available, but it may be also called
    directly from this function call. */
@@ -29,8 +29,10 @@
 
 #include "sysincl.h"
 
+#include "counters.h"
 #include "ntp_core.h"
 #include "ntp_io.h"
+#include "binlog.h"
 #include "memory.h"
 #include "sched.h"
 #include "reference.h"
@@ -143,18 +145,18 @@ struct NCR_Instance_Record {
      parameters for the current reference.  (It must be stored
      relative to local time to permit frequency and offset adjustments
      to be made when we trim the local clock). */
-  struct timeval local_rx;
+  struct timespec local_rx;
 
   /* Local timestamp when we last transmitted a packet to the source.
      We store two versions.  The first is in NTP format, and is used
      to validate the next received packet from the source.
      Additionally, this is corrected to bring it into line with the
-     current reference.  The second is in timeval format, and is kept
+     current reference.  The second is in timespec format, and is kept
      relative to the local clock.  We modify this in accordance with
      local clock frequency/offset changes, and use this for computing
      statistics about the source when a return packet arrives. */
   NTP_int64 local_ntp_tx;
-  struct timeval local_tx;
+  struct timespec local_tx;
 
   /* The instance record in the main source management module.  This
      performs the statistical analysis on the samples we generate */
@@ -174,6 +176,10 @@ struct NCR_Instance_Record {
    minimise risk of network collisions) (in seconds) */
 #define SAMPLING_SEPARATION 0.2
 
+/* Spacing between samples in burst mode, shorter to allow many sources
+   to complete their initial burst in parallel */
+#define BURST_SAMPLING_SEPARATION 0.02
+
 /* Randomness added to spacing between samples for one server/peer */
 #define SAMPLING_RANDOMNESS 0.02
 
@@ -262,20 +268,20 @@ do_size_checks(void)
 static void
 do_time_checks(void)
 {
-  struct timeval now;
+  struct timespec now;
   time_t warning_advance = 3600 * 24 * 365 * 10; /* 10 years */
 
 #ifdef HAVE_LONG_TIME_T
   /* Check that time before NTP_ERA_SPLIT underflows correctly */
 
-  struct timeval tv1 = {NTP_ERA_SPLIT, 1}, tv2 = {NTP_ERA_SPLIT - 1, 1};
+  struct timespec tv1 = {NTP_ERA_SPLIT, 1}, tv2 = {NTP_ERA_SPLIT - 1, 1};
   NTP_int64 ntv1, ntv2;
   int r;
 
-  UTI_TimevalToInt64(&tv1, &ntv1, 0);
-  UTI_TimevalToInt64(&tv2, &ntv2, 0);
-  UTI_Int64ToTimeval(&ntv1, &tv1);
-  UTI_Int64ToTimeval(&ntv2, &tv2);
+  UTI_TimespecToInt64(&tv1, &ntv1, 0);
+  UTI_TimespecToInt64(&tv2, &ntv2, 0);
+  UTI_Int64ToTimespec(&ntv1, &tv1);
+  UTI_Int64ToTimespec(&ntv2, &tv2);
 
   r = tv1.tv_sec == NTP_ERA_SPLIT &&
       tv1.tv_sec + (1ULL << 32) - 1 == tv2.tv_sec;
@@ -302,9 +308,14 @@ NCR_Initialise(void)
   do_size_checks();
   do_time_checks();
 
-  logfileid = CNF_GetLogMeasurements() ? LOG_FileOpen("measurements",
-      "   Date (UTC) Time     IP Address   L St 1234 abc 5678 LP RP Score Offset     Peer del. Peer disp. Root del.  Root disp.")
-    : -1;
+  if (!CNF_GetLogMeasurements())
+    logfileid = -1;
+  else if (CNF_GetLogBinary())
+    logfileid = LOG_FileOpenBinary("measurements", BLG_MEASUREMENTS,
+                                   sizeof (BLG_Measurement));
+  else
+    logfileid = LOG_FileOpen("measurements",
+      "   Date (UTC) Time     IP Address   L St 1234 abc 5678 LP RP Score Offset     Peer del. Peer disp. Root del.  Root disp.");
 
   access_auth_table = ADF_CreateTable();
 }
@@ -334,7 +345,10 @@ restart_timeout(NCR_Instance inst, double delay)
     SCH_RemoveTimeout(inst->timeout_id);
 
   /* Start new timer for transmission */
-  inst->timeout_id = SCH_AddTimeoutInClass(delay, SAMPLING_SEPARATION,
+  inst->timeout_id = SCH_AddTimeoutInClass(delay,
+                                           inst->opmode == MD_BURST_WAS_ONLINE ||
+                                           inst->opmode == MD_BURST_WAS_OFFLINE ?
+                                           BURST_SAMPLING_SEPARATION : SAMPLING_SEPARATION,
                                            SAMPLING_RANDOMNESS,
                                            SCH_NtpSamplingClass,
                                            transmit_timeout, (void *)inst);
@@ -506,9 +520,9 @@ NCR_ResetInstance(NCR_Instance instance)
   instance->remote_orig.hi = 0;
   instance->remote_orig.lo = 0;
   instance->local_rx.tv_sec = 0;
-  instance->local_rx.tv_usec = 0;
+  instance->local_rx.tv_nsec = 0;
   instance->local_tx.tv_sec = 0;
-  instance->local_tx.tv_usec = 0;
+  instance->local_tx.tv_nsec = 0;
   instance->local_ntp_tx.hi = 0;
   instance->local_ntp_tx.lo = 0;
 
@@ -688,8 +702,8 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
                 int do_auth, /* Boolean indicating whether to authenticate the packet or not */
                 unsigned long key_id, /* The authentication key ID */
                 NTP_int64 *orig_ts, /* Originate timestamp (from received packet) */
-                struct timeval *local_rx, /* Local time request packet was received */
-                struct timeval *local_tx, /* RESULT : Time this reply
+                struct timespec *local_rx, /* Local time request packet was received */
+                struct timespec *local_tx, /* RESULT : Time this reply
                                              is sent as local time, or
                                              NULL if don't want to
                                              know */
@@ -704,13 +718,13 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
 {
   NTP_Packet message;
   int leap, ret;
-  struct timeval local_transmit;
+  struct timespec local_transmit;
 
   /* Parameters read from reference module */
   int are_we_synchronised, our_stratum;
   NTP_Leap leap_status;
   uint32_t our_ref_id, ts_fuzz;
-  struct timeval our_ref_time;
+  struct timespec our_ref_time;
   double our_root_delay, our_root_dispersion;
 
   /* Don't reply with version higher than ours */
@@ -754,7 +768,7 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
   message.reference_id = htonl((NTP_int32) our_ref_id);
 
   /* Now fill in timestamps */
-  UTI_TimevalToInt64(&our_ref_time, &message.reference_ts, 0);
+  UTI_TimespecToInt64(&our_ref_time, &message.reference_ts, 0);
 
   /* Originate - this comes from the last packet the source sent us */
   message.originate_ts = *orig_ts;
@@ -763,7 +777,7 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
      This timestamp will have been adjusted so that it will now look to
      the source like we have been running on our latest estimate of
      frequency all along */
-  UTI_TimevalToInt64(local_rx, &message.receive_ts, 0);
+  UTI_TimespecToInt64(local_rx, &message.receive_ts, 0);
 
   /* Prepare random bits which will be added to the transmit timestamp. */
   ts_fuzz = UTI_GetNTPTsFuzz(message.precision);
@@ -778,9 +792,9 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
     int auth_len;
     /* Pre-compensate the transmit time by approx. how long it will
        take to generate the authentication data. */
-    local_transmit.tv_usec += KEY_GetAuthDelay(key_id);
-    UTI_NormaliseTimeval(&local_transmit);
-    UTI_TimevalToInt64(&local_transmit, &message.transmit_ts, ts_fuzz);
+    local_transmit.tv_nsec += KEY_GetAuthDelay(key_id);
+    UTI_NormaliseTimespec(&local_transmit);
+    UTI_TimespecToInt64(&local_transmit, &message.transmit_ts, ts_fuzz);
 
     auth_len = KEY_GenerateAuth(key_id, (unsigned char *) &message,
         offsetof(NTP_Packet, auth_keyid),
@@ -796,7 +810,7 @@ transmit_packet(NTP_Mode my_mode, /* The mode this machine wants to be */
       return 0;
     }
   } else {
-    UTI_TimevalToInt64(&local_transmit, &message.transmit_ts, ts_fuzz);
+    UTI_TimespecToInt64(&local_transmit, &message.transmit_ts, ts_fuzz);
     ret = NIO_SendNormalPacket(&message, where_to, from);
   }
 
@@ -923,7 +937,7 @@ transmit_timeout(void *arg)
 /* ================================================== */
 
 static void
-receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Instance inst, int auth_len)
+receive_packet(NTP_Packet *message, struct timespec *now, double now_err, NCR_Instance inst, int auth_len)
 {
   int pkt_leap;
   int source_is_synchronized;
@@ -937,7 +951,7 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
      the same as either the transmit or receive time.  The difference comes
      in symmetric active mode, when the receive may come minutes after the transmit, and this time
      will be midway between the two */
-  struct timeval sample_time;
+  struct timespec sample_time;
 
   /* The estimated offset (nomenclature from RFC1305 section 3.4.4).
      In seconds, a positive value indicates that the local clock is
@@ -966,10 +980,10 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
   /* The estimated skew relative to the remote source. */
   double source_freq_lo, source_freq_hi;
 
-  /* These are the timeval equivalents of the remote epochs */  
-  struct timeval remote_receive_tv, remote_transmit_tv;
-  struct timeval remote_reference_tv;
-  struct timeval local_average, remote_average;
+  /* These are the timespec equivalents of the remote epochs */  
+  struct timespec remote_receive_tv, remote_transmit_tv;
+  struct timespec remote_reference_tv;
+  struct timespec local_average, remote_average;
   double local_interval, remote_interval;
 
   int test1, test2, test3, test4, test5, test6, test7, test7i, test7ii, test8;
@@ -1049,15 +1063,15 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
 
   SRC_GetFrequencyRange(inst->source, &source_freq_lo, &source_freq_hi);
 
-  UTI_Int64ToTimeval(&message->receive_ts, &remote_receive_tv);
-  UTI_Int64ToTimeval(&message->transmit_ts, &remote_transmit_tv);
+  UTI_Int64ToTimespec(&message->receive_ts, &remote_receive_tv);
+  UTI_Int64ToTimespec(&message->transmit_ts, &remote_transmit_tv);
 
   if (test3) {
     
-    UTI_AverageDiffTimevals(&remote_receive_tv, &remote_transmit_tv,
+    UTI_AverageDiffTimespecs(&remote_receive_tv, &remote_transmit_tv,
                             &remote_average, &remote_interval);
 
-    UTI_AverageDiffTimevals(&inst->local_tx, now,
+    UTI_AverageDiffTimespecs(&inst->local_tx, now,
                             &local_average, &local_interval);
 
     /* In our case, we work out 'delta' as the worst case delay,
@@ -1069,7 +1083,7 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
     /* Calculate theta.  Following the NTP definition, this is negative
        if we are fast of the remote source. */
     
-    UTI_DiffTimevalsToDouble(&theta, &remote_average, &local_average);
+    UTI_DiffTimespecsToDouble(&theta, &remote_average, &local_average);
     
     /* We treat the time of the sample as being midway through the local
        measurement period.  An analysis assuming constant relative
@@ -1157,9 +1171,9 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
      transmit timestamp is not before the time it was synchronized (clearly
      bogus if it is), and (iii) that it was not synchronised too long ago
      */
-  UTI_Int64ToTimeval(&message->reference_ts, &remote_reference_tv);
+  UTI_Int64ToTimespec(&message->reference_ts, &remote_reference_tv);
   if ((!source_is_synchronized) ||
-      (UTI_CompareTimevals(&remote_reference_tv, &remote_transmit_tv) == 1) ||
+      (UTI_CompareTimespecs(&remote_reference_tv, &remote_transmit_tv) == 1) ||
       ((remote_reference_tv.tv_sec + NTP_MAXAGE - remote_transmit_tv.tv_sec) < 0)) {
     test6 = 0; /* Failed */
   } else {
@@ -1223,6 +1237,31 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
   valid_header = test5 && test6 && test7i && test8;
   good_header = valid_header && test7ii;
 
+  if (!test1)
+    CNT_INC(CNT_NtpTest1Failed);
+  if (!test2)
+    CNT_INC(CNT_NtpTest2Failed);
+  if (!test3)
+    CNT_INC(CNT_NtpTest3Failed);
+  if (!test4)
+    CNT_INC(CNT_NtpTest4Failed);
+  if (!test4a)
+    CNT_INC(CNT_NtpTest4aFailed);
+  if (!test4b)
+    CNT_INC(CNT_NtpTest4bFailed);
+  if (!test4c)
+    CNT_INC(CNT_NtpTest4cFailed);
+  if (!test5) {
+    CNT_INC(CNT_NtpTest5Failed);
+    CNT_INC(CNT_NtpAuthFailed);
+  }
+  if (!test6)
+    CNT_INC(CNT_NtpTest6Failed);
+  if (!test7)
+    CNT_INC(CNT_NtpTest7Failed);
+  if (!test8)
+    CNT_INC(CNT_NtpTest8Failed);
+
   root_delay = pkt_root_delay + fabs(delta);
   root_dispersion = pkt_root_dispersion + epsilon;
 
@@ -1367,7 +1406,31 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
   }
 
   /* Do measurement logging */
-  if (logfileid != -1) {
+  if (logfileid != -1 && LOG_FileIsBinary(logfileid)) {
+    BLG_Measurement record;
+
+    memset(&record, 0, sizeof (record));
+    UTI_TimespecHostToNetwork(&sample_time, &record.time);
+    UTI_IPHostToNetwork(&inst->remote_addr.ip_addr, &record.ip_addr);
+    record.leap = pkt_leap;
+    record.stratum = message->stratum;
+    record.tests = htons((test1 ? BLG_TEST1 : 0) | (test2 ? BLG_TEST2 : 0) |
+                         (test3 ? BLG_TEST3 : 0) | (test4 ? BLG_TEST4 : 0) |
+                         (test4a ? BLG_TEST4A : 0) | (test4b ? BLG_TEST4B : 0) |
+                         (test4c ? BLG_TEST4C : 0) | (test5 ? BLG_TEST5 : 0) |
+                         (test6 ? BLG_TEST6 : 0) | (test7 ? BLG_TEST7 : 0) |
+                         (test8 ? BLG_TEST8 : 0));
+    record.local_poll = inst->local_poll;
+    record.remote_poll = inst->remote_poll;
+    record.score = UTI_FloatHostToNetwork(inst->poll_score);
+    record.offset = UTI_FloatHostToNetwork(theta);
+    record.peer_delay = UTI_FloatHostToNetwork(delta);
+    record.peer_dispersion = UTI_FloatHostToNetwork(epsilon);
+    record.root_delay = UTI_FloatHostToNetwork(pkt_root_delay);
+    record.root_dispersion = UTI_FloatHostToNetwork(pkt_root_dispersion);
+
+    LOG_FileWriteRecord(logfileid, &record);
+  } else if (logfileid != -1) {
     LOG_FileWrite(logfileid, "%s %-15s %1c %2d %1d%1d%1d%1d %1d%1d%1d %1d%1d%1d%1d %2d %2d %4.2f %10.3e %10.3e %10.3e %10.3e %10.3e",
             UTI_TimeToLogForm(sample_time.tv_sec),
             UTI_IPToString(&inst->remote_addr.ip_addr),
@@ -1410,7 +1473,7 @@ receive_packet(NTP_Packet *message, struct timeval *now, double now_err, NCR_Ins
 void
 NCR_ProcessKnown
 (NTP_Packet *message,           /* the received message */
- struct timeval *now,           /* timestamp at time of receipt */
+ struct timespec *now,           /* timestamp at time of receipt */
  double now_err,
  NCR_Instance inst,             /* the instance record for this peer/server */
  int sock_fd,                   /* the receiving socket */
@@ -1583,7 +1646,7 @@ NCR_ProcessKnown
 void
 NCR_ProcessUnknown
 (NTP_Packet *message,           /* the received message */
- struct timeval *now,           /* timestamp at time of receipt */
+ struct timespec *now,           /* timestamp at time of receipt */
  double now_err,                /* assumed error in the timestamp */
  NTP_Remote_Address *remote_addr,
  NTP_Local_Address *local_addr,
@@ -1641,6 +1704,8 @@ NCR_ProcessUnknown
         key_id = ntohl(message->auth_keyid);
         do_auth = 1;
         valid_auth = check_packet_auth(message, key_id, auth_len);
+        if (!valid_auth)
+          CNT_INC(CNT_NtpAuthFailed);
       }
 
       if (!do_auth || valid_auth) {
@@ -1668,20 +1733,20 @@ NCR_ProcessUnknown
 /* ================================================== */
 
 void
-NCR_SlewTimes(NCR_Instance inst, struct timeval *when, double dfreq, double doffset)
+NCR_SlewTimes(NCR_Instance inst, struct timespec *when, double dfreq, double doffset)
 {
-  struct timeval prev;
+  struct timespec prev;
   double delta;
   prev = inst->local_rx;
-  if (inst->local_rx.tv_sec || inst->local_rx.tv_usec)
-    UTI_AdjustTimeval(&inst->local_rx, when, &inst->local_rx, &delta, dfreq, doffset);
+  if (inst->local_rx.tv_sec || inst->local_rx.tv_nsec)
+    UTI_AdjustTimespec(&inst->local_rx, when, &inst->local_rx, &delta, dfreq, doffset);
   DEBUG_LOG(LOGF_NtpCore, "rx prev=[%s] new=[%s]",
-      UTI_TimevalToString(&prev), UTI_TimevalToString(&inst->local_rx));
+      UTI_TimespecToString(&prev), UTI_TimespecToString(&inst->local_rx));
   prev = inst->local_tx;
-  if (inst->local_tx.tv_sec || inst->local_tx.tv_usec)
-    UTI_AdjustTimeval(&inst->local_tx, when, &inst->local_tx, &delta, dfreq, doffset);
+  if (inst->local_tx.tv_sec || inst->local_tx.tv_nsec)
+    UTI_AdjustTimespec(&inst->local_tx, when, &inst->local_tx, &delta, dfreq, doffset);
   DEBUG_LOG(LOGF_NtpCore, "tx prev=[%s] new=[%s]",
-      UTI_TimevalToString(&prev), UTI_TimevalToString(&inst->local_tx));
+      UTI_TimespecToString(&prev), UTI_TimespecToString(&inst->local_tx));
 }
 
 /* ================================================== */
@@ -1846,7 +1911,7 @@ NCR_InitiateSampleBurst(NCR_Instance inst, int n_good_samples, int n_total_sampl
 /* ================================================== */
 
 void
-NCR_ReportSource(NCR_Instance inst, RPT_SourceReport *report, struct timeval *now)
+NCR_ReportSource(NCR_Instance inst, RPT_SourceReport *report, struct timespec *now)
 {
   report->poll = inst->local_poll;
 
@@ -30,6 +30,7 @@
 
 #include "sysincl.h"
 
+#include "counters.h"
 #include "ntp_io.h"
 #include "ntp_core.h"
 #include "ntp_sources.h"
@@ -64,6 +65,46 @@ static int separate_client_sockets;
 /* Flag indicating that we have been initialised */
 static int initialised=0;
 
+/* Histogram of the latency of server replies, measured from the receive
+   timestamp of the request to the return from sendmsg() with the reply.
+   The buckets cover values in microseconds with a constant relative
+   error (HDR-style): values below 2 * LATENCY_SUB_BUCKETS have their own
+   bucket, each larger power of 2 is split to LATENCY_SUB_BUCKETS
+   buckets. */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BIT 26
+#define LATENCY_BUCKETS ((LATENCY_MAX_BIT - LATENCY_SUB_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+static int measure_latency;
+static unsigned long latency_histogram[LATENCY_BUCKETS];
+static unsigned long latency_count;
+static double latency_sum;
+static double latency_max;
+
+/* The largest latencies, ordered from the largest */
+typedef struct {
+  IPAddr ip_addr;
+  struct timespec when;
+  double latency;
+} WorstLatency;
+
+static WorstLatency worst_latencies[RPT_MAX_WORST_LATENCIES];
+static int n_worst_latencies;
+
+/* Request received on a server socket which is being processed */
+static int latency_rx_pending;
+static int latency_rx_sock_fd;
+static struct timespec latency_rx_raw_ts;
+static struct timespec latency_rx_ts;
+
+/* Multicast options last set on the IPv4 and IPv6 server sockets */
+static int multicast_ttl4, multicast_ttl6;
+static unsigned int multicast_if4, multicast_if6;
+
+/* Maximum number of packets sent in one sendmmsg() call */
+#define MAX_SEND_MESSAGES 64
+
 /* ================================================== */
 
 /* Forward prototypes */
@@ -155,8 +196,14 @@ prepare_socket(int family, int port_number, int client_only)
     /* Don't quit - we might survive anyway */
   }
 
-#ifdef SO_TIMESTAMP
-  /* Enable receiving of timestamp control messages */
+  /* Enable receiving of timestamp control messages, with nanosecond
+     resolution if supported */
+#ifdef SO_TIMESTAMPNS
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_TIMESTAMPNS, (char *)&on_off, sizeof(on_off)) < 0) {
+    LOG(LOGS_ERR, LOGF_NtpIO, "Could not set timestamp socket options");
+    /* Don't quit - we might survive anyway */
+  }
+#elif defined(SO_TIMESTAMP)
   if (setsockopt(sock_fd, SOL_SOCKET, SO_TIMESTAMP, (char *)&on_off, sizeof(on_off)) < 0) {
     LOG(LOGS_ERR, LOGF_NtpIO, "Could not set timestamp socket options");
     /* Don't quit - we might survive anyway */
@@ -237,33 +284,40 @@ prepare_separate_client_socket(int family)
 
 /* ================================================== */
 
-static int
-connect_socket(int sock_fd, NTP_Remote_Address *remote_addr)
+static socklen_t
+get_sockaddr(NTP_Remote_Address *remote_addr, union sockaddr_in46 *addr)
 {
-  union sockaddr_in46 addr;
-  socklen_t addr_len;
-
-  memset(&addr, 0, sizeof (addr));
+  memset(addr, 0, sizeof (*addr));
 
   switch (remote_addr->ip_addr.family) {
     case IPADDR_INET4:
-      addr_len = sizeof (addr.in4);
-      addr.in4.sin_family = AF_INET;
-      addr.in4.sin_addr.s_addr = htonl(remote_addr->ip_addr.addr.in4);
-      addr.in4.sin_port = htons(remote_addr->port);
-      break;
+      addr->in4.sin_family = AF_INET;
+      addr->in4.sin_addr.s_addr = htonl(remote_addr->ip_addr.addr.in4);
+      addr->in4.sin_port = htons(remote_addr->port);
+      return sizeof (addr->in4);
 #ifdef HAVE_IPV6
     case IPADDR_INET6:
-      addr_len = sizeof (addr.in6);
-      addr.in6.sin6_family = AF_INET6;
-      memcpy(addr.in6.sin6_addr.s6_addr, remote_addr->ip_addr.addr.in6,
-             sizeof (addr.in6.sin6_addr.s6_addr));
-      addr.in6.sin6_port = htons(remote_addr->port);
-      break;
+      addr->in6.sin6_family = AF_INET6;
+      memcpy(addr->in6.sin6_addr.s6_addr, remote_addr->ip_addr.addr.in6,
+             sizeof (addr->in6.sin6_addr.s6_addr));
+      addr->in6.sin6_port = htons(remote_addr->port);
+      return sizeof (addr->in6);
 #endif
     default:
-      assert(0);
+      return 0;
   }
+}
+
+/* ================================================== */
+
+static int
+connect_socket(int sock_fd, NTP_Remote_Address *remote_addr)
+{
+  union sockaddr_in46 addr;
+  socklen_t addr_len;
+
+  addr_len = get_sockaddr(remote_addr, &addr);
+  assert(addr_len);
 
   if (connect(sock_fd, &addr.u, addr_len) < 0) {
     DEBUG_LOG(LOGF_NtpIO, "Could not connect NTP socket to %s:%d : %s",
@@ -294,6 +348,17 @@ NIO_Initialise(int family)
   int server_port, client_port;
 
   assert(!initialised);
+  measure_latency = CNF_GetServerLatency();
+  memset(latency_histogram, 0, sizeof (latency_histogram));
+  latency_count = 0;
+  latency_sum = latency_max = 0.0;
+  n_worst_latencies = 0;
+  latency_rx_pending = 0;
+
+  /* Unknown until set */
+  multicast_ttl4 = multicast_ttl6 = -1;
+  multicast_if4 = multicast_if6 = -1;
+
   initialised = 1;
 
   server_port = CNF_GetNTPPort();
@@ -437,6 +502,122 @@ NIO_IsServerSocket(int sock_fd)
 
 /* ================================================== */
 
+static void
+count_packet(int received, int family, int sock_fd)
+{
+  switch (family) {
+    case IPADDR_INET4:
+      if (sock_fd == server_sock_fd4)
+        CNT_INC(received ? CNT_NtpServerRx4 : CNT_NtpServerTx4);
+      else
+        CNT_INC(received ? CNT_NtpClientRx4 : CNT_NtpClientTx4);
+      break;
+#ifdef HAVE_IPV6
+    case IPADDR_INET6:
+      if (sock_fd == server_sock_fd6)
+        CNT_INC(received ? CNT_NtpServerRx6 : CNT_NtpServerTx6);
+      else
+        CNT_INC(received ? CNT_NtpClientRx6 : CNT_NtpClientTx6);
+      break;
+#endif
+  }
+}
+
+/* ================================================== */
+
+static int
+get_latency_bucket(unsigned long us)
+{
+  int k;
+
+  if (us >= 1UL << (LATENCY_MAX_BIT + 1))
+    us = (1UL << (LATENCY_MAX_BIT + 1)) - 1;
+
+  if (us < 2 * LATENCY_SUB_BUCKETS)
+    return us;
+
+  /* Find the highest bit set */
+  for (k = 0; us >> (k + 1); k++)
+    ;
+
+  return (k - LATENCY_SUB_BITS) * LATENCY_SUB_BUCKETS + (us >> (k - LATENCY_SUB_BITS));
+}
+
+/* ================================================== */
+
+static unsigned long
+get_latency_bucket_start(int bucket)
+{
+  int k;
+
+  if (bucket < 2 * LATENCY_SUB_BUCKETS)
+    return bucket;
+
+  k = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+
+  return (unsigned long)(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) <<
+         (k - LATENCY_SUB_BITS);
+}
+
+/* ================================================== */
+
+static void
+record_server_latency(IPAddr *ip_addr)
+{
+  struct timespec now;
+  double latency;
+  int i;
+
+  LCL_ReadRawTime(&now);
+  UTI_DiffTimespecsToDouble(&latency, &now, &latency_rx_raw_ts);
+  if (latency < 0.0)
+    latency = 0.0;
+
+  latency_histogram[get_latency_bucket(latency < 1e3 ? latency * 1e6 : 1e9)]++;
+  latency_count++;
+  latency_sum += latency;
+  if (latency_max < latency)
+    latency_max = latency;
+
+  if (n_worst_latencies < RPT_MAX_WORST_LATENCIES ||
+      worst_latencies[n_worst_latencies - 1].latency < latency) {
+    if (n_worst_latencies < RPT_MAX_WORST_LATENCIES)
+      n_worst_latencies++;
+
+    for (i = n_worst_latencies - 1; i > 0 && worst_latencies[i - 1].latency < latency; i--)
+      worst_latencies[i] = worst_latencies[i - 1];
+
+    worst_latencies[i].ip_addr = *ip_addr;
+    worst_latencies[i].when = latency_rx_ts;
+    worst_latencies[i].latency = latency;
+  }
+}
+
+/* ================================================== */
+
+static double
+get_latency_percentile(double percentile)
+{
+  unsigned long target, sum;
+  double latency;
+  int i;
+
+  target = ceil(percentile / 100.0 * latency_count);
+
+  for (i = 0, sum = 0; i < LATENCY_BUCKETS - 1; i++) {
+    sum += latency_histogram[i];
+    if (sum >= target)
+      break;
+  }
+
+  /* Return the end of the bucket, but not more than the maximum */
+  latency = get_latency_bucket_start(i + 1) * 1e-6;
+
+  return latency < latency_max ? latency : latency_max;
+}
+
+/* ================================================== */
+
 static void
 read_from_socket(void *anything)
 {
@@ -447,7 +628,7 @@ read_from_socket(void *anything)
   ReceiveBuffer message;
   union sockaddr_in46 where_from;
   unsigned int flags = 0;
-  struct timeval now;
+  struct timespec now, raw_now;
   double now_err;
   NTP_Remote_Address remote_addr;
   NTP_Local_Address local_addr;
@@ -458,7 +639,7 @@ read_from_socket(void *anything)
 
   assert(initialised);
 
-  SCH_GetLastEventTime(&now, &now_err, NULL);
+  SCH_GetLastEventTime(&now, &now_err, &raw_now);
 
   iov.iov_base = message.arbitrary;
   iov.iov_len = sizeof(message);
@@ -527,12 +708,23 @@ read_from_socket(void *anything)
       }
 #endif
 
-#ifdef SO_TIMESTAMP
-      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+#ifdef SO_TIMESTAMPNS
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        LCL_CookTime(&ts, &now, &now_err);
+        raw_now = ts;
+      }
+#elif defined(SO_TIMESTAMP)
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
         struct timeval tv;
+        struct timespec ts;
 
         memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
-        LCL_CookTime(&tv, &now, &now_err);
+        UTI_TimevalToTimespec(&tv, &ts);
+        LCL_CookTime(&ts, &now, &now_err);
+        raw_now = ts;
       }
 #endif
     }
@@ -546,12 +738,26 @@ read_from_socket(void *anything)
 
     if (status >= NTP_NORMAL_PACKET_SIZE && status <= sizeof(NTP_Packet)) {
 
+      count_packet(1, remote_addr.ip_addr.family, sock_fd);
+
+      /* A reply to a request received on a server socket is sent before
+         NSR_ProcessReceive() returns */
+      if (measure_latency && NIO_IsServerSocket(sock_fd)) {
+        latency_rx_pending = 1;
+        latency_rx_sock_fd = sock_fd;
+        latency_rx_raw_ts = raw_now;
+        latency_rx_ts = now;
+      }
+
       NSR_ProcessReceive((NTP_Packet *) &message.ntp_pkt, &now, now_err,
                          &remote_addr, &local_addr, status);
 
+      latency_rx_pending = 0;
+
     } else {
 
       /* Just ignore the packet if it's not of a recognized length */
+      CNT_INC(CNT_NtpRxDropped);
 
     }
   }
@@ -670,9 +876,17 @@ send_packet(void *packet, int packetlen, NTP_Remote_Address *remote_addr, NTP_Lo
         UTI_IPToString(&remote_addr->ip_addr), remote_addr->port,
         UTI_IPToString(&local_addr->ip_addr), local_addr->sock_fd,
         strerror(errno));
+    CNT_INC(CNT_NtpTxErrors);
     return 0;
   }
 
+  count_packet(0, remote_addr->ip_addr.family, local_addr->sock_fd);
+
+  if (latency_rx_pending && local_addr->sock_fd == latency_rx_sock_fd) {
+    record_server_latency(&remote_addr->ip_addr);
+    latency_rx_pending = 0;
+  }
+
   DEBUG_LOG(LOGF_NtpIO, "Sent to %s:%d from %s fd %d",
       UTI_IPToString(&remote_addr->ip_addr), remote_addr->port,
       UTI_IPToString(&local_addr->ip_addr), local_addr->sock_fd);
@@ -697,3 +911,185 @@ NIO_SendAuthenticatedPacket(NTP_Packet *packet, NTP_Remote_Address *remote_addr,
 {
   return send_packet((void *) packet, NTP_NORMAL_PACKET_SIZE + auth_len, remote_addr, local_addr);
 }
+
+/* ================================================== */
+/* Send a packet to a number of addresses using a single socket */
+
+int
+NIO_SendPacketToMany(NTP_Packet *packet, int length, NTP_Remote_Address *remote_addrs,
+                     int n_addrs, int sock_fd)
+{
+  union sockaddr_in46 addrs[MAX_SEND_MESSAGES];
+  socklen_t addr_lens[MAX_SEND_MESSAGES];
+#ifdef HAVE_SENDMMSG
+  struct mmsghdr hdrs[MAX_SEND_MESSAGES];
+#else
+  struct msghdr hdr;
+#endif
+  struct iovec iov;
+  int i, j, n, r, sent = 0;
+
+  assert(initialised);
+
+  if (sock_fd == INVALID_SOCK_FD)
+    return 0;
+
+  iov.iov_base = packet;
+  iov.iov_len = length;
+
+  for (i = 0; i < n_addrs; i += n) {
+    /* Prepare a batch of messages with valid addresses */
+    for (j = n = 0; i + n < n_addrs && j < MAX_SEND_MESSAGES; n++) {
+      addr_lens[j] = get_sockaddr(&remote_addrs[i + n], &addrs[j]);
+      if (!addr_lens[j])
+        continue;
+#ifdef HAVE_SENDMMSG
+      memset(&hdrs[j], 0, sizeof (hdrs[j]));
+      hdrs[j].msg_hdr.msg_name = &addrs[j].u;
+      hdrs[j].msg_hdr.msg_namelen = addr_lens[j];
+      hdrs[j].msg_hdr.msg_iov = &iov;
+      hdrs[j].msg_hdr.msg_iovlen = 1;
+#endif
+      j++;
+    }
+
+#ifdef HAVE_SENDMMSG
+    /* On error sendmmsg() returns the number of messages sent before the
+       failed message, skip the failed message and continue */
+    for (r = 0; r < j; ) {
+      int ret = sendmmsg(sock_fd, hdrs + r, j - r, 0);
+
+      if (ret <= 0) {
+        DEBUG_LOG(LOGF_NtpIO, "Could not send to fd %d : %s", sock_fd, strerror(errno));
+        CNT_INC(CNT_NtpTxErrors);
+        r++;
+        continue;
+      }
+
+      r += ret;
+      sent += ret;
+    }
+#else
+    for (r = 0; r < j; r++) {
+      memset(&hdr, 0, sizeof (hdr));
+      hdr.msg_name = &addrs[r].u;
+      hdr.msg_namelen = addr_lens[r];
+      hdr.msg_iov = &iov;
+      hdr.msg_iovlen = 1;
+
+      if (sendmsg(sock_fd, &hdr, 0) < 0) {
+        DEBUG_LOG(LOGF_NtpIO, "Could not send to fd %d : %s", sock_fd, strerror(errno));
+        CNT_INC(CNT_NtpTxErrors);
+        continue;
+      }
+
+      sent++;
+    }
+#endif
+  }
+
+  for (i = 0; i < sent; i++)
+    count_packet(0, remote_addrs[0].ip_addr.family, sock_fd);
+
+  DEBUG_LOG(LOGF_NtpIO, "Sent %d of %d packets from fd %d", sent, n_addrs, sock_fd);
+
+  return sent;
+}
+
+/* ================================================== */
+/* Set the TTL (hop limit) and interface of multicast packets sent from
+   a server socket, ttl of 1 and if_index of 0 are the system defaults */
+
+int
+NIO_SetMulticastOptions(int sock_fd, int ttl, unsigned int if_index)
+{
+  assert(initialised);
+
+  if (sock_fd == INVALID_SOCK_FD)
+    return 0;
+
+  if (sock_fd == server_sock_fd4) {
+    unsigned char ttl4 = ttl;
+
+    if (ttl != multicast_ttl4) {
+      if (setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl4, sizeof (ttl4)) < 0) {
+        LOG(LOGS_ERR, LOGF_NtpIO, "Could not set multicast TTL socket option");
+        return 0;
+      }
+      multicast_ttl4 = ttl;
+    }
+
+    if (if_index != multicast_if4) {
+#ifdef LINUX
+      struct ip_mreqn mreq;
+
+      memset(&mreq, 0, sizeof (mreq));
+      mreq.imr_ifindex = if_index;
+      if (setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof (mreq)) < 0) {
+        LOG(LOGS_ERR, LOGF_NtpIO, "Could not set multicast interface socket option");
+        return 0;
+      }
+#else
+      if (if_index) {
+        LOG(LOGS_ERR, LOGF_NtpIO, "Multicast interface not supported");
+        return 0;
+      }
+#endif
+      multicast_if4 = if_index;
+    }
+
+    return 1;
+  }
+
+#ifdef HAVE_IPV6
+  if (sock_fd == server_sock_fd6) {
+    if (ttl != multicast_ttl6) {
+      if (setsockopt(sock_fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof (ttl)) < 0) {
+        LOG(LOGS_ERR, LOGF_NtpIO, "Could not set multicast hop limit socket option");
+        return 0;
+      }
+      multicast_ttl6 = ttl;
+    }
+
+    if (if_index != multicast_if6) {
+      if (setsockopt(sock_fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &if_index, sizeof (if_index)) < 0) {
+        LOG(LOGS_ERR, LOGF_NtpIO, "Could not set multicast interface socket option");
+        return 0;
+      }
+      multicast_if6 = if_index;
+    }
+
+    return 1;
+  }
+#endif
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+NIO_GetServerLatencyReport(RPT_ServerLatencyReport *report)
+{
+  int i;
+
+  if (!measure_latency)
+    return 0;
+
+  report->count = latency_count;
+  report->mean = latency_count ? latency_sum / latency_count : 0.0;
+  report->p50 = get_latency_percentile(50.0);
+  report->p90 = get_latency_percentile(90.0);
+  report->p99 = get_latency_percentile(99.0);
+  report->p999 = get_latency_percentile(99.9);
+  report->max = latency_max;
+
+  report->n_worst = n_worst_latencies;
+  for (i = 0; i < n_worst_latencies; i++) {
+    report->worst[i].ip_addr = worst_latencies[i].ip_addr;
+    report->worst[i].when = worst_latencies[i].when;
+    report->worst[i].latency = worst_latencies[i].latency;
+  }
+
+  return 1;
+}
@@ -31,6 +31,7 @@
 
 #include "ntp.h"
 #include "addressing.h"
+#include "reports.h"
 
 /* Function to initialise the module. */
 extern void NIO_Initialise(int family);
@@ -56,4 +57,16 @@ extern int NIO_SendNormalPacket(NTP_Packet *packet, NTP_Remote_Address *remote_a
 /* Function to transmit an authenticated packet */
 extern int NIO_SendAuthenticatedPacket(NTP_Packet *packet, NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr, int auth_len);
 
+/* Function to transmit a packet to multiple addresses, returns the
+   number of sent packets */
+extern int NIO_SendPacketToMany(NTP_Packet *packet, int length, NTP_Remote_Address *remote_addrs, int n_addrs, int sock_fd);
+
+/* Function to set the TTL and interface of multicast packets sent from
+   a server socket */
+extern int NIO_SetMulticastOptions(int sock_fd, int ttl, unsigned int if_index);
+
+/* Function to get a report of the latency of server replies, returns 0
+   if the measurement is not enabled */
+extern int NIO_GetServerLatencyReport(RPT_ServerLatencyReport *report);
+
 #endif /* GOT_NTP_IO_H */
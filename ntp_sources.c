@@ -81,17 +81,21 @@ struct UnresolvedSource {
 static struct UnresolvedSource *unresolved_sources = NULL;
 static int resolving_interval = 0;
 static SCH_TimeoutID resolving_id;
-static struct UnresolvedSource *resolving_source = NULL;
+/* Number of names being resolved and the next source to be resolved in
+   the current round */
+static int n_resolving_sources = 0;
+static struct UnresolvedSource *next_resolving_source = NULL;
 static NSR_SourceResolvingEndHandler resolving_end_handler = NULL;
 
 /* ================================================== */
 /* Forward prototypes */
 
 static void resolve_sources(void *arg);
+static void name_resolve_handler(DNS_Status status, IPAddr *ip_addr, void *anything);
 
 static void
-slew_sources(struct timeval *raw,
-             struct timeval *cooked,
+slew_sources(struct timespec *raw,
+             struct timespec *cooked,
              double dfreq,
              double doffset,
              LCL_ChangeType change_type,
@@ -223,15 +227,35 @@ NSR_AddSource(NTP_Remote_Address *remote_addr, NTP_Source_Type type, SourceParam
 
 /* ================================================== */
 
+static void
+start_resolving(void)
+{
+  struct UnresolvedSource *us;
+
+  /* Resolve multiple names concurrently, so the sources whose addresses
+     are known first can start sampling without waiting for the others */
+  while (next_resolving_source && n_resolving_sources < DNS_MAX_ASYNC_REQUESTS) {
+    us = next_resolving_source;
+    next_resolving_source = us->next;
+    n_resolving_sources++;
+
+    DEBUG_LOG(LOGF_NtpSources, "resolving %s", us->name);
+    DNS_Name2IPAddressAsync(us->name, name_resolve_handler, us);
+  }
+}
+
+/* ================================================== */
+
 static void
 name_resolve_handler(DNS_Status status, IPAddr *ip_addr, void *anything)
 {
-  struct UnresolvedSource *us, **i, *next;
+  struct UnresolvedSource *us, **i;
   NTP_Remote_Address address;
 
   us = (struct UnresolvedSource *)anything;
 
-  assert(us == resolving_source);
+  assert(n_resolving_sources > 0);
+  n_resolving_sources--;
 
   switch (status) {
     case DNS_TryAgain:
@@ -249,8 +273,6 @@ name_resolve_handler(DNS_Status status, IPAddr *ip_addr, void *anything)
       assert(0);
   }
 
-  next = us->next;
-
   if (status != DNS_TryAgain) {
     /* Remove the source from the list */
     for (i = &unresolved_sources; *i; i = &(*i)->next) {
@@ -263,13 +285,10 @@ name_resolve_handler(DNS_Status status, IPAddr *ip_addr, void *anything)
     }
   }
 
-  resolving_source = next;
-
-  if (next) {
+  if (next_resolving_source) {
     /* Continue with the next source in the list */
-    DEBUG_LOG(LOGF_NtpSources, "resolving %s", next->name);
-    DNS_Name2IPAddressAsync(next->name, name_resolve_handler, next);
-  } else {
+    start_resolving();
+  } else if (!n_resolving_sources) {
     /* This was the last source in the list. If some sources couldn't
        be resolved, try again in exponentially increasing interval. */
     if (unresolved_sources) {
@@ -294,19 +313,14 @@ name_resolve_handler(DNS_Status status, IPAddr *ip_addr, void *anything)
 static void
 resolve_sources(void *arg)
 {
-  struct UnresolvedSource *us;
-
-  assert(!resolving_source);
+  assert(!n_resolving_sources && !next_resolving_source);
 
   DNS_Reload();
 
-  /* Start with the first source in the list, name_resolve_handler
-     will iterate over the rest */
-  us = unresolved_sources;
-
-  resolving_source = us;
-  DEBUG_LOG(LOGF_NtpSources, "resolving %s", us->name);
-  DNS_Name2IPAddressAsync(us->name, name_resolve_handler, us);
+  /* Start with the first sources in the list, name_resolve_handler
+     will continue with the rest */
+  next_resolving_source = unresolved_sources;
+  start_resolving();
 }
 
 /* ================================================== */
@@ -347,7 +361,7 @@ NSR_ResolveSources(void)
   /* Try to resolve unresolved sources now */
   if (unresolved_sources) {
     /* Make sure no resolving is currently running */
-    if (!resolving_source) {
+    if (!n_resolving_sources) {
       if (resolving_interval) {
         SCH_RemoveTimeout(resolving_id);
         resolving_interval--;
@@ -447,7 +461,7 @@ NSR_RemoveAllSources(void)
 /* This routine is called by ntp_io when a new packet arrives off the network,
    possibly with an authentication tail */
 void
-NSR_ProcessReceive(NTP_Packet *message, struct timeval *now, double now_err, NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr, int length)
+NSR_ProcessReceive(NTP_Packet *message, struct timespec *now, double now_err, NTP_Remote_Address *remote_addr, NTP_Local_Address *local_addr, int length)
 {
   int slot, found;
 
@@ -465,8 +479,8 @@ NSR_ProcessReceive(NTP_Packet *message, struct timeval *now, double now_err, NTP
 /* ================================================== */
 
 static void
-slew_sources(struct timeval *raw,
-             struct timeval *cooked,
+slew_sources(struct timespec *raw,
+             struct timespec *cooked,
              double dfreq,
              double doffset,
              LCL_ChangeType change_type,
@@ -720,7 +734,7 @@ NSR_InitiateSampleBurst(int n_good_samples, int n_total_samples,
    identify the source record. */
 
 void
-NSR_ReportSource(RPT_SourceReport *report, struct timeval *now)
+NSR_ReportSource(RPT_SourceReport *report, struct timespec *now)
 {
   NTP_Remote_Address rem_addr;
   int slot, found;
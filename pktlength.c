@@ -145,6 +145,20 @@ command_unpadded_length(CMD_Request *r)
         return offsetof(CMD_Request, data.modify_minstratum.EOR);
       case REQ_MODIFY_POLLTARGET:
         return offsetof(CMD_Request, data.modify_polltarget.EOR);
+      case REQ_SOURCE_REPORTS:
+        return offsetof(CMD_Request, data.source_reports.EOR);
+      case REQ_RELOAD_LEAP:
+        return offsetof(CMD_Request, data.reload_leap.EOR);
+      case REQ_CMDMON_STATS:
+        return offsetof(CMD_Request, data.cmdmon_stats.EOR);
+      case REQ_SERVER_COUNTERS:
+        return offsetof(CMD_Request, data.server_counters.EOR);
+      case REQ_LATENCY_STATS:
+        return offsetof(CMD_Request, data.latency_stats.EOR);
+      case REQ_SERVER_LATENCY:
+        return offsetof(CMD_Request, data.server_latency.EOR);
+      case REQ_SUBSCRIBE:
+        return offsetof(CMD_Request, data.subscribe.EOR);
       default:
         /* If we fall through the switch, it most likely means we've forgotten to implement a new case */
         assert(0);
@@ -293,6 +307,20 @@ PKL_CommandPaddingLength(CMD_Request *r)
       return PADDING_LENGTH(data.modify_minstratum.EOR, data.null.EOR);
     case REQ_MODIFY_POLLTARGET:
       return PADDING_LENGTH(data.modify_polltarget.EOR, data.null.EOR);
+    case REQ_SOURCE_REPORTS:
+      return PADDING_LENGTH(data.source_reports.EOR, data.source_reports.EOR);
+    case REQ_RELOAD_LEAP:
+      return PADDING_LENGTH(data.reload_leap.EOR, data.null.EOR);
+    case REQ_CMDMON_STATS:
+      return PADDING_LENGTH(data.cmdmon_stats.EOR, data.cmdmon_stats.EOR);
+    case REQ_SERVER_COUNTERS:
+      return PADDING_LENGTH(data.server_counters.EOR, data.server_counters.EOR);
+    case REQ_LATENCY_STATS:
+      return PADDING_LENGTH(data.latency_stats.EOR, data.latency_stats.EOR);
+    case REQ_SERVER_LATENCY:
+      return PADDING_LENGTH(data.server_latency.EOR, data.server_latency.EOR);
+    case REQ_SUBSCRIBE:
+      return PADDING_LENGTH(data.subscribe.EOR, data.event.EOR);
     default:
       /* If we fall through the switch, it most likely means we've forgotten to implement a new case */
       assert(0);
@@ -356,6 +384,38 @@ PKL_ReplyLength(CMD_Reply *r)
         }
       case RPY_ACTIVITY:
         return offsetof(CMD_Reply, data.activity.EOR);
+      case RPY_SOURCE_REPORTS:
+        {
+          unsigned long ns = ntohl(r->data.source_reports.n_sources);
+          if (r->status == htons(STT_SUCCESS)) {
+            if (ns > MAX_SOURCE_REPORTS)
+              return 0;
+            return (offsetof(CMD_Reply, data.source_reports.sources) +
+                    ns * sizeof(RPY_SourceReports_Source));
+          } else {
+            return offsetof(CMD_Reply, data);
+          }
+        }
+      case RPY_CMDMON_STATS:
+        return offsetof(CMD_Reply, data.cmdmon_stats.EOR);
+      case RPY_LATENCY_STATS:
+        return offsetof(CMD_Reply, data.latency_stats.EOR);
+      case RPY_SERVER_LATENCY:
+        return offsetof(CMD_Reply, data.server_latency.EOR);
+      case RPY_EVENT:
+        return offsetof(CMD_Reply, data.event.EOR);
+      case RPY_SERVER_COUNTERS:
+        {
+          unsigned long nc = ntohl(r->data.server_counters.n_counters);
+          if (r->status == htons(STT_SUCCESS)) {
+            if (nc > MAX_SERVER_COUNTERS)
+              return 0;
+            return (offsetof(CMD_Reply, data.server_counters.counters) +
+                    nc * sizeof (r->data.server_counters.counters[0]));
+          } else {
+            return offsetof(CMD_Reply, data);
+          }
+        }
         
       default:
         assert(0);
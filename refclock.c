@@ -28,6 +28,7 @@
 #include "config.h"
 
 #include "refclock.h"
+#include "binlog.h"
 #include "reference.h"
 #include "conf.h"
 #include "local.h"
@@ -47,7 +48,7 @@ extern RefclockDriver RCL_PHC_driver;
 struct FilterSample {
   double offset;
   double dispersion;
-  struct timeval sample_time;
+  struct timespec sample_time;
 };
 
 struct MedianFilter {
@@ -59,6 +60,8 @@ struct MedianFilter {
   double avg_var;
   double max_var;
   struct FilterSample *samples;
+  /* Indices of the used samples ordered by offset */
+  int *sorted;
   int *selected;
   double *x_data;
   double *y_data;
@@ -72,6 +75,7 @@ struct RCL_Instance_Record {
   int driver_parameter_length;
   int driver_poll;
   int driver_polled;
+  int driver_multiple_samples;
   int poll;
   int leap_status;
   int pps_rate;
@@ -93,23 +97,23 @@ static int n_sources = 0;
 
 static LOG_FileID logfileid;
 
-static int valid_sample_time(RCL_Instance instance, struct timeval *tv);
-static int pps_stratum(RCL_Instance instance, struct timeval *tv);
+static int valid_sample_time(RCL_Instance instance, struct timespec *tv);
+static int pps_stratum(RCL_Instance instance, struct timespec *tv);
 static void poll_timeout(void *arg);
-static void slew_samples(struct timeval *raw, struct timeval *cooked, double dfreq,
+static void slew_samples(struct timespec *raw, struct timespec *cooked, double dfreq,
              double doffset, LCL_ChangeType change_type, void *anything);
 static void add_dispersion(double dispersion, void *anything);
-static void log_sample(RCL_Instance instance, struct timeval *sample_time, int filtered, int pulse, double raw_offset, double cooked_offset, double dispersion);
+static void log_sample(RCL_Instance instance, struct timespec *sample_time, int filtered, int pulse, double raw_offset, double cooked_offset, double dispersion);
 
 static void filter_init(struct MedianFilter *filter, int length, double max_dispersion);
 static void filter_fini(struct MedianFilter *filter);
 static void filter_reset(struct MedianFilter *filter);
 static double filter_get_avg_sample_dispersion(struct MedianFilter *filter);
-static void filter_add_sample(struct MedianFilter *filter, struct timeval *sample_time, double offset, double dispersion);
-static int filter_get_last_sample(struct MedianFilter *filter, struct timeval *sample_time, double *offset, double *dispersion);
+static void filter_add_sample(struct MedianFilter *filter, struct timespec *sample_time, double offset, double dispersion);
+static int filter_get_last_sample(struct MedianFilter *filter, struct timespec *sample_time, double *offset, double *dispersion);
 static int filter_select_samples(struct MedianFilter *filter);
-static int filter_get_sample(struct MedianFilter *filter, struct timeval *sample_time, double *offset, double *dispersion);
-static void filter_slew_samples(struct MedianFilter *filter, struct timeval *when, double dfreq, double doffset);
+static int filter_get_sample(struct MedianFilter *filter, struct timespec *sample_time, double *offset, double *dispersion);
+static void filter_slew_samples(struct MedianFilter *filter, struct timespec *when, double dfreq, double doffset);
 static void filter_add_dispersion(struct MedianFilter *filter, double dispersion);
 
 void
@@ -122,9 +126,13 @@ RCL_Initialise(void)
     LCL_AddDispersionNotifyHandler(add_dispersion, NULL);
   }
 
-  logfileid = CNF_GetLogRefclocks() ? LOG_FileOpen("refclocks",
-      "   Date (UTC) Time         Refid  DP L P  Raw offset   Cooked offset      Disp.")
-    : -1;
+  if (!CNF_GetLogRefclocks())
+    logfileid = -1;
+  else if (CNF_GetLogBinary())
+    logfileid = LOG_FileOpenBinary("refclocks", BLG_REFCLOCKS, sizeof (BLG_Refclock));
+  else
+    logfileid = LOG_FileOpen("refclocks",
+      "   Date (UTC) Time         Refid  DP L P  Raw offset   Cooked offset      Disp.");
 }
 
 void
@@ -188,6 +196,7 @@ RCL_AddRefclock(RefclockParameters *params)
   inst->driver_poll = params->driver_poll;
   inst->poll = params->poll;
   inst->driver_polled = 0;
+  inst->driver_multiple_samples = 0;
   inst->leap_status = LEAP_Normal;
   inst->pps_rate = params->pps_rate;
   inst->pps_active = 0;
@@ -224,11 +233,18 @@ RCL_AddRefclock(RefclockParameters *params)
     inst->ref_id = ref[0] << 24 | ref[1] << 16 | ref[2] << 8 | ref[3];
   }
 
-  if (inst->driver->poll) {
-    int max_samples;
+  if (inst->driver->poll && inst->driver_poll > inst->poll)
+    inst->driver_poll = inst->poll;
+
+  if (inst->driver->init)
+    if (!inst->driver->init(inst)) {
+      LOG_FATAL(LOGF_Refclock, "refclock %s initialisation failed", params->driver_name);
+      return 0;
+    }
 
-    if (inst->driver_poll > inst->poll)
-      inst->driver_poll = inst->poll;
+  /* Limit the filter length if the driver provides only one sample per poll */
+  if (inst->driver->poll && !inst->driver_multiple_samples) {
+    int max_samples;
 
     max_samples = 1 << (inst->poll - inst->driver_poll);
     if (max_samples < params->filter_length) {
@@ -240,12 +256,6 @@ RCL_AddRefclock(RefclockParameters *params)
     }
   }
 
-  if (inst->driver->init)
-    if (!inst->driver->init(inst)) {
-      LOG_FATAL(LOGF_Refclock, "refclock %s initialisation failed", params->driver_name);
-      return 0;
-    }
-
   filter_init(&inst->filter, params->filter_length, params->max_dispersion);
 
   inst->source = SRC_CreateNewInstance(inst->ref_id, SRC_REFCLOCK, params->sel_option, NULL);
@@ -282,7 +292,7 @@ RCL_StartRefclocks(void)
 }
 
 void
-RCL_ReportSource(RPT_SourceReport *report, struct timeval *now)
+RCL_ReportSource(RPT_SourceReport *report, struct timespec *now)
 {
   int i;
   uint32_t ref_id;
@@ -318,6 +328,12 @@ RCL_GetDriverParameter(RCL_Instance instance)
   return instance->driver_parameter;
 }
 
+void
+RCL_SetDriverMultipleSamples(RCL_Instance instance)
+{
+  instance->driver_multiple_samples = 1;
+}
+
 char *
 RCL_GetDriverOption(RCL_Instance instance, char *name)
 {
@@ -344,14 +360,21 @@ RCL_GetDriverOption(RCL_Instance instance, char *name)
 }
 
 int
-RCL_AddSample(RCL_Instance instance, struct timeval *sample_time, double offset, int leap)
+RCL_AddSample(RCL_Instance instance, struct timespec *sample_time, double offset, int leap)
+{
+  return RCL_AddSampleWithDispersion(instance, sample_time, offset, 0.0, leap);
+}
+
+int
+RCL_AddSampleWithDispersion(RCL_Instance instance, struct timespec *sample_time,
+                            double offset, double sample_dispersion, int leap)
 {
   double correction, dispersion;
-  struct timeval cooked_time;
+  struct timespec cooked_time;
 
   LCL_GetOffsetCorrection(sample_time, &correction, &dispersion);
-  UTI_AddDoubleToTimeval(sample_time, correction, &cooked_time);
-  dispersion += instance->precision;
+  UTI_AddDoubleToTimespec(sample_time, correction, &cooked_time);
+  dispersion += instance->precision + sample_dispersion;
 
   if (!valid_sample_time(instance, sample_time))
     return 0;
@@ -381,17 +404,24 @@ RCL_AddSample(RCL_Instance instance, struct timeval *sample_time, double offset,
 }
 
 int
-RCL_AddPulse(RCL_Instance instance, struct timeval *pulse_time, double second)
+RCL_AddPulse(RCL_Instance instance, struct timespec *pulse_time, double second)
+{
+  return RCL_AddPulseWithDispersion(instance, pulse_time, second, 0.0);
+}
+
+int
+RCL_AddPulseWithDispersion(RCL_Instance instance, struct timespec *pulse_time,
+                           double second, double pulse_dispersion)
 {
   double correction, dispersion, offset;
-  struct timeval cooked_time;
+  struct timespec cooked_time;
   int rate;
   NTP_Leap leap;
 
   leap = LEAP_Normal;
   LCL_GetOffsetCorrection(pulse_time, &correction, &dispersion);
-  UTI_AddDoubleToTimeval(pulse_time, correction, &cooked_time);
-  dispersion += instance->precision;
+  UTI_AddDoubleToTimespec(pulse_time, correction, &cooked_time);
+  dispersion += instance->precision + pulse_dispersion;
 
   if (!valid_sample_time(instance, pulse_time))
     return 0;
@@ -409,7 +439,7 @@ RCL_AddPulse(RCL_Instance instance, struct timeval *pulse_time, double second)
     offset -= 1.0 / rate;
 
   if (instance->lock_ref != -1) {
-    struct timeval ref_sample_time;
+    struct timespec ref_sample_time;
     double sample_diff, ref_offset, ref_dispersion, shift;
 
     if (!filter_get_last_sample(&refclocks[instance->lock_ref].filter,
@@ -420,7 +450,7 @@ RCL_AddPulse(RCL_Instance instance, struct timeval *pulse_time, double second)
 
     ref_dispersion += filter_get_avg_sample_dispersion(&refclocks[instance->lock_ref].filter);
 
-    UTI_DiffTimevalsToDouble(&sample_diff, &cooked_time, &ref_sample_time);
+    UTI_DiffTimespecsToDouble(&sample_diff, &cooked_time, &ref_sample_time);
     if (fabs(sample_diff) >= 2.0 / rate) {
       DEBUG_LOG(LOGF_Refclock, "refclock pulse ignored samplediff=%.9f",
           sample_diff);
@@ -446,7 +476,7 @@ RCL_AddPulse(RCL_Instance instance, struct timeval *pulse_time, double second)
     DEBUG_LOG(LOGF_Refclock, "refclock pulse second=%.9f offset=%.9f offdiff=%.9f samplediff=%.9f",
         second, offset, ref_offset - offset, sample_diff);
   } else {
-    struct timeval ref_time;
+    struct timespec ref_time;
     int is_synchronised, stratum;
     double root_delay, root_dispersion, distance;
     uint32_t ref_id;
@@ -489,25 +519,25 @@ poll_interval(int poll)
 }
 
 static int
-valid_sample_time(RCL_Instance instance, struct timeval *tv)
+valid_sample_time(RCL_Instance instance, struct timespec *tv)
 {
-  struct timeval raw_time;
+  struct timespec raw_time;
   double diff;
 
   LCL_ReadRawTime(&raw_time);
-  UTI_DiffTimevalsToDouble(&diff, &raw_time, tv);
+  UTI_DiffTimespecsToDouble(&diff, &raw_time, tv);
   if (diff < 0.0 || diff > poll_interval(instance->poll + 1)) {
     DEBUG_LOG(LOGF_Refclock, "refclock sample not valid age=%.6f tv=%s",
-        diff, UTI_TimevalToString(tv));
+        diff, UTI_TimespecToString(tv));
     return 0;
   }
   return 1;
 }
 
 static int
-pps_stratum(RCL_Instance instance, struct timeval *tv)
+pps_stratum(RCL_Instance instance, struct timespec *tv)
 {
-  struct timeval ref_time;
+  struct timespec ref_time;
   int is_synchronised, stratum, i;
   double root_delay, root_dispersion;
   NTP_Leap leap;
@@ -548,7 +578,7 @@ poll_timeout(void *arg)
   
   if (!(inst->driver->poll && inst->driver_polled < (1 << (inst->poll - inst->driver_poll)))) {
     double offset, dispersion;
-    struct timeval sample_time;
+    struct timespec sample_time;
     int sample_ok, stratum;
 
     sample_ok = filter_get_sample(&inst->filter, &sample_time, &offset, &dispersion);
@@ -576,7 +606,7 @@ poll_timeout(void *arg)
 }
 
 static void
-slew_samples(struct timeval *raw, struct timeval *cooked, double dfreq,
+slew_samples(struct timespec *raw, struct timespec *cooked, double dfreq,
              double doffset, LCL_ChangeType change_type, void *anything)
 {
   int i;
@@ -599,17 +629,32 @@ add_dispersion(double dispersion, void *anything)
 }
 
 static void
-log_sample(RCL_Instance instance, struct timeval *sample_time, int filtered, int pulse, double raw_offset, double cooked_offset, double dispersion)
+log_sample(RCL_Instance instance, struct timespec *sample_time, int filtered, int pulse, double raw_offset, double cooked_offset, double dispersion)
 {
   char sync_stats[4] = {'N', '+', '-', '?'};
 
   if (logfileid == -1)
     return;
 
-  if (!filtered) {
+  if (LOG_FileIsBinary(logfileid)) {
+    BLG_Refclock record;
+
+    memset(&record, 0, sizeof (record));
+    UTI_TimespecHostToNetwork(sample_time, &record.time);
+    record.ref_id = htonl(instance->ref_id);
+    record.driver_poll = instance->driver_polled;
+    record.leap = instance->leap_status;
+    record.pulse = pulse;
+    record.filtered = filtered;
+    record.raw_offset = UTI_FloatHostToNetwork(raw_offset);
+    record.cooked_offset = UTI_FloatHostToNetwork(cooked_offset);
+    record.dispersion = UTI_FloatHostToNetwork(dispersion);
+
+    LOG_FileWriteRecord(logfileid, &record);
+  } else if (!filtered) {
     LOG_FileWrite(logfileid, "%s.%06d %-5s %3d %1c %1d %13.6e %13.6e %10.3e",
       UTI_TimeToLogForm(sample_time->tv_sec),
-      (int)sample_time->tv_usec,
+      (int)(sample_time->tv_nsec / 1000),
       UTI_RefidToString(instance->ref_id),
       instance->driver_polled,
       sync_stats[instance->leap_status],
@@ -620,7 +665,7 @@ log_sample(RCL_Instance instance, struct timeval *sample_time, int filtered, int
   } else {
     LOG_FileWrite(logfileid, "%s.%06d %-5s   - %1c -       -       %13.6e %10.3e",
       UTI_TimeToLogForm(sample_time->tv_sec),
-      (int)sample_time->tv_usec,
+      (int)(sample_time->tv_nsec / 1000),
       UTI_RefidToString(instance->ref_id),
       sync_stats[instance->leap_status],
       cooked_offset,
@@ -643,6 +688,7 @@ filter_init(struct MedianFilter *filter, int length, double max_dispersion)
   filter->avg_var = LCL_GetSysPrecisionAsQuantum() * LCL_GetSysPrecisionAsQuantum();
   filter->max_var = max_dispersion * max_dispersion;
   filter->samples = MallocArray(struct FilterSample, filter->length);
+  filter->sorted = MallocArray(int, filter->length);
   filter->selected = MallocArray(int, filter->length);
   filter->x_data = MallocArray(double, filter->length);
   filter->y_data = MallocArray(double, filter->length);
@@ -653,6 +699,7 @@ static void
 filter_fini(struct MedianFilter *filter)
 {
   Free(filter->samples);
+  Free(filter->sorted);
   Free(filter->selected);
   Free(filter->x_data);
   Free(filter->y_data);
@@ -672,25 +719,62 @@ filter_get_avg_sample_dispersion(struct MedianFilter *filter)
   return sqrt(filter->avg_var);
 }
 
+/* Return the first position in the sorted array with offset not smaller
+   than the specified offset */
+
+static int
+filter_find_position(struct MedianFilter *filter, int n, double offset)
+{
+  int lo, hi, mid;
+
+  for (lo = 0, hi = n; lo < hi; ) {
+    mid = (lo + hi) / 2;
+    if (filter->samples[filter->sorted[mid]].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
 static void
-filter_add_sample(struct MedianFilter *filter, struct timeval *sample_time, double offset, double dispersion)
+filter_add_sample(struct MedianFilter *filter, struct timespec *sample_time, double offset, double dispersion)
 {
+  int i, n;
+
   filter->index++;
   filter->index %= filter->length;
   filter->last = filter->index;
-  if (filter->used < filter->length)
+
+  n = filter->used;
+
+  if (n < filter->length) {
     filter->used++;
+  } else {
+    /* remove the overwritten sample from the sorted array */
+    i = filter_find_position(filter, n, filter->samples[filter->index].offset);
+    while (i < n - 1 && filter->sorted[i] != filter->index)
+      i++;
+    assert(filter->sorted[i] == filter->index);
+    n--;
+    memmove(filter->sorted + i, filter->sorted + i + 1, (n - i) * sizeof (int));
+  }
 
   filter->samples[filter->index].sample_time = *sample_time;
   filter->samples[filter->index].offset = offset;
   filter->samples[filter->index].dispersion = dispersion;
 
+  i = filter_find_position(filter, n, offset);
+  memmove(filter->sorted + i + 1, filter->sorted + i, (n - i) * sizeof (int));
+  filter->sorted[i] = filter->index;
+
   DEBUG_LOG(LOGF_Refclock, "filter sample %d t=%s offset=%.9f dispersion=%.9f",
-      filter->index, UTI_TimevalToString(sample_time), offset, dispersion);
+      filter->index, UTI_TimespecToString(sample_time), offset, dispersion);
 }
 
 static int
-filter_get_last_sample(struct MedianFilter *filter, struct timeval *sample_time, double *offset, double *dispersion)
+filter_get_last_sample(struct MedianFilter *filter, struct timespec *sample_time, double *offset, double *dispersion)
 {
   if (filter->last < 0)
     return 0;
@@ -701,27 +785,10 @@ filter_get_last_sample(struct MedianFilter *filter, struct timeval *sample_time,
   return 1;
 }
 
-static const struct FilterSample *tmp_sorted_array;
-
-static int
-sample_compare(const void *a, const void *b)
-{
-  const struct FilterSample *s1, *s2;
-
-  s1 = &tmp_sorted_array[*(int *)a];
-  s2 = &tmp_sorted_array[*(int *)b];
-
-  if (s1->offset < s2->offset)
-    return -1;
-  else if (s1->offset > s2->offset)
-    return 1;
-  return 0;
-}
-
 int
 filter_select_samples(struct MedianFilter *filter)
 {
-  int i, j, k, o, from, to, *selected;
+  int i, j, k, o, from, to, *selected, *sorted;
   double min_dispersion;
 
   if (filter->used < 1)
@@ -734,6 +801,7 @@ filter_select_samples(struct MedianFilter *filter)
     return 0;
 
   selected = filter->selected;
+  sorted = filter->sorted;
 
   if (filter->used > 4) {
     /* select samples with dispersion better than 1.5 * minimum */
@@ -744,8 +812,8 @@ filter_select_samples(struct MedianFilter *filter)
     }
 
     for (i = j = 0; i < filter->used; i++) {
-      if (filter->samples[i].dispersion <= 1.5 * min_dispersion)
-        selected[j++] = i;
+      if (filter->samples[sorted[i]].dispersion <= 1.5 * min_dispersion)
+        selected[j++] = sorted[i];
     }
   } else {
     j = 0;
@@ -755,12 +823,10 @@ filter_select_samples(struct MedianFilter *filter)
     /* select all samples */
 
     for (j = 0; j < filter->used; j++)
-      selected[j] = j;
+      selected[j] = sorted[j];
   }
 
-  /* and sort their indices by offset */
-  tmp_sorted_array = filter->samples;
-  qsort(selected, j, sizeof (int), sample_compare);
+  /* the selected indices are already ordered by offset */
 
   /* select 60 percent of the samples closest to the median */ 
   if (j > 2) {
@@ -803,7 +869,7 @@ filter_select_samples(struct MedianFilter *filter)
 }
 
 static int
-filter_get_sample(struct MedianFilter *filter, struct timeval *sample_time, double *offset, double *dispersion)
+filter_get_sample(struct MedianFilter *filter, struct timespec *sample_time, double *offset, double *dispersion)
 {
   struct FilterSample *s, *ls;
   int i, n, dof;
@@ -820,7 +886,7 @@ filter_get_sample(struct MedianFilter *filter, struct timeval *sample_time, doub
   for (i = 0; i < n; i++) {
     s = &filter->samples[filter->selected[i]];
 
-    UTI_DiffTimevalsToDouble(&filter->x_data[i], &s->sample_time, &ls->sample_time);
+    UTI_DiffTimespecsToDouble(&filter->x_data[i], &s->sample_time, &ls->sample_time);
     filter->y_data[i] = s->offset;
     filter->w_data[i] = s->dispersion;
   }
@@ -895,7 +961,7 @@ filter_get_sample(struct MedianFilter *filter, struct timeval *sample_time, doub
   if (d < e)
     d = e;
 
-  UTI_AddDoubleToTimeval(&ls->sample_time, x, sample_time);
+  UTI_AddDoubleToTimespec(&ls->sample_time, x, sample_time);
   *offset = y;
   *dispersion = d;
 
@@ -905,17 +971,27 @@ filter_get_sample(struct MedianFilter *filter, struct timeval *sample_time, doub
 }
 
 static void
-filter_slew_samples(struct MedianFilter *filter, struct timeval *when, double dfreq, double doffset)
+filter_slew_samples(struct MedianFilter *filter, struct timespec *when, double dfreq, double doffset)
 {
-  int i;
+  int i, j, k;
   double delta_time;
-  struct timeval *sample;
+  struct timespec *sample;
 
   for (i = 0; i < filter->used; i++) {
     sample = &filter->samples[i].sample_time;
-    UTI_AdjustTimeval(sample, when, sample, &delta_time, dfreq, doffset);
+    UTI_AdjustTimespec(sample, when, sample, &delta_time, dfreq, doffset);
     filter->samples[i].offset -= delta_time;
   }
+
+  /* the frequency change may have swapped samples with close offsets,
+     restore the order (the array is nearly sorted) */
+  for (i = 1; i < filter->used; i++) {
+    k = filter->sorted[i];
+    for (j = i; j > 0 && filter->samples[filter->sorted[j - 1]].offset >
+         filter->samples[k].offset; j--)
+      filter->sorted[j] = filter->sorted[j - 1];
+    filter->sorted[j] = k;
+  }
 }
 
 static void
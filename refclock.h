@@ -59,14 +59,23 @@ extern void RCL_Initialise(void);
 extern void RCL_Finalise(void);
 extern int RCL_AddRefclock(RefclockParameters *params);
 extern void RCL_StartRefclocks(void);
-extern void RCL_ReportSource(RPT_SourceReport *report, struct timeval *now);
+extern void RCL_ReportSource(RPT_SourceReport *report, struct timespec *now);
 
 /* functions used by drivers */
 extern void RCL_SetDriverData(RCL_Instance instance, void *data);
 extern void *RCL_GetDriverData(RCL_Instance instance);
 extern char *RCL_GetDriverParameter(RCL_Instance instance);
 extern char *RCL_GetDriverOption(RCL_Instance instance, char *name);
-extern int RCL_AddSample(RCL_Instance instance, struct timeval *sample_time, double offset, int leap);
-extern int RCL_AddPulse(RCL_Instance instance, struct timeval *pulse_time, double second);
+/* Driver can provide more than one sample per poll */
+extern void RCL_SetDriverMultipleSamples(RCL_Instance instance);
+extern int RCL_AddSample(RCL_Instance instance, struct timespec *sample_time, double offset, int leap);
+extern int RCL_AddPulse(RCL_Instance instance, struct timespec *pulse_time, double second);
+
+/* Same as above, with an error estimate of the sample provided by the
+   driver, which is added to the precision of the refclock */
+extern int RCL_AddSampleWithDispersion(RCL_Instance instance, struct timespec *sample_time,
+                                       double offset, double sample_dispersion, int leap);
+extern int RCL_AddPulseWithDispersion(RCL_Instance instance, struct timespec *pulse_time,
+                                      double second, double pulse_dispersion);
 
 #endif
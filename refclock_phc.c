@@ -145,7 +145,6 @@ static void phc_finalise(RCL_Instance instance)
 static int phc_poll(RCL_Instance instance)
 {
   struct phc_reading readings[NUM_READINGS];
-  struct timeval tv;
   double offset = 0.0, delay, best_delay = 0.0;
   int i, phc_fd, best;
  
@@ -172,12 +171,10 @@ static int phc_poll(RCL_Instance instance)
   }
 
   offset = diff_ts(&readings[best].phc_ts, &readings[best].sys_ts2) + best_delay / 2.0;
-  tv.tv_sec = readings[best].sys_ts2.tv_sec;
-  tv.tv_usec = readings[best].sys_ts2.tv_nsec / 1000;
 
   DEBUG_LOG(LOGF_Refclock, "PHC offset: %+.9f delay: %.9f", offset, best_delay);
 
-  return RCL_AddSample(instance, &tv, offset, LEAP_Normal);
+  return RCL_AddSample(instance, &readings[best].sys_ts2, offset, LEAP_Normal);
 }
 
 RefclockDriver RCL_PHC_driver = {
@@ -23,14 +23,23 @@
 
   SHM refclock driver.
 
+  With the ring option, the segment contains a ring buffer of samples
+  (described in chrony_shmring.h) instead of the single sample used by
+  ntpd, and all new samples are read on each poll.  With the notify
+  option, a FIFO is created and new samples are also read when something
+  is written to it.
+
   */
 
 #include "config.h"
 
 #include "sysincl.h"
 
+#include "chrony_shmring.h"
 #include "refclock.h"
 #include "logging.h"
+#include "memory.h"
+#include "sched.h"
 #include "util.h"
 
 #define SHMKEY 0x4e545030
@@ -58,43 +67,206 @@ struct shmTime {
   int    dummy[8]; 
 };
 
-static int shm_initialise(RCL_Instance instance) {
-  int id, param, perm;
-  char *s;
+struct ShmInstance {
   struct shmTime *shm;
+  struct chrony_shmring *ring;
+  /* Index of the next sample to be read from the ring */
+  uint32_t read_index;
+  /* FIFO used by the writer to wake up chronyd */
+  char *fifo_path;
+  int fifo_fd;
+};
 
-  param = atoi(RCL_GetDriverParameter(instance));
-  s = RCL_GetDriverOption(instance, "perm");
-  perm = s ? strtol(s, NULL, 8) & 0777 : 0600;
+static void read_fifo(void *anything);
+
+static void *attach_segment(key_t key, size_t size, int perm)
+{
+  void *addr;
+  int id;
 
-  id = shmget(SHMKEY + param, sizeof (struct shmTime), IPC_CREAT | perm);
+  id = shmget(key, size, IPC_CREAT | perm);
   if (id == -1) {
     LOG_FATAL(LOGF_Refclock, "shmget() failed");
-    return 0;
+    return NULL;
   }
    
-  shm = (struct shmTime *)shmat(id, 0, 0);
-  if ((long)shm == -1) {
+  addr = shmat(id, 0, 0);
+  if ((long)addr == -1) {
     LOG_FATAL(LOGF_Refclock, "shmat() failed");
-    return 0;
+    return NULL;
+  }
+
+  return addr;
+}
+
+static void open_fifo(RCL_Instance instance, struct ShmInstance *inst, char *path, int perm)
+{
+  if (mkfifo(path, perm) < 0 && errno != EEXIST) {
+    LOG_FATAL(LOGF_Refclock, "Could not create FIFO %s : %s", path, strerror(errno));
+    return;
   }
 
-  RCL_SetDriverData(instance, shm);
+  /* Open it also for writing to not get EOF when writers close it */
+  inst->fifo_fd = open(path, O_RDWR | O_NONBLOCK);
+  if (inst->fifo_fd < 0) {
+    LOG_FATAL(LOGF_Refclock, "Could not open FIFO %s : %s", path, strerror(errno));
+    return;
+  }
+
+  UTI_FdSetCloexec(inst->fifo_fd);
+  inst->fifo_path = strdup(path);
+  SCH_AddInputFileHandler(inst->fifo_fd, read_fifo, instance);
+}
+
+static int shm_initialise(RCL_Instance instance) {
+  int param, perm;
+  char *s;
+  struct ShmInstance *inst;
+  struct chrony_shmring *ring;
+
+  param = atoi(RCL_GetDriverParameter(instance));
+  s = RCL_GetDriverOption(instance, "perm");
+  perm = s ? strtol(s, NULL, 8) & 0777 : 0600;
+
+  inst = MallocNew(struct ShmInstance);
+  inst->shm = NULL;
+  inst->ring = NULL;
+  inst->read_index = 0;
+  inst->fifo_path = NULL;
+  inst->fifo_fd = -1;
+
+  if (RCL_GetDriverOption(instance, "ring")) {
+    ring = attach_segment(CHRONY_SHMRING_KEY + param, sizeof (struct chrony_shmring), perm);
+    if (!ring)
+      return 0;
+
+    if (ring->magic != CHRONY_SHMRING_MAGIC || ring->version != CHRONY_SHMRING_VERSION ||
+        ring->sample_size != sizeof (struct chrony_shmring_sample) ||
+        ring->slots != CHRONY_SHMRING_SLOTS) {
+      memset(ring, 0, sizeof (*ring));
+      ring->version = CHRONY_SHMRING_VERSION;
+      ring->sample_size = sizeof (struct chrony_shmring_sample);
+      ring->slots = CHRONY_SHMRING_SLOTS;
+      __sync_synchronize();
+      ring->magic = CHRONY_SHMRING_MAGIC;
+    }
+
+    RCL_SetDriverMultipleSamples(instance);
+
+    /* Ignore samples written before start */
+    inst->read_index = ring->write_index;
+    inst->ring = ring;
+
+    s = RCL_GetDriverOption(instance, "notify");
+    if (s)
+      open_fifo(instance, inst, s, perm);
+  } else {
+    inst->shm = attach_segment(SHMKEY + param, sizeof (struct shmTime), perm);
+    if (!inst->shm)
+      return 0;
+  }
+
+  RCL_SetDriverData(instance, inst);
   return 1;
 }
 
 static void shm_finalise(RCL_Instance instance)
 {
-  shmdt(RCL_GetDriverData(instance));
+  struct ShmInstance *inst;
+
+  inst = (struct ShmInstance *)RCL_GetDriverData(instance);
+
+  if (inst->fifo_fd >= 0) {
+    SCH_RemoveInputFileHandler(inst->fifo_fd);
+    close(inst->fifo_fd);
+    unlink(inst->fifo_path);
+    free(inst->fifo_path);
+  }
+
+  shmdt(inst->ring ? (void *)inst->ring : (void *)inst->shm);
+  Free(inst);
+}
+
+static int read_ring(RCL_Instance instance, struct ShmInstance *inst)
+{
+  volatile struct chrony_shmring_sample *slot;
+  struct chrony_shmring_sample sample;
+  struct timespec tv;
+  uint32_t write_index, seq;
+  double offset;
+  int added, skipped;
+
+  write_index = *(volatile uint32_t *)&inst->ring->write_index;
+  __sync_synchronize();
+
+  /* Skip samples which were already overwritten */
+  skipped = 0;
+  if (write_index - inst->read_index > CHRONY_SHMRING_SLOTS) {
+    skipped = write_index - inst->read_index - CHRONY_SHMRING_SLOTS;
+    inst->read_index = write_index - CHRONY_SHMRING_SLOTS;
+  }
+
+  for (added = 0; inst->read_index != write_index; inst->read_index++) {
+    slot = &inst->ring->samples[inst->read_index % CHRONY_SHMRING_SLOTS];
+
+    seq = slot->seq;
+    __sync_synchronize();
+    memcpy(&sample, (void *)slot, sizeof (sample));
+    __sync_synchronize();
+
+    if (seq % 2 || seq != slot->seq || sample.index != inst->read_index ||
+        sample.clock_nsec < 0 || sample.clock_nsec >= 1000000000 ||
+        sample.receive_nsec < 0 || sample.receive_nsec >= 1000000000 ||
+        !(sample.dispersion >= 0.0)) {
+      skipped++;
+      continue;
+    }
+
+    tv.tv_sec = sample.receive_sec;
+    tv.tv_nsec = sample.receive_nsec;
+
+    offset = (sample.clock_sec - sample.receive_sec) +
+             (sample.clock_nsec - sample.receive_nsec) * 1e-9;
+
+    if (RCL_AddSampleWithDispersion(instance, &tv, offset, sample.dispersion, sample.leap))
+      added++;
+  }
+
+  if (skipped)
+    DEBUG_LOG(LOGF_Refclock, "SHM ring samples skipped=%d", skipped);
+
+  return added > 0;
+}
+
+static void read_fifo(void *anything)
+{
+  RCL_Instance instance;
+  struct ShmInstance *inst;
+  char buf[64];
+
+  instance = (RCL_Instance)anything;
+  inst = (struct ShmInstance *)RCL_GetDriverData(instance);
+
+  /* Drain the notifications */
+  while (read(inst->fifo_fd, buf, sizeof (buf)) > 0)
+    ;
+
+  read_ring(instance, inst);
 }
 
 static int shm_poll(RCL_Instance instance)
 {
-  struct timeval tv;
+  struct timespec tv;
   struct shmTime t, *shm;
+  struct ShmInstance *inst;
   double offset;
 
-  shm = (struct shmTime *)RCL_GetDriverData(instance);
+  inst = (struct ShmInstance *)RCL_GetDriverData(instance);
+
+  if (inst->ring)
+    return read_ring(instance, inst);
+
+  shm = inst->shm;
 
   t = *shm;
   
@@ -108,14 +280,16 @@ static int shm_poll(RCL_Instance instance)
   shm->valid = 0;
 
   tv.tv_sec = t.receiveTimeStampSec;
-  tv.tv_usec = t.receiveTimeStampUSec;
 
   offset = t.clockTimeStampSec - t.receiveTimeStampSec;
   if (t.clockTimeStampNSec / 1000 == t.clockTimeStampUSec &&
-      t.receiveTimeStampNSec / 1000 == t.receiveTimeStampUSec)
+      t.receiveTimeStampNSec / 1000 == t.receiveTimeStampUSec) {
+    tv.tv_nsec = t.receiveTimeStampNSec;
     offset += (t.clockTimeStampNSec - t.receiveTimeStampNSec) * 1e-9;
-  else
+  } else {
+    tv.tv_nsec = 1000 * t.receiveTimeStampUSec;
     offset += (t.clockTimeStampUSec - t.receiveTimeStampUSec) * 1e-6;
+  }
 
   return RCL_AddSample(instance, &tv, offset, t.leap);
 }
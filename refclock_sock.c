@@ -34,6 +34,8 @@
 #include "util.h"
 #include "sched.h"
 
+/* Version 1 of the protocol: one sample per datagram */
+
 #define SOCK_MAGIC 0x534f434b
 
 struct sock_sample {
@@ -45,42 +47,161 @@ struct sock_sample {
   int magic;
 };
 
-static void read_sample(void *anything)
-{
-  struct sock_sample sample;
-  RCL_Instance instance;
-  int sockfd, s;
+/* Version 2 of the protocol: a datagram starts with a header containing
+   the magic number and the number of samples, followed by the samples.
+   All fields are in the native byte order.  The offset is the difference
+   between the true time and the system time (same as in version 1) and
+   the dispersion is an estimate of the error of the sample, which is
+   added to the precision of the refclock.  Pulses specify in the offset
+   field only the offset of the pulse from the true second. */
 
-  instance = (RCL_Instance)anything;
-  sockfd = (long)RCL_GetDriverData(instance);
+#define SOCK_MAGIC_V2 0x534f4332
 
-  s = recv(sockfd, &sample, sizeof (sample), 0);
+#define SOCK_MAX_SAMPLES_V2 64
 
-  if (s < 0) {
-    LOG(LOGS_ERR, LOGF_Refclock, "Could not read SOCK sample : %s",
-        strerror(errno));
+struct sock_sample_v2 {
+  int64_t tv_sec;
+  int32_t tv_nsec;
+  int32_t leap;
+  double offset;
+  double dispersion;
+  int32_t pulse;
+  int32_t _pad;
+};
+
+struct sock_message_v2 {
+  uint32_t magic;
+  uint32_t n_samples;
+  struct sock_sample_v2 samples[SOCK_MAX_SAMPLES_V2];
+};
+
+union sock_message {
+  struct sock_sample v1;
+  struct sock_message_v2 v2;
+};
+
+/* Maximum number of datagrams received in one call */
+#ifdef HAVE_RECVMMSG
+#define MAX_RECV_MESSAGES 16
+#else
+#define MAX_RECV_MESSAGES 1
+#endif
+
+/* Buffers shared by all instances */
+static union sock_message recv_messages[MAX_RECV_MESSAGES];
+
+static void process_v1_sample(RCL_Instance instance, struct sock_sample *sample)
+{
+  struct timespec ts;
+
+  if (sample->magic != SOCK_MAGIC) {
+    LOG(LOGS_WARN, LOGF_Refclock, "Unexpected magic number in SOCK sample : %x != %x",
+        sample->magic, SOCK_MAGIC);
     return;
   }
 
-  if (s != sizeof (sample)) {
-    LOG(LOGS_WARN, LOGF_Refclock, "Unexpected length of SOCK sample : %d != %ld",
-        s, (long)sizeof (sample));
-    return;
+  /* Clients of version 1 send the time as a timeval */
+  UTI_TimevalToTimespec(&sample->tv, &ts);
+
+  if (sample->pulse) {
+    RCL_AddPulse(instance, &ts, sample->offset);
+  } else {
+    RCL_AddSample(instance, &ts, sample->offset, sample->leap);
   }
+}
 
-  if (sample.magic != SOCK_MAGIC) {
-    LOG(LOGS_WARN, LOGF_Refclock, "Unexpected magic number in SOCK sample : %x != %x",
-        sample.magic, SOCK_MAGIC);
+static void process_v2_message(RCL_Instance instance, struct sock_message_v2 *message, int length)
+{
+  struct sock_sample_v2 *sample;
+  struct timespec tv;
+  int i, n;
+
+  n = message->n_samples;
+
+  if (n > SOCK_MAX_SAMPLES_V2 ||
+      length != offsetof(struct sock_message_v2, samples) + n * sizeof (struct sock_sample_v2)) {
+    LOG(LOGS_WARN, LOGF_Refclock, "Unexpected length of SOCK message : %d", length);
     return;
   }
 
-  if (sample.pulse) {
-    RCL_AddPulse(instance, &sample.tv, sample.offset);
+  for (i = 0; i < n; i++) {
+    sample = &message->samples[i];
+
+    if (sample->tv_nsec < 0 || sample->tv_nsec >= 1000000000 ||
+        !(sample->dispersion >= 0.0)) {
+      LOG(LOGS_WARN, LOGF_Refclock, "Invalid SOCK sample");
+      continue;
+    }
+
+    tv.tv_sec = sample->tv_sec;
+    tv.tv_nsec = sample->tv_nsec;
+
+    if (sample->pulse) {
+      RCL_AddPulseWithDispersion(instance, &tv, sample->offset, sample->dispersion);
+    } else {
+      RCL_AddSampleWithDispersion(instance, &tv, sample->offset, sample->dispersion,
+                                  sample->leap);
+    }
+  }
+
+  DEBUG_LOG(LOGF_Refclock, "SOCK message with %d samples", n);
+}
+
+static void process_message(RCL_Instance instance, union sock_message *message, int length)
+{
+  if (length == sizeof (message->v1)) {
+    process_v1_sample(instance, &message->v1);
+  } else if (length >= offsetof(struct sock_message_v2, samples) &&
+             message->v2.magic == SOCK_MAGIC_V2) {
+    process_v2_message(instance, &message->v2, length);
   } else {
-    RCL_AddSample(instance, &sample.tv, sample.offset, sample.leap);
+    LOG(LOGS_WARN, LOGF_Refclock, "Unexpected length of SOCK sample : %d != %ld",
+        length, (long)sizeof (message->v1));
   }
 }
 
+static void read_sample(void *anything)
+{
+  RCL_Instance instance;
+  int n, sockfd;
+#ifdef HAVE_RECVMMSG
+  int i;
+  struct mmsghdr hdrs[MAX_RECV_MESSAGES];
+  struct iovec iovs[MAX_RECV_MESSAGES];
+#endif
+
+  instance = (RCL_Instance)anything;
+  sockfd = (long)RCL_GetDriverData(instance);
+
+#ifdef HAVE_RECVMMSG
+  for (i = 0; i < MAX_RECV_MESSAGES; i++) {
+    iovs[i].iov_base = &recv_messages[i];
+    iovs[i].iov_len = sizeof (recv_messages[i]);
+    memset(&hdrs[i], 0, sizeof (hdrs[i]));
+    hdrs[i].msg_hdr.msg_iov = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  /* Get all datagrams waiting in the socket */
+  n = recvmmsg(sockfd, hdrs, MAX_RECV_MESSAGES, MSG_DONTWAIT, NULL);
+#else
+  n = recv(sockfd, &recv_messages[0], sizeof (recv_messages[0]), 0);
+#endif
+
+  if (n < 0) {
+    LOG(LOGS_ERR, LOGF_Refclock, "Could not read SOCK sample : %s",
+        strerror(errno));
+    return;
+  }
+
+#ifdef HAVE_RECVMMSG
+  for (i = 0; i < n; i++)
+    process_message(instance, &recv_messages[i], hdrs[i].msg_len);
+#else
+  process_message(instance, &recv_messages[0], n);
+#endif
+}
+
 static int sock_initialise(RCL_Instance instance)
 {
   struct sockaddr_un s;
@@ -31,11 +31,15 @@
 
 #include "memory.h"
 #include "reference.h"
+#include "leapdb.h"
+#include "binlog.h"
 #include "util.h"
 #include "conf.h"
 #include "logging.h"
 #include "local.h"
 #include "sched.h"
+#include "statuspage.h"
+#include "cmdmon.h"
 
 /* ================================================== */
 
@@ -50,7 +54,7 @@ static int our_leap_sec;
 static int our_stratum;
 static uint32_t our_ref_id;
 static IPAddr our_ref_ip;
-struct timeval our_ref_time; /* Stored relative to reference, NOT local time */
+struct timespec our_ref_time; /* Stored relative to reference, NOT local time */
 static double our_skew;
 static double our_residual_freq;
 static double our_root_delay;
@@ -98,11 +102,6 @@ static double drift_file_age;
 
 static void update_drift_file(double, double);
 
-/* Name of a system timezone containing leap seconds occuring at midnight */
-static char *leap_tzname;
-static time_t last_tz_leap_check;
-static NTP_Leap tz_leap;
-
 /* ================================================== */
 
 static LOG_FileID logfileid;
@@ -130,18 +129,19 @@ static int next_fb_drift;
 static SCH_TimeoutID fb_drift_timeout_id;
 
 /* Timestamp of last reference update */
-static struct timeval last_ref_update;
+static struct timespec last_ref_update;
 static double last_ref_update_interval;
 
-/* ================================================== */
+/* Time when the module was initialised, used to report how long it took
+   to synchronise the clock for the first time (zero when reported) */
+static struct timespec start_time;
 
-static NTP_Leap get_tz_leap(time_t when);
 
 /* ================================================== */
 
 static void
-handle_slew(struct timeval *raw,
-            struct timeval *cooked,
+handle_slew(struct timespec *raw,
+            struct timespec *cooked,
             double dfreq,
             double doffset,
             LCL_ChangeType change_type,
@@ -151,10 +151,14 @@ handle_slew(struct timeval *raw,
 
   if (change_type == LCL_ChangeUnknownStep) {
     last_ref_update.tv_sec = 0;
-    last_ref_update.tv_usec = 0;
+    last_ref_update.tv_nsec = 0;
   } else if (last_ref_update.tv_sec) {
-    UTI_AdjustTimeval(&last_ref_update, cooked, &last_ref_update, &delta, dfreq, doffset);
+    UTI_AdjustTimespec(&last_ref_update, cooked, &last_ref_update, &delta, dfreq, doffset);
   }
+
+  /* Don't count steps of the clock in the time to synchronisation */
+  if (change_type != LCL_ChangeUnknownStep && start_time.tv_sec)
+    UTI_AdjustTimespec(&start_time, cooked, &start_time, &delta, dfreq, doffset);
 }
 
 /* ================================================== */
@@ -207,9 +211,13 @@ REF_Initialise(void)
     }
   }
 
-  logfileid = CNF_GetLogTracking() ? LOG_FileOpen("tracking",
-      "   Date (UTC) Time     IP Address   St   Freq ppm   Skew ppm     Offset L Co  Offset sd Rem. corr.")
-    : -1;
+  if (!CNF_GetLogTracking())
+    logfileid = -1;
+  else if (CNF_GetLogBinary())
+    logfileid = LOG_FileOpenBinary("tracking", BLG_TRACKING, sizeof (BLG_Tracking));
+  else
+    logfileid = LOG_FileOpen("tracking",
+      "   Date (UTC) Time     IP Address   St   Freq ppm   Skew ppm     Offset L Co  Offset sd Rem. corr.");
 
   max_update_skew = fabs(CNF_GetMaxUpdateSkew()) * 1.0e-6;
 
@@ -217,18 +225,6 @@ REF_Initialise(void)
 
   enable_local_stratum = CNF_AllowLocalReference(&local_stratum);
 
-  leap_tzname = CNF_GetLeapSecTimezone();
-  if (leap_tzname) {
-    /* Check that the timezone has good data for Jun 30 2008 and Dec 31 2008 */
-    if (get_tz_leap(1214784000) == LEAP_Normal &&
-        get_tz_leap(1230681600) == LEAP_InsertSecond) {
-      LOG(LOGS_INFO, LOGF_Reference, "Using %s timezone to obtain leap second data", leap_tzname);
-    } else {
-      LOG(LOGS_WARN, LOGF_Reference, "Timezone %s failed leap second check, ignoring", leap_tzname);
-      leap_tzname = NULL;
-    }
-  }
-
   CNF_GetMakeStep(&make_step_limit, &make_step_threshold);
   CNF_GetMaxChange(&max_offset_delay, &max_offset_ignore, &max_offset);
   CNF_GetLogChange(&do_log_change, &log_change_threshold);
@@ -244,9 +240,11 @@ REF_Initialise(void)
   }
 
   last_ref_update.tv_sec = 0;
-  last_ref_update.tv_usec = 0;
+  last_ref_update.tv_nsec = 0;
   last_ref_update_interval = 0.0;
 
+  LCL_ReadCookedTime(&start_time, NULL);
+
   LCL_AddParameterChangeHandler(handle_slew, NULL);
 
   /* And just to prevent anything wierd ... */
@@ -448,16 +446,16 @@ fb_drift_timeout(void *arg)
 /* ================================================== */
 
 static void
-schedule_fb_drift(struct timeval *now)
+schedule_fb_drift(struct timespec *now)
 {
   int i, c, secs;
   double unsynchronised;
-  struct timeval when;
+  struct timespec when;
 
   if (fb_drift_timeout_id != -1)
     return; /* already scheduled */
 
-  UTI_DiffTimevalsToDouble(&unsynchronised, now, &last_ref_update);
+  UTI_DiffTimespecsToDouble(&unsynchronised, now, &last_ref_update);
 
   for (c = secs = 0, i = fb_drift_min; i <= fb_drift_max; i++) {
     secs = 1 << i;
@@ -479,7 +477,7 @@ schedule_fb_drift(struct timeval *now)
 
   if (i <= fb_drift_max) {
     next_fb_drift = i;
-    UTI_AddDoubleToTimeval(now, secs - unsynchronised, &when);
+    UTI_AddDoubleToTimespec(now, secs - unsynchronised, &when);
     fb_drift_timeout_id = SCH_AddTimeout(&when, fb_drift_timeout, NULL);
     DEBUG_LOG(LOGF_Reference, "Fallback drift %d scheduled", i);
   }
@@ -600,62 +598,6 @@ is_leap_second_day(struct tm *stm) {
 
 /* ================================================== */
 
-static NTP_Leap
-get_tz_leap(time_t when)
-{
-  struct tm stm;
-  time_t t;
-  char *tz_env, tz_orig[128];
-
-  /* Do this check at most twice a day */
-  when = when / (12 * 3600) * (12 * 3600);
-  if (last_tz_leap_check == when)
-      return tz_leap;
-
-  last_tz_leap_check = when;
-  tz_leap = LEAP_Normal;
-
-  stm = *gmtime(&when);
-
-  if (!is_leap_second_day(&stm))
-    return tz_leap;
-
-  /* Temporarily switch to the timezone containing leap seconds */
-  tz_env = getenv("TZ");
-  if (tz_env) {
-    if (strlen(tz_env) >= sizeof (tz_orig))
-      return tz_leap;
-    strcpy(tz_orig, tz_env);
-  }
-  setenv("TZ", leap_tzname, 1);
-  tzset();
-
-  /* Set the time to 23:59:60 and see how it overflows in mktime() */
-  stm.tm_sec = 60;
-  stm.tm_min = 59;
-  stm.tm_hour = 23;
-
-  t = mktime(&stm);
-
-  if (tz_env)
-    setenv("TZ", tz_orig, 1);
-  else
-    unsetenv("TZ");
-  tzset();
-
-  if (t == -1)
-    return tz_leap;
-
-  if (stm.tm_sec == 60)
-    tz_leap = LEAP_InsertSecond;
-  else if (stm.tm_sec == 1)
-    tz_leap = LEAP_DeleteSecond;
-
-  return tz_leap;
-}
-
-/* ================================================== */
-
 static void
 update_leap_status(NTP_Leap leap, time_t now)
 {
@@ -663,8 +605,10 @@ update_leap_status(NTP_Leap leap, time_t now)
 
   leap_sec = 0;
 
-  if (leap_tzname && now && leap == LEAP_Normal)
-    leap = get_tz_leap(now);
+  /* The leap second table is used only if the sources don't announce
+     a leap second themselves */
+  if (now && leap == LEAP_Normal && LDB_IsActive())
+    leap = LDB_GetLeap(now);
 
   if (leap == LEAP_InsertSecond || leap == LEAP_DeleteSecond) {
     /* Check that leap second is allowed today */
@@ -685,22 +629,47 @@ update_leap_status(NTP_Leap leap, time_t now)
     our_leap_sec = leap_sec;
   }
 
+  if (leap != our_leap_status)
+    CAM_NotifyEvent(CAM_EVENT_LEAP);
+
   our_leap_status = leap;
 }
 
 /* ================================================== */
 
 static void
-write_log(struct timeval *ref_time, char *ref, int stratum, NTP_Leap leap,
-    double freq, double skew, double offset, int combined_sources,
+write_log(struct timespec *ref_time, IPAddr *ref_ip, uint32_t ref_id, int stratum,
+    NTP_Leap leap, double freq, double skew, double offset, int combined_sources,
     double offset_sd, double uncorrected_offset)
 {
   const char leap_codes[4] = {'N', '+', '-', '?'};
-  if (logfileid != -1) {
+
+  if (logfileid == -1)
+    return;
+
+  if (LOG_FileIsBinary(logfileid)) {
+    BLG_Tracking record;
+
+    memset(&record, 0, sizeof (record));
+    UTI_TimespecHostToNetwork(ref_time, &record.time);
+    UTI_IPHostToNetwork(ref_ip, &record.ip_addr);
+    record.ref_id = htonl(ref_id);
+    record.stratum = stratum;
+    record.leap = leap;
+    record.combined_sources = htons(combined_sources);
+    record.freq = UTI_FloatHostToNetwork(freq);
+    record.skew = UTI_FloatHostToNetwork(skew);
+    record.offset = UTI_FloatHostToNetwork(offset);
+    record.offset_sd = UTI_FloatHostToNetwork(offset_sd);
+    record.remaining_correction = UTI_FloatHostToNetwork(uncorrected_offset);
+
+    LOG_FileWriteRecord(logfileid, &record);
+  } else {
     LOG_FileWrite(logfileid, "%s %-15s %2d %10.3f %10.3f %10.3e %1c %2d %10.3e %10.3e",
-            UTI_TimeToLogForm(ref_time->tv_sec), ref, stratum, freq, skew,
-            offset, leap_codes[leap], combined_sources, offset_sd,
-            uncorrected_offset);
+            UTI_TimeToLogForm(ref_time->tv_sec),
+            ref_ip->family != IPADDR_UNSPEC ? UTI_IPToString(ref_ip) : UTI_RefidToString(ref_id),
+            stratum, freq, skew, offset, leap_codes[leap], combined_sources,
+            offset_sd, uncorrected_offset);
   }
 }
 
@@ -768,7 +737,7 @@ REF_SetReference(int stratum,
                  int combined_sources,
                  uint32_t ref_id,
                  IPAddr *ref_ip,
-                 struct timeval *ref_time,
+                 struct timespec *ref_time,
                  double offset,
                  double offset_sd,
                  double frequency,
@@ -786,10 +755,10 @@ REF_SetReference(int stratum,
   double our_frequency;
   double abs_freq_ppm;
   double update_interval;
-  double elapsed;
+  double elapsed, sync_time;
   double correction_rate;
   double uncorrected_offset, accumulate_offset, step_offset;
-  struct timeval now, raw_now;
+  struct timespec now, raw_now;
 
   assert(initialised);
 
@@ -823,15 +792,25 @@ REF_SetReference(int stratum,
     
   LCL_ReadRawTime(&raw_now);
   LCL_GetOffsetCorrection(&raw_now, &uncorrected_offset, NULL);
-  UTI_AddDoubleToTimeval(&raw_now, uncorrected_offset, &now);
+  UTI_AddDoubleToTimespec(&raw_now, uncorrected_offset, &now);
 
-  UTI_DiffTimevalsToDouble(&elapsed, &now, ref_time);
+  UTI_DiffTimespecsToDouble(&elapsed, &now, ref_time);
   our_offset = offset + elapsed * frequency;
 
   if (!is_offset_ok(our_offset))
     return;
 
   are_we_synchronised = leap != LEAP_Unsynchronised ? 1 : 0;
+
+  /* Report the time it took to synchronise after start */
+  if (are_we_synchronised && start_time.tv_sec) {
+    UTI_DiffTimespecsToDouble(&sync_time, &now, &start_time);
+    LOG(LOGS_INFO, LOGF_Reference, "System clock synchronised %.3f seconds after start",
+        sync_time);
+    start_time.tv_sec = 0;
+    start_time.tv_nsec = 0;
+  }
+
   our_stratum = stratum + 1;
   our_ref_id = ref_id;
   if (ref_ip)
@@ -843,7 +822,7 @@ REF_SetReference(int stratum,
   our_root_dispersion = root_dispersion;
 
   if (last_ref_update.tv_sec) {
-    UTI_DiffTimevalsToDouble(&update_interval, &now, &last_ref_update);
+    UTI_DiffTimespecsToDouble(&update_interval, &now, &last_ref_update);
     if (update_interval < 0.0)
       update_interval = 0.0;
   } else {
@@ -931,7 +910,8 @@ REF_SetReference(int stratum,
   abs_freq_ppm = LCL_ReadAbsoluteFrequency();
 
   write_log(&now,
-            our_ref_ip.family != IPADDR_UNSPEC ? UTI_IPToString(&our_ref_ip) : UTI_RefidToString(our_ref_id),
+            &our_ref_ip,
+            our_ref_id,
             our_stratum,
             our_leap_status,
             abs_freq_ppm,
@@ -941,6 +921,9 @@ REF_SetReference(int stratum,
             offset_sd,
             uncorrected_offset);
 
+  STP_Update();
+  CAM_NotifyEvent(CAM_EVENT_TRACKING);
+
   if (drift_file) {
     /* Update drift file at most once per hour */
     drift_file_age += update_interval;
@@ -973,7 +956,7 @@ REF_SetReference(int stratum,
 void
 REF_SetManualReference
 (
- struct timeval *ref_time,
+ struct timespec *ref_time,
  double offset,
  double frequency,
  double skew
@@ -994,8 +977,9 @@ void
 REF_SetUnsynchronised(void)
 {
   /* Variables required for logging to statistics log */
-  struct timeval now, now_raw;
+  struct timespec now, now_raw;
   double uncorrected_offset;
+  IPAddr ref_ip;
 
   assert(initialised);
 
@@ -1007,7 +991,7 @@ REF_SetUnsynchronised(void)
 
   LCL_ReadRawTime(&now_raw);
   LCL_GetOffsetCorrection(&now_raw, &uncorrected_offset, NULL);
-  UTI_AddDoubleToTimeval(&now_raw, uncorrected_offset, &now);
+  UTI_AddDoubleToTimespec(&now_raw, uncorrected_offset, &now);
 
   if (fb_drifts) {
     schedule_fb_drift(&now);
@@ -1016,8 +1000,12 @@ REF_SetUnsynchronised(void)
   update_leap_status(LEAP_Unsynchronised, 0);
   are_we_synchronised = 0;
 
+  ref_ip.family = IPADDR_INET4;
+  ref_ip.addr.in4 = 0;
+
   write_log(&now,
-            "0.0.0.0",
+            &ref_ip,
+            0,
             0,
             our_leap_status,
             LCL_ReadAbsoluteFrequency(),
@@ -1026,6 +1014,9 @@ REF_SetUnsynchronised(void)
             0,
             0.0,
             uncorrected_offset);
+
+  STP_Update();
+  CAM_NotifyEvent(CAM_EVENT_TRACKING);
 }
 
 /* ================================================== */
@@ -1033,12 +1024,12 @@ REF_SetUnsynchronised(void)
 void
 REF_GetReferenceParams
 (
- struct timeval *local_time,
+ struct timespec *local_time,
  int *is_synchronised,
  NTP_Leap *leap_status,
  int *stratum,
  uint32_t *ref_id,
- struct timeval *ref_time,
+ struct timespec *ref_time,
  double *root_delay,
  double *root_dispersion
 )
@@ -1054,7 +1045,7 @@ REF_GetReferenceParams
 
     *stratum = our_stratum;
 
-    UTI_DiffTimevalsToDouble(&elapsed, local_time, &our_ref_time);
+    UTI_DiffTimespecsToDouble(&elapsed, local_time, &our_ref_time);
     extra_dispersion = (our_skew + fabs(our_residual_freq) + LCL_GetMaxClockError()) * elapsed;
 
     *leap_status = our_leap_status;
@@ -1091,7 +1082,7 @@ REF_GetReferenceParams
     *leap_status = LEAP_Unsynchronised;
     *stratum = 0;
     *ref_id = 0;
-    ref_time->tv_sec = ref_time->tv_usec = 0;
+    ref_time->tv_sec = ref_time->tv_nsec = 0;
     /* These values seem to be standard for a client, and
        any peer or client of ours will ignore them anyway because
        we don't claim to be synchronised */
@@ -1154,7 +1145,7 @@ REF_IsLocalActive(void)
 
 int REF_IsLeapSecondClose(void)
 {
-  struct timeval now, now_raw;
+  struct timespec now, now_raw;
   time_t t;
 
   if (!our_leap_sec)
@@ -1180,19 +1171,19 @@ REF_GetTrackingReport(RPT_TrackingReport *rep)
 {
   double elapsed;
   double extra_dispersion;
-  struct timeval now_raw, now_cooked;
+  struct timespec now_raw, now_cooked;
   double correction;
 
   LCL_ReadRawTime(&now_raw);
   LCL_GetOffsetCorrection(&now_raw, &correction, NULL);
-  UTI_AddDoubleToTimeval(&now_raw, correction, &now_cooked);
+  UTI_AddDoubleToTimespec(&now_raw, correction, &now_cooked);
 
   rep->ref_id = 0;
   rep->ip_addr.family = IPADDR_UNSPEC;
   rep->stratum = 0;
   rep->leap_status = our_leap_status;
   rep->ref_time.tv_sec = 0;
-  rep->ref_time.tv_usec = 0;
+  rep->ref_time.tv_nsec = 0;
   rep->current_correction = correction;
   rep->freq_ppm = LCL_ReadAbsoluteFrequency();
   rep->resid_freq_ppm = 0.0;
@@ -1205,7 +1196,7 @@ REF_GetTrackingReport(RPT_TrackingReport *rep)
 
   if (are_we_synchronised) {
     
-    UTI_DiffTimevalsToDouble(&elapsed, &now_cooked, &our_ref_time);
+    UTI_DiffTimespecsToDouble(&elapsed, &now_cooked, &our_ref_time);
     extra_dispersion = (our_skew + fabs(our_residual_freq) + LCL_GetMaxClockError()) * elapsed;
     
     rep->ref_id = our_ref_id;
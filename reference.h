@@ -88,12 +88,12 @@ extern void REF_SetModeEndHandler(REF_ModeEndHandler handler);
 
 extern void REF_GetReferenceParams
 (
- struct timeval *local_time,
+ struct timespec *local_time,
  int *is_synchronised,
  NTP_Leap *leap,
  int *stratum,
  uint32_t *ref_id,
- struct timeval *ref_time,
+ struct timespec *ref_time,
  double *root_delay,
  double *root_dispersion
 );
@@ -129,7 +129,7 @@ extern void REF_SetReference
  int combined_sources,
  uint32_t ref_id,
  IPAddr *ref_ip,
- struct timeval *ref_time,
+ struct timespec *ref_time,
  double offset,
  double offset_sd,
  double frequency,
@@ -140,7 +140,7 @@ extern void REF_SetReference
 
 extern void REF_SetManualReference
 (
- struct timeval *ref_time,
+ struct timespec *ref_time,
  double offset,
  double frequency,
  double skew
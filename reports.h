@@ -52,7 +52,7 @@ typedef struct {
   IPAddr ip_addr;
   unsigned long stratum;
   unsigned long leap_status;
-  struct timeval ref_time;
+  struct timespec ref_time;
   double current_correction;
   double last_offset;
   double rms_offset;
@@ -78,7 +78,7 @@ typedef struct {
 } RPT_SourcestatsReport;
 
 typedef struct {
-  struct timeval ref_time;
+  struct timespec ref_time;
   unsigned short n_samples;
   unsigned short n_runs;
   unsigned long span_seconds;
@@ -108,7 +108,7 @@ typedef struct {
 } RPT_ClientAccessByIndex_Report;
 
 typedef struct {
-  struct timeval when;
+  struct timespec when;
   double slewed_offset;
   double orig_offset;
   double residual;
@@ -122,4 +122,22 @@ typedef struct {
   int unresolved;
 } RPT_ActivityReport;
 
+#define RPT_MAX_WORST_LATENCIES 8
+
+typedef struct {
+  unsigned long count;
+  double mean;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  double max;
+  int n_worst;
+  struct {
+    IPAddr ip_addr;
+    struct timespec when;
+    double latency;
+  } worst[RPT_MAX_WORST_LATENCIES];
+} RPT_ServerLatencyReport;
+
 #endif /* GOT_REPORTS_H */
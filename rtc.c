@@ -79,7 +79,7 @@ static struct {
 static void
 fallback_time_init(void)
 {
-  struct timeval now;
+  struct timespec now;
   struct stat buf;
   char *drift_file;
 
@@ -52,6 +52,8 @@ static void measurement_timeout(void *any);
 
 static void read_from_device(void *any);
 
+static void read_update(void *any);
+
 /* ================================================== */
 
 typedef enum {
@@ -79,6 +81,37 @@ static int skip_interrupts;
 
 /* ================================================== */
 
+/* Flag indicating that the RTC should be sampled on demand, without
+   update interrupts, when the coefficients are valid */
+static int on_demand;
+
+/* How long before the predicted update of the RTC its reading starts
+   (adapted to the error of the prediction and lateness of the timeout).
+   The RTC is read in a busy loop for at most twice the margin, if a larger
+   margin would be needed, interrupts are used again. */
+#define MIN_UPDATE_MARGIN 0.001
+#define MAX_UPDATE_MARGIN 0.005
+#define INITIAL_UPDATE_MARGIN 0.002
+
+static double update_margin;
+
+/* Maximum error of the prediction which allows the measurement period
+   to be increased */
+#define MAX_PREDICTION_ERROR 0.001
+
+/* Number of updates missed in a row before interrupts are used again */
+#define MAX_MISSED_UPDATES 3
+
+static int missed_updates;
+
+/* Predicted time of the next update, the new RTC time and the time when
+   its reading should start */
+static struct timespec predicted_update;
+static time_t predicted_update_rtc;
+static struct timespec update_read_start;
+
+/* ================================================== */
+
 /* Maximum number of samples held */
 #define MAX_SAMPLES 64
 
@@ -95,7 +128,7 @@ static time_t rtc_ref;
 
 /* System clock (gettimeofday) samples associated with the above
    samples. */
-static struct timeval system_times[MAX_SAMPLES];
+static struct timespec system_times[MAX_SAMPLES];
 
 /* Number of samples currently stored. */
 static int n_samples;   
@@ -171,7 +204,7 @@ discard_samples(int new_first)
 
   memmove(rtc_sec, rtc_sec + new_first, n_to_save * sizeof(time_t));
   memmove(rtc_trim, rtc_trim + new_first, n_to_save * sizeof(double));
-  memmove(system_times, system_times + new_first, n_to_save * sizeof(struct timeval));
+  memmove(system_times, system_times + new_first, n_to_save * sizeof(struct timespec));
 
   n_samples = n_to_save;
 }
@@ -181,7 +214,7 @@ discard_samples(int new_first)
 #define NEW_FIRST_WHEN_FULL 4
 
 static void
-accumulate_sample(time_t rtc, struct timeval *sys)
+accumulate_sample(time_t rtc, struct timespec *sys)
 {
 
   if (n_samples == MAX_SAMPLES) {
@@ -226,7 +259,7 @@ run_regression(int new_sample,
     for (i=0; i<n_samples; i++) {
       rtc_rel[i] = rtc_trim[i] + (double)(rtc_sec[i] - rtc_ref);
       offsets[i] = ((double) (rtc_ref - system_times[i].tv_sec) -
-                    (1.0e-6 * (double) system_times[i].tv_usec) +
+                    (1.0e-9 * (double) system_times[i].tv_nsec) +
                     rtc_rel[i]);
 
     }
@@ -263,7 +296,7 @@ run_regression(int new_sample,
 
 static void
 slew_samples
-(struct timeval *raw, struct timeval *cooked,
+(struct timespec *raw, struct timespec *cooked,
  double dfreq,
  double doffset,
  LCL_ChangeType change_type,
@@ -279,7 +312,7 @@ slew_samples
   }
 
   for (i=0; i<n_samples; i++) {
-    UTI_AdjustTimeval(system_times + i, cooked, system_times + i, &delta_time,
+    UTI_AdjustTimespec(system_times + i, cooked, system_times + i, &delta_time,
         dfreq, doffset);
   }
 
@@ -421,6 +454,8 @@ setup_config(void)
   read_hwclock_file(CNF_GetHwclockFile());
 
   autotrim_threshold = CNF_GetRtcAutotrim();
+
+  on_demand = CNF_GetRtcOnDemand();
 }
 
 /* ================================================== */
@@ -555,6 +590,9 @@ RTC_Linux_Initialise(void)
 
   measurement_period = LOWEST_MEASUREMENT_PERIOD;
 
+  update_margin = INITIAL_UPDATE_MARGIN;
+  missed_updates = 0;
+
   operating_mode = OM_NORMAL;
 
   /* Register file handler */
@@ -615,11 +653,49 @@ switch_interrupts(int onoff)
 
 /* ================================================== */
 
+/* Schedule reading of the RTC shortly before its next update predicted
+   from the coefficients */
+
+static void
+schedule_update_read(void)
+{
+  struct timespec now;
+  double sys_rel, rtc_rel, update_rel, delay;
+
+  LCL_ReadCookedTime(&now, NULL);
+
+  /* The offset is a linear function of the RTC time relative to the
+     reference time */
+  sys_rel = (now.tv_sec - coef_ref_time) + 1.0e-9 * now.tv_nsec;
+  rtc_rel = (sys_rel + coef_seconds_fast) / (1.0 - coef_gain_rate);
+
+  /* Find the first update which leaves enough time to start the reading */
+  for (update_rel = floor(rtc_rel) + 1.0; ; update_rel += 1.0) {
+    delay = update_rel - (coef_seconds_fast + coef_gain_rate * update_rel) - sys_rel;
+    if (delay > 2.0 * update_margin)
+      break;
+  }
+
+  UTI_AddDoubleToTimespec(&now, delay, &predicted_update);
+  UTI_AddDoubleToTimespec(&now, delay - update_margin, &update_read_start);
+  predicted_update_rtc = coef_ref_time + (time_t)update_rel;
+
+  timeout_running = 1;
+  timeout_id = SCH_AddPreciseTimeoutByDelay(delay - update_margin, read_update, NULL);
+}
+
+/* ================================================== */
+
 static void
 measurement_timeout(void *any)
 {
   timeout_running = 0;
-  switch_interrupts(1);
+
+  if (on_demand && operating_mode == OM_NORMAL && coefs_valid &&
+      missed_updates < MAX_MISSED_UPDATES)
+    schedule_update_read();
+  else
+    switch_interrupts(1);
 }
 
 /* ================================================== */
@@ -748,7 +824,7 @@ maybe_autotrim(void)
 /* ================================================== */
 
 static void
-process_reading(time_t rtc_time, struct timeval *system_time)
+process_reading(time_t rtc_time, struct timespec *system_time)
 {
   double rtc_fast;
 
@@ -781,7 +857,7 @@ process_reading(time_t rtc_time, struct timeval *system_time)
 
 
   if (logfileid != -1) {
-    rtc_fast = (double)(rtc_time - system_time->tv_sec) - 1.0e-6 * (double) system_time->tv_usec;
+    rtc_fast = (double)(rtc_time - system_time->tv_sec) - 1.0e-9 * (double) system_time->tv_nsec;
 
     LOG_FileWrite(logfileid, "%s %14.6f %1d  %14.6f  %12.3f  %2d  %2d %4d",
             UTI_TimeToLogForm(system_time->tv_sec),
@@ -794,14 +870,166 @@ process_reading(time_t rtc_time, struct timeval *system_time)
 
 /* ================================================== */
 
+static time_t
+convert_rtc_time(struct rtc_time *rtc_raw)
+{
+  struct tm rtc_tm;
+
+  rtc_tm.tm_sec = rtc_raw->tm_sec;
+  rtc_tm.tm_min = rtc_raw->tm_min;
+  rtc_tm.tm_hour = rtc_raw->tm_hour;
+  rtc_tm.tm_mday = rtc_raw->tm_mday;
+  rtc_tm.tm_mon = rtc_raw->tm_mon;
+  rtc_tm.tm_year = rtc_raw->tm_year;
+
+  return t_from_rtc(&rtc_tm);
+}
+
+/* ================================================== */
+
+static void
+update_measurement_period(void)
+{
+  if (n_samples < 4) {
+    measurement_period = LOWEST_MEASUREMENT_PERIOD;
+  } else if (n_samples < 6) {
+    measurement_period = LOWEST_MEASUREMENT_PERIOD << 1;
+  } else if (n_samples < 10) {
+    measurement_period = LOWEST_MEASUREMENT_PERIOD << 2;
+  } else if (n_samples < 14) {
+    measurement_period = LOWEST_MEASUREMENT_PERIOD << 3;
+  } else {
+    measurement_period = LOWEST_MEASUREMENT_PERIOD << 4;
+  }
+}
+
+/* ================================================== */
+
+static void
+handle_missed_update(double lateness)
+{
+  missed_updates++;
+
+  update_margin *= 2.0;
+  if (update_margin < 2.0 * lateness)
+    update_margin = 2.0 * lateness;
+  if (update_margin > MAX_UPDATE_MARGIN) {
+    update_margin = MAX_UPDATE_MARGIN;
+    /* Don't spin longer, switch back to the interrupts */
+    if (2.0 * lateness > MAX_UPDATE_MARGIN)
+      missed_updates = MAX_MISSED_UPDATES;
+  }
+
+  measurement_period = LOWEST_MEASUREMENT_PERIOD;
+
+  DEBUG_LOG(LOGF_RtcLinux, "Missed RTC update missed=%d margin=%f lateness=%f",
+            missed_updates, update_margin, lateness);
+
+  measurement_timeout(NULL);
+}
+
+/* ================================================== */
+/* Timeout handler reading the RTC repeatedly around its predicted update.
+   The update is assumed to be in the middle between the start of the last
+   reading which returned the old time and the end of the first reading
+   which returned the new time. */
+
+static void
+read_update(void *any)
+{
+  struct rtc_time rtc_raw;
+  struct timespec before, after, prev_before, sample;
+  double lateness, elapsed, error, width;
+  time_t rtc_t;
+  int status, first_sec;
+
+  timeout_running = 0;
+
+  LCL_ReadCookedTime(&before, NULL);
+  status = ioctl(fd, RTC_RD_TIME, &rtc_raw);
+
+  UTI_DiffTimespecsToDouble(&lateness, &before, &update_read_start);
+
+  /* The first reading has to be made before the update */
+  if (status < 0 || convert_rtc_time(&rtc_raw) != predicted_update_rtc - 1) {
+    if (status < 0)
+      LOG(LOGS_ERR, LOGF_RtcLinux, "Could not read time from %s : %s",
+          CNF_GetRtcDevice(), strerror(errno));
+    handle_missed_update(lateness);
+    return;
+  }
+
+  first_sec = rtc_raw.tm_sec;
+
+  while (1) {
+    prev_before = before;
+
+    LCL_ReadCookedTime(&before, NULL);
+    status = ioctl(fd, RTC_RD_TIME, &rtc_raw);
+    LCL_ReadCookedTime(&after, NULL);
+
+    if (status < 0 || rtc_raw.tm_sec != first_sec)
+      break;
+
+    UTI_DiffTimespecsToDouble(&elapsed, &after, &predicted_update);
+    if (elapsed > update_margin)
+      break;
+  }
+
+  if (status < 0 || rtc_raw.tm_sec == first_sec) {
+    handle_missed_update(lateness);
+    return;
+  }
+
+  rtc_t = convert_rtc_time(&rtc_raw);
+  if (rtc_t != predicted_update_rtc) {
+    handle_missed_update(lateness);
+    return;
+  }
+
+  UTI_AverageDiffTimespecs(&prev_before, &after, &sample, &width);
+  UTI_DiffTimespecsToDouble(&error, &sample, &predicted_update);
+
+  DEBUG_LOG(LOGF_RtcLinux, "RTC update error=%f width=%f lateness=%f margin=%f",
+            error, width, lateness, update_margin);
+
+  missed_updates = 0;
+
+  /* Adapt the margin to the observed errors */
+  update_margin = 4.0 * fabs(error) + width + (lateness > 0.0 ? 2.0 * lateness : 0.0);
+  if (update_margin < MIN_UPDATE_MARGIN)
+    update_margin = MIN_UPDATE_MARGIN;
+  else if (update_margin > MAX_UPDATE_MARGIN)
+    update_margin = MAX_UPDATE_MARGIN;
+
+  process_reading(rtc_t, &sample);
+
+  /* The RTC may have been trimmed */
+  if (operating_mode != OM_NORMAL)
+    return;
+
+  /* Sample less frequently while the predictions are good */
+  if (fabs(error) < MAX_PREDICTION_ERROR) {
+    measurement_period *= 2;
+    if (measurement_period > HIGHEST_MEASUREMENT_PERIOD)
+      measurement_period = HIGHEST_MEASUREMENT_PERIOD;
+  } else {
+    update_measurement_period();
+  }
+
+  timeout_running = 1;
+  timeout_id = SCH_AddTimeoutByDelay((double) measurement_period, measurement_timeout, NULL);
+}
+
+/* ================================================== */
+
 static void
 read_from_device(void *any)
 {
   int status;
   unsigned long data;
-  struct timeval sys_time;
+  struct timespec sys_time;
   struct rtc_time rtc_raw;
-  struct tm rtc_tm;
   time_t rtc_t;
   int error = 0;
 
@@ -839,35 +1067,19 @@ read_from_device(void *any)
       goto turn_off_interrupt;
     }
 
-    /* Convert RTC time into a struct timeval */
-    rtc_tm.tm_sec = rtc_raw.tm_sec;
-    rtc_tm.tm_min = rtc_raw.tm_min;
-    rtc_tm.tm_hour = rtc_raw.tm_hour;
-    rtc_tm.tm_mday = rtc_raw.tm_mday;
-    rtc_tm.tm_mon = rtc_raw.tm_mon;
-    rtc_tm.tm_year = rtc_raw.tm_year;
-
-    rtc_t = t_from_rtc(&rtc_tm);
+    /* Convert RTC time into a struct timespec */
+    rtc_t = convert_rtc_time(&rtc_raw);
 
     if (rtc_t == (time_t)(-1)) {
-      LOG(LOGS_ERR, LOGF_RtcLinux, "Could not convert RTC time to timeval");
+      LOG(LOGS_ERR, LOGF_RtcLinux, "Could not convert RTC time to timespec");
       error = 1;
       goto turn_off_interrupt;
     }      
 
     process_reading(rtc_t, &sys_time);
 
-    if (n_samples < 4) {
-      measurement_period = LOWEST_MEASUREMENT_PERIOD;
-    } else if (n_samples < 6) {
-      measurement_period = LOWEST_MEASUREMENT_PERIOD << 1;
-    } else if (n_samples < 10) {
-      measurement_period = LOWEST_MEASUREMENT_PERIOD << 2;
-    } else if (n_samples < 14) {
-      measurement_period = LOWEST_MEASUREMENT_PERIOD << 3;
-    } else {
-      measurement_period = LOWEST_MEASUREMENT_PERIOD << 4;
-    }
+    update_measurement_period();
+    missed_updates = 0;
 
   }
 
@@ -974,7 +1186,7 @@ RTC_Linux_TimePreInit(void)
   struct tm rtc_tm;
   time_t rtc_t;
   double accumulated_error, sys_offset;
-  struct timeval new_sys_time, old_sys_time;
+  struct timespec new_sys_time, old_sys_time;
 
   coefs_file_name = CNF_GetRtcFile();
 
@@ -1028,11 +1240,11 @@ RTC_Linux_TimePreInit(void)
 
       new_sys_time.tv_sec = rtc_t;
       /* Average error in the RTC reading */
-      new_sys_time.tv_usec = 500000;
+      new_sys_time.tv_nsec = 500000000;
 
-      UTI_AddDoubleToTimeval(&new_sys_time, -accumulated_error, &new_sys_time);
+      UTI_AddDoubleToTimespec(&new_sys_time, -accumulated_error, &new_sys_time);
 
-      UTI_DiffTimevalsToDouble(&sys_offset, &old_sys_time, &new_sys_time);
+      UTI_DiffTimespecsToDouble(&sys_offset, &old_sys_time, &new_sys_time);
 
       /* Set system time only if the step is larger than 1 second */
       if (fabs(sys_offset) >= 1.0) {
@@ -1055,7 +1267,7 @@ int
 RTC_Linux_GetReport(RPT_RTC_Report *report)
 {
   report->ref_time.tv_sec = coef_ref_time;
-  report->ref_time.tv_usec = 0;
+  report->ref_time.tv_nsec = 0;
   report->n_samples = n_samples;
   report->n_runs = n_runs;
   if (n_samples > 1) {
@@ -1074,7 +1286,7 @@ RTC_Linux_GetReport(RPT_RTC_Report *report)
 int
 RTC_Linux_Trim(void)
 {
-  struct timeval now;
+  struct timespec now;
 
 
   /* Remember the slope coefficient - we won't be able to determine a
@@ -1104,7 +1316,7 @@ RTC_Linux_Trim(void)
 
     /* Estimate the offset in case writertc is called or chronyd
        is terminated during rapid sampling */
-    coef_seconds_fast = -now.tv_usec / 1e6 + 0.5;
+    coef_seconds_fast = -now.tv_nsec / 1e9 + 0.5;
     coef_ref_time = now.tv_sec;
 
     /* And start rapid sampling, interrupts on now */
@@ -30,6 +30,8 @@
 
 #include "sysincl.h"
 
+#include "conf.h"
+#include "counters.h"
 #include "sched.h"
 #include "memory.h"
 #include "util.h"
@@ -66,12 +68,13 @@ static unsigned int one_highest_fd;
 typedef struct {
   SCH_FileHandler       handler;
   SCH_ArbitraryArgument arg;
+  int                   latency_index;
 } FileHandlerEntry;
 
 static FileHandlerEntry file_handlers[FD_SETSIZE];
 
 /* Timestamp when last select() returned */
-static struct timeval last_select_ts, last_select_ts_raw;
+static struct timespec last_select_ts, last_select_ts_raw;
 static double last_select_ts_err;
 
 /* ================================================== */
@@ -82,7 +85,7 @@ typedef struct _TimerQueueEntry
 {
   struct _TimerQueueEntry *next; /* Forward and back links in the list */
   struct _TimerQueueEntry *prev;
-  struct timeval tv;            /* Local system time at which the
+  struct timespec tv;            /* Local system time at which the
                                    timeout is to expire.  Clearly this
                                    must be in terms of what the
                                    operating system thinks of as
@@ -92,11 +95,17 @@ typedef struct _TimerQueueEntry
                                    driver module would apply to time
                                    that we pass to clients etc doesn't
                                    apply to this. */
+  struct timespec latest;       /* Latest time at which the timeout
+                                   can be dispatched, timeouts are
+                                   allowed to be late by a slack in
+                                   order to dispatch them together
+                                   with other timeouts */
   SCH_TimeoutID id;             /* ID to allow client to delete
                                    timeout */
   SCH_TimeoutClass class;       /* The class that the epoch is in */
   SCH_TimeoutHandler handler;   /* The handler routine to use */
   SCH_ArbitraryArgument arg;    /* The argument to pass to the handler */
+  int latency_index;            /* Index of the latency histogram */
 
 } TimerQueueEntry;
 
@@ -110,7 +119,17 @@ static SCH_TimeoutID next_tqe_id;
 static TimerQueueEntry *tqe_free_list = NULL;
 
 /* Timestamp when was last timeout dispatched for each class */
-static struct timeval last_class_dispatch[SCH_NumberOfClasses];
+static struct timespec last_class_dispatch[SCH_NumberOfClasses];
+
+/* Maximum slack of timeouts, the slack is also limited to a fraction of
+   the delay of the timeout */
+static double max_timer_slack;
+#define MAX_TIMER_SLACK_RATIO 0.0625
+
+/* Counters of select() returns, raw time when the counting started */
+static unsigned long timeout_wakeups;
+static unsigned long file_wakeups;
+static struct timespec wakeups_start_ts;
 
 /* ================================================== */
 
@@ -118,9 +137,39 @@ static int need_to_exit;
 
 /* ================================================== */
 
+/* Latency histograms of the dispatched handlers.  The histogram is
+   looked up when the handler is registered, so the dispatch needs only
+   one extra reading of the clock per handler. */
+
+#define MAX_LATENCY_STATS 64
+
+/* Index of the histogram of the delay between select() return and start
+   of the handlers */
+#define DISPATCH_DELAY_INDEX 0
+
+typedef struct {
+  SCH_LatencyType type;
+  SCH_TimeoutHandler handler;   /* SCH_TimeoutHandler or SCH_FileHandler */
+  unsigned long count;
+  double total;
+  double max;
+  unsigned long buckets[SCH_LATENCY_BUCKETS];
+} LatencyStats;
+
+static LatencyStats latency_stats[MAX_LATENCY_STATS];
+static int n_latency_stats;
+
+/* Raw time when the currently running handler was started */
+static struct timespec handler_start_ts;
+
+/* Flag set by SCH_RequestLatencyDump() */
+static int dump_latency;
+
+/* ================================================== */
+
 static void
-handle_slew(struct timeval *raw,
-            struct timeval *cooked,
+handle_slew(struct timespec *raw,
+            struct timespec *cooked,
             double dfreq,
             double doffset,
             LCL_ChangeType change_type,
@@ -142,12 +191,22 @@ SCH_Initialise(void)
 
   need_to_exit = 0;
 
+  memset(latency_stats, 0, sizeof (latency_stats));
+  latency_stats[DISPATCH_DELAY_INDEX].type = SCH_DispatchDelay;
+  n_latency_stats = 1;
+  dump_latency = 0;
+
+  max_timer_slack = CNF_GetTimerSlack();
+  timeout_wakeups = file_wakeups = 0;
+
   LCL_AddParameterChangeHandler(handle_slew, NULL);
 
   LCL_ReadRawTime(&last_select_ts_raw);
   last_select_ts = last_select_ts_raw;
+  handler_start_ts = last_select_ts_raw;
+  wakeups_start_ts = last_select_ts_raw;
 
-  srandom(last_select_ts.tv_sec << 16 ^ last_select_ts.tv_usec);
+  srandom(last_select_ts.tv_sec << 16 ^ last_select_ts.tv_nsec);
 
   initialised = 1;
 }
@@ -162,6 +221,58 @@ SCH_Finalise(void) {
 
 /* ================================================== */
 
+static int
+get_latency_index(SCH_LatencyType type, SCH_TimeoutHandler handler)
+{
+  int i;
+
+  for (i = 0; i < n_latency_stats; i++) {
+    if (latency_stats[i].type == type && latency_stats[i].handler == handler)
+      return i;
+  }
+
+  if (n_latency_stats >= MAX_LATENCY_STATS)
+    return -1;
+
+  latency_stats[i].type = type;
+  latency_stats[i].handler = handler;
+  n_latency_stats++;
+
+  return i;
+}
+
+/* ================================================== */
+
+static void
+record_latency(int index, struct timespec *start, struct timespec *end)
+{
+  LatencyStats *stats;
+  unsigned long us;
+  double latency;
+  int bucket;
+
+  if (index < 0)
+    return;
+
+  UTI_DiffTimespecsToDouble(&latency, end, start);
+  if (latency < 0.0)
+    latency = 0.0;
+
+  stats = &latency_stats[index];
+  stats->count++;
+  stats->total += latency;
+  if (stats->max < latency)
+    stats->max = latency;
+
+  us = latency < 1e3 ? latency * 1e6 : 1e9;
+  for (bucket = 0; us && bucket < SCH_LATENCY_BUCKETS - 1; bucket++)
+    us >>= 1;
+
+  stats->buckets[bucket]++;
+}
+
+/* ================================================== */
+
 void
 SCH_AddInputFileHandler
 (int fd, SCH_FileHandler handler, SCH_ArbitraryArgument arg)
@@ -181,6 +292,7 @@ SCH_AddInputFileHandler
   
   file_handlers[fd].handler = handler;
   file_handlers[fd].arg     = arg;
+  file_handlers[fd].latency_index = get_latency_index(SCH_FileLatency, handler);
 
   FD_SET(fd, &read_fds);
 
@@ -222,7 +334,7 @@ SCH_RemoveInputFileHandler(int fd)
 /* ================================================== */
 
 void
-SCH_GetLastEventTime(struct timeval *cooked, double *err, struct timeval *raw)
+SCH_GetLastEventTime(struct timespec *cooked, double *err, struct timespec *raw)
 {
   if (cooked) {
     *cooked = last_select_ts;
@@ -268,11 +380,33 @@ release_tqe(TimerQueueEntry *node)
 
 /* ================================================== */
 
-SCH_TimeoutID
-SCH_AddTimeout(struct timeval *tv, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+/* Set the latest dispatch time of a timeout which is delay seconds
+   in the future */
+
+static void
+set_timer_slack(TimerQueueEntry *tqe, double delay)
+{
+  double slack;
+
+  slack = delay * MAX_TIMER_SLACK_RATIO;
+  if (slack > max_timer_slack)
+    slack = max_timer_slack;
+
+  if (slack > 0.0)
+    UTI_AddDoubleToTimespec(&tqe->tv, slack, &tqe->latest);
+  else
+    tqe->latest = tqe->tv;
+}
+
+/* ================================================== */
+
+static SCH_TimeoutID
+add_timeout(struct timespec *tv, int precise, SCH_TimeoutHandler handler,
+            SCH_ArbitraryArgument arg)
 {
   TimerQueueEntry *new_tqe;
   TimerQueueEntry *ptr;
+  double delay;
 
   assert(initialised);
 
@@ -282,11 +416,21 @@ SCH_AddTimeout(struct timeval *tv, SCH_TimeoutHandler handler, SCH_ArbitraryArgu
   new_tqe->handler = handler;
   new_tqe->arg = arg;
   new_tqe->tv = *tv;
+
+  /* Avoid reading the clock, the start of the current handler is close
+     enough for the slack */
+  if (max_timer_slack > 0.0 && !precise) {
+    UTI_DiffTimespecsToDouble(&delay, tv, &handler_start_ts);
+    set_timer_slack(new_tqe, delay);
+  } else {
+    new_tqe->latest = *tv;
+  }
   new_tqe->class = SCH_ReservedTimeoutValue;
+  new_tqe->latency_index = get_latency_index(SCH_TimeoutLatency, handler);
 
   /* Now work out where to insert the new entry in the list */
   for (ptr = timer_queue.next; ptr != &timer_queue; ptr = ptr->next) {
-    if (UTI_CompareTimevals(&new_tqe->tv, &ptr->tv) == -1) {
+    if (UTI_CompareTimespecs(&new_tqe->tv, &ptr->tv) == -1) {
       /* If the new entry comes before the current pointer location in
          the list, we want to insert the new entry just before ptr. */
       break;
@@ -306,6 +450,14 @@ SCH_AddTimeout(struct timeval *tv, SCH_TimeoutHandler handler, SCH_ArbitraryArgu
   return new_tqe->id;
 }
 
+/* ================================================== */
+
+SCH_TimeoutID
+SCH_AddTimeout(struct timespec *tv, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+{
+  return add_timeout(tv, 0, handler, arg);
+}
+
 /* ================================================== */
 /* This queues a timeout to elapse at a given delta time relative to
    the current (raw) time */
@@ -313,19 +465,34 @@ SCH_AddTimeout(struct timeval *tv, SCH_TimeoutHandler handler, SCH_ArbitraryArgu
 SCH_TimeoutID
 SCH_AddTimeoutByDelay(double delay, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
 {
-  struct timeval now, then;
+  struct timespec now, then;
 
   assert(initialised);
   assert(delay >= 0.0);
 
   LCL_ReadRawTime(&now);
-  UTI_AddDoubleToTimeval(&now, delay, &then);
+  UTI_AddDoubleToTimespec(&now, delay, &then);
   return SCH_AddTimeout(&then, handler, arg);
 
 }
 
 /* ================================================== */
 
+SCH_TimeoutID
+SCH_AddPreciseTimeoutByDelay(double delay, SCH_TimeoutHandler handler, SCH_ArbitraryArgument arg)
+{
+  struct timespec now, then;
+
+  assert(initialised);
+  assert(delay >= 0.0);
+
+  LCL_ReadRawTime(&now);
+  UTI_AddDoubleToTimespec(&now, delay, &then);
+  return add_timeout(&then, 1, handler, arg);
+}
+
+/* ================================================== */
+
 SCH_TimeoutID
 SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
                       SCH_TimeoutClass class,
@@ -333,7 +500,7 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
 {
   TimerQueueEntry *new_tqe;
   TimerQueueEntry *ptr;
-  struct timeval now;
+  struct timespec now;
   double diff, r;
   double new_min_delay;
 
@@ -351,7 +518,7 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
   new_min_delay = min_delay;
 
   /* Check the separation from the last dispatched timeout */
-  UTI_DiffTimevalsToDouble(&diff, &now, &last_class_dispatch[class]);
+  UTI_DiffTimespecsToDouble(&diff, &now, &last_class_dispatch[class]);
   if (diff < separation && diff >= 0.0 && diff + new_min_delay < separation) {
     new_min_delay = separation - diff;
   }
@@ -360,7 +527,7 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
      if necessary to keep at least the separation away */
   for (ptr = timer_queue.next; ptr != &timer_queue; ptr = ptr->next) {
     if (ptr->class == class) {
-      UTI_DiffTimevalsToDouble(&diff, &ptr->tv, &now);
+      UTI_DiffTimespecsToDouble(&diff, &ptr->tv, &now);
       if (new_min_delay > diff) {
         if (new_min_delay - diff < separation) {
           new_min_delay = diff + separation;
@@ -374,7 +541,7 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
   }
 
   for (ptr = timer_queue.next; ptr != &timer_queue; ptr = ptr->next) {
-    UTI_DiffTimevalsToDouble(&diff, &ptr->tv, &now);
+    UTI_DiffTimespecsToDouble(&diff, &ptr->tv, &now);
     if (diff > new_min_delay) {
       break;
     }
@@ -386,8 +553,10 @@ SCH_AddTimeoutInClass(double min_delay, double separation, double randomness,
   new_tqe->id = next_tqe_id++;
   new_tqe->handler = handler;
   new_tqe->arg = arg;
-  UTI_AddDoubleToTimeval(&now, new_min_delay, &new_tqe->tv);
+  UTI_AddDoubleToTimespec(&now, new_min_delay, &new_tqe->tv);
+  set_timer_slack(new_tqe, new_min_delay);
   new_tqe->class = class;
+  new_tqe->latency_index = get_latency_index(SCH_TimeoutLatency, handler);
 
   new_tqe->next = ptr;
   new_tqe->prev = ptr->prev;
@@ -434,17 +603,21 @@ SCH_RemoveTimeout(SCH_TimeoutID id)
    completed). */
 
 static void
-dispatch_timeouts(struct timeval *now) {
+dispatch_timeouts(struct timespec *now) {
   TimerQueueEntry *ptr;
   SCH_TimeoutHandler handler;
   SCH_ArbitraryArgument arg;
-  int n_done = 0, n_entries_on_start = n_timer_queue_entries;
+  int n_done = 0, n_entries_on_start = n_timer_queue_entries, latency_index = -1;
 
   while (1) {
     LCL_ReadRawTime(now);
 
+    /* Record the run time of the previous handler */
+    if (n_done > 0)
+      record_latency(latency_index, &handler_start_ts, now);
+
     if (!(n_timer_queue_entries > 0 &&
-          UTI_CompareTimevals(now, &(timer_queue.next->tv)) >= 0)) {
+          UTI_CompareTimespecs(now, &(timer_queue.next->tv)) >= 0)) {
       break;
     }
 
@@ -454,10 +627,15 @@ dispatch_timeouts(struct timeval *now) {
 
     handler = ptr->handler;
     arg = ptr->arg;
+    latency_index = ptr->latency_index;
 
     SCH_RemoveTimeout(ptr->id);
 
+    record_latency(DISPATCH_DELAY_INDEX, &last_select_ts_raw, now);
+    handler_start_ts = *now;
+
     /* Dispatch the handler */
+    CNT_INC(CNT_SchTimeouts);
     (handler)(arg);
 
     /* Increment count of timeouts handled */
@@ -482,14 +660,26 @@ dispatch_timeouts(struct timeval *now) {
 static void
 dispatch_filehandlers(int nfh, fd_set *fhs)
 {
-  int fh = 0;
+  struct timespec now;
+  int fh = 0, latency_index;
+
+  /* The first handler starts right after select() returned */
+  handler_start_ts = last_select_ts_raw;
   
   while (nfh > 0) {
     if (FD_ISSET(fh, fhs)) {
+      record_latency(DISPATCH_DELAY_INDEX, &last_select_ts_raw, &handler_start_ts);
+      latency_index = file_handlers[fh].latency_index;
 
       /* This descriptor can be read from, dispatch its handler */
+      CNT_INC(CNT_SchFileHandlers);
       (file_handlers[fh].handler)(file_handlers[fh].arg);
 
+      /* The next handler starts when this one finished */
+      LCL_ReadRawTime(&now);
+      record_latency(latency_index, &handler_start_ts, &now);
+      handler_start_ts = now;
+
       /* Decrement number of readable files still to find */
       --nfh;
     }
@@ -502,8 +692,8 @@ dispatch_filehandlers(int nfh, fd_set *fhs)
 /* ================================================== */
 
 static void
-handle_slew(struct timeval *raw,
-            struct timeval *cooked,
+handle_slew(struct timespec *raw,
+            struct timespec *cooked,
             double dfreq,
             double doffset,
             LCL_ChangeType change_type,
@@ -521,17 +711,93 @@ handle_slew(struct timeval *raw,
     /* If a step change occurs, just shift all raw time stamps by the offset */
     
     for (ptr = timer_queue.next; ptr != &timer_queue; ptr = ptr->next) {
-      UTI_AddDoubleToTimeval(&ptr->tv, -doffset, &ptr->tv);
+      UTI_AddDoubleToTimespec(&ptr->tv, -doffset, &ptr->tv);
+      UTI_AddDoubleToTimespec(&ptr->latest, -doffset, &ptr->latest);
     }
 
     for (i = 0; i < SCH_NumberOfClasses; i++) {
-      UTI_AddDoubleToTimeval(&last_class_dispatch[i], -doffset, &last_class_dispatch[i]);
+      UTI_AddDoubleToTimespec(&last_class_dispatch[i], -doffset, &last_class_dispatch[i]);
     }
 
-    UTI_AddDoubleToTimeval(&last_select_ts_raw, -doffset, &last_select_ts_raw);
+    UTI_AddDoubleToTimespec(&last_select_ts_raw, -doffset, &last_select_ts_raw);
+    UTI_AddDoubleToTimespec(&handler_start_ts, -doffset, &handler_start_ts);
+    UTI_AddDoubleToTimespec(&wakeups_start_ts, -doffset, &wakeups_start_ts);
   }
 
-  UTI_AdjustTimeval(&last_select_ts, cooked, &last_select_ts, &delta, dfreq, doffset);
+  UTI_AdjustTimespec(&last_select_ts, cooked, &last_select_ts, &delta, dfreq, doffset);
+}
+
+/* ================================================== */
+
+static void
+log_latency_stats(void)
+{
+  const char *types[] = {"Dispatch delay", "Timeout handler", "File handler"};
+  SCH_LatencyReport report;
+  char buf[SCH_LATENCY_BUCKETS * 24];
+  int i, j, len;
+
+  for (i = 0; SCH_GetLatencyStats(i, &report); i++) {
+    if (!report.count)
+      continue;
+
+    buf[0] = '\0';
+
+    for (j = len = 0; j < SCH_LATENCY_BUCKETS && len < sizeof (buf); j++) {
+      if (!report.buckets[j])
+        continue;
+      len += snprintf(buf + len, sizeof (buf) - len, " %s%luus:%lu",
+                      j < SCH_LATENCY_BUCKETS - 1 ? "<" : ">=",
+                      1UL << (j < SCH_LATENCY_BUCKETS - 1 ? j : j - 1), report.buckets[j]);
+    }
+
+    if (report.type == SCH_DispatchDelay)
+      LOG(LOGS_INFO, LOGF_Scheduler, "%s : count=%lu mean=%.1fus max=%.1fus%s",
+          types[report.type], report.count, report.mean * 1e6, report.max * 1e6, buf);
+    else
+      LOG(LOGS_INFO, LOGF_Scheduler, "%s 0x%lx : count=%lu mean=%.1fus max=%.1fus%s",
+          types[report.type], report.handler, report.count, report.mean * 1e6,
+          report.max * 1e6, buf);
+  }
+}
+
+/* ================================================== */
+
+static void
+log_wakeups(void)
+{
+  struct timespec now;
+  double elapsed;
+
+  LCL_ReadRawTime(&now);
+  UTI_DiffTimespecsToDouble(&elapsed, &now, &wakeups_start_ts);
+  if (elapsed < 1.0)
+    return;
+
+  LOG(LOGS_INFO, LOGF_Scheduler, "Wakeups : timeout=%lu file=%lu rate=%.1f/hour slack=%.3f",
+      timeout_wakeups, file_wakeups,
+      (timeout_wakeups + file_wakeups) / elapsed * 3600.0, max_timer_slack);
+}
+
+/* ================================================== */
+
+/* Get the time until which select() can wait.  The first timeout in the
+   queue has to be dispatched before its latest time, but other timeouts
+   may have their latest time earlier. */
+
+static void
+get_select_deadline(struct timespec *deadline)
+{
+  TimerQueueEntry *ptr;
+
+  *deadline = timer_queue.next->latest;
+
+  for (ptr = timer_queue.next->next; ptr != &timer_queue; ptr = ptr->next) {
+    if (UTI_CompareTimespecs(&ptr->tv, deadline) >= 0)
+      break;
+    if (UTI_CompareTimespecs(&ptr->latest, deadline) < 0)
+      *deadline = ptr->latest;
+  }
 }
 
 /* ================================================== */
@@ -539,31 +805,34 @@ handle_slew(struct timeval *raw,
 #define JUMP_DETECT_THRESHOLD 10
 
 static int
-check_current_time(struct timeval *prev_raw, struct timeval *raw, int timeout,
+check_current_time(struct timespec *prev_raw, struct timespec *raw, int timeout,
                    struct timeval *orig_select_tv,
                    struct timeval *rem_select_tv)
 {
-  struct timeval elapsed_min, elapsed_max;
+  struct timespec elapsed_min, elapsed_max, orig_select_ts, rem_select_ts;
   double step, elapsed;
 
   /* Get an estimate of the time spent waiting in the select() call. On some
      systems (e.g. Linux) the timeout timeval is modified to return the
      remaining time, use that information. */
+  UTI_TimevalToTimespec(orig_select_tv, &orig_select_ts);
+
   if (timeout) {
-    elapsed_max = elapsed_min = *orig_select_tv;
+    elapsed_max = elapsed_min = orig_select_ts;
   } else if (rem_select_tv && rem_select_tv->tv_sec >= 0 &&
              rem_select_tv->tv_sec <= orig_select_tv->tv_sec &&
              (rem_select_tv->tv_sec != orig_select_tv->tv_sec ||
               rem_select_tv->tv_usec != orig_select_tv->tv_usec)) {
-    UTI_DiffTimevals(&elapsed_min, orig_select_tv, rem_select_tv);
+    UTI_TimevalToTimespec(rem_select_tv, &rem_select_ts);
+    UTI_DiffTimespecs(&elapsed_min, &orig_select_ts, &rem_select_ts);
     elapsed_max = elapsed_min;
   } else {
     if (rem_select_tv)
-      elapsed_max = *orig_select_tv;
+      elapsed_max = orig_select_ts;
     else
-      UTI_DiffTimevals(&elapsed_max, raw, prev_raw);
+      UTI_DiffTimespecs(&elapsed_max, raw, prev_raw);
     elapsed_min.tv_sec = 0;
-    elapsed_min.tv_usec = 0;
+    elapsed_min.tv_nsec = 0;
   }
 
   if (last_select_ts_raw.tv_sec + elapsed_min.tv_sec >
@@ -576,8 +845,8 @@ check_current_time(struct timeval *prev_raw, struct timeval *raw, int timeout,
     return 1;
   }
 
-  UTI_DiffTimevalsToDouble(&step, &last_select_ts_raw, raw);
-  UTI_TimevalToDouble(&elapsed_min, &elapsed);
+  UTI_DiffTimespecsToDouble(&step, &last_select_ts_raw, raw);
+  UTI_TimespecToDouble(&elapsed_min, &elapsed);
   step += elapsed;
 
   /* Cooked time may no longer be valid after dispatching the handlers */
@@ -594,12 +863,14 @@ SCH_MainLoop(void)
   fd_set rd;
   int status, errsv;
   struct timeval tv, saved_tv, *ptv;
-  struct timeval now, saved_now, cooked;
+  struct timespec ts, deadline, now, saved_now, cooked;
   double err;
 
   assert(initialised);
 
   while (!need_to_exit) {
+    CNT_INC(CNT_SchIterations);
+
     /* Dispatch timeouts and fill now with current raw time */
     dispatch_timeouts(&now);
     saved_now = now;
@@ -611,9 +882,14 @@ SCH_MainLoop(void)
     /* Check whether there is a timeout and set it up */
     if (n_timer_queue_entries > 0) {
 
-      UTI_DiffTimevals(&tv, &(timer_queue.next->tv), &now);
+      get_select_deadline(&deadline);
+      UTI_DiffTimespecs(&ts, &deadline, &now);
+      assert(ts.tv_sec > 0 || ts.tv_nsec > 0);
+
+      /* Round the timeout up to microseconds for select() */
+      UTI_AddDoubleToTimespec(&ts, 0.999e-6, &ts);
+      UTI_TimespecToTimeval(&ts, &tv);
       ptv = &tv;
-      assert(tv.tv_sec > 0 || tv.tv_usec > 0);
       saved_tv = tv;
 
     } else {
@@ -647,6 +923,17 @@ SCH_MainLoop(void)
     last_select_ts = cooked;
     last_select_ts_err = err;
 
+    if (status > 0)
+      file_wakeups++;
+    else if (status == 0)
+      timeout_wakeups++;
+
+    if (dump_latency) {
+      dump_latency = 0;
+      log_latency_stats();
+      log_wakeups();
+    }
+
     if (status < 0) {
       if (!need_to_exit && errsv != EINTR) {
         LOG_FATAL(LOGF_Scheduler, "select() failed : %s", strerror(errsv));
@@ -667,6 +954,8 @@ SCH_MainLoop(void)
 
     }
   }         
+
+  log_wakeups();
 }
 
 /* ================================================== */
@@ -680,3 +969,50 @@ SCH_QuitProgram(void)
 
 /* ================================================== */
 
+int
+SCH_GetNumberOfLatencyStats(void)
+{
+  return n_latency_stats;
+}
+
+/* ================================================== */
+
+int
+SCH_GetLatencyStats(int index, SCH_LatencyReport *report)
+{
+  LatencyStats *stats;
+#ifdef HAVE_DLADDR
+  Dl_info info;
+#endif
+
+  if (index < 0 || index >= n_latency_stats)
+    return 0;
+
+  stats = &latency_stats[index];
+
+  report->type = stats->type;
+  report->handler = (unsigned long)stats->handler;
+#ifdef HAVE_DLADDR
+  /* Executables are usually position-independent, the offset can be
+     translated to the function name without knowing the load address */
+  if (stats->handler && dladdr((void *)stats->handler, &info) && info.dli_fbase)
+    report->handler -= (unsigned long)info.dli_fbase;
+#endif
+  report->count = stats->count;
+  report->mean = stats->count ? stats->total / stats->count : 0.0;
+  report->max = stats->max;
+  memcpy(report->buckets, stats->buckets, sizeof (report->buckets));
+
+  return 1;
+}
+
+/* ================================================== */
+
+void
+SCH_RequestLatencyDump(void)
+{
+  dump_latency = 1;
+}
+
+/* ================================================== */
+
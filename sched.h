@@ -42,6 +42,29 @@ typedef void* SCH_ArbitraryArgument;
 typedef void (*SCH_FileHandler)(SCH_ArbitraryArgument);
 typedef void (*SCH_TimeoutHandler)(SCH_ArbitraryArgument);
 
+/* Number of buckets in latency histograms.  The first bucket counts
+   latencies shorter than 1 microsecond, bucket i latencies in the
+   interval [2^(i-1), 2^i) microseconds and the last bucket includes
+   all longer latencies. */
+#define SCH_LATENCY_BUCKETS 24
+
+typedef enum {
+  SCH_DispatchDelay,            /* From select() return to handler start */
+  SCH_TimeoutLatency,           /* Run time of a timeout handler */
+  SCH_FileLatency               /* Run time of a file handler */
+} SCH_LatencyType;
+
+typedef struct {
+  SCH_LatencyType type;
+  /* Offset of the handler in the executable (for addr2line), or its
+     address if the offset is not known */
+  unsigned long handler;
+  unsigned long count;
+  double mean;
+  double max;
+  unsigned long buckets[SCH_LATENCY_BUCKETS];
+} SCH_LatencyReport;
+
 /* Exported functions */
 
 /* Initialisation function for the module */
@@ -59,14 +82,18 @@ extern void SCH_AddInputFileHandler
 extern void SCH_RemoveInputFileHandler(int fd);
 
 /* Get the time stamp taken after a file descriptor became ready or a timeout expired */
-extern void SCH_GetLastEventTime(struct timeval *cooked, double *err, struct timeval *raw);
+extern void SCH_GetLastEventTime(struct timespec *cooked, double *err, struct timespec *raw);
 
 /* This queues a timeout to elapse at a given (raw) local time */
-extern SCH_TimeoutID SCH_AddTimeout(struct timeval *tv, SCH_TimeoutHandler, SCH_ArbitraryArgument);
+extern SCH_TimeoutID SCH_AddTimeout(struct timespec *tv, SCH_TimeoutHandler, SCH_ArbitraryArgument);
 
 /* This queues a timeout to elapse at a given delta time relative to the current (raw) time */
 extern SCH_TimeoutID SCH_AddTimeoutByDelay(double delay, SCH_TimeoutHandler, SCH_ArbitraryArgument);
 
+/* Same as above, but the timeout is not delayed by the timer slack */
+extern SCH_TimeoutID SCH_AddPreciseTimeoutByDelay(double delay, SCH_TimeoutHandler,
+                                                  SCH_ArbitraryArgument);
+
 /* This queues a timeout in a particular class, ensuring that the
    expiry time is at least a given separation away from any other
    timeout in the same class, given randomness is added to the delay
@@ -82,4 +109,15 @@ extern void SCH_MainLoop(void);
 
 extern void SCH_QuitProgram(void);
 
+/* Return the number of latency histograms (the first one is the
+   dispatch delay, the others are per handler) */
+extern int SCH_GetNumberOfLatencyStats(void);
+
+/* Get a latency histogram, return 0 if the index is not valid */
+extern int SCH_GetLatencyStats(int index, SCH_LatencyReport *report);
+
+/* Log all latency histograms from the main loop (safe to call from a
+   signal handler) */
+extern void SCH_RequestLatencyDump(void);
+
 #endif /* GOT_SCHED_H */
@@ -33,6 +33,7 @@
 #include "sysincl.h"
 
 #include "sources.h"
+#include "counters.h"
 #include "sourcestats.h"
 #include "memory.h"
 #include "ntp.h" /* For NTP_Leap */
@@ -46,6 +47,7 @@
 #include "mkdirpp.h"
 #include "sched.h"
 #include "regress.h"
+#include "cmdmon.h"
 
 /* ================================================== */
 /* Flag indicating that we are initialised */
@@ -149,14 +151,19 @@ static double reselect_distance;
 static double stratum_weight;
 static double combine_limit;
 
+/* Flag indicating that new sources should be loaded from dump files */
+static int reload_new_sources = 0;
+
 /* ================================================== */
 /* Forward prototype */
 
 static void
-slew_sources(struct timeval *raw, struct timeval *cooked, double dfreq,
+slew_sources(struct timespec *raw, struct timespec *cooked, double dfreq,
              double doffset, LCL_ChangeType change_type, void *anything);
 static void
 add_dispersion(double dispersion, void *anything);
+static void
+load_source(SRC_Instance inst);
 static char *
 source_to_string(SRC_Instance inst);
 
@@ -230,6 +237,9 @@ SRC_Instance SRC_CreateNewInstance(uint32_t ref_id, SRC_Type type, SRC_SelectOpt
 
   n_sources++;
 
+  if (reload_new_sources)
+    load_source(result);
+
   return result;
 }
 
@@ -295,7 +305,7 @@ void SRC_GetFrequencyRange(SRC_Instance instance, double *lo, double *hi)
 
 void SRC_AccumulateSample
 (SRC_Instance inst, 
- struct timeval *sample_time, 
+ struct timespec *sample_time, 
  double offset, 
  double peer_delay,
  double peer_dispersion,
@@ -310,7 +320,7 @@ void SRC_AccumulateSample
   inst->leap_status = leap_status;
 
   DEBUG_LOG(LOGF_Sources, "ip=[%s] t=%s ofs=%f del=%f disp=%f str=%d",
-      source_to_string(inst), UTI_TimevalToString(sample_time), -offset, root_delay, root_dispersion, stratum);
+      source_to_string(inst), UTI_TimespecToString(sample_time), -offset, root_delay, root_dispersion, stratum);
 
   if (REF_IsLeapSecondClose()) {
     LOG(LOGS_INFO, LOGF_Sources, "Dropping sample around leap second");
@@ -480,10 +490,10 @@ source_to_string(SRC_Instance inst)
 /* ================================================== */
 
 static int
-combine_sources(int n_sel_sources, struct timeval *ref_time, double *offset,
+combine_sources(int n_sel_sources, struct timespec *ref_time, double *offset,
                 double *offset_sd, double *frequency, double *skew)
 {
-  struct timeval src_ref_time;
+  struct timespec src_ref_time;
   double src_offset, src_offset_sd, src_frequency, src_skew;
   double src_root_delay, src_root_dispersion, elapsed;
   double offset_weight, sum_offset_weight, sum_offset, sum2_offset_sd;
@@ -522,7 +532,7 @@ combine_sources(int n_sel_sources, struct timeval *ref_time, double *offset,
     if (sources[index]->outlier)
       continue;
 
-    UTI_DiffTimevalsToDouble(&elapsed, ref_time, &src_ref_time);
+    UTI_DiffTimespecsToDouble(&elapsed, ref_time, &src_ref_time);
     src_offset += elapsed * src_frequency;
     offset_weight = 1.0 / sources[index]->sel_info.root_distance;
     frequency_weight = 1.0 / src_skew;
@@ -565,7 +575,7 @@ void
 SRC_SelectSource(SRC_Instance updated_inst)
 {
   int i, j, index, old_selected_index, sel_prefer;
-  struct timeval now, ref_time;
+  struct timespec now, ref_time;
   double src_offset, src_offset_sd, src_frequency, src_skew;
   double src_root_delay, src_root_dispersion;
   int n_endpoints, j1, j2;
@@ -583,11 +593,14 @@ SRC_SelectSource(SRC_Instance updated_inst)
   NTP_Leap leap_status = LEAP_Normal;
   old_selected_index = selected_source_index;
 
+  CNT_INC(CNT_Selections);
+
   if (n_sources == 0) {
     /* In this case, we clearly cannot synchronise to anything */
     if (selected_source_index != INVALID_SOURCE) {
       log_selection_message("Can't synchronise: no sources", NULL);
       selected_source_index = INVALID_SOURCE;
+      CAM_NotifyEvent(CAM_EVENT_SELECTION);
       REF_SetUnsynchronised();
     }
     return;
@@ -926,6 +939,7 @@ SRC_SelectSource(SRC_Instance updated_inst)
           selected_source_index = max_score_index;
           log_selection_message("Selected source %s",
                 source_to_string(sources[selected_source_index]));
+          CAM_NotifyEvent(CAM_EVENT_SELECTION);
                                  
           /* New source has been selected, reset all scores */
           for (i=0; i < n_sources; i++) {
@@ -984,6 +998,7 @@ SRC_SelectSource(SRC_Instance updated_inst)
 
   if (selected_source_index == INVALID_SOURCE &&
       selected_source_index != old_selected_index) {
+    CAM_NotifyEvent(CAM_EVENT_SELECTION);
     REF_SetUnsynchronised();
   }
 }
@@ -1012,7 +1027,7 @@ SRC_SetReselectDistance(double distance)
 /* ================================================== */
 
 double
-SRC_PredictOffset(SRC_Instance inst, struct timeval *when)
+SRC_PredictOffset(SRC_Instance inst, struct timespec *when)
 {
   return SST_PredictOffset(inst->stats, when);
 }
@@ -1029,7 +1044,7 @@ SRC_MinRoundTripDelay(SRC_Instance inst)
 
 int
 SRC_IsGoodSample(SRC_Instance inst, double offset, double delay,
-   double max_delay_dev_ratio, double clock_error, struct timeval *when)
+   double max_delay_dev_ratio, double clock_error, struct timespec *when)
 {
   return SST_IsGoodSample(inst->stats, offset, delay, max_delay_dev_ratio,
       clock_error, when);
@@ -1043,8 +1058,8 @@ SRC_IsGoodSample(SRC_Instance inst, double offset, double delay,
    the new regime. */
 
 static void
-slew_sources(struct timeval *raw,
-             struct timeval *cooked,
+slew_sources(struct timespec *raw,
+             struct timespec *cooked,
              double dfreq,
              double doffset,
              LCL_ChangeType change_type,
@@ -1121,40 +1136,57 @@ SRC_DumpSources(void)
 
 /* ================================================== */
 
-void
-SRC_ReloadSources(void)
+static void
+load_source(SRC_Instance inst)
 {
   FILE *in;
   char *filename;
   unsigned int a, b, c, d;
-  int i;
   char *dumpdir;
   int dumpdirlen, filelen;
 
-  for (i=0; i<n_sources; i++) {
-    a = (sources[i]->ref_id) >> 24;
-    b = ((sources[i]->ref_id) >> 16) & 0xff;
-    c = ((sources[i]->ref_id) >> 8) & 0xff;
-    d = ((sources[i]->ref_id)) & 0xff;
-
-    dumpdir = CNF_GetDumpDir();
-    dumpdirlen = strlen(dumpdir);
-    filelen = dumpdirlen + 24;
-    filename = MallocArray(char, filelen);
-    snprintf(filename, filelen-1, "%s/%d.%d.%d.%d.dat", dumpdir, a, b, c, d);
-    in = fopen(filename, "r");
-    if (!in) {
-      LOG(LOGS_WARN, LOGF_Sources, "Could not open dump file %s", filename);
+  a = (inst->ref_id) >> 24;
+  b = ((inst->ref_id) >> 16) & 0xff;
+  c = ((inst->ref_id) >> 8) & 0xff;
+  d = ((inst->ref_id)) & 0xff;
+
+  dumpdir = CNF_GetDumpDir();
+  dumpdirlen = strlen(dumpdir);
+  filelen = dumpdirlen + 24;
+  filename = MallocArray(char, filelen);
+  snprintf(filename, filelen-1, "%s/%d.%d.%d.%d.dat", dumpdir, a, b, c, d);
+  in = fopen(filename, "r");
+  if (!in) {
+    LOG(LOGS_WARN, LOGF_Sources, "Could not open dump file %s", filename);
+  } else {
+    if (SST_LoadFromFile(inst->stats, in)) {
+      SST_DoNewRegression(inst->stats);
     } else {
-      if (SST_LoadFromFile(sources[i]->stats, in)) {
-        SST_DoNewRegression(sources[i]->stats);
-      } else {
-        LOG(LOGS_WARN, LOGF_Sources, "Problem loading from file %s", filename);
-      }
-      fclose(in);
+      LOG(LOGS_WARN, LOGF_Sources, "Problem loading from file %s", filename);
     }
-    Free(filename);
+    fclose(in);
   }
+  Free(filename);
+}
+
+/* ================================================== */
+
+void
+SRC_ReloadSources(void)
+{
+  int i;
+
+  for (i=0; i<n_sources; i++) {
+    load_source(sources[i]);
+  }
+}
+
+/* ================================================== */
+
+void
+SRC_SetReloadNewSources(int reload)
+{
+  reload_new_sources = reload;
 }
 
 /* ================================================== */
@@ -1203,7 +1235,7 @@ SRC_ActiveSources(void)
 /* ================================================== */
 
 int
-SRC_ReportSource(int index, RPT_SourceReport *report, struct timeval *now)
+SRC_ReportSource(int index, RPT_SourceReport *report, struct timespec *now)
 {
   SRC_Instance src;
   if ((index >= n_sources) || (index < 0)) {
@@ -1245,7 +1277,7 @@ SRC_ReportSource(int index, RPT_SourceReport *report, struct timeval *now)
 
     switch (src->sel_option) {
       case SRC_SelectNormal:
-        report->sel_option = RPT_NOSELECT;
+        report->sel_option = RPT_NORMAL;
         break;
       case SRC_SelectPrefer:
         report->sel_option = RPT_PREFER;
@@ -1270,7 +1302,7 @@ SRC_ReportSource(int index, RPT_SourceReport *report, struct timeval *now)
 /* ================================================== */
 
 int
-SRC_ReportSourcestats(int index, RPT_SourcestatsReport *report, struct timeval *now)
+SRC_ReportSourcestats(int index, RPT_SourcestatsReport *report, struct timespec *now)
 { 
   SRC_Instance src;
 
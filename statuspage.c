@@ -0,0 +1,195 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ * 
+ **********************************************************************
+
+  =======================================================================
+
+  Time status page.  The tracking parameters are copied to a read-only
+  shared memory segment whenever the reference or the local clock is
+  updated, so local programs can get them without sending a request
+  to the command socket.  The layout is defined in chrony_statuspage.h.
+
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "chrony_statuspage.h"
+#include "conf.h"
+#include "local.h"
+#include "logging.h"
+#include "reference.h"
+#include "reports.h"
+#include "statuspage.h"
+#include "util.h"
+
+/* ================================================== */
+
+static int shm_id = -1;
+static struct chrony_status_page *page = NULL;
+
+/* ================================================== */
+
+static void
+handle_slew(struct timespec *raw, struct timespec *cooked, double dfreq,
+            double doffset, LCL_ChangeType change_type, void *anything)
+{
+  STP_Update();
+}
+
+/* ================================================== */
+
+void
+STP_Initialise(void)
+{
+  long key;
+
+  if (!CNF_GetStatusPage(&key))
+    return;
+
+  /* Create a new segment, never attach to an existing one which might have
+     been created by another user with a writable mode to forge the status.
+     A segment left by previous instance is removed if possible (only its
+     owner or root can do that). */
+  shm_id = shmget(key, sizeof (struct chrony_status_page), IPC_CREAT | IPC_EXCL | 0644);
+  if (shm_id < 0 && errno == EEXIST) {
+    shm_id = shmget(key, 0, 0);
+    if (shm_id >= 0 && shmctl(shm_id, IPC_RMID, NULL) < 0) {
+      LOG(LOGS_ERR, LOGF_StatusPage, "Could not remove existing shared memory segment %#lx : %s",
+          key, strerror(errno));
+      shm_id = -1;
+      return;
+    }
+    shm_id = shmget(key, sizeof (struct chrony_status_page), IPC_CREAT | IPC_EXCL | 0644);
+  }
+
+  if (shm_id < 0) {
+    LOG(LOGS_ERR, LOGF_StatusPage, "Could not get shared memory segment %#lx : %s",
+        key, strerror(errno));
+    return;
+  }
+
+  page = (struct chrony_status_page *)shmat(shm_id, 0, 0);
+  if ((long)page == -1) {
+    LOG(LOGS_ERR, LOGF_StatusPage, "Could not attach shared memory segment %#lx : %s",
+        key, strerror(errno));
+    page = NULL;
+    return;
+  }
+
+  /* Invalidate the page while it's being initialised */
+  page->magic = 0;
+  __sync_synchronize();
+
+  page->seq = 0;
+  page->version = CHRONY_STATUS_VERSION;
+  page->size = sizeof (struct chrony_status);
+  memset(&page->status, 0, sizeof (page->status));
+
+  __sync_synchronize();
+  page->magic = CHRONY_STATUS_MAGIC;
+
+  LCL_AddParameterChangeHandler(handle_slew, NULL);
+
+  STP_Update();
+}
+
+/* ================================================== */
+
+void
+STP_Finalise(void)
+{
+  if (!page)
+    return;
+
+  LCL_RemoveParameterChangeHandler(handle_slew, NULL);
+
+  page->magic = 0;
+  shmdt(page);
+  shmctl(shm_id, IPC_RMID, NULL);
+  page = NULL;
+}
+
+/* ================================================== */
+
+void
+STP_Update(void)
+{
+  struct chrony_status status;
+  volatile uint32_t *seq;
+  RPT_TrackingReport rep;
+  struct timespec now;
+
+  if (!page)
+    return;
+
+  REF_GetTrackingReport(&rep);
+  LCL_ReadCookedTime(&now, NULL);
+
+  memset(&status, 0, sizeof (status));
+
+  status.ref_id = rep.ref_id;
+  switch (rep.ip_addr.family) {
+    case IPADDR_INET4:
+      status.ip_family = CHRONY_STATUS_IP_INET4;
+      status.ip_addr[0] = rep.ip_addr.addr.in4 >> 24;
+      status.ip_addr[1] = rep.ip_addr.addr.in4 >> 16;
+      status.ip_addr[2] = rep.ip_addr.addr.in4 >> 8;
+      status.ip_addr[3] = rep.ip_addr.addr.in4;
+      break;
+    case IPADDR_INET6:
+      status.ip_family = CHRONY_STATUS_IP_INET6;
+      memcpy(status.ip_addr, rep.ip_addr.addr.in6, sizeof (status.ip_addr));
+      break;
+    default:
+      status.ip_family = CHRONY_STATUS_IP_UNSPEC;
+  }
+  status.stratum = rep.stratum;
+  status.leap_status = rep.leap_status;
+  status.synchronised = rep.leap_status != LEAP_Unsynchronised;
+  status.ref_time_sec = rep.ref_time.tv_sec;
+  status.ref_time_nsec = rep.ref_time.tv_nsec;
+  status.update_time_sec = now.tv_sec;
+  status.update_time_nsec = now.tv_nsec;
+  status.offset = rep.current_correction;
+  status.freq_ppm = rep.freq_ppm;
+  status.resid_freq_ppm = rep.resid_freq_ppm;
+  status.skew_ppm = rep.skew_ppm;
+  status.root_delay = rep.root_delay;
+  status.root_dispersion = rep.root_dispersion;
+  status.last_offset = rep.last_offset;
+  status.rms_offset = rep.rms_offset;
+  status.last_update_interval = rep.last_update_interval;
+  status.max_clock_error_ppm = LCL_GetMaxClockError() * 1e6;
+  status.precision = LCL_GetSysPrecisionAsQuantum();
+
+  /* Sequence lock, readers retry while the number is odd or changed */
+  seq = &page->seq;
+  *seq = *seq + 1;
+  __sync_synchronize();
+
+  memcpy(&page->status, &status, sizeof (status));
+
+  __sync_synchronize();
+  *seq = *seq + 1;
+}
+
+/* ================================================== */
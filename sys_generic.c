@@ -67,7 +67,7 @@ static double offset_register;
 static double slew_freq;
 
 /* Time (raw) of last update of slewing frequency and offset */
-static struct timeval slew_start;
+static struct timespec slew_start;
 
 /* Limits for the slew timeout */
 #define MIN_SLEW_TIMEOUT 1.0
@@ -84,25 +84,111 @@ static double correction_rate;
    real frequency of the clock */
 static double slew_error;
 
+/* Driver correcting small offsets by the kernel PLL and the maximum offset
+   which is passed to it, larger offsets are slewed here */
+static SYS_Generic_PllOffsetDriver drv_set_pll_offset;
+static double max_pll_offset;
+
+/* Offset passed to the kernel PLL, time (raw) when it was passed and the
+   shift of the PLL (each second 1/2^shift of the remaining offset is
+   corrected) */
+static double pll_offset;
+static struct timespec pll_offset_start;
+static int pll_shift;
+
+/* Limits for the shift of the kernel PLL */
+#define MIN_PLL_SHIFT 0
+#define MAX_PLL_SHIFT 30
+
 /* ================================================== */
 
 static void handle_end_of_slew(void *anything);
 static void update_slew(void);
 
+/* ================================================== */
+/* Get the part of the offset passed to the kernel PLL which was not
+   corrected yet.  The kernel corrects 1/2^shift of the remaining offset
+   in each second, starting with the first second boundary after the offset
+   was set, spreading the correction evenly over the second. */
+
+static double
+get_pll_offset(struct timespec *raw)
+{
+  double chunk;
+  long seconds;
+
+  if (pll_offset == 0.0)
+    return 0.0;
+
+  seconds = raw->tv_sec - pll_offset_start.tv_sec;
+  if (seconds <= 0)
+    return pll_offset;
+
+  chunk = ldexp(1.0, -pll_shift);
+
+  return pll_offset * pow(1.0 - chunk, seconds - 1) *
+         (1.0 - chunk * raw->tv_nsec * 1.0e-9);
+}
+
+/* ================================================== */
+/* Pass the offset register to the kernel PLL if it's small enough, or
+   take the remaining offset back from the PLL if it's too large */
+
+static void
+update_pll_offset(struct timespec *now)
+{
+  double duration;
+
+  offset_register += get_pll_offset(now);
+
+  if (fabs(offset_register) > max_pll_offset) {
+    if (pll_offset != 0.0) {
+      (*drv_set_pll_offset)(0.0, &pll_shift);
+      pll_offset = 0.0;
+    }
+    return;
+  }
+
+  /* Correct the offset in about the same time as it would be slewed */
+  if (fabs(offset_register) < MIN_OFFSET_CORRECTION)
+    duration = MAX_SLEW_TIMEOUT;
+  else
+    duration = correction_rate / fabs(offset_register);
+
+  pll_shift = duration > 1.0 ? (int)(log(duration) / log(2.0) + 0.5) : 0;
+  if (pll_shift < MIN_PLL_SHIFT)
+    pll_shift = MIN_PLL_SHIFT;
+  else if (pll_shift > MAX_PLL_SHIFT)
+    pll_shift = MAX_PLL_SHIFT;
+
+  (*drv_set_pll_offset)(offset_register, &pll_shift);
+
+  pll_offset = offset_register;
+  pll_offset_start = *now;
+  offset_register = 0.0;
+
+  DEBUG_LOG(LOGF_SysGeneric, "PLL offset=%e shift=%d", pll_offset, pll_shift);
+}
+
 /* ================================================== */
 /* Adjust slew_start on clock step */
 
 static void
-handle_step(struct timeval *raw, struct timeval *cooked, double dfreq,
+handle_step(struct timespec *raw, struct timespec *cooked, double dfreq,
             double doffset, LCL_ChangeType change_type, void *anything)
 {
   if (change_type == LCL_ChangeUnknownStep) {
     /* Reset offset and slewing */
     slew_start = *raw;
     offset_register = 0.0;
+    if (pll_offset != 0.0) {
+      (*drv_set_pll_offset)(0.0, &pll_shift);
+      pll_offset = 0.0;
+    }
     update_slew();
   } else if (change_type == LCL_ChangeStep) {
-    UTI_AddDoubleToTimeval(&slew_start, -doffset, &slew_start);
+    UTI_AddDoubleToTimespec(&slew_start, -doffset, &slew_start);
+    UTI_AddDoubleToTimespec(&pll_offset_start, -doffset, &pll_offset_start);
   }
 }
 
@@ -112,7 +198,7 @@ handle_step(struct timeval *raw, struct timeval *cooked, double dfreq,
 static void
 update_slew(void)
 {
-  struct timeval now, end_of_slew;
+  struct timespec now, end_of_slew;
   double old_slew_freq, total_freq, corr_freq, duration;
 
   /* Remove currently running timeout */
@@ -122,9 +208,12 @@ update_slew(void)
   LCL_ReadRawTime(&now);
 
   /* Adjust the offset register by achieved slew */
-  UTI_DiffTimevalsToDouble(&duration, &now, &slew_start);
+  UTI_DiffTimespecsToDouble(&duration, &now, &slew_start);
   offset_register -= slew_freq * duration;
 
+  if (drv_set_pll_offset)
+    update_pll_offset(&now);
+
   /* Estimate how long should the next slew take */
   if (fabs(offset_register) < MIN_OFFSET_CORRECTION) {
     duration = MAX_SLEW_TIMEOUT;
@@ -180,7 +269,7 @@ update_slew(void)
   }
 
   /* Restart timer for the next update */
-  UTI_AddDoubleToTimeval(&now, duration, &end_of_slew);
+  UTI_AddDoubleToTimespec(&now, duration, &end_of_slew);
   slew_timeout_id = SCH_AddTimeout(&end_of_slew, handle_end_of_slew, NULL);
 
   slew_start = now;
@@ -234,14 +323,14 @@ accrue_offset(double offset, double corr_rate)
 /* Determine the correction to generate the cooked time for given raw time */
 
 static void
-offset_convert(struct timeval *raw,
+offset_convert(struct timespec *raw,
                double *corr, double *err)
 {
   double duration;
 
-  UTI_DiffTimevalsToDouble(&duration, raw, &slew_start);
+  UTI_DiffTimespecsToDouble(&duration, raw, &slew_start);
 
-  *corr = slew_freq * duration - offset_register;
+  *corr = slew_freq * duration - offset_register - get_pll_offset(raw);
   if (err)
     *err = fabs(duration) <= max_freq_change_delay ? slew_error : 0.0;
 }
@@ -252,18 +341,18 @@ offset_convert(struct timeval *raw,
 static void
 apply_step_offset(double offset)
 {
-  struct timeval old_time, new_time;
+  struct timespec old_time, new_time;
   double err;
 
   LCL_ReadRawTime(&old_time);
-  UTI_AddDoubleToTimeval(&old_time, -offset, &new_time);
+  UTI_AddDoubleToTimespec(&old_time, -offset, &new_time);
 
-  if (settimeofday(&new_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysGeneric, "settimeofday() failed");
+  if (clock_settime(CLOCK_REALTIME, &new_time) < 0) {
+    LOG_FATAL(LOGF_SysGeneric, "clock_settime() failed");
   }
 
   LCL_ReadRawTime(&old_time);
-  UTI_DiffTimevalsToDouble(&err, &old_time, &new_time);
+  UTI_DiffTimespecsToDouble(&err, &old_time, &new_time);
 
   lcl_InvokeDispersionNotifyHandlers(fabs(err));
 }
@@ -288,6 +377,9 @@ SYS_Generic_CompleteFreqDriver(double max_set_freq_ppm, double max_set_freq_dela
 
   max_corr_freq = CNF_GetMaxSlewRate() / 1.0e6;
 
+  drv_set_pll_offset = NULL;
+  pll_offset = 0.0;
+
   lcl_RegisterSystemDrivers(read_frequency, set_frequency,
                             accrue_offset, sys_apply_step_offset ?
                               sys_apply_step_offset : apply_step_offset,
@@ -298,6 +390,18 @@ SYS_Generic_CompleteFreqDriver(double max_set_freq_ppm, double max_set_freq_dela
 
 /* ================================================== */
 
+void
+SYS_Generic_EnablePllOffset(double max_offset, SYS_Generic_PllOffsetDriver sys_set_pll_offset)
+{
+  max_pll_offset = max_offset;
+  drv_set_pll_offset = sys_set_pll_offset;
+
+  LOG(LOGS_INFO, LOGF_SysGeneric, "Offsets up to %.9f seconds will be corrected by kernel PLL",
+      max_pll_offset);
+}
+
+/* ================================================== */
+
 void
 SYS_Generic_Finalise(void)
 {
@@ -308,6 +412,11 @@ SYS_Generic_Finalise(void)
     slew_timer_running = 0;
   }
 
+  if (pll_offset != 0.0) {
+    (*drv_set_pll_offset)(0.0, &pll_shift);
+    pll_offset = 0.0;
+  }
+
   (*drv_set_freq)(base_freq);
 }
 
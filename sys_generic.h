@@ -37,6 +37,17 @@ extern void SYS_Generic_CompleteFreqDriver(double max_set_freq_ppm, double max_s
                                            lcl_ApplyStepOffsetDriver sys_apply_step_offset,
                                            lcl_SetLeapDriver sys_set_leap);
 
+/* System driver to pass an offset to the kernel PLL (positive means the
+   clock is fast).  In each second 1/2^shift of the remaining offset is
+   corrected, the driver should update the shift to the closest value it
+   supports.  The previous offset is replaced. */
+typedef void (*SYS_Generic_PllOffsetDriver)(double offset, int *shift);
+
+/* Enable correction of offsets up to max_offset by the kernel PLL, larger
+   offsets are slewed by changing the frequency of the clock */
+extern void SYS_Generic_EnablePllOffset(double max_offset,
+                                        SYS_Generic_PllOffsetDriver sys_set_pll_offset);
+
 extern void SYS_Generic_Finalise(void);
 
 #endif  /* GOT_SYS_GENERIC_H */
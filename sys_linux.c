@@ -58,6 +58,15 @@ int LockAll = 0;
 #include "logging.h"
 #include "wrap_adjtimex.h"
 
+/* Maximum frequency offset accepted by the kernel in ppm */
+#define MAX_KERNEL_FREQ 500.0
+
+/* Shift of the kernel PLL with zero time constant (SHIFT_PLL), maximum
+   time constant and maximum offset accepted by ADJ_OFFSET */
+#define KERNEL_PLL_SHIFT 2
+#define MAX_KERNEL_PLL_CONSTANT 10
+#define MAX_KERNEL_PLL_OFFSET 0.5
+
 /* This is the uncompensated system tick value */
 static int nominal_tick;
 
@@ -117,20 +126,24 @@ set_frequency(double freq_ppm)
   double required_freq;
   int required_delta_tick;
 
-  required_delta_tick = our_round(freq_ppm / dhz);
+  /* The frequency is set with ADJ_FREQUENCY, which has a resolution of
+     2^-16 ppm.  The tick is changed only when the required frequency is
+     out of the +/- 500 ppm range of the frequency offset.
 
-  /* Older kernels (pre-2.6.18) don't apply the frequency offset exactly as
+     Older kernels (pre-2.6.18) don't apply the frequency offset exactly as
      set by adjtimex() and a scaling constant (that depends on the internal
      kernel HZ constant) would be needed to compensate for the error. Because
      chronyd is closed loop it doesn't matter much if we don't scale the
      required frequency, but we want to prevent thrashing between two states
-     when the system's frequency error is close to a multiple of USER_HZ.  With
-     USER_HZ <= 250, the maximum frequency adjustment of 500 ppm overlaps at
-     least two ticks and we can stick to the current tick if it's next to the
-     required tick. */
-  if (hz <= 250 && (required_delta_tick + 1 == current_delta_tick ||
-                    required_delta_tick - 1 == current_delta_tick)) {
+     when the system's frequency error is close to a multiple of USER_HZ.
+     Keep the current tick as long as the frequency offset can cover the
+     rest. */
+  if (fabs(freq_ppm - dhz * current_delta_tick) <= MAX_KERNEL_FREQ) {
     required_delta_tick = current_delta_tick;
+  } else if (fabs(freq_ppm) <= MAX_KERNEL_FREQ) {
+    required_delta_tick = 0;
+  } else {
+    required_delta_tick = our_round(freq_ppm / dhz);
   }
 
   required_freq = -(freq_ppm - dhz * required_delta_tick);
@@ -315,12 +328,34 @@ get_version_specific_details(void)
       hz, nominal_tick, max_tick_bias);
 }
 
+/* ================================================== */
+
+static void
+set_pll_offset(double offset, int *shift)
+{
+  int constant;
+
+  constant = *shift - KERNEL_PLL_SHIFT;
+  if (constant < 0)
+    constant = 0;
+  else if (constant > MAX_KERNEL_PLL_CONSTANT)
+    constant = MAX_KERNEL_PLL_CONSTANT;
+
+  if (TMX_SetPllOffset(-offset, constant) < 0) {
+    LOG_FATAL(LOGF_SysLinux, "adjtimex() failed in set_pll_offset");
+  }
+
+  *shift = constant + KERNEL_PLL_SHIFT;
+}
+
 /* ================================================== */
 /* Initialisation code for this module */
 
 void
 SYS_Linux_Initialise(void)
 {
+  double max_pll_offset;
+
   get_version_specific_details();
 
   if (TMX_ResetOffset() < 0) {
@@ -339,6 +374,16 @@ SYS_Linux_Initialise(void)
                                  read_frequency, set_frequency,
                                  have_setoffset ? apply_step_offset : NULL,
                                  set_leap);
+
+  max_pll_offset = CNF_GetKernelPllMaxOffset();
+  if (max_pll_offset > 0.0) {
+    if (max_pll_offset > MAX_KERNEL_PLL_OFFSET)
+      max_pll_offset = MAX_KERNEL_PLL_OFFSET;
+    if (TMX_EnablePll(1) < 0) {
+      LOG_FATAL(LOGF_SysLinux, "adjtimex() failed");
+    }
+    SYS_Generic_EnablePllOffset(max_pll_offset, set_pll_offset);
+  }
 }
 
 /* ================================================== */
@@ -348,6 +393,9 @@ void
 SYS_Linux_Finalise(void)
 {
   SYS_Generic_Finalise();
+
+  if (CNF_GetKernelPllMaxOffset() > 0.0)
+    TMX_EnablePll(0);
 }
 
 /* ================================================== */
@@ -39,6 +39,7 @@
 #include <signal.h>
 
 #include "sys_netbsd.h"
+#include "local.h"
 #include "localp.h"
 #include "logging.h"
 #include "util.h"
@@ -47,13 +48,13 @@
 
 /* This register contains the number of seconds by which the local
    clock was estimated to be fast of reference time at the epoch when
-   gettimeofday() returned T0 */
+   LCL_ReadRawTime() returned T0 */
 
 static double offset_register;
 
 /* This register contains the epoch to which the offset is referenced */
 
-static struct timeval T0;
+static struct timespec T0;
 
 /* This register contains the current estimate of the system
    frequency, in absolute (NOT ppm) */
@@ -81,9 +82,7 @@ clock_initialise(void)
   adjustment_requested = 0.0;
   current_freq = 0.0;
 
-  if (gettimeofday(&T0, NULL) < 0) {
-    LOG_FATAL(LOGF_SysNetBSD, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T0);
 
   newadj.tv_sec = 0;
   newadj.tv_usec = 0;
@@ -109,53 +108,52 @@ static void
 start_adjust(void)
 {
   struct timeval newadj, oldadj;
-  struct timeval T1;
+  struct timespec T1;
   double elapsed, accrued_error;
   double adjust_required;
-  struct timeval exact_newadj;
+  struct timespec exact_newadj, ts;
   long delta, tickdelta;
   double rounding_error;
   double old_adjust_remaining;
 
   /* Determine the amount of error built up since the last adjustment */
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysNetBSD, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
 
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
   accrued_error = elapsed * current_freq;
   
   adjust_required = - (accrued_error + offset_register);
 
-  UTI_DoubleToTimeval(adjust_required, &exact_newadj);
+  UTI_DoubleToTimespec(adjust_required, &exact_newadj);
 
   /* At this point, we need to round the required adjustment the
      same way the kernel does. */
 
-  delta = exact_newadj.tv_sec * 1000000 + exact_newadj.tv_usec;
+  delta = exact_newadj.tv_sec * 1000000 + exact_newadj.tv_nsec / 1000;
   if (delta > kern_bigadj || delta < -kern_bigadj)
     tickdelta = 10 * kern_tickadj;
   else
     tickdelta = kern_tickadj;
   if (delta % tickdelta)
 	delta = delta / tickdelta * tickdelta;
-  newadj.tv_sec = 0;
-  newadj.tv_usec = delta;
-  UTI_NormaliseTimeval(&newadj);
+  UTI_DoubleToTimespec(delta * 1.0e-6, &ts);
+  UTI_TimespecToTimeval(&ts, &newadj);
 
   /* Add rounding error back onto offset register. */
-  UTI_DiffTimevalsToDouble(&rounding_error, &newadj, &exact_newadj);
+  UTI_DiffTimespecsToDouble(&rounding_error, &ts, &exact_newadj);
 
   if (adjtime(&newadj, &oldadj) < 0) {
     LOG_FATAL(LOGF_SysNetBSD, "adjtime() failed");
   }
 
-  UTI_TimevalToDouble(&oldadj, &old_adjust_remaining);
+  UTI_TimevalToTimespec(&oldadj, &ts);
+  UTI_TimespecToDouble(&ts, &old_adjust_remaining);
 
   offset_register = rounding_error - old_adjust_remaining;
 
   T0 = T1;
-  UTI_TimevalToDouble(&newadj, &adjustment_requested);
+  UTI_TimevalToTimespec(&newadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_requested);
 
 }
 
@@ -164,8 +162,9 @@ start_adjust(void)
 static void
 stop_adjust(void)
 {
-  struct timeval T1;
+  struct timespec T1;
   struct timeval zeroadj, remadj;
+  struct timespec ts;
   double adjustment_remaining, adjustment_achieved;
   double elapsed, elapsed_plus_adjust;
 
@@ -176,12 +175,11 @@ stop_adjust(void)
     LOG_FATAL(LOGF_SysNetBSD, "adjtime() failed");
   }
 
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysNetBSD, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
   
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
-  UTI_TimevalToDouble(&remadj, &adjustment_remaining);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
+  UTI_TimevalToTimespec(&remadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_remaining);
 
   adjustment_achieved = adjustment_requested - adjustment_remaining;
   elapsed_plus_adjust = elapsed - adjustment_achieved;
@@ -215,21 +213,19 @@ accrue_offset(double offset, double corr_rate)
 static void
 apply_step_offset(double offset)
 {
-  struct timeval old_time, new_time, T1;
+  struct timespec old_time, new_time, T1;
   
   stop_adjust();
 
-  if (gettimeofday(&old_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysNetBSD, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&old_time);
 
-  UTI_AddDoubleToTimeval(&old_time, -offset, &new_time);
+  UTI_AddDoubleToTimespec(&old_time, -offset, &new_time);
 
-  if (settimeofday(&new_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysNetBSD, "settimeofday() failed");
+  if (clock_settime(CLOCK_REALTIME, &new_time) < 0) {
+    LOG_FATAL(LOGF_SysNetBSD, "clock_settime() failed");
   }
 
-  UTI_AddDoubleToTimeval(&T0, offset, &T1);
+  UTI_AddDoubleToTimespec(&T0, offset, &T1);
   T0 = T1;
 
   start_adjust();
@@ -259,7 +255,7 @@ read_frequency(void)
 /* ================================================== */
 
 static void
-get_offset_correction(struct timeval *raw,
+get_offset_correction(struct timespec *raw,
                       double *corr, double *err)
 {
   stop_adjust();
@@ -38,6 +38,7 @@
 #include <stdio.h>
 
 #include "sys_solaris.h"
+#include "local.h"
 #include "localp.h"
 #include "sched.h"
 #include "logging.h"
@@ -47,13 +48,13 @@
 
 /* This register contains the number of seconds by which the local
    clock was estimated to be fast of reference time at the epoch when
-   gettimeofday() returned T0 */
+   LCL_ReadRawTime() returned T0 */
 
 static double offset_register;
 
 /* This register contains the epoch to which the offset is referenced */
 
-static struct timeval T0;
+static struct timespec T0;
 
 /* This register contains the current estimate of the system
    frequency, in absolute (NOT ppm) */
@@ -97,9 +98,7 @@ clock_initialise(void)
   adjustment_requested = 0.0;
   current_freq = 0.0;
 
-  if (gettimeofday(&T0, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSolaris, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T0);
 
   newadj = GET_ZERO;
 
@@ -126,44 +125,45 @@ static void
 start_adjust(void)
 {
   struct timeval newadj, oldadj;
-  struct timeval T1;
+  struct timespec T1;
   double elapsed, accrued_error;
   double adjust_required;
-  struct timeval exact_newadj;
+  struct timespec exact_newadj, ts;
   double rounding_error;
   double old_adjust_remaining;
 
   /* Determine the amount of error built up since the last adjustment */
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSolaris, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
 
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
   accrued_error = elapsed * current_freq;
   
   adjust_required = - (accrued_error + offset_register);
 
-  UTI_DoubleToTimeval(adjust_required, &exact_newadj);
+  UTI_DoubleToTimespec(adjust_required, &exact_newadj);
 
   /* At this point, we will need to call the adjustment rounding
      algorithm in the system-specific layer.  For now, just assume the
      adjustment can be applied exactly. */
 
-  newadj = exact_newadj;
+  UTI_TimespecToTimeval(&exact_newadj, &newadj);
   
   /* Want to *add* rounding error back onto offset register */
-  UTI_DiffTimevalsToDouble(&rounding_error, &exact_newadj, &newadj);
+  UTI_TimevalToTimespec(&newadj, &ts);
+  UTI_DiffTimespecsToDouble(&rounding_error, &exact_newadj, &ts);
 
   if (adjtime(&newadj, &oldadj) < 0) {
     LOG_FATAL(LOGF_SysSolaris, "adjtime() failed");
   }
 
-  UTI_TimevalToDouble(&oldadj, &old_adjust_remaining);
+  UTI_TimevalToTimespec(&oldadj, &ts);
+  UTI_TimespecToDouble(&ts, &old_adjust_remaining);
 
   offset_register = rounding_error - old_adjust_remaining;
 
   T0 = T1;
-  UTI_TimevalToDouble(&newadj, &adjustment_requested);
+  UTI_TimevalToTimespec(&newadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_requested);
   
 }
 
@@ -172,8 +172,9 @@ start_adjust(void)
 static void
 stop_adjust(void)
 {
-  struct timeval T1;
+  struct timespec T1;
   struct timeval zeroadj, remadj;
+  struct timespec ts;
   double adjustment_remaining, adjustment_achieved;
   double elapsed, elapsed_plus_adjust;
 
@@ -184,12 +185,11 @@ stop_adjust(void)
     LOG_FATAL(LOGF_SysSolaris, "adjtime() failed");
   }
 
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSolaris, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
   
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
-  UTI_TimevalToDouble(&remadj, &adjustment_remaining);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
+  UTI_TimevalToTimespec(&remadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_remaining);
 
   adjustment_achieved = adjustment_requested - adjustment_remaining;
   elapsed_plus_adjust = elapsed - adjustment_achieved;
@@ -222,36 +222,34 @@ accrue_offset(double offset, double corr_rate)
 static void
 apply_step_offset(double offset)
 {
-  struct timeval old_time, new_time, rounded_new_time, T1;
+  struct timespec old_time, new_time, rounded_new_time, T1;
   double rounding_error;
   
   stop_adjust();
-  if (gettimeofday(&old_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSolaris, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&old_time);
 
-  UTI_AddDoubleToTimeval(&old_time, -offset, &new_time);
+  UTI_AddDoubleToTimespec(&old_time, -offset, &new_time);
 
-  /* The settimeofday function (on Solaris 2.5/Sparc20 at least) does
+  /* Setting the time (on Solaris 2.5/Sparc20 at least) does
      not work quite as we would want.  The time we want to set is
      rounded to the nearest second and that time is used.  Also, the
      clock appears to start from that second boundary plus about 4ms.
      For now we'll tolerate this small error. */
 
-  rounded_new_time.tv_usec = 0;
-  if (new_time.tv_usec >= 500000) {
+  rounded_new_time.tv_nsec = 0;
+  if (new_time.tv_nsec >= 500000000) {
     rounded_new_time.tv_sec = new_time.tv_sec + 1;
   } else {
     rounded_new_time.tv_sec = new_time.tv_sec;
   }
 
-  UTI_DiffTimevalsToDouble(&rounding_error, &rounded_new_time, &new_time);
+  UTI_DiffTimespecsToDouble(&rounding_error, &rounded_new_time, &new_time);
 
-  if (settimeofday(&new_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSolaris, "settimeofday() failed");
+  if (clock_settime(CLOCK_REALTIME, &new_time) < 0) {
+    LOG_FATAL(LOGF_SysSolaris, "clock_settime() failed");
   }
 
-  UTI_AddDoubleToTimeval(&T0, offset, &T1);
+  UTI_AddDoubleToTimespec(&T0, offset, &T1);
   T0 = T1;
 
   offset_register += rounding_error;
@@ -282,7 +280,7 @@ read_frequency(void)
 /* ================================================== */
 
 static void
-get_offset_correction(struct timeval *raw,
+get_offset_correction(struct timespec *raw,
                       double *corr, double *err)
 {
   stop_adjust();
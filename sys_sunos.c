@@ -38,6 +38,7 @@
 #include <signal.h>
 
 #include "sys_sunos.h"
+#include "local.h"
 #include "localp.h"
 #include "logging.h"
 #include "util.h"
@@ -47,13 +48,13 @@
 
 /* This register contains the number of seconds by which the local
    clock was estimated to be fast of reference time at the epoch when
-   gettimeofday() returned T0 */
+   LCL_ReadRawTime() returned T0 */
 
 static double offset_register;
 
 /* This register contains the epoch to which the offset is referenced */
 
-static struct timeval T0;
+static struct timespec T0;
 
 /* This register contains the current estimate of the system
    frequency, in absolute (NOT ppm) */
@@ -87,9 +88,7 @@ clock_initialise(void)
   adjustment_requested = 0.0;
   current_freq = 0.0;
 
-  if (gettimeofday(&T0, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSunOS, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T0);
 
   newadj.tv_sec = 0;
   newadj.tv_usec = 0;
@@ -117,32 +116,30 @@ static void
 start_adjust(void)
 {
   struct timeval newadj, oldadj;
-  struct timeval T1;
+  struct timespec T1;
   double elapsed, accrued_error;
   double adjust_required;
-  struct timeval exact_newadj;
+  struct timespec exact_newadj, ts;
   double rounding_error;
   double old_adjust_remaining;
   long remainder, multiplier;
 
   /* Determine the amount of error built up since the last adjustment */
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSunOS, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
 
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
   accrued_error = elapsed * current_freq;
   
   adjust_required = - (accrued_error + offset_register);
 
-  UTI_DoubleToTimeval(adjust_required, &exact_newadj);
+  UTI_DoubleToTimespec(adjust_required, &exact_newadj);
 
   /* At this point, we need to round the required adjustment to the
      closest multiple of _tickadj --- because SunOS can't process
      other adjustments exactly and will silently discard the residual.
      Obviously such behaviour can't be tolerated for us. */
 
-  newadj = exact_newadj;
+  UTI_TimespecToTimeval(&exact_newadj, &newadj);
   remainder = newadj.tv_usec % our_tickadj;
   multiplier = newadj.tv_usec / our_tickadj;
   if (remainder >= (our_tickadj >> 1)) {
@@ -151,22 +148,26 @@ start_adjust(void)
     newadj.tv_usec = multiplier * our_tickadj;
   }
 
-  UTI_NormaliseTimeval(&newadj);
+  UTI_TimevalToTimespec(&newadj, &ts);
+  UTI_NormaliseTimespec(&ts);
+  UTI_TimespecToTimeval(&ts, &newadj);
   
   /* Want to *add* rounding error back onto offset register.  Note
      that the exact adjustment was the offset register *negated* */
-  UTI_DiffTimevalsToDouble(&rounding_error, &newadj, &exact_newadj);
+  UTI_DiffTimespecsToDouble(&rounding_error, &ts, &exact_newadj);
 
   if (adjtime(&newadj, &oldadj) < 0) {
     LOG_FATAL(LOGF_SysSunOS, "adjtime() failed");
   }
 
-  UTI_TimevalToDouble(&oldadj, &old_adjust_remaining);
+  UTI_TimevalToTimespec(&oldadj, &ts);
+  UTI_TimespecToDouble(&ts, &old_adjust_remaining);
 
   offset_register = rounding_error - old_adjust_remaining;
 
   T0 = T1;
-  UTI_TimevalToDouble(&newadj, &adjustment_requested);
+  UTI_TimevalToTimespec(&newadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_requested);
 
 }
 
@@ -175,8 +176,9 @@ start_adjust(void)
 static void
 stop_adjust(void)
 {
-  struct timeval T1;
+  struct timespec T1;
   struct timeval zeroadj, remadj;
+  struct timespec ts;
   double adjustment_remaining, adjustment_achieved;
   double gap;
   double elapsed, elapsed_plus_adjust;
@@ -188,12 +190,11 @@ stop_adjust(void)
     LOG_FATAL(LOGF_SysSunOS, "adjtime() failed");
   }
 
-  if (gettimeofday(&T1, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSunOS, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&T1);
   
-  UTI_DiffTimevalsToDouble(&elapsed, &T1, &T0);
-  UTI_TimevalToDouble(&remadj, &adjustment_remaining);
+  UTI_DiffTimespecsToDouble(&elapsed, &T1, &T0);
+  UTI_TimevalToTimespec(&remadj, &ts);
+  UTI_TimespecToDouble(&ts, &adjustment_remaining);
 
   adjustment_achieved = adjustment_requested - adjustment_remaining;
   elapsed_plus_adjust = elapsed - adjustment_achieved;
@@ -226,20 +227,18 @@ accrue_offset(double offset, double corr_rate)
 static void
 apply_step_offset(double offset)
 {
-  struct timeval old_time, new_time, T1;
+  struct timespec old_time, new_time, T1;
   
   stop_adjust();
-  if (gettimeofday(&old_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSunOS, "gettimeofday() failed");
-  }
+  LCL_ReadRawTime(&old_time);
 
-  UTI_AddDoubleToTimeval(&old_time, -offset, &new_time);
+  UTI_AddDoubleToTimespec(&old_time, -offset, &new_time);
 
-  if (settimeofday(&new_time, NULL) < 0) {
-    LOG_FATAL(LOGF_SysSunOS, "settimeofday() failed");
+  if (clock_settime(CLOCK_REALTIME, &new_time) < 0) {
+    LOG_FATAL(LOGF_SysSunOS, "clock_settime() failed");
   }
 
-  UTI_AddDoubleToTimeval(&T0, offset, &T1);
+  UTI_AddDoubleToTimespec(&T0, offset, &T1);
   T0 = T1;
 
   start_adjust();
@@ -269,7 +268,7 @@ read_frequency(void)
 /* ================================================== */
 
 static void
-get_offset_correction(struct timeval *raw,
+get_offset_correction(struct timespec *raw,
                       double *corr, double *err)
 {
   stop_adjust();
@@ -43,6 +43,7 @@
 #include <malloc.h>
 #endif
 #include <math.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <resolv.h>
@@ -83,6 +84,10 @@
 #include <arpa/inet.h>
 #endif
 
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#endif
+
 #if defined (SOLARIS) || defined(SUNOS)
 /* Only needed on these platforms, and doesn't exist on some Linux
    versions. */
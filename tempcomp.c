@@ -61,7 +61,7 @@ read_timeout(void *arg)
       comp = LCL_SetTempComp(comp);
 
       if (logfileid != -1) {
-        struct timeval now;
+        struct timespec now;
 
         LCL_ReadCookedTime(&now, NULL);
         LOG_FileWrite(logfileid, "%s %11.4e %11.4e",
@@ -0,0 +1,448 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Load generator for the NTP server.  It sends client requests at a
+  constant rate from a number of sockets bound to different loopback
+  addresses (127.1.0.1, 127.1.0.2, ...) and ephemeral ports, optionally
+  authenticated with a key from a chrony keyfile, and reports the
+  achieved rate, loss and percentiles of the round-trip time.
+
+  The sequence number of each request is sent in the transmit timestamp
+  and matched with the originate timestamp of the reply.
+
+  Example:  ./ntpbench -p 11123 -r 50000 -d 10 -n 100 -P 10
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include <poll.h>
+
+#include "cmdparse.h"
+#include "memory.h"
+#include "ntp.h"
+#include "util.h"
+
+/* Base of the source addresses (127.1.0.0) */
+#define SOURCE_NET 0x7f010000U
+#define MAX_SOURCE_ADDRESSES 65534
+
+#define NTP_VERSION 4
+
+/* ================================================== */
+
+struct bench_key {
+  unsigned long id;
+  int hash_id;
+  int len;
+  char val[512];
+};
+
+static int n_sockets;
+static int *sockets;
+static struct pollfd *pollfds;
+
+static struct sockaddr_in server_addr;
+
+static struct bench_key key;
+static int use_key = 0;
+
+static unsigned long n_requests;
+static double *send_times;
+static double *rtts;
+
+static unsigned long sent, send_errors, received, invalid, auth_failures, duplicates;
+
+/* ================================================== */
+
+static double
+get_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ================================================== */
+
+static int
+load_key(const char *keyfile, unsigned long key_id)
+{
+  char line[2048], *keyval;
+  const char *hashname;
+  unsigned long id;
+  FILE *in;
+
+  in = fopen(keyfile, "r");
+  if (!in) {
+    fprintf(stderr, "Could not open %s : %s\n", keyfile, strerror(errno));
+    return 0;
+  }
+
+  while (fgets(line, sizeof (line), in)) {
+    CPS_NormalizeLine(line);
+    if (!*line || !CPS_ParseKey(line, &id, &hashname, &keyval) || id != key_id)
+      continue;
+
+    fclose(in);
+
+    key.id = id;
+    key.hash_id = HSH_GetHashId(hashname);
+    if (key.hash_id < 0) {
+      fprintf(stderr, "Unknown hash function in key %lu\n", id);
+      return 0;
+    }
+
+    key.len = UTI_DecodePasswordFromText(keyval);
+    if (key.len <= 0 || key.len > sizeof (key.val)) {
+      fprintf(stderr, "Could not decode password in key %lu\n", id);
+      return 0;
+    }
+
+    memcpy(key.val, keyval, key.len);
+    return 1;
+  }
+
+  fclose(in);
+  fprintf(stderr, "Key %lu not found in %s\n", key_id, keyfile);
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+open_sockets(int n_addresses, int n_ports)
+{
+  struct sockaddr_in addr;
+  int i, fd;
+
+  n_sockets = n_addresses * n_ports;
+  sockets = MallocArray(int, n_sockets);
+  pollfds = MallocArray(struct pollfd, n_sockets);
+
+  for (i = 0; i < n_sockets; i++) {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+      fprintf(stderr, "Could not open socket : %s\n", strerror(errno));
+      return 0;
+    }
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(SOURCE_NET + 1 + i % n_addresses);
+    addr.sin_port = 0;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+      fprintf(stderr, "Could not bind socket to %s : %s\n",
+              inet_ntoa(addr.sin_addr), strerror(errno));
+      return 0;
+    }
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+      fprintf(stderr, "Could not set O_NONBLOCK : %s\n", strerror(errno));
+      return 0;
+    }
+
+    sockets[i] = fd;
+    pollfds[i].fd = fd;
+    pollfds[i].events = POLLIN;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+send_request(unsigned long seq)
+{
+  NTP_Packet message;
+  int length, auth_len;
+
+  memset(&message, 0, sizeof (message));
+  message.lvm = ((LEAP_Unsynchronised << 6) & 0xc0) |
+                ((NTP_VERSION << 3) & 0x38) | (MODE_CLIENT & 0x07);
+  message.poll = 6;
+  message.precision = -20;
+  message.transmit_ts.hi = htonl(seq);
+  message.transmit_ts.lo = htonl(~seq);
+
+  length = NTP_NORMAL_PACKET_SIZE;
+
+  if (use_key) {
+    auth_len = UTI_GenerateNTPAuth(key.hash_id, (unsigned char *)key.val, key.len,
+                                   (unsigned char *)&message, NTP_NORMAL_PACKET_SIZE,
+                                   message.auth_data, sizeof (message.auth_data));
+    message.auth_keyid = htonl(key.id);
+    length += sizeof (message.auth_keyid) + auth_len;
+  }
+
+  send_times[seq] = get_time();
+
+  if (sendto(sockets[seq % n_sockets], &message, length, 0,
+             (struct sockaddr *)&server_addr, sizeof (server_addr)) != length) {
+    send_errors++;
+    return;
+  }
+
+  sent++;
+}
+
+/* ================================================== */
+
+static void
+process_reply(NTP_Packet *message, int length, double now)
+{
+  unsigned long seq;
+  int auth_len;
+
+  if (length < NTP_NORMAL_PACKET_SIZE || (message->lvm & 0x07) != MODE_SERVER) {
+    invalid++;
+    return;
+  }
+
+  seq = ntohl(message->originate_ts.hi);
+  if (seq >= n_requests || ntohl(message->originate_ts.lo) != (uint32_t)~seq ||
+      send_times[seq] <= 0.0) {
+    invalid++;
+    return;
+  }
+
+  if (rtts[seq] > 0.0) {
+    duplicates++;
+    return;
+  }
+
+  if (use_key) {
+    auth_len = length - (NTP_NORMAL_PACKET_SIZE + sizeof (message->auth_keyid));
+    if (auth_len <= 0 || ntohl(message->auth_keyid) != key.id ||
+        !UTI_CheckNTPAuth(key.hash_id, (unsigned char *)key.val, key.len,
+                          (unsigned char *)message, NTP_NORMAL_PACKET_SIZE,
+                          message->auth_data, auth_len)) {
+      auth_failures++;
+      return;
+    }
+  }
+
+  rtts[seq] = now - send_times[seq];
+  received++;
+}
+
+/* ================================================== */
+
+static void
+receive_replies(int timeout)
+{
+  NTP_Packet message;
+  int i, n, length;
+
+  n = poll(pollfds, n_sockets, timeout);
+  if (n <= 0)
+    return;
+
+  for (i = 0; i < n_sockets && n > 0; i++) {
+    if (!(pollfds[i].revents & POLLIN))
+      continue;
+    n--;
+
+    while ((length = recv(pollfds[i].fd, &message, sizeof (message), 0)) >= 0)
+      process_reply(&message, length, get_time());
+  }
+}
+
+/* ================================================== */
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* ================================================== */
+
+static void
+print_report(double elapsed)
+{
+  unsigned long i, n;
+  double *r;
+
+  for (i = n = 0; i < n_requests; i++) {
+    if (rtts[i] > 0.0)
+      rtts[n++] = rtts[i];
+  }
+  r = rtts;
+  qsort(r, n, sizeof (double), compare_doubles);
+
+  printf("Sources         : %d sockets\n", n_sockets);
+  printf("Requests sent   : %lu (%lu send errors)\n", sent, send_errors);
+  printf("Replies         : %lu (%lu invalid, %lu duplicate, %lu auth failures)\n",
+         received, invalid, duplicates, auth_failures);
+  printf("Send rate       : %.0f requests/s\n", elapsed > 0.0 ? sent / elapsed : 0.0);
+  printf("Reply rate      : %.0f replies/s\n", elapsed > 0.0 ? received / elapsed : 0.0);
+  printf("Loss            : %.3f %%\n", sent ? 100.0 * (sent - received) / sent : 0.0);
+
+  if (!n)
+    return;
+
+  printf("RTT min         : %.1f us\n", r[0] * 1e6);
+  printf("RTT 50%%         : %.1f us\n", r[n * 50 / 100] * 1e6);
+  printf("RTT 90%%         : %.1f us\n", r[n * 90 / 100] * 1e6);
+  printf("RTT 99%%         : %.1f us\n", r[n * 99 / 100] * 1e6);
+  printf("RTT 99.9%%       : %.1f us\n", r[n * 999 / 1000] * 1e6);
+  printf("RTT max         : %.1f us\n", r[n - 1] * 1e6);
+}
+
+/* ================================================== */
+
+static void
+usage(const char *progname)
+{
+  fprintf(stderr,
+          "Usage: %s [-a address] [-p port] [-r rate] [-d duration] [-n addresses]\n"
+          "          [-P ports] [-k keyfile -K keyid] [-t timeout]\n"
+          "\t-a address\taddress of the server (default 127.0.0.1)\n"
+          "\t-p port\t\tNTP port of the server (default 123)\n"
+          "\t-r rate\t\trequests per second (default 1000)\n"
+          "\t-d duration\tlength of the test in seconds (default 10)\n"
+          "\t-n addresses\tnumber of source addresses (default 1, maximum %d)\n"
+          "\t-P ports\tnumber of source ports per address (default 1)\n"
+          "\t-k keyfile\tchrony keyfile containing the key\n"
+          "\t-K keyid\tauthenticate requests with the key\n"
+          "\t-t timeout\ttime to wait for late replies in seconds (default 1)\n",
+          progname, MAX_SOURCE_ADDRESSES);
+}
+
+/* ================================================== */
+
+int
+main(int argc, char **argv)
+{
+  const char *address = "127.0.0.1", *keyfile = NULL;
+  double rate = 1000.0, duration = 10.0, timeout = 1.0, start, now, next, end;
+  unsigned long key_id = 0, seq;
+  int opt, port = 123, n_addresses = 1, n_ports = 1, wait;
+
+  while ((opt = getopt(argc, argv, "a:d:k:K:n:p:P:r:t:v")) != -1) {
+    switch (opt) {
+      case 'a':
+        address = optarg;
+        break;
+      case 'd':
+        duration = atof(optarg);
+        break;
+      case 'k':
+        keyfile = optarg;
+        break;
+      case 'K':
+        key_id = strtoul(optarg, NULL, 10);
+        use_key = 1;
+        break;
+      case 'n':
+        n_addresses = atoi(optarg);
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'P':
+        n_ports = atoi(optarg);
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 't':
+        timeout = atof(optarg);
+        break;
+      case 'v':
+        printf("ntpbench (chrony) version %s\n", CHRONY_VERSION);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind != argc || rate <= 0.0 || duration <= 0.0 || timeout < 0.0 ||
+      n_addresses < 1 || n_addresses > MAX_SOURCE_ADDRESSES || n_ports < 1 ||
+      port < 1 || port > 65535 || (use_key && !keyfile)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  memset(&server_addr, 0, sizeof (server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &server_addr.sin_addr) != 1) {
+    fprintf(stderr, "Invalid address %s\n", address);
+    return 1;
+  }
+
+  if (use_key && !load_key(keyfile, key_id))
+    return 1;
+
+  if (!open_sockets(n_addresses, n_ports))
+    return 1;
+
+  n_requests = rate * duration;
+  if (n_requests < 1 || n_requests > 0xffffffffUL) {
+    fprintf(stderr, "Invalid number of requests\n");
+    return 1;
+  }
+
+  send_times = calloc(n_requests, sizeof (double));
+  rtts = calloc(n_requests, sizeof (double));
+  if (!send_times || !rtts) {
+    fprintf(stderr, "Could not allocate memory\n");
+    return 1;
+  }
+
+  start = next = get_time();
+  seq = 0;
+
+  /* Send the requests on schedule, catching up after late wakeups */
+  while (seq < n_requests) {
+    now = get_time();
+    while (seq < n_requests && next <= now) {
+      send_request(seq++);
+      next = start + seq / rate;
+    }
+
+    wait = next > now ? (next - now) * 1000.0 : 0;
+    receive_replies(wait);
+  }
+
+  end = get_time();
+
+  /* Wait for late replies */
+  while ((now = get_time()) < end + timeout && received + invalid + auth_failures < sent)
+    receive_replies((end + timeout - now) * 1000.0 + 1);
+
+  print_report(end - start);
+
+  return 0;
+}
+
+/* ================================================== */
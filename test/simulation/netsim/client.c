@@ -0,0 +1,1976 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Library preloaded in programs running in the network simulator.  It
+  replaces the system calls working with the clock, IPv4 UDP sockets,
+  select() and sleeping with requests to the simulator.  The node number
+  and path of the simulator's socket are specified by the CLKNETSIM_NODE
+  and CLKNETSIM_SOCKET environment variables.  Without them all calls
+  are passed to the C library.
+
+  Unix domain datagram sockets are simulated as UDP sockets of the node.
+  Binding to a path creates a real file with the node and port of the
+  socket, which is read by sockets sending to the path.  If the
+  CLKNETSIM_UNIX_DIR variable is set, the directory of the path is replaced
+  with it.  Messages received on the sockets have credentials with the user
+  ID specified by CLKNETSIM_UID (default 0), which is also returned by
+  getuid() and geteuid().  Packets sent to the loopback address are
+  delivered to the node specified by CLKNETSIM_LOCAL_NODE (default the
+  node itself).
+
+  The name nodeN.net is resolved by getaddrinfo() to the address of node N.
+
+  IPv6 datagram sockets are not supported, creating them fails with
+  EAFNOSUPPORT.  Other file descriptors (e.g. pipes of the asynchronous
+  resolver) can be used in select() with real time.
+
+  Opening /dev/rtc* gives a simulated RTC, which supports reading and
+  setting of the time and update interrupts (RTC_UIE_ON/RTC_UIE_OFF).
+
+  */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/rtc.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/ipc.h>
+#include <sys/select.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/timex.h>
+#include <sys/un.h>
+
+#include "netsim.h"
+
+#define MAX_SOCKETS 1024
+
+/* First port assigned to sockets bound to port 0 */
+#define EPHEMERAL_PORT 32768
+
+/* Maximum timeout in virtual time of select() with real file descriptors
+   and the real time (in seconds) for which they are polled */
+#define MAX_REAL_FD_TIMEOUT 1.0
+#define REAL_FD_WAIT 1
+
+/* Arbitrary identifiers of the simulated SHM segments */
+#define SHM_ID_BASE 0x7e570000
+
+/* Format of the abstract address of automatically bound Unix domain
+   sockets, with the node and port of the socket */
+#define UNIX_ABSTRACT_FORMAT "netsim:%d:%hu"
+
+/* Prefix of the path of the simulated RTC device */
+#define RTC_DEVICE_PREFIX "/dev/rtc"
+
+/* Segment of the SHM refclock driver, see refclock_shm.c */
+struct shmTime {
+  int mode;
+  volatile int count;
+  time_t clockTimeStampSec;
+  int clockTimeStampUSec;
+  time_t receiveTimeStampSec;
+  int receiveTimeStampUSec;
+  int leap;
+  int precision;
+  int nsamples;
+  volatile int valid;
+  int clockTimeStampNSec;
+  int receiveTimeStampNSec;
+  int dummy[8];
+};
+
+struct Packet {
+  struct Packet *next;
+  uint32_t src_addr;
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t uid;
+  double time;
+  uint32_t length;
+  unsigned char data[];
+};
+
+struct Socket {
+  int used;
+  /* Local port, zero if not bound */
+  uint16_t port;
+  /* Remote address and port if connected */
+  uint32_t remote_addr;
+  uint16_t remote_port;
+  /* Simulated Unix domain socket */
+  int unix_domain;
+  /* Remote address is the local node reached via the loopback address */
+  int loopback;
+  int timestamp;
+  int timestampns;
+  int pktinfo;
+  int passcred;
+  struct Packet *head;
+  struct Packet *tail;
+};
+
+/* ================================================== */
+
+static int initialised = 0;
+static int node;
+static int local_node;
+static uid_t uid;
+static const char *unix_dir;
+static int server_fd;
+static int64_t start_date;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct Socket sockets[MAX_SOCKETS];
+static uint16_t next_port = EPHEMERAL_PORT;
+
+static struct shmTime shm_segments[NETSIM_SHM_SEGMENTS];
+static int shm_attached[NETSIM_SHM_SEGMENTS];
+static uint32_t last_refclock_id;
+
+/* Descriptor of the simulated RTC, -1 if not open, and the state of its
+   update interrupts (the last second which was reported) */
+static int rtc_fd = -1;
+static int rtc_uie;
+static double rtc_uie_second;
+static unsigned long rtc_interrupts;
+
+static int (*real_socket)(int domain, int type, int protocol);
+static int (*real_connect)(int fd, const struct sockaddr *addr, socklen_t len);
+static int (*real_close)(int fd);
+static int (*real_select)(int nfds, fd_set *readfds, fd_set *writefds,
+                          fd_set *exceptfds, struct timeval *timeout);
+
+/* ================================================== */
+
+static void
+fail(const char *message)
+{
+  fprintf(stderr, "netsim: %s\n", message);
+  _exit(1);
+}
+
+/* ================================================== */
+
+static void
+make_request(int type, const void *data, int data_length, void *reply, int reply_length)
+{
+  struct netsim_request request;
+  int length, received;
+
+  request.type = type;
+  request._pad = 0;
+  if (data_length > 0)
+    memcpy(&request.data, data, data_length);
+  length = offsetof(struct netsim_request, data) + data_length;
+
+  if (send(server_fd, &request, length, 0) != length)
+    fail("could not send request");
+
+  if (!reply)
+    return;
+
+  received = recv(server_fd, reply, reply_length, 0);
+  if (received <= 0)
+    fail("connection closed");
+  if (received < reply_length)
+    memset((char *)reply + received, 0, reply_length - received);
+}
+
+/* ================================================== */
+
+__attribute__((constructor))
+static void
+init(void)
+{
+  struct netsim_register reg;
+  struct netsim_time_reply reply;
+  struct sockaddr_un addr;
+  const char *env_node, *env_socket, *env_uid, *env_local_node;
+  int i;
+
+  env_node = getenv("CLKNETSIM_NODE");
+  env_socket = getenv("CLKNETSIM_SOCKET");
+  if (!env_node || !env_socket)
+    return;
+
+  real_socket = dlsym(RTLD_NEXT, "socket");
+  real_connect = dlsym(RTLD_NEXT, "connect");
+  real_close = dlsym(RTLD_NEXT, "close");
+  real_select = dlsym(RTLD_NEXT, "select");
+
+  node = atoi(env_node);
+
+  env_uid = getenv("CLKNETSIM_UID");
+  uid = env_uid ? atoi(env_uid) : 0;
+  env_local_node = getenv("CLKNETSIM_LOCAL_NODE");
+  local_node = env_local_node ? atoi(env_local_node) : node;
+  unix_dir = getenv("CLKNETSIM_UNIX_DIR");
+
+  memset(&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (snprintf(addr.sun_path, sizeof (addr.sun_path), "%s", env_socket) >=
+      sizeof (addr.sun_path))
+    fail("path too long");
+
+  server_fd = real_socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (server_fd < 0)
+    fail("could not create socket");
+
+  /* The simulator may start after the programs */
+  for (i = 0; real_connect(server_fd, (struct sockaddr *)&addr, sizeof (addr)) < 0; i++) {
+    if (i >= 6000)
+      fail("could not connect to simulator");
+    usleep(10000);
+  }
+
+  /* Don't preload the library in other programs started by this one */
+  unsetenv("LD_PRELOAD");
+
+  /* Wait for the start of the node */
+  reg.node = node;
+  make_request(NETSIM_REQ_REGISTER, &reg, sizeof (reg), &reply, sizeof (reply));
+  start_date = reply.start_date;
+
+  initialised = 1;
+}
+
+/* ================================================== */
+
+static void
+double_to_timespec(double t, struct timespec *ts)
+{
+  double f;
+
+  f = floor(t);
+  ts->tv_sec = start_date + (int64_t)f;
+  ts->tv_nsec = (t - f) * 1.0e9;
+  if (ts->tv_nsec > 999999999)
+    ts->tv_nsec = 999999999;
+}
+
+/* ================================================== */
+
+static void
+update_refclock(const struct netsim_time_reply *reply)
+{
+  struct timespec clock_ts, receive_ts;
+  struct shmTime *shm;
+  int i;
+
+  if (reply->refclock_id == last_refclock_id)
+    return;
+  last_refclock_id = reply->refclock_id;
+
+  double_to_timespec(reply->refclock_time, &clock_ts);
+  double_to_timespec(reply->refclock_receive_time, &receive_ts);
+
+  for (i = 0; i < NETSIM_SHM_SEGMENTS; i++) {
+    if (!shm_attached[i])
+      continue;
+
+    shm = &shm_segments[i];
+    shm->mode = 1;
+    shm->count++;
+    shm->clockTimeStampSec = clock_ts.tv_sec;
+    shm->clockTimeStampUSec = clock_ts.tv_nsec / 1000;
+    shm->clockTimeStampNSec = clock_ts.tv_nsec;
+    shm->receiveTimeStampSec = receive_ts.tv_sec;
+    shm->receiveTimeStampUSec = receive_ts.tv_nsec / 1000;
+    shm->receiveTimeStampNSec = receive_ts.tv_nsec;
+    shm->leap = 0;
+    shm->precision = -20;
+    shm->valid = 1;
+    shm->count++;
+  }
+}
+
+/* ================================================== */
+
+static void
+get_time(struct netsim_time_reply *reply)
+{
+  pthread_mutex_lock(&mutex);
+  make_request(NETSIM_REQ_GETTIME, NULL, 0, reply, sizeof (*reply));
+  update_refclock(reply);
+  pthread_mutex_unlock(&mutex);
+}
+
+/* ================================================== */
+
+static double
+get_rtc_time(void)
+{
+  struct netsim_time_reply reply;
+
+  get_time(&reply);
+  return reply.rtc_time;
+}
+
+/* ================================================== */
+
+/* Get the time until the next update interrupt of the RTC, zero if it
+   should be reported now, or negative if the interrupts are disabled */
+
+static double
+get_rtc_interrupt_wait(void)
+{
+  double wait;
+
+  if (rtc_fd < 0 || !rtc_uie)
+    return -1.0;
+
+  wait = rtc_uie_second + 1.0 - get_rtc_time();
+  if (wait <= 0.0)
+    return 0.0;
+
+  /* The RTC and the node's clock run at slightly different rates, don't
+     wait past the update */
+  return wait * 0.999 + 1.0e-9;
+}
+
+/* ================================================== */
+
+static void
+get_realtime(struct timespec *ts)
+{
+  struct netsim_time_reply reply;
+
+  get_time(&reply);
+  double_to_timespec(reply.realtime, ts);
+}
+
+/* ================================================== */
+
+static int
+set_realtime(const struct timespec *ts)
+{
+  struct netsim_settime settime;
+  struct netsim_time_reply reply;
+
+  if (ts->tv_nsec < 0 || ts->tv_nsec >= 1000000000) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  settime.time = (ts->tv_sec - start_date) + ts->tv_nsec * 1.0e-9;
+
+  pthread_mutex_lock(&mutex);
+  make_request(NETSIM_REQ_SETTIME, &settime, sizeof (settime), &reply, sizeof (reply));
+  pthread_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+gettimeofday(struct timeval *tv, void *tz)
+{
+  struct timespec ts;
+
+  if (!initialised) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+  } else {
+    get_realtime(&ts);
+  }
+
+  tv->tv_sec = ts.tv_sec;
+  tv->tv_usec = ts.tv_nsec / 1000;
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+clock_gettime(clockid_t clock_id, struct timespec *ts)
+{
+  static int (*real_clock_gettime)(clockid_t clock_id, struct timespec *ts);
+  struct netsim_time_reply reply;
+
+  if (initialised) {
+    switch (clock_id) {
+      case CLOCK_REALTIME:
+      case CLOCK_REALTIME_COARSE:
+        get_time(&reply);
+        double_to_timespec(reply.realtime, ts);
+        return 0;
+      case CLOCK_MONOTONIC:
+      case CLOCK_MONOTONIC_COARSE:
+      case CLOCK_MONOTONIC_RAW:
+      case CLOCK_BOOTTIME:
+        get_time(&reply);
+        ts->tv_sec = floor(reply.monotonic);
+        ts->tv_nsec = (reply.monotonic - ts->tv_sec) * 1.0e9;
+        return 0;
+      default:
+        break;
+    }
+  }
+
+  if (!real_clock_gettime)
+    real_clock_gettime = dlsym(RTLD_NEXT, "clock_gettime");
+
+  return real_clock_gettime(clock_id, ts);
+}
+
+/* ================================================== */
+
+time_t
+time(time_t *t)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  if (t)
+    *t = ts.tv_sec;
+
+  return ts.tv_sec;
+}
+
+/* ================================================== */
+
+int
+settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+  static int (*real_settimeofday)(const struct timeval *tv, const struct timezone *tz);
+  struct timespec ts;
+
+  if (!initialised) {
+    if (!real_settimeofday)
+      real_settimeofday = dlsym(RTLD_NEXT, "settimeofday");
+    return real_settimeofday(tv, tz);
+  }
+
+  if (!tv)
+    return 0;
+
+  ts.tv_sec = tv->tv_sec;
+  ts.tv_nsec = tv->tv_usec * 1000L;
+
+  return set_realtime(&ts);
+}
+
+/* ================================================== */
+
+int
+clock_settime(clockid_t clock_id, const struct timespec *ts)
+{
+  static int (*real_clock_settime)(clockid_t clock_id, const struct timespec *ts);
+
+  if (!initialised) {
+    if (!real_clock_settime)
+      real_clock_settime = dlsym(RTLD_NEXT, "clock_settime");
+    return real_clock_settime(clock_id, ts);
+  }
+
+  if (clock_id != CLOCK_REALTIME) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return set_realtime(ts);
+}
+
+/* ================================================== */
+
+static int
+do_adjtimex(struct timex *buf)
+{
+  struct netsim_adjtimex adjtimex;
+  struct netsim_adjtimex_reply reply;
+
+  adjtimex.timex = *buf;
+
+  pthread_mutex_lock(&mutex);
+  make_request(NETSIM_REQ_ADJTIMEX, &adjtimex, sizeof (adjtimex), &reply, sizeof (reply));
+  pthread_mutex_unlock(&mutex);
+
+  if (reply.ret < 0) {
+    errno = -reply.ret;
+    return -1;
+  }
+
+  *buf = reply.timex;
+
+  return reply.ret;
+}
+
+/* ================================================== */
+
+int
+adjtimex(struct timex *buf)
+{
+  static int (*real_adjtimex)(struct timex *buf);
+
+  if (!initialised) {
+    if (!real_adjtimex)
+      real_adjtimex = dlsym(RTLD_NEXT, "adjtimex");
+    return real_adjtimex(buf);
+  }
+
+  return do_adjtimex(buf);
+}
+
+/* ================================================== */
+
+int
+ntp_adjtime(struct timex *buf)
+{
+  static int (*real_ntp_adjtime)(struct timex *buf);
+
+  if (!initialised) {
+    if (!real_ntp_adjtime)
+      real_ntp_adjtime = dlsym(RTLD_NEXT, "ntp_adjtime");
+    return real_ntp_adjtime(buf);
+  }
+
+  return do_adjtimex(buf);
+}
+
+/* ================================================== */
+
+int
+clock_adjtime(clockid_t clock_id, struct timex *buf)
+{
+  static int (*real_clock_adjtime)(clockid_t clock_id, struct timex *buf);
+
+  if (!initialised) {
+    if (!real_clock_adjtime)
+      real_clock_adjtime = dlsym(RTLD_NEXT, "clock_adjtime");
+    return real_clock_adjtime(clock_id, buf);
+  }
+
+  if (clock_id != CLOCK_REALTIME) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return do_adjtimex(buf);
+}
+
+/* ================================================== */
+
+uid_t
+getuid(void)
+{
+  static uid_t (*real_getuid)(void);
+
+  /* The simulated programs can do everything as root, the user ID is
+     only used in the credentials of Unix domain sockets */
+  if (initialised)
+    return uid;
+
+  if (!real_getuid)
+    real_getuid = dlsym(RTLD_NEXT, "getuid");
+
+  return real_getuid();
+}
+
+/* ================================================== */
+
+uid_t
+geteuid(void)
+{
+  static uid_t (*real_geteuid)(void);
+
+  if (initialised)
+    return uid;
+
+  if (!real_geteuid)
+    real_geteuid = dlsym(RTLD_NEXT, "geteuid");
+
+  return real_geteuid();
+}
+
+/* ================================================== */
+
+static struct Socket *
+get_socket(int fd)
+{
+  if (!initialised || fd < 0 || fd >= MAX_SOCKETS || !sockets[fd].used)
+    return NULL;
+
+  return &sockets[fd];
+}
+
+/* ================================================== */
+
+static uint16_t
+get_ephemeral_port(void)
+{
+  uint16_t port;
+  int i;
+
+  /* Find a port not used by any socket */
+  while (1) {
+    port = next_port++;
+    if (next_port == 0)
+      next_port = EPHEMERAL_PORT;
+
+    for (i = 0; i < MAX_SOCKETS; i++) {
+      if (sockets[i].used && sockets[i].port == port)
+        break;
+    }
+    if (i == MAX_SOCKETS)
+      return port;
+  }
+}
+
+/* ================================================== */
+
+static void
+free_packets(struct Socket *s)
+{
+  struct Packet *packet;
+
+  while (s->head) {
+    packet = s->head;
+    s->head = packet->next;
+    free(packet);
+  }
+  s->tail = NULL;
+}
+
+/* ================================================== */
+/* Copy the path (or abstract name starting with a zero byte) of a Unix
+   domain socket address to a terminated string */
+
+static int
+get_unix_name(const struct sockaddr *addr, socklen_t len, char *name)
+{
+  const struct sockaddr_un *sun = (const struct sockaddr_un *)addr;
+  size_t name_len;
+
+  if (len <= offsetof(struct sockaddr_un, sun_path) || sun->sun_family != AF_UNIX)
+    return 0;
+
+  name_len = len - offsetof(struct sockaddr_un, sun_path);
+  if (name_len > sizeof (sun->sun_path))
+    name_len = sizeof (sun->sun_path);
+
+  memcpy(name, sun->sun_path, name_len);
+  name[name_len] = '\0';
+
+  return 1;
+}
+
+/* ================================================== */
+
+static const char *
+map_unix_path(const char *path, char *buf, size_t len)
+{
+  const char *base;
+
+  if (!unix_dir)
+    return path;
+
+  base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+
+  if (snprintf(buf, len, "%s/%s", unix_dir, base) >= len)
+    fail("path too long");
+
+  return buf;
+}
+
+/* ================================================== */
+/* Get the node address and port of a simulated Unix domain socket */
+
+static int
+parse_unix_addr(const struct sockaddr *addr, socklen_t len, uint32_t *ip, uint16_t *port)
+{
+  char name[sizeof (((struct sockaddr_un *)NULL)->sun_path) + 1], buf[PATH_MAX];
+  int addr_node, ok;
+  FILE *f;
+
+  if (!get_unix_name(addr, len, name)) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  if (name[0] == '\0') {
+    ok = sscanf(name + 1, UNIX_ABSTRACT_FORMAT, &addr_node, port) == 2;
+  } else {
+    f = fopen(map_unix_path(name, buf, sizeof (buf)), "r");
+    if (!f)
+      return 0;
+    ok = fscanf(f, "%d %hu", &addr_node, port) == 2;
+    fclose(f);
+  }
+
+  if (!ok || addr_node < 1 || addr_node > NETSIM_MAX_NODES) {
+    errno = ECONNREFUSED;
+    return 0;
+  }
+
+  *ip = NETSIM_NET_ADDR | addr_node;
+
+  return 1;
+}
+
+/* ================================================== */
+
+static socklen_t
+make_unix_addr(struct sockaddr_un *sun, uint32_t ip, uint16_t port)
+{
+  int length;
+
+  memset(sun, 0, sizeof (*sun));
+  sun->sun_family = AF_UNIX;
+  length = snprintf(sun->sun_path + 1, sizeof (sun->sun_path) - 1, UNIX_ABSTRACT_FORMAT,
+                    (int)(ip & ~NETSIM_NET_MASK), port);
+
+  return offsetof(struct sockaddr_un, sun_path) + 1 + length;
+}
+
+/* ================================================== */
+/* Map the loopback address to the local node */
+
+static uint32_t
+map_loopback_addr(struct Socket *s, uint32_t addr)
+{
+  if ((addr >> 24) != 127) {
+    s->loopback = 0;
+    return addr;
+  }
+
+  s->loopback = 1;
+  return NETSIM_NET_ADDR | local_node;
+}
+
+/* ================================================== */
+
+int
+socket(int domain, int type, int protocol)
+{
+  int fd;
+
+  if (!real_socket)
+    real_socket = dlsym(RTLD_NEXT, "socket");
+
+  if (!initialised)
+    return real_socket(domain, type, protocol);
+
+  if (domain == AF_INET6 && (type & 0xff) == SOCK_DGRAM) {
+    errno = EAFNOSUPPORT;
+    return -1;
+  }
+
+  if ((domain != AF_INET && domain != AF_UNIX) || (type & 0xff) != SOCK_DGRAM)
+    return real_socket(domain, type, protocol);
+
+  /* Create a real socket to allocate the descriptor, it will not be
+     bound or used for any communication */
+  fd = real_socket(domain, type, protocol);
+  if (fd < 0)
+    return fd;
+
+  if (fd >= MAX_SOCKETS) {
+    real_close(fd);
+    errno = EMFILE;
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex);
+  memset(&sockets[fd], 0, sizeof (sockets[fd]));
+  sockets[fd].used = 1;
+  sockets[fd].unix_domain = domain == AF_UNIX;
+  pthread_mutex_unlock(&mutex);
+
+  return fd;
+}
+
+/* ================================================== */
+
+static int
+open_rtc(const char *pathname, int flags)
+{
+  static int (*real_open)(const char *pathname, int flags, ...);
+
+  if (!real_open)
+    real_open = dlsym(RTLD_NEXT, "open");
+
+  /* Only one process can have the device open */
+  if (rtc_fd >= 0) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  /* Allocate a descriptor which will not be used for anything else */
+  rtc_fd = real_open("/dev/null", O_RDONLY | (flags & O_CLOEXEC));
+  rtc_uie = 0;
+
+  return rtc_fd;
+}
+
+/* ================================================== */
+
+int
+open(const char *pathname, int flags, ...)
+{
+  static int (*real_open)(const char *pathname, int flags, ...);
+  va_list ap;
+  mode_t mode;
+
+  if (!real_open)
+    real_open = dlsym(RTLD_NEXT, "open");
+
+  if (initialised && !strncmp(pathname, RTC_DEVICE_PREFIX, strlen(RTC_DEVICE_PREFIX)))
+    return open_rtc(pathname, flags);
+
+  va_start(ap, flags);
+  mode = flags & O_CREAT ? va_arg(ap, mode_t) : 0;
+  va_end(ap);
+
+  return real_open(pathname, flags, mode);
+}
+
+/* ================================================== */
+
+int
+open64(const char *pathname, int flags, ...)
+{
+  static int (*real_open64)(const char *pathname, int flags, ...);
+  va_list ap;
+  mode_t mode;
+
+  if (!real_open64)
+    real_open64 = dlsym(RTLD_NEXT, "open64");
+
+  if (initialised && !strncmp(pathname, RTC_DEVICE_PREFIX, strlen(RTC_DEVICE_PREFIX)))
+    return open_rtc(pathname, flags);
+
+  va_start(ap, flags);
+  mode = flags & O_CREAT ? va_arg(ap, mode_t) : 0;
+  va_end(ap);
+
+  return real_open64(pathname, flags, mode);
+}
+
+/* ================================================== */
+
+static int
+rtc_ioctl(unsigned long request, void *arg)
+{
+  struct netsim_settime settime;
+  struct netsim_time_reply reply;
+  struct rtc_time *rtc;
+  struct tm tm;
+  time_t t;
+
+  switch (request) {
+    case RTC_RD_TIME:
+      t = start_date + (time_t)floor(get_rtc_time());
+      gmtime_r(&t, &tm);
+      rtc = arg;
+      memset(rtc, 0, sizeof (*rtc));
+      rtc->tm_sec = tm.tm_sec;
+      rtc->tm_min = tm.tm_min;
+      rtc->tm_hour = tm.tm_hour;
+      rtc->tm_mday = tm.tm_mday;
+      rtc->tm_mon = tm.tm_mon;
+      rtc->tm_year = tm.tm_year;
+      rtc->tm_wday = tm.tm_wday;
+      rtc->tm_yday = tm.tm_yday;
+      return 0;
+    case RTC_SET_TIME:
+      rtc = arg;
+      memset(&tm, 0, sizeof (tm));
+      tm.tm_sec = rtc->tm_sec;
+      tm.tm_min = rtc->tm_min;
+      tm.tm_hour = rtc->tm_hour;
+      tm.tm_mday = rtc->tm_mday;
+      tm.tm_mon = rtc->tm_mon;
+      tm.tm_year = rtc->tm_year;
+      t = timegm(&tm);
+      if (t == (time_t)-1) {
+        errno = EINVAL;
+        return -1;
+      }
+      /* Like the MC146818 RTC, the first update comes half a second
+         after setting the time */
+      settime.time = (t - start_date) + 0.5;
+      pthread_mutex_lock(&mutex);
+      make_request(NETSIM_REQ_SETRTC, &settime, sizeof (settime), &reply, sizeof (reply));
+      pthread_mutex_unlock(&mutex);
+      rtc_uie_second = floor(reply.rtc_time);
+      return 0;
+    case RTC_UIE_ON:
+      rtc_uie = 1;
+      rtc_uie_second = floor(get_rtc_time());
+      return 0;
+    case RTC_UIE_OFF:
+      rtc_uie = 0;
+      return 0;
+    default:
+      errno = ENOTTY;
+      return -1;
+  }
+}
+
+/* ================================================== */
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+  static int (*real_ioctl)(int fd, unsigned long request, ...);
+  va_list ap;
+  void *arg;
+
+  if (!real_ioctl)
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+  va_start(ap, request);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (initialised && fd >= 0 && fd == rtc_fd)
+    return rtc_ioctl(request, arg);
+
+  return real_ioctl(fd, request, arg);
+}
+
+/* ================================================== */
+
+ssize_t
+read(int fd, void *buf, size_t count)
+{
+  static ssize_t (*real_read)(int fd, void *buf, size_t count);
+  unsigned long data;
+  double second;
+
+  if (!real_read)
+    real_read = dlsym(RTLD_NEXT, "read");
+
+  if (!initialised || fd < 0 || fd != rtc_fd)
+    return real_read(fd, buf, count);
+
+  if (count < sizeof (data)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Report the number of updates since the last read */
+  second = floor(get_rtc_time());
+  if (!rtc_uie || second <= rtc_uie_second) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  rtc_interrupts = second - rtc_uie_second;
+  rtc_uie_second = second;
+
+  data = rtc_interrupts << 8 | RTC_UF | RTC_IRQF;
+  memcpy(buf, &data, sizeof (data));
+
+  return sizeof (data);
+}
+
+/* ================================================== */
+
+int
+close(int fd)
+{
+  struct Socket *s;
+
+  if (!real_close)
+    real_close = dlsym(RTLD_NEXT, "close");
+
+  if (fd >= 0 && fd == rtc_fd) {
+    rtc_fd = -1;
+    rtc_uie = 0;
+  }
+
+  if ((s = get_socket(fd))) {
+    pthread_mutex_lock(&mutex);
+    free_packets(s);
+    s->used = 0;
+    pthread_mutex_unlock(&mutex);
+  }
+
+  return real_close(fd);
+}
+
+/* ================================================== */
+/* Bind a Unix domain socket to a path, or an abstract address if only
+   the address family is specified */
+
+static int
+bind_unix(struct Socket *s, const struct sockaddr *addr, socklen_t len)
+{
+  char name[sizeof (((struct sockaddr_un *)NULL)->sun_path) + 1], buf[PATH_MAX];
+  const char *path;
+  FILE *f;
+
+  if (len < sizeof (sa_family_t) || addr->sa_family != AF_UNIX ||
+      (len > sizeof (sa_family_t) && (!get_unix_name(addr, len, name) || !name[0]))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex);
+
+  s->port = get_ephemeral_port();
+
+  if (len > sizeof (sa_family_t)) {
+    path = map_unix_path(name, buf, sizeof (buf));
+    if (access(path, F_OK) == 0) {
+      s->port = 0;
+      pthread_mutex_unlock(&mutex);
+      errno = EADDRINUSE;
+      return -1;
+    }
+
+    f = fopen(path, "w");
+    if (!f) {
+      s->port = 0;
+      pthread_mutex_unlock(&mutex);
+      return -1;
+    }
+    fprintf(f, "%d %u\n", node, (unsigned int)s->port);
+    fclose(f);
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+  static int (*real_bind)(int fd, const struct sockaddr *addr, socklen_t len);
+  const struct sockaddr_in *sin;
+  struct Socket *s;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_bind)
+      real_bind = dlsym(RTLD_NEXT, "bind");
+    return real_bind(fd, addr, len);
+  }
+
+  if (s->unix_domain)
+    return bind_unix(s, addr, len);
+
+  sin = (const struct sockaddr_in *)addr;
+  if (len < sizeof (*sin) || sin->sin_family != AF_INET) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex);
+  s->port = sin->sin_port ? ntohs(sin->sin_port) : get_ephemeral_port();
+  pthread_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+  const struct sockaddr_in *sin;
+  struct Socket *s;
+  uint32_t remote_addr;
+  uint16_t remote_port;
+
+  if (!real_connect)
+    real_connect = dlsym(RTLD_NEXT, "connect");
+
+  if (!(s = get_socket(fd)))
+    return real_connect(fd, addr, len);
+
+  if (s->unix_domain) {
+    if (!parse_unix_addr(addr, len, &remote_addr, &remote_port))
+      return -1;
+
+    pthread_mutex_lock(&mutex);
+    s->remote_addr = remote_addr;
+    s->remote_port = remote_port;
+    if (!s->port)
+      s->port = get_ephemeral_port();
+    pthread_mutex_unlock(&mutex);
+
+    return 0;
+  }
+
+  sin = (const struct sockaddr_in *)addr;
+
+  pthread_mutex_lock(&mutex);
+
+  if (sin->sin_family == AF_UNSPEC) {
+    s->remote_addr = 0;
+    s->remote_port = 0;
+  } else if (len >= sizeof (*sin) && sin->sin_family == AF_INET) {
+    s->remote_addr = map_loopback_addr(s, ntohl(sin->sin_addr.s_addr));
+    s->remote_port = ntohs(sin->sin_port);
+    if (!s->port)
+      s->port = get_ephemeral_port();
+  } else {
+    pthread_mutex_unlock(&mutex);
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+getsockname(int fd, struct sockaddr *addr, socklen_t *len)
+{
+  static int (*real_getsockname)(int fd, struct sockaddr *addr, socklen_t *len);
+  struct sockaddr_un sun;
+  struct sockaddr_in sin;
+  struct Socket *s;
+  socklen_t sun_len;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_getsockname)
+      real_getsockname = dlsym(RTLD_NEXT, "getsockname");
+    return real_getsockname(fd, addr, len);
+  }
+
+  if (s->unix_domain) {
+    sun_len = make_unix_addr(&sun, NETSIM_NET_ADDR | node, s->port);
+    memcpy(addr, &sun, *len < sun_len ? *len : sun_len);
+    *len = sun_len;
+    return 0;
+  }
+
+  memset(&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(s->remote_port ? NETSIM_NET_ADDR | node : INADDR_ANY);
+  sin.sin_port = htons(s->port);
+
+  memcpy(addr, &sin, *len < sizeof (sin) ? *len : sizeof (sin));
+  *len = sizeof (sin);
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen)
+{
+  static int (*real_setsockopt)(int fd, int level, int optname, const void *optval,
+                                socklen_t optlen);
+  struct Socket *s;
+  int value;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_setsockopt)
+      real_setsockopt = dlsym(RTLD_NEXT, "setsockopt");
+    return real_setsockopt(fd, level, optname, optval, optlen);
+  }
+
+  value = optlen >= sizeof (int) ? *(const int *)optval : 0;
+
+  if (level == SOL_SOCKET && optname == SO_TIMESTAMP)
+    s->timestamp = value;
+  else if (level == SOL_SOCKET && optname == SO_TIMESTAMPNS)
+    s->timestampns = value;
+  else if (level == IPPROTO_IP && optname == IP_PKTINFO)
+    s->pktinfo = value;
+  else if (level == SOL_SOCKET && optname == SO_PASSCRED)
+    s->passcred = value;
+
+  /* Other options are accepted and ignored */
+  return 0;
+}
+
+/* ================================================== */
+
+static ssize_t
+send_packet(struct Socket *s, const struct sockaddr *addr, socklen_t addr_len,
+            const struct iovec *iov, size_t iovlen)
+{
+  struct netsim_send send;
+  const struct sockaddr_in *sin;
+  size_t i, length;
+
+  if (addr && s->unix_domain) {
+    if (!parse_unix_addr(addr, addr_len, &send.dst_addr, &send.dst_port))
+      return -1;
+  } else if (addr) {
+    sin = (const struct sockaddr_in *)addr;
+    if (addr_len < sizeof (*sin) || sin->sin_family != AF_INET) {
+      errno = EINVAL;
+      return -1;
+    }
+    send.dst_addr = map_loopback_addr(s, ntohl(sin->sin_addr.s_addr));
+    send.dst_port = ntohs(sin->sin_port);
+  } else if (s->remote_port) {
+    send.dst_addr = s->remote_addr;
+    send.dst_port = s->remote_port;
+  } else {
+    errno = EDESTADDRREQ;
+    return -1;
+  }
+
+  for (i = length = 0; i < iovlen; i++) {
+    if (length + iov[i].iov_len > sizeof (send.data)) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+    memcpy(send.data + length, iov[i].iov_base, iov[i].iov_len);
+    length += iov[i].iov_len;
+  }
+
+  pthread_mutex_lock(&mutex);
+
+  if (!s->port)
+    s->port = get_ephemeral_port();
+
+  send.src_port = s->port;
+  send.uid = uid;
+  send.length = length;
+
+  make_request(NETSIM_REQ_SEND, &send, offsetof(struct netsim_send, data) + length, NULL, 0);
+
+  pthread_mutex_unlock(&mutex);
+
+  return length;
+}
+
+/* ================================================== */
+
+ssize_t
+sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr,
+       socklen_t addr_len)
+{
+  static ssize_t (*real_sendto)(int fd, const void *buf, size_t len, int flags,
+                                const struct sockaddr *addr, socklen_t addr_len);
+  struct Socket *s;
+  struct iovec iov;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_sendto)
+      real_sendto = dlsym(RTLD_NEXT, "sendto");
+    return real_sendto(fd, buf, len, flags, addr, addr_len);
+  }
+
+  iov.iov_base = (void *)buf;
+  iov.iov_len = len;
+
+  return send_packet(s, addr, addr_len, &iov, 1);
+}
+
+/* ================================================== */
+
+ssize_t
+send(int fd, const void *buf, size_t len, int flags)
+{
+  static ssize_t (*real_send)(int fd, const void *buf, size_t len, int flags);
+
+  if (!get_socket(fd)) {
+    if (!real_send)
+      real_send = dlsym(RTLD_NEXT, "send");
+    return real_send(fd, buf, len, flags);
+  }
+
+  return sendto(fd, buf, len, flags, NULL, 0);
+}
+
+/* ================================================== */
+
+ssize_t
+sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+  static ssize_t (*real_sendmsg)(int fd, const struct msghdr *msg, int flags);
+  struct Socket *s;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_sendmsg)
+      real_sendmsg = dlsym(RTLD_NEXT, "sendmsg");
+    return real_sendmsg(fd, msg, flags);
+  }
+
+  return send_packet(s, msg->msg_name, msg->msg_namelen, msg->msg_iov, msg->msg_iovlen);
+}
+
+/* ================================================== */
+
+int
+sendmmsg(int fd, struct mmsghdr *vmessages, unsigned int vlen, int flags)
+{
+  static int (*real_sendmmsg)(int fd, struct mmsghdr *vmessages, unsigned int vlen,
+                              int flags);
+  struct Socket *s;
+  unsigned int i;
+  ssize_t r;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_sendmmsg)
+      real_sendmmsg = dlsym(RTLD_NEXT, "sendmmsg");
+    return real_sendmmsg(fd, vmessages, vlen, flags);
+  }
+
+  for (i = 0; i < vlen; i++) {
+    r = sendmsg(fd, &vmessages[i].msg_hdr, flags);
+    if (r < 0)
+      return i > 0 ? (int)i : -1;
+    vmessages[i].msg_len = r;
+  }
+
+  return vlen;
+}
+
+/* ================================================== */
+/* Get all packets received by the node from the simulator and queue them
+   in the matching sockets */
+
+static void
+fetch_packets(void)
+{
+  struct netsim_recv_reply reply;
+  struct Packet *packet;
+  struct Socket *s;
+  int i, found;
+
+  while (1) {
+    make_request(NETSIM_REQ_RECV, NULL, 0, &reply, sizeof (reply));
+    if (!reply.valid)
+      break;
+
+    /* Prefer a connected socket */
+    for (i = 0, found = -1; i < MAX_SOCKETS; i++) {
+      s = &sockets[i];
+      if (!s->used || s->port != reply.dst_port)
+        continue;
+      if (s->remote_port) {
+        if (s->remote_addr == reply.src_addr && s->remote_port == reply.src_port) {
+          found = i;
+          break;
+        }
+      } else if (found < 0) {
+        found = i;
+      }
+    }
+
+    if (found < 0 || reply.length > NETSIM_MAX_PACKET)
+      continue;
+
+    packet = malloc(sizeof (*packet) + reply.length);
+    if (!packet)
+      fail("could not allocate packet");
+
+    packet->next = NULL;
+    packet->src_addr = reply.src_addr;
+    packet->dst_addr = reply.dst_addr;
+    packet->src_port = reply.src_port;
+    packet->dst_port = reply.dst_port;
+    packet->uid = reply.uid;
+    packet->time = reply.time;
+    packet->length = reply.length;
+    memcpy(packet->data, reply.data, reply.length);
+
+    s = &sockets[found];
+    if (s->tail)
+      s->tail->next = packet;
+    else
+      s->head = packet;
+    s->tail = packet;
+  }
+}
+
+/* ================================================== */
+
+static void
+add_cmsg(struct msghdr *msg, size_t *length, int level, int type, const void *data,
+         size_t data_length)
+{
+  struct cmsghdr *cmsg;
+
+  if (*length + CMSG_SPACE(data_length) > msg->msg_controllen) {
+    msg->msg_flags |= MSG_CTRUNC;
+    return;
+  }
+
+  cmsg = (struct cmsghdr *)((char *)msg->msg_control + *length);
+  memset(cmsg, 0, CMSG_SPACE(data_length));
+  cmsg->cmsg_level = level;
+  cmsg->cmsg_type = type;
+  cmsg->cmsg_len = CMSG_LEN(data_length);
+  memcpy(CMSG_DATA(cmsg), data, data_length);
+
+  *length += CMSG_SPACE(data_length);
+}
+
+/* ================================================== */
+
+static ssize_t
+receive_packet(struct Socket *s, struct msghdr *msg, int flags)
+{
+  struct sockaddr_un sun;
+  struct sockaddr_in sin;
+  struct in_pktinfo pktinfo;
+  struct ucred ucred;
+  struct timespec ts;
+  struct timeval tv;
+  struct Packet *packet;
+  size_t i, length, n, control_length;
+  socklen_t sun_len;
+
+  if (flags & MSG_ERRQUEUE) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex);
+
+  if (!s->head)
+    fetch_packets();
+
+  packet = s->head;
+  if (!packet) {
+    pthread_mutex_unlock(&mutex);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (!(flags & MSG_PEEK)) {
+    s->head = packet->next;
+    if (!s->head)
+      s->tail = NULL;
+  }
+
+  pthread_mutex_unlock(&mutex);
+
+  msg->msg_flags = 0;
+
+  for (i = length = 0; i < msg->msg_iovlen && length < packet->length; i++) {
+    n = packet->length - length;
+    if (n > msg->msg_iov[i].iov_len)
+      n = msg->msg_iov[i].iov_len;
+    memcpy(msg->msg_iov[i].iov_base, packet->data + length, n);
+    length += n;
+  }
+  if (length < packet->length)
+    msg->msg_flags |= MSG_TRUNC;
+
+  if (msg->msg_name && s->unix_domain) {
+    sun_len = make_unix_addr(&sun, packet->src_addr, packet->src_port);
+    memcpy(msg->msg_name, &sun, msg->msg_namelen < sun_len ? msg->msg_namelen : sun_len);
+    msg->msg_namelen = sun_len;
+  } else if (msg->msg_name) {
+    memset(&sin, 0, sizeof (sin));
+    sin.sin_family = AF_INET;
+    if (s->loopback && packet->src_addr == (NETSIM_NET_ADDR | local_node))
+      sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    else
+      sin.sin_addr.s_addr = htonl(packet->src_addr);
+    sin.sin_port = htons(packet->src_port);
+    memcpy(msg->msg_name, &sin,
+           msg->msg_namelen < sizeof (sin) ? msg->msg_namelen : sizeof (sin));
+    msg->msg_namelen = sizeof (sin);
+  }
+
+  control_length = 0;
+
+  if (msg->msg_control) {
+    double_to_timespec(packet->time, &ts);
+
+    if (s->timestampns) {
+      add_cmsg(msg, &control_length, SOL_SOCKET, SCM_TIMESTAMPNS, &ts, sizeof (ts));
+    } else if (s->timestamp) {
+      tv.tv_sec = ts.tv_sec;
+      tv.tv_usec = ts.tv_nsec / 1000;
+      add_cmsg(msg, &control_length, SOL_SOCKET, SCM_TIMESTAMP, &tv, sizeof (tv));
+    }
+
+    if (s->pktinfo) {
+      memset(&pktinfo, 0, sizeof (pktinfo));
+      pktinfo.ipi_ifindex = 1;
+      pktinfo.ipi_spec_dst.s_addr = htonl(NETSIM_NET_ADDR | node);
+      pktinfo.ipi_addr.s_addr = htonl(packet->dst_addr);
+      add_cmsg(msg, &control_length, IPPROTO_IP, IP_PKTINFO, &pktinfo, sizeof (pktinfo));
+    }
+
+    if (s->unix_domain && s->passcred) {
+      ucred.pid = 0;
+      ucred.uid = packet->uid;
+      ucred.gid = packet->uid;
+      add_cmsg(msg, &control_length, SOL_SOCKET, SCM_CREDENTIALS, &ucred, sizeof (ucred));
+    }
+  }
+
+  msg->msg_controllen = control_length;
+
+  if (!(flags & MSG_PEEK))
+    free(packet);
+
+  return length;
+}
+
+/* ================================================== */
+
+ssize_t
+recvmsg(int fd, struct msghdr *msg, int flags)
+{
+  static ssize_t (*real_recvmsg)(int fd, struct msghdr *msg, int flags);
+  struct Socket *s;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_recvmsg)
+      real_recvmsg = dlsym(RTLD_NEXT, "recvmsg");
+    return real_recvmsg(fd, msg, flags);
+  }
+
+  return receive_packet(s, msg, flags);
+}
+
+/* ================================================== */
+
+ssize_t
+recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addr_len)
+{
+  static ssize_t (*real_recvfrom)(int fd, void *buf, size_t len, int flags,
+                                  struct sockaddr *addr, socklen_t *addr_len);
+  struct Socket *s;
+  struct msghdr msg;
+  struct iovec iov;
+  ssize_t r;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_recvfrom)
+      real_recvfrom = dlsym(RTLD_NEXT, "recvfrom");
+    return real_recvfrom(fd, buf, len, flags, addr, addr_len);
+  }
+
+  iov.iov_base = buf;
+  iov.iov_len = len;
+
+  memset(&msg, 0, sizeof (msg));
+  msg.msg_name = addr;
+  msg.msg_namelen = addr && addr_len ? *addr_len : 0;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  r = receive_packet(s, &msg, flags);
+
+  if (r >= 0 && addr && addr_len)
+    *addr_len = msg.msg_namelen;
+
+  return r;
+}
+
+/* ================================================== */
+
+ssize_t
+recv(int fd, void *buf, size_t len, int flags)
+{
+  static ssize_t (*real_recv)(int fd, void *buf, size_t len, int flags);
+
+  if (!get_socket(fd)) {
+    if (!real_recv)
+      real_recv = dlsym(RTLD_NEXT, "recv");
+    return real_recv(fd, buf, len, flags);
+  }
+
+  return recvfrom(fd, buf, len, flags, NULL, NULL);
+}
+
+/* ================================================== */
+
+int
+recvmmsg(int fd, struct mmsghdr *vmessages, unsigned int vlen, int flags,
+         struct timespec *timeout)
+{
+  static int (*real_recvmmsg)(int fd, struct mmsghdr *vmessages, unsigned int vlen,
+                              int flags, struct timespec *timeout);
+  struct Socket *s;
+  unsigned int i;
+  ssize_t r;
+
+  if (!(s = get_socket(fd))) {
+    if (!real_recvmmsg)
+      real_recvmmsg = dlsym(RTLD_NEXT, "recvmmsg");
+    return real_recvmmsg(fd, vmessages, vlen, flags, timeout);
+  }
+
+  for (i = 0; i < vlen; i++) {
+    r = receive_packet(s, &vmessages[i].msg_hdr, flags);
+    if (r < 0)
+      return i > 0 ? (int)i : -1;
+    vmessages[i].msg_len = r;
+  }
+
+  return vlen;
+}
+
+/* ================================================== */
+
+int
+getaddrinfo(const char *node_name, const char *service, const struct addrinfo *hints,
+            struct addrinfo **res)
+{
+  static int (*real_getaddrinfo)(const char *node_name, const char *service,
+                                 const struct addrinfo *hints, struct addrinfo **res);
+  struct addrinfo numeric_hints;
+  char addr[16], domain[8];
+  int addr_node;
+
+  if (!real_getaddrinfo)
+    real_getaddrinfo = dlsym(RTLD_NEXT, "getaddrinfo");
+
+  if (!initialised || !node_name ||
+      sscanf(node_name, "node%d.%7s", &addr_node, domain) != 2 || strcmp(domain, "net"))
+    return real_getaddrinfo(node_name, service, hints, res);
+
+  if (addr_node < 1 || addr_node > NETSIM_MAX_NODES ||
+      (hints && hints->ai_family != AF_UNSPEC && hints->ai_family != AF_INET))
+    return EAI_NONAME;
+
+  /* Let the C library make the result from the address */
+  snprintf(addr, sizeof (addr), "%u.%u.%u.%d", NETSIM_NET_ADDR >> 24,
+           (NETSIM_NET_ADDR >> 16) & 0xff, (NETSIM_NET_ADDR >> 8) & 0xff, addr_node);
+
+  memset(&numeric_hints, 0, sizeof (numeric_hints));
+  if (hints)
+    numeric_hints = *hints;
+  numeric_hints.ai_family = AF_INET;
+  numeric_hints.ai_flags |= AI_NUMERICHOST;
+
+  return real_getaddrinfo(addr, service, &numeric_hints, res);
+}
+
+/* ================================================== */
+/* Wait in virtual time until a packet is received by one of the selected
+   sockets, or the timeout (in seconds, negative for no timeout) expires.
+   Return 0 on timeout, 1 if a packet was received and -1 if the
+   simulation is terminating. */
+
+static int
+wait_for_packet(struct Socket **selected, int n_selected, double timeout)
+{
+  struct netsim_select select;
+  struct netsim_select_reply reply;
+  int i, n_ports;
+
+  pthread_mutex_lock(&mutex);
+
+  for (i = n_ports = 0; i < n_selected; i++) {
+    if (selected[i]->head)
+      break;
+    if (selected[i]->port && n_ports < NETSIM_MAX_SELECT_PORTS)
+      select.ports[n_ports++] = selected[i]->port;
+  }
+
+  /* A packet already queued */
+  if (i < n_selected) {
+    pthread_mutex_unlock(&mutex);
+    return 1;
+  }
+
+  select.timeout = timeout;
+  select.n_ports = n_ports;
+
+  make_request(NETSIM_REQ_SELECT, &select, sizeof (select), &reply, sizeof (reply));
+
+  if (reply.ret == NETSIM_SELECT_PACKET)
+    fetch_packets();
+
+  pthread_mutex_unlock(&mutex);
+
+  if (reply.ret == NETSIM_SELECT_TERMINATE)
+    return -1;
+
+  return reply.ret == NETSIM_SELECT_PACKET;
+}
+
+/* ================================================== */
+
+static void
+terminate(void)
+{
+  /* Let the program exit as if it was killed */
+  raise(SIGTERM);
+  errno = EINTR;
+}
+
+/* ================================================== */
+
+int
+select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+       struct timeval *timeout)
+{
+  struct Socket *selected[MAX_SOCKETS];
+  fd_set real_fds, real_readfds, sim_readfds;
+  struct timeval real_timeout;
+  double virtual_timeout, wait, rtc_wait;
+  int i, n_selected, n_real, r, ready, rtc_selected, rtc_ready;
+
+  if (!real_select)
+    real_select = dlsym(RTLD_NEXT, "select");
+
+  if (!initialised)
+    return real_select(nfds, readfds, writefds, exceptfds, timeout);
+
+  FD_ZERO(&real_fds);
+  FD_ZERO(&real_readfds);
+  FD_ZERO(&sim_readfds);
+
+  rtc_selected = rtc_ready = 0;
+
+  for (i = n_selected = n_real = 0; i < nfds && readfds; i++) {
+    if (!FD_ISSET(i, readfds))
+      continue;
+    if (i == rtc_fd) {
+      rtc_selected = 1;
+    } else if (get_socket(i)) {
+      selected[n_selected++] = &sockets[i];
+    } else {
+      FD_SET(i, &real_fds);
+      n_real++;
+    }
+  }
+
+  /* Simulated sockets are always writable */
+  for (i = ready = 0; i < nfds && writefds; i++) {
+    if (FD_ISSET(i, writefds) && get_socket(i))
+      ready++;
+  }
+
+  virtual_timeout = timeout ? timeout->tv_sec + timeout->tv_usec * 1.0e-6 : -1.0;
+
+  while (1) {
+    if (n_real > 0) {
+      /* Give the real descriptors (e.g. pipe of the asynchronous resolver)
+         some real time before the virtual time is advanced, so the result
+         doesn't depend on the speed of the system */
+      real_readfds = real_fds;
+      real_timeout.tv_sec = REAL_FD_WAIT;
+      real_timeout.tv_usec = 0;
+      r = real_select(nfds, &real_readfds, NULL, NULL, &real_timeout);
+      if (r < 0)
+        return r;
+      ready += r;
+    }
+
+    /* Check the update interrupt of the RTC */
+    rtc_wait = rtc_selected ? get_rtc_interrupt_wait() : -1.0;
+    if (rtc_wait == 0.0) {
+      rtc_ready = 1;
+      ready++;
+    }
+
+    /* Don't wait too long in virtual time before checking the real
+       descriptors again */
+    wait = ready ? 0.0 : virtual_timeout;
+    if (n_real > 0 && (wait < 0.0 || wait > MAX_REAL_FD_TIMEOUT))
+      wait = MAX_REAL_FD_TIMEOUT;
+    if (rtc_wait > 0.0 && (wait < 0.0 || wait > rtc_wait))
+      wait = rtc_wait;
+
+    r = wait_for_packet(selected, n_selected, wait);
+    if (r < 0) {
+      terminate();
+      return -1;
+    }
+
+    for (i = 0; i < n_selected; i++) {
+      if (selected[i]->head) {
+        FD_SET(selected[i] - sockets, &sim_readfds);
+        ready++;
+      }
+    }
+
+    if (ready || wait == virtual_timeout)
+      break;
+
+    if (virtual_timeout > 0.0)
+      virtual_timeout -= wait;
+  }
+
+  if (readfds) {
+    FD_ZERO(readfds);
+    for (i = 0; i < nfds; i++) {
+      if (FD_ISSET(i, &real_readfds) || FD_ISSET(i, &sim_readfds) ||
+          (rtc_ready && i == rtc_fd))
+        FD_SET(i, readfds);
+    }
+  }
+
+  if (writefds) {
+    for (i = 0; i < nfds; i++) {
+      if (FD_ISSET(i, writefds) && !get_socket(i))
+        FD_CLR(i, writefds);
+    }
+  }
+
+  if (exceptfds)
+    FD_ZERO(exceptfds);
+
+  return ready;
+}
+
+/* ================================================== */
+
+static int
+sleep_virtual(double interval)
+{
+  if (wait_for_packet(NULL, 0, interval) < 0) {
+    terminate();
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+int
+nanosleep(const struct timespec *req, struct timespec *rem)
+{
+  static int (*real_nanosleep)(const struct timespec *req, struct timespec *rem);
+
+  if (!initialised) {
+    if (!real_nanosleep)
+      real_nanosleep = dlsym(RTLD_NEXT, "nanosleep");
+    return real_nanosleep(req, rem);
+  }
+
+  if (rem)
+    rem->tv_sec = rem->tv_nsec = 0;
+
+  return sleep_virtual(req->tv_sec + req->tv_nsec * 1.0e-9);
+}
+
+/* ================================================== */
+
+int
+usleep(useconds_t usec)
+{
+  static int (*real_usleep)(useconds_t usec);
+
+  if (!initialised) {
+    if (!real_usleep)
+      real_usleep = dlsym(RTLD_NEXT, "usleep");
+    return real_usleep(usec);
+  }
+
+  return sleep_virtual(usec * 1.0e-6);
+}
+
+/* ================================================== */
+
+unsigned int
+sleep(unsigned int seconds)
+{
+  static unsigned int (*real_sleep)(unsigned int seconds);
+
+  if (!initialised) {
+    if (!real_sleep)
+      real_sleep = dlsym(RTLD_NEXT, "sleep");
+    return real_sleep(seconds);
+  }
+
+  return sleep_virtual(seconds) < 0 ? seconds : 0;
+}
+
+/* ================================================== */
+
+int
+shmget(key_t key, size_t size, int shmflg)
+{
+  static int (*real_shmget)(key_t key, size_t size, int shmflg);
+
+  if (initialised && key >= NETSIM_SHM_KEY && key < NETSIM_SHM_KEY + NETSIM_SHM_SEGMENTS &&
+      size <= sizeof (struct shmTime))
+    return SHM_ID_BASE + (key - NETSIM_SHM_KEY);
+
+  if (!real_shmget)
+    real_shmget = dlsym(RTLD_NEXT, "shmget");
+
+  return real_shmget(key, size, shmflg);
+}
+
+/* ================================================== */
+
+void *
+shmat(int shmid, const void *shmaddr, int shmflg)
+{
+  static void *(*real_shmat)(int shmid, const void *shmaddr, int shmflg);
+  int i;
+
+  if (initialised && shmid >= SHM_ID_BASE && shmid < SHM_ID_BASE + NETSIM_SHM_SEGMENTS) {
+    i = shmid - SHM_ID_BASE;
+    shm_attached[i] = 1;
+    return &shm_segments[i];
+  }
+
+  if (!real_shmat)
+    real_shmat = dlsym(RTLD_NEXT, "shmat");
+
+  return real_shmat(shmid, shmaddr, shmflg);
+}
+
+/* ================================================== */
+
+int
+shmdt(const void *shmaddr)
+{
+  static int (*real_shmdt)(const void *shmaddr);
+  int i;
+
+  for (i = 0; i < NETSIM_SHM_SEGMENTS; i++) {
+    if (shmaddr == &shm_segments[i]) {
+      shm_attached[i] = 0;
+      return 0;
+    }
+  }
+
+  if (!real_shmdt)
+    real_shmdt = dlsym(RTLD_NEXT, "shmdt");
+
+  return real_shmdt(shmaddr);
+}
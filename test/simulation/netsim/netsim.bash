@@ -0,0 +1,139 @@
+# Copyright (C) 2026  agent <agent@local>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Functions for running simulations with the in-tree network simulator.
+# They have the same interface as the functions in clknetsim.bash.
+
+mkdir -p tmp
+
+client_pids=""
+
+# Start chronyd or chronyc as the specified node.  The chronyd
+# configuration is extended to allow NTP and command access from the
+# simulated network, chronyc gets the configuration lines as commands.
+# Unix domain sockets are created in the tmp directory.
+start_client() {
+	local node=$1 client=$2 config=$3 suffix=$4 opts=$5
+	local args=() line
+
+	rm -f tmp/log.$node tmp/conf.$node
+
+	case $client in
+		chronyd)
+			cat > tmp/conf.$node <<-EOF2
+				pidfile tmp/pidfile.$node
+				allow
+				cmdallow
+				bindcmdaddress 0.0.0.0
+				bindcmdaddress /
+				$config
+			EOF2
+			args=(-d -f tmp/conf.$node $opts)
+			;;
+		chronyc)
+			args=($opts -m)
+			while read -r line; do
+				[ -n "$line" ] && args+=("$line")
+			done <<< "$config"
+			;;
+		*)
+			echo "Unknown client $client" >&2
+			return 1
+			;;
+	esac
+
+	LD_PRELOAD=$NETSIM_PATH/netsim.so \
+		CLKNETSIM_NODE=$node CLKNETSIM_SOCKET=tmp/sock \
+		CLKNETSIM_UNIX_DIR=$PWD/tmp \
+		$client$suffix "${args[@]}" &> tmp/log.$node &
+
+	client_pids="$client_pids $!"
+
+	return 0
+}
+
+# Run the simulation with the specified number of nodes and options of
+# the simulator.  The statistics are written to tmp/stats.
+start_server() {
+	local nodes=$1 ret=0
+	shift
+
+	$NETSIM_PATH/netsim "$@" -s tmp/sock tmp/conf $nodes > tmp/stats 2> tmp/log
+	ret=$?
+
+	[ $ret -ne 0 ] && kill $client_pids &> /dev/null
+	wait $client_pids &> /dev/null
+	client_pids=""
+
+	return $ret
+}
+
+# Print the number of the first update from which the offset and frequency
+# of the node stay within the limits, or -1 if they don't
+find_sync() {
+	local offlog=$1 freqlog=$2 index=$3 offsync=$4 freqsync=$5 smooth=$6
+
+	[ -z "$smooth" ] && smooth=0.05
+
+	paste <(cut -f $index $offlog) <(cut -f $index $freqlog) | \
+		awk -v offsync=$offsync -v freqsync=$freqsync -v smooth=$smooth '
+		BEGIN {
+			lines = 0
+			unsync = 0
+		}
+		{
+			off = $1 < 0 ? -$1 : $1
+			freq = $2 < 0 ? -$2 : $2
+			if (lines == 0) {
+				avgoff = off
+				avgfreq = freq
+			} else {
+				avgoff += smooth * (off - avgoff)
+				avgfreq += smooth * (freq - avgfreq)
+			}
+			lines++
+			if (avgoff > offsync || avgfreq > freqsync)
+				unsync = lines
+		}
+		END {
+			print unsync < lines ? unsync + 1 : -1
+		}'
+}
+
+# Print a statistic of the node (or of all nodes if no index is specified)
+get_stat() {
+	local statname=$1 index=$2
+
+	if [ -z "$index" ]; then
+		echo $(grep "^$statname:" tmp/stats | cut -f 2-)
+	else
+		grep "^$statname:" tmp/stats | cut -f $[$index + 1]
+	fi
+}
+
+# Check if the value is within the limits with an optional tolerance
+check_stat() {
+	local value=$1 min=$2 max=$3 tolerance=$4
+
+	[ -z "$tolerance" ] && tolerance=0.0
+
+	awk "BEGIN {
+		value = \"$value\" == \"inf\" ? 1e300 : $value + 0
+		min = \"$min\" == \"inf\" ? 1e300 : $min + 0
+		max = \"$max\" == \"inf\" ? 1e300 : $max + 0
+		tolerance = $tolerance
+		exit !(value >= min - tolerance && value <= max + tolerance)
+	}"
+}
@@ -0,0 +1,157 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Protocol between the network simulator and the library preloaded in
+  the simulated programs.  Each program has one connection (a Unix domain
+  SOCK_SEQPACKET socket) to the simulator.  The program sends a request
+  and waits for the reply, the simulator runs only one program at a time
+  and the virtual time doesn't advance (except for a small increment on
+  each reading of the clock) until the program waits in select().
+
+  */
+
+#ifndef GOT_NETSIM_H
+#define GOT_NETSIM_H
+
+#include <stdint.h>
+#include <sys/timex.h>
+
+/* Network of the simulated nodes, node N has address 192.168.123.N */
+#define NETSIM_NET_ADDR 0xc0a87b00U
+#define NETSIM_NET_MASK 0xffffff00U
+#define NETSIM_BROADCAST_ADDR (NETSIM_NET_ADDR | 0xff)
+
+#define NETSIM_MAX_NODES 254
+#define NETSIM_MAX_PACKET 4096
+#define NETSIM_MAX_SELECT_PORTS 64
+
+/* Key of the first SHM refclock segment (as used by gpsd and chronyd) */
+#define NETSIM_SHM_KEY 0x4e545030
+#define NETSIM_SHM_SEGMENTS 4
+
+#define NETSIM_REQ_REGISTER 1
+#define NETSIM_REQ_GETTIME 2
+#define NETSIM_REQ_SETTIME 3
+#define NETSIM_REQ_ADJTIMEX 4
+#define NETSIM_REQ_SELECT 5
+#define NETSIM_REQ_SEND 6
+#define NETSIM_REQ_RECV 7
+#define NETSIM_REQ_SETRTC 8
+
+/* Results of the select request */
+#define NETSIM_SELECT_TIMEOUT 0
+#define NETSIM_SELECT_PACKET 1
+#define NETSIM_SELECT_TERMINATE 2
+
+struct netsim_register {
+  int32_t node;
+};
+
+struct netsim_settime {
+  /* Seconds since the start date */
+  double time;
+};
+
+struct netsim_adjtimex {
+  struct timex timex;
+};
+
+struct netsim_select {
+  /* Timeout in seconds of the node's clock, negative for no timeout */
+  double timeout;
+  int32_t n_ports;
+  uint16_t ports[NETSIM_MAX_SELECT_PORTS];
+};
+
+struct netsim_send {
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+  /* User ID of the sender, received as credentials on Unix domain sockets */
+  uint32_t uid;
+  uint32_t length;
+  unsigned char data[NETSIM_MAX_PACKET];
+};
+
+struct netsim_request {
+  int32_t type;
+  int32_t _pad;
+  union {
+    struct netsim_register reg;
+    struct netsim_settime settime;
+    struct netsim_adjtimex adjtimex;
+    struct netsim_select select;
+    struct netsim_send send;
+  } data;
+};
+
+struct netsim_time_reply {
+  /* Start date of the simulation (Unix time) */
+  int64_t start_date;
+  /* Real-time clock of the node in seconds since the start date */
+  double realtime;
+  /* Monotonic clock of the node */
+  double monotonic;
+  /* Last sample of the reference clock, the id is incremented with each
+     new sample */
+  uint32_t refclock_id;
+  int32_t _pad;
+  double refclock_time;
+  double refclock_receive_time;
+  /* Real-time clock (RTC) of the node in seconds since the start date */
+  double rtc_time;
+};
+
+struct netsim_adjtimex_reply {
+  int32_t ret;
+  int32_t _pad;
+  struct timex timex;
+};
+
+struct netsim_select_reply {
+  int32_t ret;
+};
+
+struct netsim_recv_reply {
+  /* Zero if there are no more packets waiting for the node */
+  int32_t valid;
+  uint32_t src_addr;
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t uid;
+  int32_t _pad;
+  /* Time of the node's clock when the packet was received */
+  double time;
+  uint32_t length;
+  unsigned char data[NETSIM_MAX_PACKET];
+};
+
+union netsim_reply {
+  struct netsim_time_reply time;
+  struct netsim_adjtimex_reply adjtimex;
+  struct netsim_select_reply select;
+  struct netsim_recv_reply recv;
+};
+
+#endif /* GOT_NETSIM_H */
@@ -0,0 +1,1850 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Simulator of a network of computers running chronyd or chronyc in
+  virtual time.  The programs are started with the netsim.so library
+  preloaded, which forwards their system calls working with the clock
+  and the network to the simulator.
+
+  Each node has a clock with a configurable frequency offset, which is
+  controlled by a model of the Linux kernel (frequency and tick, offset
+  slewing, PLL, leap seconds).  Packets sent between the nodes are
+  delayed by configurable random delays.  The nodes are run one at a
+  time in the order of their numbers, so a simulation with the same
+  configuration and random seed always gives the same results.
+
+  The configuration file has lines in the form "node<N>_<key> = <expr>",
+  where the key is one of freq (frequency offset of the clock), step
+  (time step made in each update), offset (initial offset of the clock),
+  start (start time of the program), refclock (offset of samples of the
+  SHM reference clock), shift_pll (SHIFT_PLL of the kernel PLL), rtc
+  (initial offset of the RTC), rtcfreq (frequency offset of the RTC) and
+  delay<M> (delay of packets sent to node M, negative value drops the
+  packet).  The expressions are in a Lisp-like syntax, e.g.
+  "(+ 1e-4 (* 1e-5 (exponential)))".
+
+  */
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timex.h>
+#include <sys/un.h>
+
+#include "netsim.h"
+
+/* Increment of the virtual time on each reading of the clock, which
+   allows the programs to measure the precision of the clock */
+#define CLOCK_READ_STEP 1.0e-7
+
+/* Tolerance in comparison of the node's clock with its select deadline */
+#define DEADLINE_EPS 1.0e-9
+
+/* Rate of the singleshot offset adjustment (500 ppm) */
+#define SLEW_RATE 500.0e-6
+
+/* Parameters of the simulated kernel (HZ=100) */
+#define NOMINAL_TICK 10000
+#define MIN_TICK 9000
+#define MAX_TICK 11000
+#define MAX_FREQ 500.0
+#define MAX_PHASE 0.5
+#define PHASE_LIMIT 16000000
+#define MAX_TIME_CONSTANT 10
+#define MIN_FLL_SEC 256
+#define MAX_FLL_SEC 2048
+#define SHIFT_FLL 2
+
+#ifndef ADJ_ADJTIME
+#define ADJ_ADJTIME 0x8000
+#endif
+#ifndef ADJ_OFFSET_READONLY
+#define ADJ_OFFSET_READONLY 0x2000
+#endif
+
+#define MONOTONIC_BASE 10000.0
+
+#define SECS_PER_DAY 86400
+
+/* Jan 1 2010 */
+#define DEFAULT_START_DATE 1262304000
+
+/* Real time (in milliseconds) to wait for the programs to connect */
+#define CONNECT_TIMEOUT 30000
+
+/* Number of select requests answered with a termination before the
+   connection is closed */
+#define MAX_TERMINATIONS 3
+
+/* ================================================== */
+
+typedef enum {
+  EXPR_NUMBER,
+  EXPR_TIME,
+  EXPR_FROM,
+  EXPR_TO,
+  EXPR_ADD,
+  EXPR_SUB,
+  EXPR_MUL,
+  EXPR_DIV,
+  EXPR_MOD,
+  EXPR_MIN,
+  EXPR_MAX,
+  EXPR_SUM,
+  EXPR_EQUAL,
+  EXPR_UNIFORM,
+  EXPR_NORMAL,
+  EXPR_EXPONENTIAL
+} ExprType;
+
+struct Expr {
+  ExprType type;
+  /* Value of a number, or state of the sum function */
+  double value;
+  int n_args;
+  struct Expr **args;
+};
+
+struct ExprVars {
+  double time;
+  int from;
+  int to;
+};
+
+static const struct {
+  const char *name;
+  ExprType type;
+  int min_args;
+  int max_args;
+} functions[] = {
+  { "+", EXPR_ADD, 1, -1 },
+  { "-", EXPR_SUB, 1, -1 },
+  { "*", EXPR_MUL, 1, -1 },
+  { "/", EXPR_DIV, 2, -1 },
+  { "%", EXPR_MOD, 2, 2 },
+  { "min", EXPR_MIN, 1, -1 },
+  { "max", EXPR_MAX, 1, -1 },
+  { "sum", EXPR_SUM, 1, 1 },
+  { "equal", EXPR_EQUAL, 2, -1 },
+  { "uniform", EXPR_UNIFORM, 0, 0 },
+  { "normal", EXPR_NORMAL, 0, 0 },
+  { "exponential", EXPR_EXPONENTIAL, 0, 0 },
+  { NULL, 0, 0, 0 }
+};
+
+typedef enum {
+  NODE_NEW,             /* Program not connected yet */
+  NODE_STARTING,        /* Waiting for the start time */
+  NODE_RUNNING,         /* Running */
+  NODE_WAITING,         /* Waiting in select() */
+  NODE_EXITED           /* Connection closed */
+} NodeState;
+
+struct Packet {
+  struct Packet *next;
+  /* True time of the arrival */
+  double arrival;
+  /* Time of the receiving node's clock at the arrival */
+  double rx_time;
+  int from;
+  int to;
+  uint32_t src_addr;
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+  uint32_t uid;
+  uint32_t length;
+  unsigned char data[];
+};
+
+struct PacketStats {
+  unsigned long count;
+  double first;
+  double last;
+  double min_interval;
+};
+
+struct Node {
+  int id;
+  int fd;
+  NodeState state;
+
+  /* Configuration */
+  struct Expr *freq_expr;
+  struct Expr *step_expr;
+  struct Expr *offset_expr;
+  struct Expr *start_expr;
+  struct Expr *refclock_expr;
+  struct Expr *rtc_expr;
+  struct Expr **delay_exprs;
+  int shift_pll;
+  double rtc_freq;
+  double start;
+
+  /* Offset of the clock from the true time is kept in two parts, the
+     sum of all steps (including the initial offset) and the phase
+     accumulated from the frequency offset and slewing, which is also the
+     offset of the monotonic clock.  The frequency offset of the
+     oscillator is updated in each tick. */
+  double steps;
+  double phase;
+  double freq;
+
+  /* State of the kernel */
+  long tick;
+  double kernel_freq;
+  double slew_offset;
+  double pll_offset;
+  double pll_rate;
+  double pll_reftime;
+  int status;
+  int time_constant;
+  int time_state;
+  long maxerror;
+  long esterror;
+
+  /* Current select request */
+  int has_deadline;
+  double deadline;
+  int n_ports;
+  uint16_t ports[NETSIM_MAX_SELECT_PORTS];
+  int terminations;
+
+  /* Packets waiting to be received by the program */
+  struct Packet *rx_head;
+  struct Packet *rx_tail;
+
+  /* Last sample of the reference clock */
+  uint32_t refclock_id;
+  double refclock_time;
+  double refclock_receive_time;
+
+  /* Offset of the RTC from the true time at the time when it was set */
+  double rtc_offset;
+  double rtc_set_time;
+
+  /* Statistics */
+  unsigned long samples;
+  double offset_sum2;
+  double max_offset;
+  double freq_sum2;
+  double max_freq;
+  struct PacketStats in;
+  struct PacketStats out;
+};
+
+/* ================================================== */
+
+static struct Node *nodes;
+static int n_nodes;
+
+/* True time since the start of the simulation */
+static double now;
+
+static int64_t start_date;
+static double limit;
+static double stats_start;
+static double update_rate;
+static int terminating;
+
+static unsigned long n_ticks;
+static unsigned long n_seconds;
+
+/* Packets which are on the way, ordered by their arrival */
+static struct Packet *in_flight;
+
+static FILE *offset_log;
+static FILE *freq_log;
+static FILE *packet_log;
+
+static uint64_t random_state;
+
+/* ================================================== */
+
+static double
+get_uniform(void)
+{
+  uint64_t z;
+
+  /* splitmix64 */
+  random_state += 0x9e3779b97f4a7c15ULL;
+  z = random_state;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+
+  return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* ================================================== */
+
+static double
+get_normal(void)
+{
+  double u1, u2;
+
+  do {
+    u1 = get_uniform();
+  } while (u1 <= 0.0);
+  u2 = get_uniform();
+
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* ================================================== */
+
+static double
+get_exponential(void)
+{
+  double u;
+
+  do {
+    u = get_uniform();
+  } while (u <= 0.0);
+
+  return -log(u);
+}
+
+/* ================================================== */
+
+static const char *
+skip_space(const char *s)
+{
+  while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+    s++;
+  return s;
+}
+
+/* ================================================== */
+
+static int
+get_token(const char **s, char *buf, int len)
+{
+  int i;
+
+  *s = skip_space(*s);
+
+  for (i = 0; **s && !strchr(" \t\r\n()", **s); (*s)++) {
+    if (i + 1 >= len)
+      return 0;
+    buf[i++] = **s;
+  }
+  buf[i] = '\0';
+
+  return i > 0;
+}
+
+/* ================================================== */
+
+static struct Expr *
+new_expr(ExprType type, double value)
+{
+  struct Expr *e;
+
+  e = calloc(1, sizeof (*e));
+  if (!e) {
+    perror("calloc");
+    exit(1);
+  }
+
+  e->type = type;
+  e->value = value;
+
+  return e;
+}
+
+/* ================================================== */
+
+static void
+free_expr(struct Expr *e)
+{
+  int i;
+
+  if (!e)
+    return;
+
+  for (i = 0; i < e->n_args; i++)
+    free_expr(e->args[i]);
+  free(e->args);
+  free(e);
+}
+
+/* ================================================== */
+
+static struct Expr *
+parse_expr(const char **s)
+{
+  struct Expr *e, *arg;
+  char token[64], *end;
+  double value;
+  int i;
+
+  *s = skip_space(*s);
+
+  if (**s == '(') {
+    (*s)++;
+    if (!get_token(s, token, sizeof (token)))
+      return NULL;
+
+    for (i = 0; functions[i].name && strcmp(functions[i].name, token); i++)
+      ;
+    if (!functions[i].name) {
+      fprintf(stderr, "Unknown function %s\n", token);
+      return NULL;
+    }
+
+    e = new_expr(functions[i].type, 0.0);
+
+    while (1) {
+      *s = skip_space(*s);
+      if (**s == ')') {
+        (*s)++;
+        break;
+      }
+
+      if (!**s || !(arg = parse_expr(s))) {
+        free_expr(e);
+        return NULL;
+      }
+
+      e->args = realloc(e->args, (e->n_args + 1) * sizeof (e->args[0]));
+      if (!e->args) {
+        perror("realloc");
+        exit(1);
+      }
+      e->args[e->n_args++] = arg;
+    }
+
+    if (e->n_args < functions[i].min_args ||
+        (functions[i].max_args >= 0 && e->n_args > functions[i].max_args)) {
+      fprintf(stderr, "Invalid number of arguments of %s\n", token);
+      free_expr(e);
+      return NULL;
+    }
+
+    return e;
+  }
+
+  if (!get_token(s, token, sizeof (token)))
+    return NULL;
+
+  if (!strcmp(token, "time"))
+    return new_expr(EXPR_TIME, 0.0);
+  if (!strcmp(token, "from"))
+    return new_expr(EXPR_FROM, 0.0);
+  if (!strcmp(token, "to"))
+    return new_expr(EXPR_TO, 0.0);
+
+  value = strtod(token, &end);
+  if (*end) {
+    fprintf(stderr, "Invalid number %s\n", token);
+    return NULL;
+  }
+
+  return new_expr(EXPR_NUMBER, value);
+}
+
+/* ================================================== */
+
+static double
+eval_expr(struct Expr *e, const struct ExprVars *vars)
+{
+  double x, y, eps;
+  int i, equal;
+
+  switch (e->type) {
+    case EXPR_NUMBER:
+      return e->value;
+    case EXPR_TIME:
+      return vars->time;
+    case EXPR_FROM:
+      return vars->from;
+    case EXPR_TO:
+      return vars->to;
+    case EXPR_ADD:
+      for (i = 0, x = 0.0; i < e->n_args; i++)
+        x += eval_expr(e->args[i], vars);
+      return x;
+    case EXPR_SUB:
+      x = eval_expr(e->args[0], vars);
+      if (e->n_args == 1)
+        return -x;
+      for (i = 1; i < e->n_args; i++)
+        x -= eval_expr(e->args[i], vars);
+      return x;
+    case EXPR_MUL:
+      for (i = 0, x = 1.0; i < e->n_args; i++)
+        x *= eval_expr(e->args[i], vars);
+      return x;
+    case EXPR_DIV:
+      x = eval_expr(e->args[0], vars);
+      for (i = 1; i < e->n_args; i++)
+        x /= eval_expr(e->args[i], vars);
+      return x;
+    case EXPR_MOD:
+      x = eval_expr(e->args[0], vars);
+      y = eval_expr(e->args[1], vars);
+      return fmod(x, y);
+    case EXPR_MIN:
+    case EXPR_MAX:
+      x = eval_expr(e->args[0], vars);
+      for (i = 1; i < e->n_args; i++) {
+        y = eval_expr(e->args[i], vars);
+        if (e->type == EXPR_MIN ? y < x : y > x)
+          x = y;
+      }
+      return x;
+    case EXPR_SUM:
+      e->value += eval_expr(e->args[0], vars);
+      return e->value;
+    case EXPR_EQUAL:
+      /* All arguments after the first are evaluated, so the number of
+         generated random numbers doesn't depend on their values */
+      eps = eval_expr(e->args[0], vars);
+      x = eval_expr(e->args[1], vars);
+      for (i = 2, equal = 1; i < e->n_args; i++) {
+        if (fabs(eval_expr(e->args[i], vars) - x) > eps)
+          equal = 0;
+      }
+      return equal;
+    case EXPR_UNIFORM:
+      return get_uniform();
+    case EXPR_NORMAL:
+      return get_normal();
+    case EXPR_EXPONENTIAL:
+      return get_exponential();
+  }
+
+  return 0.0;
+}
+
+/* ================================================== */
+
+static double
+eval_node_expr(struct Expr *e, double default_value)
+{
+  struct ExprVars vars;
+
+  if (!e)
+    return default_value;
+
+  vars.time = now;
+  vars.from = vars.to = 0;
+
+  return eval_expr(e, &vars);
+}
+
+/* ================================================== */
+
+static int
+read_config(const char *filename)
+{
+  struct Expr *expr, **target;
+  const char *p, *key;
+  int id, to, key_length, line_number;
+  char *line = NULL;
+  size_t line_size = 0;
+  FILE *f;
+
+  f = fopen(filename, "r");
+  if (!f) {
+    fprintf(stderr, "Could not open %s : %s\n", filename, strerror(errno));
+    return 0;
+  }
+
+  for (line_number = 1; getline(&line, &line_size, f) > 0; line_number++) {
+    p = skip_space(line);
+    if (!*p || *p == '#')
+      continue;
+
+    if (strncmp(p, "node", 4))
+      break;
+    id = strtol(p + 4, (char **)&p, 10);
+    if (*p++ != '_')
+      break;
+
+    for (key = p; (*p >= 'a' && *p <= 'z') || *p == '_'; p++)
+      ;
+    key_length = p - key;
+    to = *p >= '0' && *p <= '9' ? strtol(p, (char **)&p, 10) : 0;
+
+    p = skip_space(p);
+    if (*p++ != '=')
+      break;
+
+    expr = parse_expr(&p);
+    if (!expr || *skip_space(p)) {
+      free_expr(expr);
+      break;
+    }
+
+    /* Ignore nodes which are not simulated */
+    if (id < 1 || id > n_nodes) {
+      free_expr(expr);
+      continue;
+    }
+
+#define KEY(name) (key_length == strlen(name) && !strncmp(key, name, key_length))
+    if (KEY("freq")) {
+      target = &nodes[id].freq_expr;
+    } else if (KEY("step")) {
+      target = &nodes[id].step_expr;
+    } else if (KEY("offset")) {
+      target = &nodes[id].offset_expr;
+    } else if (KEY("start")) {
+      target = &nodes[id].start_expr;
+    } else if (KEY("refclock")) {
+      target = &nodes[id].refclock_expr;
+    } else if (KEY("rtc")) {
+      target = &nodes[id].rtc_expr;
+    } else if (KEY("delay") && to >= 1 && to <= n_nodes) {
+      target = &nodes[id].delay_exprs[to];
+    } else if (KEY("shift_pll")) {
+      nodes[id].shift_pll = eval_node_expr(expr, 0.0);
+      free_expr(expr);
+      continue;
+    } else if (KEY("rtcfreq")) {
+      nodes[id].rtc_freq = eval_node_expr(expr, 0.0);
+      free_expr(expr);
+      continue;
+    } else if (KEY("delay")) {
+      free_expr(expr);
+      continue;
+    } else {
+      free_expr(expr);
+      break;
+    }
+#undef KEY
+
+    free_expr(*target);
+    *target = expr;
+  }
+
+  free(line);
+
+  if (!feof(f)) {
+    fprintf(stderr, "Could not parse line %d in %s\n", line_number, filename);
+    fclose(f);
+    return 0;
+  }
+
+  fclose(f);
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+init_nodes(void)
+{
+  struct Node *node;
+  int i;
+
+  nodes = calloc(n_nodes + 1, sizeof (nodes[0]));
+  if (!nodes) {
+    perror("calloc");
+    exit(1);
+  }
+
+  for (i = 1; i <= n_nodes; i++) {
+    node = &nodes[i];
+    node->id = i;
+    node->fd = -1;
+    node->state = NODE_NEW;
+    node->delay_exprs = calloc(n_nodes + 1, sizeof (node->delay_exprs[0]));
+    if (!node->delay_exprs) {
+      perror("calloc");
+      exit(1);
+    }
+    node->shift_pll = 2;
+    node->tick = NOMINAL_TICK;
+    node->status = STA_UNSYNC;
+    node->time_constant = 2;
+    node->time_state = TIME_OK;
+    node->maxerror = PHASE_LIMIT;
+    node->esterror = PHASE_LIMIT;
+  }
+}
+
+/* ================================================== */
+
+static void
+step_clock(struct Node *node, double step)
+{
+  node->steps += step;
+}
+
+/* ================================================== */
+
+static double
+get_realtime(struct Node *node)
+{
+  return now + node->steps + node->phase;
+}
+
+/* ================================================== */
+
+static double
+get_rtc_time(struct Node *node)
+{
+  return now + node->rtc_offset + (now - node->rtc_set_time) * node->rtc_freq;
+}
+
+/* ================================================== */
+
+static void
+set_rtc_time(struct Node *node, double time)
+{
+  node->rtc_offset = time - now;
+  node->rtc_set_time = now;
+}
+
+/* ================================================== */
+
+static double
+get_offset(struct Node *node)
+{
+  return node->steps + node->phase;
+}
+
+/* ================================================== */
+
+static double
+get_monotonic(struct Node *node)
+{
+  return MONOTONIC_BASE + now + node->phase;
+}
+
+/* ================================================== */
+/* Return the frequency offset of the clock, optionally including the
+   correction of the PLL offset in the current second.  The singleshot
+   adjustment is not included. */
+
+static double
+get_clock_freq(struct Node *node, int with_pll)
+{
+  double kernel_freq;
+
+  kernel_freq = (double)(node->tick - NOMINAL_TICK) / NOMINAL_TICK +
+                node->kernel_freq * 1.0e-6;
+  if (with_pll)
+    kernel_freq += node->pll_rate;
+
+  return (1.0 + node->freq) * (1.0 + kernel_freq) - 1.0;
+}
+
+/* ================================================== */
+
+static void
+advance_clocks(double interval)
+{
+  struct Node *node;
+  double slew;
+  int i;
+
+  if (interval <= 0.0)
+    return;
+
+  for (i = 1; i <= n_nodes; i++) {
+    node = &nodes[i];
+    node->phase += get_clock_freq(node, 1) * interval;
+
+    if (node->slew_offset != 0.0) {
+      slew = SLEW_RATE * interval;
+      if (slew >= fabs(node->slew_offset)) {
+        node->phase += node->slew_offset;
+        node->slew_offset = 0.0;
+      } else {
+        slew = copysign(slew, node->slew_offset);
+        node->phase += slew;
+        node->slew_offset -= slew;
+      }
+    }
+  }
+}
+
+/* ================================================== */
+/* Return the interval of true time in which the node's clock will advance
+   by the specified interval, assuming the frequency will not change */
+
+static double
+get_true_interval(struct Node *node, double interval)
+{
+  double rate, slew_rate, slew_length;
+
+  rate = 1.0 + get_clock_freq(node, 1);
+
+  if (node->slew_offset != 0.0) {
+    slew_rate = rate + copysign(SLEW_RATE, node->slew_offset);
+    slew_length = fabs(node->slew_offset) / SLEW_RATE;
+    if (interval <= slew_length * slew_rate)
+      return interval / slew_rate;
+    return slew_length + (interval - slew_length * slew_rate) / rate;
+  }
+
+  return interval / rate;
+}
+
+/* ================================================== */
+
+static void
+update_pll_offset(struct Node *node, double offset)
+{
+  double reftime, secs, freq_adj;
+  int shift;
+
+  if (!(node->status & STA_PLL))
+    return;
+
+  if (offset > MAX_PHASE)
+    offset = MAX_PHASE;
+  else if (offset < -MAX_PHASE)
+    offset = -MAX_PHASE;
+
+  reftime = floor(get_realtime(node));
+  secs = node->status & STA_FREQHOLD ? 0.0 : reftime - node->pll_reftime;
+  node->pll_reftime = reftime;
+
+  /* FLL update */
+  node->status &= ~STA_MODE;
+  freq_adj = 0.0;
+  if (secs >= MIN_FLL_SEC && (node->status & STA_FLL || secs > MAX_FLL_SEC)) {
+    node->status |= STA_MODE;
+    freq_adj = ldexp(offset / secs, -SHIFT_FLL);
+  }
+
+  /* PLL update */
+  shift = node->shift_pll + node->time_constant;
+  if (secs > ldexp(1.0, shift + 1))
+    secs = ldexp(1.0, shift + 1);
+  freq_adj += ldexp(offset * secs, -2 * (shift + 2));
+
+  node->kernel_freq += freq_adj * 1.0e6;
+  if (node->kernel_freq > MAX_FREQ)
+    node->kernel_freq = MAX_FREQ;
+  else if (node->kernel_freq < -MAX_FREQ)
+    node->kernel_freq = -MAX_FREQ;
+
+  node->pll_offset = offset;
+}
+
+/* ================================================== */
+
+static void
+fill_timex(struct Node *node, struct timex *t)
+{
+  double realtime, scale;
+
+  scale = node->status & STA_NANO ? 1.0e9 : 1.0e6;
+  realtime = get_realtime(node);
+
+  t->offset = node->pll_offset * scale;
+  t->freq = node->kernel_freq * 65536.0;
+  t->maxerror = node->maxerror;
+  t->esterror = node->esterror;
+  t->status = node->status;
+  t->constant = node->time_constant;
+  t->precision = 1;
+  t->tolerance = MAX_FREQ * 65536.0;
+  t->tick = node->tick;
+  t->time.tv_sec = start_date + (int64_t)floor(realtime);
+  t->time.tv_usec = (realtime - floor(realtime)) * scale;
+  t->tai = 0;
+}
+
+/* ================================================== */
+/* Emulate the adjtimex() system call of Linux, return the time state or
+   negative errno */
+
+static int
+do_adjtimex(struct Node *node, struct timex *t)
+{
+  double old_slew, step;
+
+  if (t->modes & ADJ_ADJTIME) {
+    if (!(t->modes & ADJ_OFFSET))
+      return -EINVAL;
+
+    old_slew = node->slew_offset;
+    if (!(t->modes & ADJ_OFFSET_READONLY))
+      node->slew_offset = t->offset * 1.0e-6;
+
+    fill_timex(node, t);
+    t->offset = round(old_slew * 1.0e6);
+  } else {
+    if (t->modes & ADJ_TICK && (t->tick < MIN_TICK || t->tick > MAX_TICK))
+      return -EINVAL;
+    if (t->modes & ADJ_SETOFFSET &&
+        (t->time.tv_usec < 0 || t->time.tv_usec >= (t->modes & ADJ_NANO ? 1000000000 : 1000000)))
+      return -EINVAL;
+
+    if (t->modes & ADJ_SETOFFSET) {
+      step = t->time.tv_sec + t->time.tv_usec * (t->modes & ADJ_NANO ? 1.0e-9 : 1.0e-6);
+      step_clock(node, step);
+      node->status |= STA_UNSYNC;
+      node->maxerror = node->esterror = PHASE_LIMIT;
+    }
+
+    if (t->modes & ADJ_STATUS) {
+      if (node->status & STA_PLL && !(t->status & STA_PLL)) {
+        node->time_state = TIME_OK;
+        node->status = STA_UNSYNC;
+      }
+      if (!(node->status & STA_PLL) && t->status & STA_PLL)
+        node->pll_reftime = floor(get_realtime(node));
+      node->status &= STA_RONLY;
+      node->status |= t->status & ~STA_RONLY;
+    }
+
+    if (t->modes & ADJ_NANO)
+      node->status |= STA_NANO;
+    if (t->modes & ADJ_MICRO)
+      node->status &= ~STA_NANO;
+
+    if (t->modes & ADJ_FREQUENCY) {
+      node->kernel_freq = t->freq / 65536.0;
+      if (node->kernel_freq > MAX_FREQ)
+        node->kernel_freq = MAX_FREQ;
+      else if (node->kernel_freq < -MAX_FREQ)
+        node->kernel_freq = -MAX_FREQ;
+    }
+
+    if (t->modes & ADJ_MAXERROR)
+      node->maxerror = t->maxerror;
+    if (t->modes & ADJ_ESTERROR)
+      node->esterror = t->esterror;
+
+    if (t->modes & ADJ_TIMECONST) {
+      node->time_constant = t->constant + (node->status & STA_NANO ? 0 : 4);
+      if (node->time_constant > MAX_TIME_CONSTANT)
+        node->time_constant = MAX_TIME_CONSTANT;
+      else if (node->time_constant < 0)
+        node->time_constant = 0;
+    }
+
+    if (t->modes & ADJ_OFFSET)
+      update_pll_offset(node, t->offset * (node->status & STA_NANO ? 1.0e-9 : 1.0e-6));
+
+    if (t->modes & ADJ_TICK)
+      node->tick = t->tick;
+
+    fill_timex(node, t);
+  }
+
+  return node->status & STA_UNSYNC ? TIME_ERROR : node->time_state;
+}
+
+/* ================================================== */
+/* Update the kernel state at the start of a new second */
+
+static void
+update_kernel(struct Node *node)
+{
+  int64_t second;
+  double delta;
+
+  node->maxerror += MAX_FREQ;
+  if (node->maxerror > PHASE_LIMIT) {
+    node->maxerror = PHASE_LIMIT;
+    node->status |= STA_UNSYNC;
+  }
+
+  /* The kernel second is assumed to be the node's second closest to the
+     true second */
+  second = start_date + (int64_t)floor(get_realtime(node) + 0.5);
+
+  switch (node->time_state) {
+    case TIME_OK:
+      if (node->status & STA_INS)
+        node->time_state = TIME_INS;
+      else if (node->status & STA_DEL)
+        node->time_state = TIME_DEL;
+      break;
+    case TIME_INS:
+      if (!(node->status & STA_INS)) {
+        node->time_state = TIME_OK;
+      } else if (second % SECS_PER_DAY == 0) {
+        step_clock(node, -1.0);
+        node->time_state = TIME_OOP;
+      }
+      break;
+    case TIME_DEL:
+      if (!(node->status & STA_DEL)) {
+        node->time_state = TIME_OK;
+      } else if ((second + 1) % SECS_PER_DAY == 0) {
+        step_clock(node, 1.0);
+        node->time_state = TIME_WAIT;
+      }
+      break;
+    case TIME_OOP:
+      node->time_state = TIME_WAIT;
+      break;
+    case TIME_WAIT:
+      if (!(node->status & (STA_INS | STA_DEL)))
+        node->time_state = TIME_OK;
+      break;
+  }
+
+  /* Correct a part of the PLL offset in the next second */
+  delta = ldexp(node->pll_offset, -(node->shift_pll + node->time_constant));
+  node->pll_offset -= delta;
+  node->pll_rate = delta;
+}
+
+/* ================================================== */
+
+static void
+record_packet(struct PacketStats *stats)
+{
+  double interval;
+
+  if (now < stats_start)
+    return;
+
+  if (stats->count > 0) {
+    interval = now - stats->last;
+    if (stats->count == 1 || interval < stats->min_interval)
+      stats->min_interval = interval;
+  } else {
+    stats->first = now;
+  }
+
+  stats->last = now;
+  stats->count++;
+}
+
+/* ================================================== */
+
+static void
+queue_packet(struct Node *node, int to, const struct netsim_send *send)
+{
+  struct Packet *packet, **p;
+  struct ExprVars vars;
+  double delay;
+
+  if (!node->delay_exprs[to])
+    return;
+
+  vars.time = now;
+  vars.from = node->id;
+  vars.to = to;
+  delay = eval_expr(node->delay_exprs[to], &vars);
+
+  if (delay < 0.0)
+    return;
+
+  if (packet_log)
+    fprintf(packet_log, "%.9e\t%d\t%d\t%e\t%d\t%d\n",
+            now, node->id, to, delay, send->dst_port, send->src_port);
+
+  packet = malloc(sizeof (*packet) + send->length);
+  if (!packet) {
+    perror("malloc");
+    exit(1);
+  }
+
+  packet->arrival = now + delay;
+  packet->rx_time = 0.0;
+  packet->from = node->id;
+  packet->to = to;
+  packet->src_addr = NETSIM_NET_ADDR | node->id;
+  packet->dst_addr = send->dst_addr;
+  packet->src_port = send->src_port;
+  packet->dst_port = send->dst_port;
+  packet->uid = send->uid;
+  packet->length = send->length;
+  memcpy(packet->data, send->data, send->length);
+
+  for (p = &in_flight; *p && (*p)->arrival <= packet->arrival; p = &(*p)->next)
+    ;
+  packet->next = *p;
+  *p = packet;
+}
+
+/* ================================================== */
+
+static void
+send_packet(struct Node *node, const struct netsim_send *send)
+{
+  int i;
+
+  record_packet(&node->out);
+
+  if ((send->dst_addr & NETSIM_NET_MASK) != NETSIM_NET_ADDR)
+    return;
+
+  if (send->dst_addr == NETSIM_BROADCAST_ADDR) {
+    for (i = 1; i <= n_nodes; i++) {
+      if (i != node->id)
+        queue_packet(node, i, send);
+    }
+  } else {
+    i = send->dst_addr & ~NETSIM_NET_MASK;
+    if (i >= 1 && i <= n_nodes)
+      queue_packet(node, i, send);
+  }
+}
+
+/* ================================================== */
+
+static void
+deliver_packet(void)
+{
+  struct Packet *packet;
+  struct Node *node;
+
+  packet = in_flight;
+  in_flight = packet->next;
+  packet->next = NULL;
+
+  node = &nodes[packet->to];
+
+  if (node->state != NODE_RUNNING && node->state != NODE_WAITING) {
+    free(packet);
+    return;
+  }
+
+  packet->rx_time = get_realtime(node);
+
+  if (node->rx_tail)
+    node->rx_tail->next = packet;
+  else
+    node->rx_head = packet;
+  node->rx_tail = packet;
+
+  record_packet(&node->in);
+}
+
+/* ================================================== */
+
+static void
+process_second(void)
+{
+  struct Node *node;
+  int i;
+
+  n_seconds++;
+
+  for (i = 1; i <= n_nodes; i++) {
+    node = &nodes[i];
+    update_kernel(node);
+
+    if (node->refclock_expr) {
+      node->refclock_time = now + eval_node_expr(node->refclock_expr, 0.0);
+      node->refclock_receive_time = get_realtime(node);
+      node->refclock_id++;
+    }
+  }
+}
+
+/* ================================================== */
+
+static void
+log_values(FILE *f, int freq)
+{
+  int i;
+
+  for (i = 1; i <= n_nodes; i++)
+    fprintf(f, "%.9e%c", freq ? get_clock_freq(&nodes[i], 0) : get_offset(&nodes[i]),
+            i < n_nodes ? '\t' : '\n');
+}
+
+/* ================================================== */
+
+static void
+process_tick(void)
+{
+  struct Node *node;
+  double step, offset, freq;
+  int i;
+
+  n_ticks++;
+
+  for (i = 1; i <= n_nodes; i++) {
+    step = eval_node_expr(nodes[i].step_expr, 0.0);
+    if (step != 0.0)
+      step_clock(&nodes[i], step);
+  }
+
+  if (now <= limit) {
+    if (offset_log)
+      log_values(offset_log, 0);
+    if (freq_log)
+      log_values(freq_log, 1);
+
+    for (i = 1; i <= n_nodes && now >= stats_start; i++) {
+      node = &nodes[i];
+      offset = get_offset(node);
+      freq = get_clock_freq(node, 0);
+
+      node->samples++;
+      node->offset_sum2 += offset * offset;
+      node->freq_sum2 += freq * freq;
+      if (fabs(offset) > node->max_offset)
+        node->max_offset = fabs(offset);
+      if (fabs(freq) > node->max_freq)
+        node->max_freq = fabs(freq);
+    }
+  }
+
+  for (i = 1; i <= n_nodes; i++)
+    nodes[i].freq = eval_node_expr(nodes[i].freq_expr, 0.0);
+}
+
+/* ================================================== */
+
+static double
+get_next_tick(void)
+{
+  return (n_ticks + 1) / update_rate;
+}
+
+/* ================================================== */
+
+static double
+get_next_second(void)
+{
+  return n_seconds + 1.0;
+}
+
+/* ================================================== */
+static double
+get_next_event(void)
+{
+  double next;
+
+  next = get_next_second();
+  if (get_next_tick() < next)
+    next = get_next_tick();
+  if (in_flight && in_flight->arrival < next)
+    next = in_flight->arrival;
+
+  return next;
+}
+
+/* ================================================== */
+/* Advance the time and process all events up to the specified time */
+
+static void
+advance_time(double t)
+{
+  double next;
+
+  while (1) {
+    next = get_next_event();
+    if (next > t)
+      break;
+
+    if (next > now) {
+      advance_clocks(next - now);
+      now = next;
+    }
+
+    if (get_next_second() <= now)
+      process_second();
+    else if (get_next_tick() <= now)
+      process_tick();
+    else
+      deliver_packet();
+  }
+
+  if (t > now) {
+    advance_clocks(t - now);
+    now = t;
+  }
+}
+
+/* ================================================== */
+
+static void
+close_node(struct Node *node)
+{
+  struct Packet *packet;
+
+  if (node->fd >= 0)
+    close(node->fd);
+  node->fd = -1;
+  node->state = NODE_EXITED;
+
+  while (node->rx_head) {
+    packet = node->rx_head;
+    node->rx_head = packet->next;
+    free(packet);
+  }
+  node->rx_tail = NULL;
+}
+
+/* ================================================== */
+
+static void
+send_reply(struct Node *node, const void *reply, int length)
+{
+  if (send(node->fd, reply, length, 0) != length)
+    close_node(node);
+}
+
+/* ================================================== */
+
+static void
+send_time_reply(struct Node *node)
+{
+  struct netsim_time_reply reply;
+
+  memset(&reply, 0, sizeof (reply));
+  reply.start_date = start_date;
+  reply.realtime = get_realtime(node);
+  reply.monotonic = get_monotonic(node);
+  reply.refclock_id = node->refclock_id;
+  reply.refclock_time = node->refclock_time;
+  reply.refclock_receive_time = node->refclock_receive_time;
+  reply.rtc_time = get_rtc_time(node);
+
+  send_reply(node, &reply, sizeof (reply));
+}
+
+/* ================================================== */
+
+static void
+send_recv_reply(struct Node *node)
+{
+  struct netsim_recv_reply reply;
+  struct Packet *packet;
+
+  packet = node->rx_head;
+
+  if (!packet) {
+    reply.valid = 0;
+    send_reply(node, &reply, offsetof(struct netsim_recv_reply, data));
+    return;
+  }
+
+  node->rx_head = packet->next;
+  if (!node->rx_head)
+    node->rx_tail = NULL;
+
+  reply.valid = 1;
+  reply.src_addr = packet->src_addr;
+  reply.dst_addr = packet->dst_addr;
+  reply.src_port = packet->src_port;
+  reply.dst_port = packet->dst_port;
+  reply.uid = packet->uid;
+  reply._pad = 0;
+  reply.time = packet->rx_time;
+  reply.length = packet->length;
+  memcpy(reply.data, packet->data, packet->length);
+
+  free(packet);
+
+  send_reply(node, &reply, offsetof(struct netsim_recv_reply, data) + reply.length);
+}
+
+/* ================================================== */
+
+static int
+has_packet(struct Node *node)
+{
+  struct Packet *packet;
+  int i;
+
+  for (packet = node->rx_head; packet; packet = packet->next) {
+    for (i = 0; i < node->n_ports; i++) {
+      if (packet->dst_port == node->ports[i])
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* ================================================== */
+
+static int
+is_node_ready(struct Node *node)
+{
+  switch (node->state) {
+    case NODE_STARTING:
+      return terminating || now >= node->start;
+    case NODE_WAITING:
+      return terminating || has_packet(node) ||
+             (node->has_deadline && get_monotonic(node) >= node->deadline - DEADLINE_EPS);
+    default:
+      return 0;
+  }
+}
+
+/* ================================================== */
+
+static double
+get_wakeup_time(struct Node *node)
+{
+  double remaining;
+
+  switch (node->state) {
+    case NODE_STARTING:
+      return node->start;
+    case NODE_WAITING:
+      if (!node->has_deadline)
+        return INFINITY;
+      remaining = node->deadline - get_monotonic(node);
+      if (remaining <= 0.0)
+        return now;
+      return now + get_true_interval(node, remaining);
+    default:
+      return INFINITY;
+  }
+}
+
+/* ================================================== */
+
+static void
+start_select(struct Node *node, const struct netsim_select *select)
+{
+  node->has_deadline = select->timeout >= 0.0;
+  node->deadline = get_monotonic(node) + select->timeout;
+  node->n_ports = select->n_ports;
+  if (node->n_ports < 0 || node->n_ports > NETSIM_MAX_SELECT_PORTS)
+    node->n_ports = 0;
+  memcpy(node->ports, select->ports, node->n_ports * sizeof (node->ports[0]));
+  node->state = NODE_WAITING;
+}
+
+/* ================================================== */
+/* Resume the program and serve its requests until it waits in select() */
+
+static void
+run_node(struct Node *node)
+{
+  struct netsim_request request;
+  union netsim_reply reply;
+  int length;
+
+  if (node->state == NODE_STARTING) {
+    if (terminating) {
+      close_node(node);
+      return;
+    }
+    node->state = NODE_RUNNING;
+    send_time_reply(node);
+  } else {
+    if (terminating) {
+      if (node->terminations++ >= MAX_TERMINATIONS) {
+        close_node(node);
+        return;
+      }
+      reply.select.ret = NETSIM_SELECT_TERMINATE;
+    } else {
+      reply.select.ret = has_packet(node) ? NETSIM_SELECT_PACKET : NETSIM_SELECT_TIMEOUT;
+    }
+    node->state = NODE_RUNNING;
+    send_reply(node, &reply, sizeof (reply.select));
+  }
+
+  while (node->state == NODE_RUNNING) {
+    length = recv(node->fd, &request, sizeof (request), 0);
+    if (length < (int)offsetof(struct netsim_request, data)) {
+      close_node(node);
+      return;
+    }
+
+    switch (request.type) {
+      case NETSIM_REQ_GETTIME:
+        if (!terminating)
+          advance_time(now + CLOCK_READ_STEP);
+        send_time_reply(node);
+        break;
+      case NETSIM_REQ_SETTIME:
+        step_clock(node, request.data.settime.time - get_realtime(node));
+        node->status |= STA_UNSYNC;
+        node->maxerror = node->esterror = PHASE_LIMIT;
+        send_time_reply(node);
+        break;
+      case NETSIM_REQ_SETRTC:
+        set_rtc_time(node, request.data.settime.time);
+        send_time_reply(node);
+        break;
+      case NETSIM_REQ_ADJTIMEX:
+        reply.adjtimex.timex = request.data.adjtimex.timex;
+        reply.adjtimex.ret = do_adjtimex(node, &reply.adjtimex.timex);
+        send_reply(node, &reply, sizeof (reply.adjtimex));
+        break;
+      case NETSIM_REQ_SEND:
+        if (length < (int)offsetof(struct netsim_request, data.send.data) ||
+            request.data.send.length > length - offsetof(struct netsim_request, data.send.data)) {
+          fprintf(stderr, "Invalid send request from node %d\n", node->id);
+          close_node(node);
+          return;
+        }
+        send_packet(node, &request.data.send);
+        break;
+      case NETSIM_REQ_RECV:
+        send_recv_reply(node);
+        break;
+      case NETSIM_REQ_SELECT:
+        start_select(node, &request.data.select);
+        break;
+      default:
+        fprintf(stderr, "Invalid request %d from node %d\n", request.type, node->id);
+        close_node(node);
+        return;
+    }
+  }
+}
+
+/* ================================================== */
+
+static void
+run_simulation(void)
+{
+  double t, wakeup;
+  int i, alive;
+
+  while (1) {
+    for (i = 1; i <= n_nodes; i++) {
+      if (is_node_ready(&nodes[i]))
+        break;
+    }
+
+    if (i <= n_nodes) {
+      run_node(&nodes[i]);
+      continue;
+    }
+
+    for (i = 1, alive = 0; i <= n_nodes; i++) {
+      if (nodes[i].state != NODE_EXITED)
+        alive = 1;
+    }
+
+    if (!alive || terminating)
+      break;
+
+    /* Advance to the next event which may wake up a node */
+    t = get_next_event();
+    if (t > limit)
+      t = limit;
+
+    for (i = 1; i <= n_nodes; i++) {
+      wakeup = get_wakeup_time(&nodes[i]);
+      if (wakeup < t)
+        t = wakeup;
+    }
+
+    advance_time(t);
+
+    if (now >= limit)
+      terminating = 1;
+  }
+}
+
+/* ================================================== */
+
+static int
+accept_nodes(int sock_fd)
+{
+  struct netsim_request request;
+  struct timespec ts;
+  struct pollfd pfd;
+  double deadline;
+  int i, fd, registered, timeout;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  deadline = ts.tv_sec + ts.tv_nsec * 1e-9 + CONNECT_TIMEOUT / 1000.0;
+
+  for (registered = 0; registered < n_nodes; ) {
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    timeout = (deadline - ts.tv_sec - ts.tv_nsec * 1e-9) * 1000.0;
+
+    pfd.fd = sock_fd;
+    pfd.events = POLLIN;
+
+    if (timeout <= 0 || poll(&pfd, 1, timeout) <= 0) {
+      fprintf(stderr, "Nodes not connected:");
+      for (i = 1; i <= n_nodes; i++) {
+        if (nodes[i].state == NODE_NEW)
+          fprintf(stderr, " %d", i);
+      }
+      fprintf(stderr, "\n");
+      return 0;
+    }
+
+    fd = accept(sock_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+
+    if (recv(fd, &request, sizeof (request), 0) < (int)offsetof(struct netsim_request, data) +
+                                                  (int)sizeof (request.data.reg) ||
+        request.type != NETSIM_REQ_REGISTER || request.data.reg.node < 1 ||
+        request.data.reg.node > n_nodes || nodes[request.data.reg.node].state != NODE_NEW) {
+      fprintf(stderr, "Invalid registration\n");
+      close(fd);
+      continue;
+    }
+
+    nodes[request.data.reg.node].fd = fd;
+    nodes[request.data.reg.node].state = NODE_STARTING;
+    registered++;
+  }
+
+  return 1;
+}
+
+/* ================================================== */
+
+static void
+init_simulation(void)
+{
+  struct Node *node;
+  double step;
+  int i;
+
+  now = 0.0;
+  n_ticks = n_seconds = 0;
+  terminating = 0;
+
+  for (i = 1; i <= n_nodes; i++) {
+    node = &nodes[i];
+    node->steps = eval_node_expr(node->offset_expr, 0.0);
+    node->phase = 0.0;
+    node->start = eval_node_expr(node->start_expr, 0.0);
+    node->freq = eval_node_expr(node->freq_expr, 0.0);
+    set_rtc_time(node, eval_node_expr(node->rtc_expr, 0.0));
+    step = eval_node_expr(node->step_expr, 0.0);
+    if (step != 0.0)
+      step_clock(node, step);
+  }
+}
+
+/* ================================================== */
+
+static void
+print_stat(const char *name, int type)
+{
+  struct Node *node;
+  struct PacketStats *stats;
+  double value;
+  int i;
+
+  printf("%s:", name);
+
+  for (i = 1; i <= n_nodes; i++) {
+    node = &nodes[i];
+    stats = type == 4 || type == 6 ? &node->in : &node->out;
+
+    switch (type) {
+      case 0:
+        value = node->samples > 0 ? sqrt(node->offset_sum2 / node->samples) : INFINITY;
+        break;
+      case 1:
+        value = node->samples > 0 ? node->max_offset : INFINITY;
+        break;
+      case 2:
+        value = node->samples > 0 ? sqrt(node->freq_sum2 / node->samples) : INFINITY;
+        break;
+      case 3:
+        value = node->samples > 0 ? node->max_freq : INFINITY;
+        break;
+      case 4:
+      case 5:
+        value = stats->count > 1 ? (stats->last - stats->first) / (stats->count - 1) : INFINITY;
+        break;
+      default:
+        value = stats->count > 1 ? stats->min_interval : INFINITY;
+        break;
+    }
+
+    if (isfinite(value))
+      printf("\t%e", value);
+    else
+      printf("\tinf");
+  }
+
+  printf("\n");
+}
+
+/* ================================================== */
+
+static void
+print_stats(void)
+{
+  print_stat("RMS offset", 0);
+  print_stat("Maximum absolute offset", 1);
+  print_stat("RMS frequency", 2);
+  print_stat("Maximum absolute frequency", 3);
+  print_stat("Mean incoming packet interval", 4);
+  print_stat("Mean outgoing packet interval", 5);
+  print_stat("Minimum incoming packet interval", 6);
+  print_stat("Minimum outgoing packet interval", 7);
+}
+
+/* ================================================== */
+
+static FILE *
+open_log(const char *filename)
+{
+  FILE *f;
+
+  f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "Could not open %s : %s\n", filename, strerror(errno));
+    exit(1);
+  }
+
+  return f;
+}
+
+/* ================================================== */
+
+static void
+usage(const char *progname)
+{
+  fprintf(stderr,
+          "Usage: %s [-o offset_log] [-f freq_log] [-p packet_log] [-R rate]\n"
+          "          [-r stats_start] [-l limit] -s socket config nodes\n"
+          "\t-o file\t\tlog offsets of the clocks\n"
+          "\t-f file\t\tlog frequency offsets of the clocks\n"
+          "\t-p file\t\tlog packets\n"
+          "\t-R rate\t\tnumber of updates and log entries per second (default 1)\n"
+          "\t-r seconds\tstart of the statistics (default 0)\n"
+          "\t-l seconds\tlength of the simulation (default 10000)\n"
+          "\t-s socket\tpath of the socket for the simulated programs\n"
+          "The start date and random seed can be set by the CLKNETSIM_START_DATE\n"
+          "and CLKNETSIM_RANDOM_SEED environment variables.\n",
+          progname);
+}
+
+/* ================================================== */
+
+int
+main(int argc, char **argv)
+{
+  const char *socket_path = NULL, *env;
+  struct sockaddr_un addr;
+  int opt, sock_fd, i;
+
+  update_rate = 1.0;
+  stats_start = 0.0;
+  limit = 10000.0;
+
+  while ((opt = getopt(argc, argv, "f:l:o:p:r:R:s:")) != -1) {
+    switch (opt) {
+      case 'f':
+        freq_log = open_log(optarg);
+        break;
+      case 'l':
+        limit = atof(optarg);
+        break;
+      case 'o':
+        offset_log = open_log(optarg);
+        break;
+      case 'p':
+        packet_log = open_log(optarg);
+        break;
+      case 'r':
+        stats_start = atof(optarg);
+        break;
+      case 'R':
+        update_rate = atof(optarg);
+        break;
+      case 's':
+        socket_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind + 2 != argc || !socket_path || update_rate <= 0.0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  n_nodes = atoi(argv[optind + 1]);
+  if (n_nodes < 1 || n_nodes > NETSIM_MAX_NODES) {
+    fprintf(stderr, "Invalid number of nodes\n");
+    return 1;
+  }
+
+  env = getenv("CLKNETSIM_START_DATE");
+  start_date = env ? strtoll(env, NULL, 10) : DEFAULT_START_DATE;
+  env = getenv("CLKNETSIM_RANDOM_SEED");
+  random_state = env ? strtoull(env, NULL, 10) : 1;
+
+  init_nodes();
+
+  if (!read_config(argv[optind]))
+    return 1;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (snprintf(addr.sun_path, sizeof (addr.sun_path), "%s", socket_path) >=
+      sizeof (addr.sun_path)) {
+    fprintf(stderr, "Path too long\n");
+    return 1;
+  }
+
+  unlink(socket_path);
+
+  sock_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (sock_fd < 0 || bind(sock_fd, (struct sockaddr *)&addr, sizeof (addr)) < 0 ||
+      listen(sock_fd, n_nodes) < 0) {
+    fprintf(stderr, "Could not open socket %s : %s\n", socket_path, strerror(errno));
+    return 1;
+  }
+
+  if (!accept_nodes(sock_fd)) {
+    unlink(socket_path);
+    return 1;
+  }
+
+  close(sock_fd);
+  unlink(socket_path);
+
+  init_simulation();
+  run_simulation();
+
+  for (i = 1; i <= n_nodes; i++)
+    close_node(&nodes[i]);
+
+  print_stats();
+
+  if (offset_log)
+    fclose(offset_log);
+  if (freq_log)
+    fclose(freq_log);
+  if (packet_log)
+    fclose(packet_log);
+
+  return 0;
+}
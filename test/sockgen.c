@@ -0,0 +1,227 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Generator of samples for the SOCK refclock driver.  It sends samples
+  with a constant offset and random jitter at the specified rate, in
+  batches using the version 2 of the protocol, or one sample per datagram
+  using the version 1.
+
+  Build with:  cc -O2 -o sockgen sockgen.c
+
+  Example configuration of chronyd:  refclock SOCK /tmp/refclock.sock
+  Example:  ./sockgen -r 100 -b 10 -o 0.001 -j 1e-6 /tmp/refclock.sock
+  */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Message formats, see refclock_sock.c */
+
+#define SOCK_MAGIC 0x534f434b
+#define SOCK_MAGIC_V2 0x534f4332
+#define SOCK_MAX_SAMPLES_V2 64
+
+struct sock_sample {
+  struct timeval tv;
+  double offset;
+  int pulse;
+  int leap;
+  int _pad;
+  int magic;
+};
+
+struct sock_sample_v2 {
+  int64_t tv_sec;
+  int32_t tv_nsec;
+  int32_t leap;
+  double offset;
+  double dispersion;
+  int32_t pulse;
+  int32_t _pad;
+};
+
+struct sock_message_v2 {
+  uint32_t magic;
+  uint32_t n_samples;
+  struct sock_sample_v2 samples[SOCK_MAX_SAMPLES_V2];
+};
+
+/* ================================================== */
+
+static double
+get_jitter(double jitter)
+{
+  /* Approximately normal distribution */
+  double x;
+  int i;
+
+  for (i = 0, x = 0.0; i < 12; i++)
+    x += random() / (RAND_MAX + 1.0);
+
+  return (x - 6.0) * jitter;
+}
+
+/* ================================================== */
+
+static void
+usage(const char *progname)
+{
+  fprintf(stderr,
+          "Usage: %s [-1] [-r rate] [-b batch] [-n count] [-o offset] [-j jitter]\n"
+          "          [-d dispersion] [-p] <socket>\n"
+          "\t-1\t\tuse version 1 of the protocol\n"
+          "\t-r rate\t\tsamples per second (default 1)\n"
+          "\t-b batch\tsamples per datagram (default 1, maximum %d)\n"
+          "\t-n count\tstop after count samples (default 0 = no limit)\n"
+          "\t-o offset\toffset of the samples in seconds (default 0)\n"
+          "\t-j jitter\tstandard deviation of the jitter (default 1e-6)\n"
+          "\t-d dispersion\tdispersion of the samples (default 0)\n"
+          "\t-p\t\tsend pulses instead of samples\n",
+          progname, SOCK_MAX_SAMPLES_V2);
+}
+
+/* ================================================== */
+
+int
+main(int argc, char **argv)
+{
+  struct sock_message_v2 message;
+  struct sock_sample sample;
+  struct sockaddr_un addr;
+  struct timespec now, interval;
+  double rate = 1.0, offset = 0.0, jitter = 1e-6, dispersion = 0.0, o;
+  int opt, fd, v1 = 0, pulse = 0, batch = 1, n, length;
+  long count = 0, sent;
+
+  while ((opt = getopt(argc, argv, "1b:d:j:n:o:pr:")) != -1) {
+    switch (opt) {
+      case '1':
+        v1 = 1;
+        break;
+      case 'b':
+        batch = atoi(optarg);
+        break;
+      case 'd':
+        dispersion = atof(optarg);
+        break;
+      case 'j':
+        jitter = atof(optarg);
+        break;
+      case 'n':
+        count = atol(optarg);
+        break;
+      case 'o':
+        offset = atof(optarg);
+        break;
+      case 'p':
+        pulse = 1;
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind + 1 != argc || rate <= 0.0 || batch < 1 || batch > SOCK_MAX_SAMPLES_V2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (v1)
+    batch = 1;
+
+  addr.sun_family = AF_UNIX;
+  if (snprintf(addr.sun_path, sizeof (addr.sun_path), "%s", argv[optind]) >=
+      sizeof (addr.sun_path)) {
+    fprintf(stderr, "Path too long\n");
+    return 1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+    fprintf(stderr, "Could not connect to %s : %s\n", addr.sun_path, strerror(errno));
+    return 1;
+  }
+
+  srandom(time(NULL));
+
+  interval.tv_sec = (time_t)(1.0 / rate);
+  interval.tv_nsec = (long)((1.0 / rate - interval.tv_sec) * 1e9);
+
+  for (sent = n = 0; !count || sent < count; sent++) {
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    /* The timestamp of a pulse is assumed to be the system time at the
+       start of a true second */
+    o = offset + get_jitter(jitter);
+
+    if (v1) {
+      memset(&sample, 0, sizeof (sample));
+      sample.tv.tv_sec = now.tv_sec;
+      sample.tv.tv_usec = now.tv_nsec / 1000;
+      sample.offset = pulse ? -o : o;
+      sample.pulse = pulse;
+      sample.leap = 0;
+      sample.magic = SOCK_MAGIC;
+
+      if (send(fd, &sample, sizeof (sample), 0) < 0)
+        fprintf(stderr, "send() failed : %s\n", strerror(errno));
+    } else {
+      memset(&message.samples[n], 0, sizeof (message.samples[n]));
+      message.samples[n].tv_sec = now.tv_sec;
+      message.samples[n].tv_nsec = now.tv_nsec;
+      message.samples[n].offset = pulse ? -o : o;
+      message.samples[n].dispersion = dispersion;
+      message.samples[n].pulse = pulse;
+      message.samples[n].leap = 0;
+      n++;
+
+      if (n == batch || (count && sent + 1 == count)) {
+        message.magic = SOCK_MAGIC_V2;
+        message.n_samples = n;
+        length = sizeof (message) - (SOCK_MAX_SAMPLES_V2 - n) * sizeof (message.samples[0]);
+
+        if (send(fd, &message, length, 0) < 0)
+          fprintf(stderr, "send() failed : %s\n", strerror(errno));
+        n = 0;
+      }
+    }
+
+    nanosleep(&interval, NULL);
+  }
+
+  close(fd);
+
+  return 0;
+}
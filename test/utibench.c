@@ -0,0 +1,196 @@
+/*
+  chronyd/chronyc - Programs for keeping computer clocks accurate.
+
+ **********************************************************************
+ * Copyright (C) agent  2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ **********************************************************************
+
+  =======================================================================
+
+  Benchmark of the time conversion routines from util.c which are called
+  for every NTP packet and every sample (reading of the system clock,
+  conversion between timespec, double and NTP timestamps).  It also checks
+  that timestamps survive the conversion to NTP format and back without
+  losing a nanosecond.
+
+  Build with:  make utibench
+  Example:  ./utibench -n 10000000
+  */
+
+#include "config.h"
+
+#include "sysincl.h"
+
+#include "util.h"
+
+static volatile double sink_double;
+static volatile uint32_t sink_u32;
+
+/* ================================================== */
+
+static double
+get_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/* ================================================== */
+
+static void
+report(const char *name, double start, long n)
+{
+  printf("%-28s %8.2f ns/call\n", name, (get_time() - start) / n * 1.0e9);
+}
+
+/* ================================================== */
+
+static int
+check_ntp_conversion(long n)
+{
+  struct timespec ts, ts2;
+  NTP_int64 ntp;
+  long i, errors;
+
+  ts.tv_sec = 1420070400;
+  for (i = errors = 0; i < n; i++) {
+    ts.tv_nsec = random() % 1000000000;
+    UTI_TimespecToInt64(&ts, &ntp, 0);
+    UTI_Int64ToTimespec(&ntp, &ts2);
+    if (ts.tv_sec != ts2.tv_sec || ts.tv_nsec != ts2.tv_nsec) {
+      if (errors++ < 10)
+        fprintf(stderr, "Conversion of %s gave %s\n",
+                UTI_TimespecToString(&ts), UTI_TimespecToString(&ts2));
+    }
+  }
+
+  return !errors;
+}
+
+/* ================================================== */
+
+static void
+usage(void)
+{
+  fprintf(stderr, "Usage: utibench [-n iterations]\n");
+}
+
+/* ================================================== */
+
+int
+main(int argc, char **argv)
+{
+  struct timespec ts, ts2, ts3;
+  struct timeval tv;
+  NTP_int64 ntp;
+  double start, d;
+  long i, n = 10000000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atol(optarg);
+        break;
+      default:
+        usage();
+        return 1;
+    }
+  }
+
+  if (n < 1) {
+    usage();
+    return 1;
+  }
+
+  if (!check_ntp_conversion(n)) {
+    fprintf(stderr, "NTP timestamp conversion is not exact\n");
+    return 1;
+  }
+
+  start = get_time();
+  for (i = 0; i < n; i++)
+    clock_gettime(CLOCK_REALTIME, &ts);
+  report("clock_gettime(REALTIME)", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++)
+    gettimeofday(&tv, NULL);
+  report("gettimeofday()", start, n);
+
+  ts.tv_sec = 1420070400;
+  ts.tv_nsec = 123456789;
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    ts.tv_nsec = (ts.tv_nsec + 7919) % 1000000000;
+    UTI_TimespecToInt64(&ts, &ntp, 0);
+    sink_u32 = ntp.lo;
+  }
+  report("UTI_TimespecToInt64", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    ntp.lo += 7919;
+    UTI_Int64ToTimespec(&ntp, &ts2);
+    sink_u32 = ts2.tv_nsec;
+  }
+  report("UTI_Int64ToTimespec", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    ts.tv_nsec = (ts.tv_nsec + 7919) % 1000000000;
+    UTI_TimespecToDouble(&ts, &d);
+    sink_double = d;
+  }
+  report("UTI_TimespecToDouble", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    UTI_DoubleToTimespec(i * 1.0e-7, &ts2);
+    sink_u32 = ts2.tv_nsec;
+  }
+  report("UTI_DoubleToTimespec", start, n);
+
+  ts2 = ts;
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    ts2.tv_nsec = (ts2.tv_nsec + 7919) % 1000000000;
+    UTI_DiffTimespecsToDouble(&d, &ts2, &ts);
+    sink_double = d;
+  }
+  report("UTI_DiffTimespecsToDouble", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    UTI_AddDoubleToTimespec(&ts, i * 1.0e-7, &ts2);
+    sink_u32 = ts2.tv_nsec;
+  }
+  report("UTI_AddDoubleToTimespec", start, n);
+
+  start = get_time();
+  for (i = 0; i < n; i++) {
+    ts3 = ts;
+    UTI_AdjustTimespec(&ts, &ts3, &ts2, &d, 1.0e-6, 1.0e-3);
+    sink_u32 = ts2.tv_nsec;
+  }
+  report("UTI_AdjustTimespec", start, n);
+
+  return 0;
+}
@@ -35,38 +35,38 @@
 /* ================================================== */
 
 INLINE_STATIC void
-UTI_TimevalToDouble(struct timeval *a, double *b)
+UTI_TimespecToDouble(struct timespec *a, double *b)
 {
-  *b = (double)(a->tv_sec) + 1.0e-6 * (double)(a->tv_usec);
+  *b = (double)(a->tv_sec) + 1.0e-9 * (double)(a->tv_nsec);
 
 }
 
 /* ================================================== */
 
 INLINE_STATIC void
-UTI_DoubleToTimeval(double a, struct timeval *b)
+UTI_DoubleToTimespec(double a, struct timespec *b)
 {
   long int_part, frac_part;
   int_part = (long)(a);
-  frac_part = (long)(0.5 + 1.0e6 * (a - (double)(int_part)));
+  frac_part = (long)(0.5 + 1.0e9 * (a - (double)(int_part)));
   b->tv_sec = int_part;
-  b->tv_usec = frac_part;
-  UTI_NormaliseTimeval(b);
+  b->tv_nsec = frac_part;
+  UTI_NormaliseTimespec(b);
 }
 
 /* ================================================== */
 
 INLINE_STATIC int
-UTI_CompareTimevals(struct timeval *a, struct timeval *b)
+UTI_CompareTimespecs(struct timespec *a, struct timespec *b)
 {
   if (a->tv_sec < b->tv_sec) {
     return -1;
   } else if (a->tv_sec > b->tv_sec) {
     return +1;
   } else {
-    if (a->tv_usec < b->tv_usec) {
+    if (a->tv_nsec < b->tv_nsec) {
       return -1;
-    } else if (a->tv_usec > b->tv_usec) {
+    } else if (a->tv_nsec > b->tv_nsec) {
       return +1;
     } else {
       return 0;
@@ -77,87 +77,86 @@ UTI_CompareTimevals(struct timeval *a, struct timeval *b)
 /* ================================================== */
 
 INLINE_STATIC void
-UTI_NormaliseTimeval(struct timeval *x)
+UTI_NormaliseTimespec(struct timespec *x)
 {
-  /* Reduce tv_usec to within +-1000000 of zero. JGH */
-  if ((x->tv_usec >= 1000000) || (x->tv_usec <= -1000000)) {
-    x->tv_sec += x->tv_usec/1000000;
-    x->tv_usec = x->tv_usec%1000000;
+  /* Reduce tv_nsec to within +-1000000000 of zero */
+  if ((x->tv_nsec >= 1000000000) || (x->tv_nsec <= -1000000000)) {
+    x->tv_sec += x->tv_nsec / 1000000000;
+    x->tv_nsec = x->tv_nsec % 1000000000;
   }
 
-  /* Make tv_usec positive. JGH */
-   if (x->tv_usec < 0) {
+  /* Make tv_nsec positive */
+  if (x->tv_nsec < 0) {
     --x->tv_sec;
-    x->tv_usec += 1000000;
- }
-
+    x->tv_nsec += 1000000000;
+  }
 }
 
 /* ================================================== */
 
 INLINE_STATIC void
-UTI_DiffTimevals(struct timeval *result,
-                 struct timeval *a,
-                 struct timeval *b)
+UTI_DiffTimespecs(struct timespec *result,
+                  struct timespec *a,
+                  struct timespec *b)
 {
   result->tv_sec  = a->tv_sec  - b->tv_sec;
-  result->tv_usec = a->tv_usec - b->tv_usec;
+  result->tv_nsec = a->tv_nsec - b->tv_nsec;
 
-  /* Correct microseconds field to bring it into the range
-     (0,1000000) */
+  /* Correct nanoseconds field to bring it into the range
+     (0,1000000000) */
 
-  UTI_NormaliseTimeval(result); /* JGH */
+  UTI_NormaliseTimespec(result);
 }
 
 /* ================================================== */
 
 /* Calculate result = a - b and return as a double */
 INLINE_STATIC void
-UTI_DiffTimevalsToDouble(double *result, 
-                         struct timeval *a,
-                         struct timeval *b)
+UTI_DiffTimespecsToDouble(double *result, 
+                          struct timespec *a,
+                          struct timespec *b)
 {
   *result = (double)(a->tv_sec - b->tv_sec) +
-    (double)(a->tv_usec - b->tv_usec) * 1.0e-6;
+    (double)(a->tv_nsec - b->tv_nsec) * 1.0e-9;
 }
 
 /* ================================================== */
 
 INLINE_STATIC void
-UTI_AddDoubleToTimeval(struct timeval *start,
-                       double increment,
-                       struct timeval *end)
+UTI_AddDoubleToTimespec(struct timespec *start,
+                        double increment,
+                        struct timespec *end)
 {
   long int_part, frac_part;
 
-  /* Don't want to do this by using (long)(1000000 * increment), since
-     that will only cope with increments up to +/- 2148 seconds, which
+  /* Don't want to do this by using (long)(1000000000 * increment), since
+     that will only cope with increments up to +/- 2 seconds, which
      is too marginal here. */
 
   int_part = (long) increment;
-  increment = (increment - int_part) * 1.0e6;
+  increment = (increment - int_part) * 1.0e9;
   frac_part = (long) (increment > 0.0 ? increment + 0.5 : increment - 0.5);
 
   end->tv_sec  = int_part  + start->tv_sec;
-  end->tv_usec = frac_part + start->tv_usec;
+  end->tv_nsec = frac_part + start->tv_nsec;
 
-  UTI_NormaliseTimeval(end);
+  UTI_NormaliseTimespec(end);
 }
 
 /* ================================================== */
 
-/* Calculate the average and difference (as a double) of two timevals */
+/* Calculate the average and difference (as a double) of two timespecs */
 INLINE_STATIC void
-UTI_AverageDiffTimevals (struct timeval *earlier,
-                         struct timeval *later,
-                         struct timeval *average,
+UTI_AverageDiffTimespecs(struct timespec *earlier,
+                         struct timespec *later,
+                         struct timespec *average,
                          double *diff)
 {
-  struct timeval tvdiff;
-  struct timeval tvhalf;
+  struct timespec tsdiff;
+  struct timespec tshalf;
 
-  UTI_DiffTimevals(&tvdiff, later, earlier);
-  *diff = (double)tvdiff.tv_sec + 1.0e-6 * (double)tvdiff.tv_usec;
+  UTI_DiffTimespecs(&tsdiff, later, earlier);
+  *diff = (double)tsdiff.tv_sec + 1.0e-9 * (double)tsdiff.tv_nsec;
 
   if (*diff < 0.0) {
     /* Either there's a bug elsewhere causing 'earlier' and 'later' to
@@ -168,27 +167,45 @@ UTI_AverageDiffTimevals (struct timeval *earlier,
     *diff = 0.0;
   }
 
-  tvhalf.tv_sec = tvdiff.tv_sec / 2;
-  tvhalf.tv_usec = tvdiff.tv_usec / 2 + (tvdiff.tv_sec % 2) * 500000; /* JGH */
+  tshalf.tv_sec = tsdiff.tv_sec / 2;
+  tshalf.tv_nsec = tsdiff.tv_nsec / 2 + (tsdiff.tv_sec % 2) * 500000000;
   
-  average->tv_sec  = earlier->tv_sec  + tvhalf.tv_sec;
-  average->tv_usec = earlier->tv_usec + tvhalf.tv_usec;
+  average->tv_sec  = earlier->tv_sec  + tshalf.tv_sec;
+  average->tv_nsec = earlier->tv_nsec + tshalf.tv_nsec;
   
   /* Bring into range */
-  UTI_NormaliseTimeval(average);
+  UTI_NormaliseTimespec(average);
 
  }
 
 /* ================================================== */
 
 void
-UTI_AddDiffToTimeval(struct timeval *a, struct timeval *b,
-                     struct timeval *c, struct timeval *result)
+UTI_AddDiffToTimespec(struct timespec *a, struct timespec *b,
+                      struct timespec *c, struct timespec *result)
 {
   double diff;
 
-  UTI_DiffTimevalsToDouble(&diff, a, b);
-  UTI_AddDoubleToTimeval(c, diff, result);
+  UTI_DiffTimespecsToDouble(&diff, a, b);
+  UTI_AddDoubleToTimespec(c, diff, result);
+}
+
+/* ================================================== */
+
+void
+UTI_TimevalToTimespec(struct timeval *tv, struct timespec *ts)
+{
+  ts->tv_sec = tv->tv_sec;
+  ts->tv_nsec = 1000 * tv->tv_usec;
+}
+
+/* ================================================== */
+
+void
+UTI_TimespecToTimeval(struct timespec *ts, struct timeval *tv)
+{
+  tv->tv_sec = ts->tv_sec;
+  tv->tv_usec = ts->tv_nsec / 1000;
 }
 
 /* ================================================== */
@@ -201,21 +218,21 @@ static int  pool_ptr = 0;
 #define NEXT_BUFFER (buffer_pool[pool_ptr = ((pool_ptr + 1) % POOL_ENTRIES)])
 
 /* ================================================== */
-/* Convert a timeval into a temporary string, largely for diagnostic
+/* Convert a timespec into a temporary string, largely for diagnostic
    display */
 
 char *
-UTI_TimevalToString(struct timeval *tv)
+UTI_TimespecToString(struct timespec *ts)
 {
   char *result;
 
   result = NEXT_BUFFER;
 #ifdef HAVE_LONG_TIME_T
-  snprintf(result, BUFFER_LENGTH, "%"PRId64".%06lu",
-      (int64_t)tv->tv_sec, (unsigned long)tv->tv_usec);
+  snprintf(result, BUFFER_LENGTH, "%"PRId64".%09lu",
+      (int64_t)ts->tv_sec, (unsigned long)ts->tv_nsec);
 #else
-  snprintf(result, BUFFER_LENGTH, "%ld.%06lu",
-      (long)tv->tv_sec, (unsigned long)tv->tv_usec);
+  snprintf(result, BUFFER_LENGTH, "%ld.%09lu",
+      (long)ts->tv_sec, (unsigned long)ts->tv_nsec);
 #endif
   return result;
 }
@@ -227,9 +244,9 @@ UTI_TimevalToString(struct timeval *tv)
 char *
 UTI_TimestampToString(NTP_int64 *ts)
 {
-  struct timeval tv;
-  UTI_Int64ToTimeval(ts, &tv);
-  return UTI_TimevalToString(&tv);
+  struct timespec tv;
+  UTI_Int64ToTimespec(ts, &tv);
+  return UTI_TimespecToString(&tv);
 }
 
 /* ================================================== */
@@ -443,13 +460,13 @@ UTI_TimeToLogForm(time_t t)
 /* ================================================== */
 
 void
-UTI_AdjustTimeval(struct timeval *old_tv, struct timeval *when, struct timeval *new_tv, double *delta_time, double dfreq, double doffset)
+UTI_AdjustTimespec(struct timespec *old_ts, struct timespec *when, struct timespec *new_ts, double *delta_time, double dfreq, double doffset)
 {
   double elapsed;
 
-  UTI_DiffTimevalsToDouble(&elapsed, when, old_tv);
+  UTI_DiffTimespecsToDouble(&elapsed, when, old_ts);
   *delta_time = elapsed * dfreq - doffset;
-  UTI_AddDoubleToTimeval(old_tv, *delta_time, new_tv);
+  UTI_AddDoubleToTimespec(old_ts, *delta_time, new_ts);
 }
 
 /* ================================================== */
@@ -491,27 +508,28 @@ UTI_DoubleToInt32(double x)
 /* ================================================== */
 
 /* Seconds part of RFC1305 timestamp correponding to the origin of the
-   struct timeval format. */
+   struct timespec format. */
 #define JAN_1970 0x83aa7e80UL
 
 void
-UTI_TimevalToInt64(struct timeval *src,
-                   NTP_int64 *dest, uint32_t fuzz)
+UTI_TimespecToInt64(struct timespec *src,
+                    NTP_int64 *dest, uint32_t fuzz)
 {
-  uint32_t lo, sec, usec;
+  uint32_t lo, sec, nsec;
 
   sec = (uint32_t)src->tv_sec;
-  usec = (uint32_t)src->tv_usec;
+  nsec = (uint32_t)src->tv_nsec;
 
   /* Recognize zero as a special case - it always signifies
      an 'unknown' value */
-  if (!usec && !sec) {
+  if (!nsec && !sec) {
     dest->hi = dest->lo = 0;
   } else {
     dest->hi = htonl(sec + JAN_1970);
 
-    /* This formula gives an error of about 0.1us worst case */
-    lo = 4295 * usec - (usec>>5) - (usec>>9);
+    /* Round up, so the conversion back to timespec gives the same
+       number of nanoseconds */
+    lo = ((uint64_t)nsec << 32 | 999999999U) / 1000000000U;
 
     /* Add the fuzz */
     lo ^= fuzz;
@@ -523,8 +541,8 @@ UTI_TimevalToInt64(struct timeval *src,
 /* ================================================== */
 
 void
-UTI_Int64ToTimeval(NTP_int64 *src,
-                   struct timeval *dest)
+UTI_Int64ToTimespec(NTP_int64 *src,
+                    struct timespec *dest)
 {
   uint32_t ntp_sec, ntp_frac;
 
@@ -541,21 +559,20 @@ UTI_Int64ToTimeval(NTP_int64 *src,
   dest->tv_sec = ntp_sec - JAN_1970;
 #endif
   
-  /* Until I invent a slick way to do this, just do it the obvious way */
-  dest->tv_usec = (int)(0.5 + (double)(ntp_frac) / 4294.967296);
+  dest->tv_nsec = (uint64_t)ntp_frac * 1000000000U >> 32;
 }
 
 /* ================================================== */
 
 void
-UTI_TimevalNetworkToHost(Timeval *src, struct timeval *dest)
+UTI_TimespecNetworkToHost(Timeval *src, struct timespec *dest)
 {
   uint32_t sec_low;
 #ifdef HAVE_LONG_TIME_T
   uint32_t sec_high;
 #endif
 
-  dest->tv_usec = ntohl(src->tv_nsec) / 1000;
+  dest->tv_nsec = ntohl(src->tv_nsec);
   sec_low = ntohl(src->tv_sec_low);
 #ifdef HAVE_LONG_TIME_T
   sec_high = ntohl(src->tv_sec_high);
@@ -571,9 +588,9 @@ UTI_TimevalNetworkToHost(Timeval *src, struct timeval *dest)
 /* ================================================== */
 
 void
-UTI_TimevalHostToNetwork(struct timeval *src, Timeval *dest)
+UTI_TimespecHostToNetwork(struct timespec *src, Timeval *dest)
 {
-  dest->tv_nsec = htonl(src->tv_usec * 1000);
+  dest->tv_nsec = htonl(src->tv_nsec);
 #ifdef HAVE_LONG_TIME_T
   dest->tv_sec_high = htonl((uint64_t)src->tv_sec >> 32);
 #else
@@ -34,41 +34,45 @@
 #include "candm.h"
 #include "hash.h"
 
-/* Convert a timeval into a floating point number of seconds */
-extern void UTI_TimevalToDouble(struct timeval *a, double *b);
+/* Convert a timespec into a floating point number of seconds */
+extern void UTI_TimespecToDouble(struct timespec *a, double *b);
 
 /* Convert a number of seconds expressed in floating point into a
-   timeval */
-extern void UTI_DoubleToTimeval(double a, struct timeval *b);
+   timespec */
+extern void UTI_DoubleToTimespec(double a, struct timespec *b);
 
 /* Returns -1 if a comes earlier than b, 0 if a is the same time as b,
    and +1 if a comes after b */
-extern int UTI_CompareTimevals(struct timeval *a, struct timeval *b);
+extern int UTI_CompareTimespecs(struct timespec *a, struct timespec *b);
 
-/* Normalise a struct timeval, by adding or subtracting seconds to bring
-   its microseconds field into range */
-extern void UTI_NormaliseTimeval(struct timeval *x);
+/* Normalise a struct timespec, by adding or subtracting seconds to bring
+   its nanoseconds field into range */
+extern void UTI_NormaliseTimespec(struct timespec *x);
 
 /* Calculate result = a - b */
-extern void UTI_DiffTimevals(struct timeval *result, struct timeval *a, struct timeval *b);
+extern void UTI_DiffTimespecs(struct timespec *result, struct timespec *a, struct timespec *b);
 
 /* Calculate result = a - b and return as a double */
-extern void UTI_DiffTimevalsToDouble(double *result, struct timeval *a, struct timeval *b);
+extern void UTI_DiffTimespecsToDouble(double *result, struct timespec *a, struct timespec *b);
 
-/* Add a double increment to a timeval to get a new one. 'start' is
+/* Add a double increment to a timespec to get a new one. 'start' is
    the starting time, 'end' is the result that we return.  This is
    safe to use if start and end are the same */
-extern void UTI_AddDoubleToTimeval(struct timeval *start, double increment, struct timeval *end);
+extern void UTI_AddDoubleToTimespec(struct timespec *start, double increment, struct timespec *end);
 
-/* Calculate the average and difference (as a double) of two timevals */
-extern void UTI_AverageDiffTimevals(struct timeval *earlier, struct timeval *later, struct timeval *average, double *diff);
+/* Calculate the average and difference (as a double) of two timespecs */
+extern void UTI_AverageDiffTimespecs(struct timespec *earlier, struct timespec *later, struct timespec *average, double *diff);
 
 /* Calculate result = a - b + c */
-extern void UTI_AddDiffToTimeval(struct timeval *a, struct timeval *b, struct timeval *c, struct timeval *result);
+extern void UTI_AddDiffToTimespec(struct timespec *a, struct timespec *b, struct timespec *c, struct timespec *result);
 
-/* Convert a timeval into a temporary string, largely for diagnostic
+/* Convert between timeval and timespec */
+extern void UTI_TimevalToTimespec(struct timeval *tv, struct timespec *ts);
+extern void UTI_TimespecToTimeval(struct timespec *ts, struct timeval *tv);
+
+/* Convert a timespec into a temporary string, largely for diagnostic
    display */
-extern char *UTI_TimevalToString(struct timeval *tv);
+extern char *UTI_TimespecToString(struct timespec *ts);
 
 /* Convert an NTP timestamp into a temporary string, largely for
    diagnostic display */
@@ -89,7 +93,7 @@ extern int UTI_CompareIPs(IPAddr *a, IPAddr *b, IPAddr *mask);
 extern char *UTI_TimeToLogForm(time_t t);
 
 /* Adjust time following a frequency/offset change */
-extern void UTI_AdjustTimeval(struct timeval *old_tv, struct timeval *when, struct timeval *new_tv, double *delta, double dfreq, double doffset);
+extern void UTI_AdjustTimespec(struct timespec *old_ts, struct timespec *when, struct timespec *new_ts, double *delta, double dfreq, double doffset);
 
 /* Get a random value to fuzz an NTP timestamp in the given precision */
 extern uint32_t UTI_GetNTPTsFuzz(int precision);
@@ -97,12 +101,12 @@ extern uint32_t UTI_GetNTPTsFuzz(int precision);
 extern double UTI_Int32ToDouble(NTP_int32 x);
 extern NTP_int32 UTI_DoubleToInt32(double x);
 
-extern void UTI_TimevalToInt64(struct timeval *src, NTP_int64 *dest, uint32_t fuzz);
+extern void UTI_TimespecToInt64(struct timespec *src, NTP_int64 *dest, uint32_t fuzz);
 
-extern void UTI_Int64ToTimeval(NTP_int64 *src, struct timeval *dest);
+extern void UTI_Int64ToTimespec(NTP_int64 *src, struct timespec *dest);
 
-extern void UTI_TimevalNetworkToHost(Timeval *src, struct timeval *dest);
-extern void UTI_TimevalHostToNetwork(struct timeval *src, Timeval *dest);
+extern void UTI_TimespecNetworkToHost(Timeval *src, struct timespec *dest);
+extern void UTI_TimespecHostToNetwork(struct timespec *src, Timeval *dest);
 
 extern double UTI_FloatNetworkToHost(Float x);
 extern Float UTI_FloatHostToNetwork(double x);
@@ -31,11 +31,36 @@
 
 #include "config.h"
 
+#include <errno.h>
+
 #include "chrony_timex.h"
 #include "wrap_adjtimex.h"
 
 static int status = 0;
 
+#ifdef HAVE_CLOCK_ADJTIME
+/* Flag indicating the kernel supports clock_adjtime() */
+static int have_clock_adjtime = 1;
+#endif
+
+/* Make the adjtimex() call on the system clock.  clock_adjtime() is
+   preferred, older kernels (pre-2.6.39) have only adjtimex(). */
+static int
+adjust_clock(struct timex *txc)
+{
+#ifdef HAVE_CLOCK_ADJTIME
+  int r;
+
+  if (have_clock_adjtime) {
+    r = clock_adjtime(CLOCK_REALTIME, txc);
+    if (r >= 0 || errno != ENOSYS)
+      return r;
+    have_clock_adjtime = 0;
+  }
+#endif
+  return adjtimex(txc);
+}
+
 int
 TMX_ResetOffset(void)
 {
@@ -44,20 +69,20 @@ TMX_ResetOffset(void)
   /* Reset adjtime() offset */
   txc.modes = ADJ_OFFSET_SINGLESHOT;
   txc.offset = 0;
-  if (adjtimex(&txc) < 0)
+  if (adjust_clock(&txc) < 0)
     return -1;
 
   /* Reset PLL offset */
   txc.modes = ADJ_OFFSET | ADJ_STATUS;
   txc.status = STA_PLL;
   txc.offset = 0;
-  if (adjtimex(&txc) < 0)
+  if (adjust_clock(&txc) < 0)
     return -1;
 
   /* Set status back */
   txc.modes = ADJ_STATUS;
-  txc.modes = status;
-  if (adjtimex(&txc) < 0)
+  txc.status = status;
+  if (adjust_clock(&txc) < 0)
     return -1;
 
   return 0;
@@ -70,7 +95,8 @@ TMX_SetFrequency(double *freq, long tick)
   
   txc.modes = ADJ_TICK | ADJ_FREQUENCY | ADJ_STATUS;
 
-  txc.freq = (long)(*freq * (double)(1 << SHIFT_USEC));
+  /* Round to the full resolution of the kernel (2^-16 ppm) */
+  txc.freq = *freq * (double)(1 << SHIFT_USEC) + (*freq >= 0.0 ? 0.5 : -0.5);
   *freq = txc.freq / (double)(1 << SHIFT_USEC);
   txc.tick = tick;
   txc.status = status; 
@@ -82,7 +108,7 @@ TMX_SetFrequency(double *freq, long tick)
     txc.maxerror = 0;
   }
 
-  return adjtimex(&txc);
+  return adjust_clock(&txc);
 }
 
 int
@@ -91,7 +117,7 @@ TMX_GetFrequency(double *freq, long *tick)
   struct timex txc;
   int result;
   txc.modes = 0; /* pure read */
-  result = adjtimex(&txc);
+  result = adjust_clock(&txc);
   *freq = txc.freq / (double)(1 << SHIFT_USEC);
   *tick = txc.tick;
   return result;
@@ -104,7 +130,7 @@ TMX_ReadCurrentParams(struct tmx_params *params)
   int result;
   
   txc.modes = 0; /* pure read */
-  result = adjtimex(&txc);
+  result = adjust_clock(&txc);
 
   params->tick     = txc.tick;
   params->offset   = txc.offset;
@@ -158,7 +184,7 @@ TMX_SetLeap(int leap)
   txc.modes = ADJ_STATUS;
   txc.status = status;
 
-  return adjtimex(&txc);
+  return adjust_clock(&txc);
 }
 
 int TMX_SetSync(int sync)
@@ -174,7 +200,37 @@ int TMX_SetSync(int sync)
   txc.modes = ADJ_STATUS;
   txc.status = status;
 
-  return adjtimex(&txc);
+  return adjust_clock(&txc);
+}
+
+int
+TMX_EnablePll(int enable)
+{
+  struct timex txc;
+
+  /* The frequency is held, the PLL is used only to correct the offset */
+  if (enable) {
+    status |= STA_PLL | STA_FREQHOLD;
+  } else {
+    status &= ~(STA_PLL | STA_FREQHOLD);
+  }
+
+  txc.modes = ADJ_STATUS;
+  txc.status = status;
+
+  return adjust_clock(&txc);
+}
+
+int
+TMX_SetPllOffset(double offset, int constant)
+{
+  struct timex txc;
+
+  txc.modes = ADJ_OFFSET | ADJ_TIMECONST | ADJ_NANO;
+  txc.offset = offset * 1.0e9 + (offset >= 0.0 ? 0.5 : -0.5);
+  txc.constant = constant;
+
+  return adjust_clock(&txc);
 }
 
 int
@@ -189,13 +245,13 @@ TMX_TestStepOffset(void)
 
   txc.modes = ADJ_MAXERROR;
   txc.maxerror = 0;
-  if (adjtimex(&txc) < 0 || txc.maxerror != 0)
+  if (adjust_clock(&txc) < 0 || txc.maxerror != 0)
     return -1;
 
   txc.modes = ADJ_SETOFFSET | ADJ_NANO;
   txc.time.tv_sec = 0;
   txc.time.tv_usec = 0;
-  if (adjtimex(&txc) < 0 || txc.maxerror < 100000)
+  if (adjust_clock(&txc) < 0 || txc.maxerror < 100000)
     return -1;
 
   return 0;
@@ -205,14 +261,22 @@ int
 TMX_ApplyStepOffset(double offset)
 {
   struct timex txc;
+  long sec, nsec;
+
+  /* The kernel requires the nanoseconds in the range 0-999999999, with
+     ADJ_NANO they are passed in the tv_usec field */
+  sec = offset;
+  if (sec > offset)
+    sec--;
+  nsec = 1.0e9 * (offset - sec) + 0.5;
+  if (nsec >= 1000000000) {
+    sec++;
+    nsec -= 1000000000;
+  }
 
   txc.modes = ADJ_SETOFFSET | ADJ_NANO;
-  if (offset >= 0) {
-    txc.time.tv_sec = offset;
-  } else {
-    txc.time.tv_sec = offset - 1;
-  }
-  txc.time.tv_usec = 1.0e9 * (offset - txc.time.tv_sec);
+  txc.time.tv_sec = sec;
+  txc.time.tv_usec = nsec;
 
-  return adjtimex(&txc);
+  return adjust_clock(&txc);
 }
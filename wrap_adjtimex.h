@@ -70,6 +70,8 @@ int TMX_GetFrequency(double *freq, long *tick);
 int TMX_ReadCurrentParams(struct tmx_params *params);
 int TMX_SetLeap(int leap);
 int TMX_SetSync(int sync);
+int TMX_EnablePll(int enable);
+int TMX_SetPllOffset(double offset, int constant);
 int TMX_TestStepOffset(void);
 int TMX_ApplyStepOffset(double offset);
 